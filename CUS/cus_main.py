@@ -252,11 +252,8 @@ class ControlUnitSystem:
         """Periodically sync WCS display (background thread)"""
         while self._running:
             try:
-                # Also send valve command to ensure WCS is in sync
-                valve_opening = self.state_manager.get_valve_opening()
-                self.serial_handler.send_valve_command(valve_opening)
-                
-                # Update display
+                # The display update carries the valve position too; the
+                # serial handler only sends it if the last WCS ACK differs
                 self._update_wcs_display()
                 
                 # Sleep for 2 seconds
@@ -46,9 +46,25 @@ MQTT_CLIENT_ID = "CUS_Controller"
 # ====================
 
 SERIAL_PORT = "COM11"
-SERIAL_BAUDRATE = 9600
+SERIAL_BAUDRATE = 9600  # Initial rate, must match the WCS SERIAL_BAUD
 SERIAL_TIMEOUT = 1  # seconds
 
+# Wire protocol offered to the WCS at connect: "binary" (COBS + CRC-16
+# frames, falls back to JSON if the WCS does not accept) or "json"
+SERIAL_PROTOCOL = "binary"
+SERIAL_HANDSHAKE_TIMEOUT = 1.0  # seconds to wait for a handshake reply
+
+# Rates offered in link-rate negotiation; the highest one the WCS also
+# supports is used. Leave only SERIAL_BAUDRATE to disable negotiation.
+SERIAL_SUPPORTED_RATES = [9600, 19200, 38400, 57600, 115200]
+
+# Sequenced commands: commands in flight before waiting for an ACK, time
+# before an unacknowledged command is retransmitted, retransmissions before
+# giving up on it
+SERIAL_WINDOW = 4
+SERIAL_ACK_TIMEOUT = 0.5  # seconds
+SERIAL_MAX_RETRIES = 3
+
 # ====================
 # HTTP Server
 # ====================
@@ -0,0 +1,122 @@
+"""
+Binary Frame Codec for Control Unit Subsystem (CUS)
+Mirrors WCS/src/kernel/FrameCodec.cpp and WCS/src/kernel/Protocol.h
+
+Wire format: COBS(opcode | payload | crc16) followed by a 0x00 delimiter
+"""
+
+from typing import Optional, Tuple
+
+
+# Value of the JSON "hello" message announcing binary protocol v2
+# (v2: sequenced commands acknowledged with OP_ACK / OP_NACK)
+PROTO_HELLO_BINARY = "bin2"
+
+# Commands carry a sequence number 1..255 (wrapping, 0 is skipped)
+SEQ_NONE = 0
+
+# Opcodes: CUS -> WCS
+OP_VALVE = 0x01            # [seq, percentage]
+OP_DISPLAY = 0x02          # [seq, mode code, percentage]
+OP_PONG = 0x03             # [] answer to OP_PING
+
+# Opcodes: WCS -> CUS
+OP_MODE = 0x11             # [mode code]
+OP_VALVE_REPORT = 0x12     # [percentage]
+OP_PING = 0x14             # [] link liveness check
+OP_ACK = 0x15              # [seq, mode code, percentage] cumulative
+OP_NACK = 0x16             # [seq, reason]
+
+# Mode codes
+MODE_CODES = {
+    "AUTOMATIC": 0,
+    "MANUAL": 1,
+    "UNCONNECTED": 2,
+}
+MODE_NAMES = {code: name for name, code in MODE_CODES.items()}
+
+# NACK reasons
+NACK_RANGE = 0x01
+NACK_MODE = 0x02
+NACK_REASONS = {
+    NACK_RANGE: "valve percentage out of range",
+    NACK_MODE: "unknown mode",
+}
+
+# Largest payload accepted by the WCS
+MAX_PAYLOAD = 5
+
+
+def crc16(data: bytes) -> int:
+    """CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF)"""
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+def cobs_encode(data: bytes) -> bytes:
+    """COBS-encode data (no trailing delimiter)"""
+    out = bytearray([0])
+    code_idx = 0
+    code = 1
+    for byte in data:
+        if byte == 0:
+            out[code_idx] = code
+            code_idx = len(out)
+            out.append(0)
+            code = 1
+        else:
+            out.append(byte)
+            code += 1
+            if code == 0xFF:
+                out[code_idx] = code
+                code_idx = len(out)
+                out.append(0)
+                code = 1
+    out[code_idx] = code
+    return bytes(out)
+
+
+def cobs_decode(data: bytes) -> Optional[bytes]:
+    """Decode a COBS block (delimiter excluded), None if malformed"""
+    out = bytearray()
+    idx = 0
+    while idx < len(data):
+        code = data[idx]
+        idx += 1
+        if code == 0 or idx + code - 1 > len(data):
+            return None
+        out.extend(data[idx:idx + code - 1])
+        idx += code - 1
+        if code < 0xFF and idx < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def encode_frame(opcode: int, payload: bytes = b"") -> bytes:
+    """Build the bytes to send for one frame, delimiter included"""
+    if len(payload) > MAX_PAYLOAD:
+        raise ValueError(f"Payload too long for WCS frame: {len(payload)} bytes")
+    raw = bytes([opcode]) + bytes(payload)
+    crc = crc16(raw)
+    raw += bytes([crc >> 8, crc & 0xFF])
+    return cobs_encode(raw) + b"\x00"
+
+
+def decode_frame(wire: bytes) -> Optional[Tuple[int, bytes]]:
+    """
+    Decode the bytes received before a delimiter
+
+    Returns:
+        (opcode, payload) or None on COBS/CRC errors
+    """
+    raw = cobs_decode(wire)
+    if raw is None or len(raw) < 3:
+        return None
+    if crc16(raw[:-2]) != ((raw[-2] << 8) | raw[-1]):
+        return None
+    return raw[0], raw[1:-2]
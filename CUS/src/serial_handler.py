@@ -7,9 +7,15 @@ import json
 import logging
 import threading
 import time
+from collections import OrderedDict, deque
 import serial
-from typing import Callable, Optional
+from typing import Callable, List, Optional, Tuple
 from . import config
+from . import frame_codec
+from .frame_codec import (
+    OP_VALVE, OP_DISPLAY, OP_PONG, OP_MODE, OP_VALVE_REPORT, OP_PING, OP_ACK, OP_NACK,
+    MODE_CODES, NACK_REASONS, PROTO_HELLO_BINARY
+)
 
 
 logger = logging.getLogger(__name__)
@@ -34,6 +40,32 @@ class SerialHandler:
         self._running = False
         self._read_thread = None
         self._write_lock = threading.Lock()
+        
+        # Protocol and link-rate negotiation (JSON at SERIAL_BAUDRATE until
+        # the WCS accepts something better)
+        self._binary = False
+        self._control_event = threading.Event()
+        self._control_type: Optional[str] = None
+        self._control_reply: Optional[str] = None
+        
+        # Receive state: bytes of the JSON line or binary frame being assembled
+        self._rx_json: Optional[bytearray] = None
+        self._rx_frame = bytearray()
+        self._frame_errors = 0
+        
+        # Sequenced commands: the latest unsent command of each kind, the
+        # commands waiting for an ACK (in send order) and the WCS state
+        # (mode code, valve) reported by the last ACK
+        self._cmd_lock = threading.RLock()
+        self._next_seq = 1
+        self._last_sent_seq: Optional[int] = None
+        self._pending: "OrderedDict[str, dict]" = OrderedDict()
+        self._in_flight: "OrderedDict[int, dict]" = OrderedDict()
+        self._wcs_state: Optional[Tuple[int, int]] = None
+        self._retransmissions = 0
+        
+        # Command-to-acknowledge latency of valve commands (seconds)
+        self._valve_latency = deque(maxlen=50)
     
     def connect(self):
         """Connect to serial port"""
@@ -55,6 +87,8 @@ class SerialHandler:
             self._read_thread = threading.Thread(target=self._read_loop, daemon=True)
             self._read_thread.start()
             
+            self._handshake()
+            
         except serial.SerialException as e:
             logger.error(f"Failed to open serial port: {e}")
             raise
@@ -71,6 +105,81 @@ class SerialHandler:
             self.serial_port.close()
             logger.info("Serial port closed")
     
+    def _control_request(self, command: dict, reply_type: str) -> Optional[str]:
+        """Send a JSON control message and wait for the WCS reply of the given type"""
+        self._control_type = reply_type
+        self._control_reply = None
+        self._control_event.clear()
+        self._write(command, None)
+        
+        if self._control_event.wait(config.SERIAL_HANDSHAKE_TIMEOUT):
+            return self._control_reply
+        return None
+    
+    def _handshake(self):
+        """Negotiate wire protocol and link rate with a freshly started WCS"""
+        self._reset_commands()
+        self._negotiate_protocol()
+        self._negotiate_rate()
+    
+    def _negotiate_protocol(self):
+        """
+        Offer binary framing to the WCS, keep JSON if it does not accept.
+        The hello is sent in JSON mode too: it restarts the WCS sequence.
+        """
+        self._binary = False
+        if config.SERIAL_PROTOCOL != "binary":
+            if self._control_request({'type': 'hello', 'value': 'json'}, 'hello') is None:
+                logger.warning("WCS did not answer hello")
+            logger.info("Serial protocol: JSON")
+            return
+        
+        reply = self._control_request({'type': 'hello', 'value': PROTO_HELLO_BINARY}, 'hello')
+        if reply == PROTO_HELLO_BINARY:
+            self._binary = True
+            logger.info("Serial protocol: binary (COBS + CRC-16)")
+        else:
+            logger.info("WCS did not accept binary framing, falling back to JSON")
+    
+    def _negotiate_rate(self):
+        """
+        Switch to the highest link rate supported by both sides.
+        The WCS answers at the current rate and then switches; a probe at the
+        new rate confirms it. Without a probe reply both sides return to
+        SERIAL_BAUDRATE: the WCS after SERIAL_RATE_PROBE_TIMEOUT if the probe
+        never arrived, or after its LINK_TIMEOUT if only the reply was lost.
+        """
+        rates = [r for r in config.SERIAL_SUPPORTED_RATES if r >= config.SERIAL_BAUDRATE]
+        if len(rates) < 2:
+            return
+        
+        offer = ','.join(str(r) for r in rates)
+        reply = self._control_request({'type': 'rates', 'value': offer}, 'rate')
+        try:
+            rate = int(reply) if reply is not None else None
+        except ValueError:
+            rate = None
+        
+        if rate is None or rate not in rates:
+            logger.info(f"WCS did not negotiate a link rate, staying at {self.serial_port.baudrate} baud")
+            return
+        if rate == self.serial_port.baudrate:
+            return
+        
+        self._set_baudrate(rate)
+        if self._control_request({'type': 'probe'}, 'probe') == str(rate):
+            logger.info(f"Serial link switched to {rate} baud")
+        else:
+            logger.warning(f"Probe at {rate} baud failed, returning to {config.SERIAL_BAUDRATE} baud")
+            self._set_baudrate(config.SERIAL_BAUDRATE)
+    
+    def _set_baudrate(self, rate: int):
+        """Change the local port rate and drop any partially received message"""
+        with self._write_lock:
+            self.serial_port.baudrate = rate
+            self._rx_json = None
+            self._rx_frame.clear()
+    
     def _read_loop(self):
         """Background thread to continuously read from serial port"""
         logger.info("Serial read thread started")
@@ -78,15 +187,13 @@ class SerialHandler:
         while self._running:
             try:
                 if self.serial_port and self.serial_port.is_open and self.serial_port.in_waiting > 0:
-                    # Read line from serial port
-                    line = self.serial_port.readline().decode('utf-8').strip()
-                    
-                    if line:
-                        logger.debug(f"Received from WCS: {line}")
-                        self._process_message(line)
+                    self._feed(self.serial_port.read(self.serial_port.in_waiting))
                 else:
                     # Brief sleep to avoid excessive CPU usage
-                    time.sleep(0.1)
+                    time.sleep(0.01)
+                
+                if self.serial_port and self.serial_port.is_open:
+                    self._check_ack_timeouts()
                     
             except Exception as e:
                 logger.error(f"Error reading from serial port: {e}", exc_info=True)
@@ -94,6 +201,67 @@ class SerialHandler:
         
         logger.info("Serial read thread stopped")
     
+    def _feed(self, data: bytes):
+        """
+        Split incoming bytes into JSON lines and binary frames.
+        A JSON line starts with '{' and ends with a newline; anything else
+        between two 0x00 delimiters is a COBS frame.
+        """
+        for byte in data:
+            if self._rx_json is not None:
+                if byte == 0x0A:
+                    line = self._rx_json.decode('utf-8', errors='replace').strip()
+                    self._rx_json = None
+                    logger.debug(f"Received from WCS: {line}")
+                    self._process_message(line)
+                elif byte == 0x00:
+                    # JSON never contains a frame delimiter: the '{' was a
+                    # corrupted frame byte, resynchronise here
+                    self._rx_json = None
+                else:
+                    self._rx_json.append(byte)
+                continue
+            
+            if byte == 0x00:
+                if self._rx_frame:
+                    self._process_frame(bytes(self._rx_frame))
+                    self._rx_frame.clear()
+                continue
+            
+            if not self._rx_frame:
+                if byte == ord('{'):
+                    self._rx_json = bytearray(b'{')
+                    continue
+                if byte in (0x0A, 0x0D, 0x20):
+                    continue
+            
+            self._rx_frame.append(byte)
+            if len(self._rx_frame) > 64:
+                # Not a frame (e.g. plain text debug output): drop it
+                self._rx_frame.clear()
+    
+    def _process_frame(self, wire: bytes):
+        """Process a binary frame from WCS"""
+        decoded = frame_codec.decode_frame(wire)
+        if decoded is None:
+            self._frame_errors += 1
+            logger.debug(f"Dropped corrupted frame from WCS: {wire.hex()}")
+            return
+        
+        opcode, payload = decoded
+        if opcode == OP_MODE and len(payload) >= 1:
+            self._handle_mode_report(payload[0])
+        elif opcode == OP_VALVE_REPORT and len(payload) >= 1:
+            self._handle_valve_report(payload[0])
+        elif opcode == OP_PING:
+            self._send_pong()
+        elif opcode == OP_ACK and len(payload) >= 3:
+            self._handle_ack(payload[0], payload[1], payload[2])
+        elif opcode == OP_NACK and len(payload) >= 2:
+            self._handle_nack(payload[0], payload[1])
+        else:
+            logger.debug(f"Unhandled frame from WCS: opcode=0x{opcode:02x}")
+    
     def _process_message(self, message: str):
         """
         Process incoming message from WCS
@@ -110,30 +278,36 @@ class SerialHandler:
                 logger.debug(f"Message missing 'type' or type is not string: {message}")
                 return
             
+            if msg_type == 'ping':
+                self._send_pong()
+                return
+            
+            if msg_type in ('hello', 'rate', 'probe'):
+                if msg_type == self._control_type:
+                    self._control_reply = str(data.get('value', ''))
+                    self._control_event.set()
+                return
+            
+            if self._binary:
+                # A binary WCS only talks JSON after a reset: renegotiate
+                logger.warning("WCS fell back to JSON (reset?), renegotiating protocol")
+                self._binary = False
+                threading.Thread(target=self._handshake, daemon=True).start()
+            
             if msg_type == 'mode':
-                mode = int(data.get('value', 0))
-                if mode == 0:
-                    mode = "AUTOMATIC"
-                elif mode == 1:
-                    mode = "MANUAL"
-                else:
-                    mode = "Unknown"
-                logger.info(f"WCS mode change: {mode}")
-                if self.on_mode_change:
-                    self.on_mode_change(mode)
+                self._handle_mode_report(int(data.get('value', 0)))
             
             elif msg_type == 'valve':
                 try:
-                    opening = int(data.get('value', 0))
-                    logger.info(f"WCS manual valve position: {opening}%")
-                    if self.on_manual_valve:
-                        self.on_manual_valve(opening)
+                    self._handle_valve_report(int(data.get('value', 0)))
                 except (ValueError, TypeError):
                     logger.warning(f"Invalid valve value from WCS: {data.get('value')}")
             
-            elif msg_type == 'status':
-                status_msg = str(data.get('message', ''))
-                logger.info(f"WCS status: {status_msg}")
+            elif msg_type == 'ack':
+                self._handle_ack(int(data.get('seq', 0)), int(data.get('mode', 0)), int(data.get('valve', 0)))
+            
+            elif msg_type == 'nack':
+                self._handle_nack(int(data.get('seq', 0)), int(data.get('value', 0)))
             
             else:
                 logger.debug(f"Unhandled message type from WCS: {msg_type}")
@@ -144,6 +318,213 @@ class SerialHandler:
         except Exception as e:
             logger.error(f"Error processing WCS message: {e}")
     
+    def _handle_mode_report(self, code: int):
+        """WCS reported a mode change (0 = AUTOMATIC, 1 = MANUAL)"""
+        if code == 0:
+            mode = "AUTOMATIC"
+        elif code == 1:
+            mode = "MANUAL"
+        else:
+            mode = "Unknown"
+        logger.info(f"WCS mode change: {mode}")
+        with self._cmd_lock:
+            if self._wcs_state is not None:
+                self._wcs_state = (code, self._wcs_state[1])
+        if self.on_mode_change:
+            self.on_mode_change(mode)
+    
+    def _handle_valve_report(self, opening: int):
+        """WCS reported a manual valve position change"""
+        logger.info(f"WCS manual valve position: {opening}%")
+        with self._cmd_lock:
+            if self._wcs_state is not None:
+                self._wcs_state = (self._wcs_state[0], opening)
+        if self.on_manual_valve:
+            self.on_manual_valve(opening)
+    
+    # ====================
+    # Sequenced commands
+    # ====================
+    
+    def _reset_commands(self):
+        """Forget commands and WCS state: the WCS restarts its sequence on hello"""
+        with self._cmd_lock:
+            self._next_seq = 1
+            self._last_sent_seq = None
+            self._pending.clear()
+            self._in_flight.clear()
+            self._wcs_state = None
+    
+    def _submit(self, kind: str, command: dict, opcode: Optional[int], payload: bytes) -> bool:
+        """
+        Queue a command; it replaces an unsent one of the same kind.
+        Returns False if the command would not change the WCS state.
+        """
+        with self._cmd_lock:
+            if self._is_redundant(kind, command):
+                logger.debug(f"Skipping redundant {kind} command: {command}")
+                return False
+            self._pending[kind] = {'kind': kind, 'command': command, 'opcode': opcode,
+                                   'payload': payload, 'retries': 0}
+            self._pending.move_to_end(kind)
+            self._pump()
+            return True
+    
+    def _is_redundant(self, kind: str, command: dict) -> bool:
+        """True if the WCS already has (or is about to get) what the command asks for"""
+        if kind in self._pending:
+            return False
+        if self._in_flight:
+            newest = next(reversed(self._in_flight.values()))
+            return newest['kind'] == kind and newest['command'] == command
+        if self._wcs_state is None:
+            return False
+        mode, valve = self._wcs_state
+        if kind == 'valve':
+            return valve == command['value']
+        return mode == MODE_CODES.get(command['mode']) and valve == command['valve']
+    
+    def _pump(self):
+        """Send pending commands while the window has room"""
+        while self._pending and len(self._in_flight) < config.SERIAL_WINDOW:
+            _, entry = self._pending.popitem(last=False)
+            entry['seq'] = self._next_seq
+            self._last_sent_seq = self._next_seq
+            self._next_seq = self._next_seq % 255 + 1
+            entry['first_sent'] = time.monotonic()
+            self._in_flight[entry['seq']] = entry
+            self._transmit(entry)
+    
+    def _transmit(self, entry: dict):
+        """Write one command with its sequence number"""
+        entry['sent_at'] = time.monotonic()
+        command = dict(entry['command'], seq=entry['seq'])
+        frame = None
+        if entry['opcode'] is not None:
+            frame = frame_codec.encode_frame(entry['opcode'], bytes([entry['seq']]) + entry['payload'])
+        logger.debug(f"SERIAL WRITE ({entry['kind']}): {command}")
+        self._write(command, frame)
+    
+    @staticmethod
+    def _seq_not_after(seq: int, ack: int) -> bool:
+        """True if seq was sent no later than ack (sequence numbers wrap)"""
+        return (ack - seq) % 256 < 128
+    
+    @staticmethod
+    def _superseded(entry: dict, newer: List[dict]) -> bool:
+        """True if a newer command overrides what entry sets (display also sets the valve)"""
+        if entry['kind'] == 'valve':
+            return bool(newer)
+        return any(e['kind'] == 'display' for e in newer)
+    
+    def _handle_ack(self, seq: int, mode: int, valve: int):
+        """Cumulative ACK: every command up to seq has been handled"""
+        with self._cmd_lock:
+            if self._last_sent_seq is None or not self._seq_not_after(seq, self._last_sent_seq):
+                # Not one of ours: the WCS still counts from before our restart
+                logger.debug(f"Ignoring ACK for unsent seq {seq}")
+                return
+            self._wcs_state = (mode, valve)
+            now = time.monotonic()
+            popped = [self._in_flight.pop(s) for s in list(self._in_flight)
+                      if self._seq_not_after(s, seq)]
+            
+            for i, entry in enumerate(popped):
+                if entry['kind'] == 'valve':
+                    latency = now - entry['first_sent']
+                    self._valve_latency.append(latency)
+                    logger.debug(f"Valve command acknowledged after {latency * 1000:.1f} ms")
+                
+                if entry['seq'] == seq or self._superseded(entry, popped[i + 1:]):
+                    continue
+                # Covered by a later ACK but not in effect: the command was lost
+                in_effect = (valve == entry['command']['value'] if entry['kind'] == 'valve'
+                             else mode == MODE_CODES.get(entry['command']['mode']))
+                if not in_effect:
+                    if entry['kind'] == 'display':
+                        # Keep the valve position set by the newer valve command
+                        entry['command'] = dict(entry['command'], valve=valve)
+                        if entry['opcode'] is not None:
+                            entry['payload'] = bytes([entry['payload'][0], valve])
+                    self._resend(entry)
+            
+            self._pump()
+    
+    def _handle_nack(self, seq: int, reason: int):
+        """The WCS rejected a command; it is not retried"""
+        with self._cmd_lock:
+            entry = self._in_flight.pop(seq, None)
+            self._pump()
+        if entry is not None:
+            logger.warning(f"WCS rejected {entry['kind']} command {entry['command']}: "
+                           f"{NACK_REASONS.get(reason, f'reason {reason}')}")
+    
+    def _resend(self, entry: dict):
+        """Queue a lost command again unless something newer replaces it"""
+        pending = list(self._pending.values()) + list(self._in_flight.values())
+        if entry['kind'] in self._pending or self._superseded(entry, pending):
+            return
+        if entry['retries'] >= config.SERIAL_MAX_RETRIES:
+            logger.warning(f"Giving up on {entry['kind']} command {entry['command']}")
+            return
+        entry['retries'] += 1
+        self._retransmissions += 1
+        self._pending[entry['kind']] = entry
+    
+    def _check_ack_timeouts(self):
+        """Retransmit commands not acknowledged within SERIAL_ACK_TIMEOUT"""
+        with self._cmd_lock:
+            now = time.monotonic()
+            for seq, entry in list(self._in_flight.items()):
+                if now - entry['sent_at'] < config.SERIAL_ACK_TIMEOUT:
+                    continue
+                if entry['retries'] >= config.SERIAL_MAX_RETRIES:
+                    del self._in_flight[seq]
+                    logger.warning(f"No ACK from WCS for {entry['kind']} command {entry['command']}")
+                    continue
+                # Same sequence number: the WCS drops it if it already applied it
+                entry['retries'] += 1
+                self._retransmissions += 1
+                self._transmit(entry)
+            self._pump()
+    
+    def _send_pong(self):
+        """Answer a WCS liveness check; without it the WCS fails safe after LINK_TIMEOUT"""
+        try:
+            self._write({'type': 'pong'}, frame_codec.encode_frame(OP_PONG))
+        except Exception as e:
+            logger.error(f"Failed to answer WCS ping: {e}")
+    
+    def _write(self, command: dict, frame: Optional[bytes]):
+        """Send a binary frame if negotiated, the JSON command otherwise"""
+        if self._binary and frame is not None:
+            data = frame
+        else:
+            data = (json.dumps(command) + '\n').encode('utf-8')
+        
+        # Thread-safe write
+        with self._write_lock:
+            self.serial_port.write(data)
+            self.serial_port.flush()
+    
+    def get_link_stats(self) -> dict:
+        """Protocol and rate in use, dropped frames, command window and valve command latency (ms)"""
+        samples = list(self._valve_latency)
+        with self._cmd_lock:
+            in_flight = len(self._in_flight)
+        return {
+            'protocol': 'binary' if self._binary else 'json',
+            'baudrate': self.serial_port.baudrate if self.serial_port else None,
+            'frame_errors': self._frame_errors,
+            'commands_in_flight': in_flight,
+            'retransmissions': self._retransmissions,
+            'valve_latency_ms': {
+                'samples': len(samples),
+                'mean': round(1000 * sum(samples) / len(samples), 1) if samples else None,
+                'max': round(1000 * max(samples), 1) if samples else None,
+            }
+        }
+    
     def send_valve_command(self, opening: int) -> bool:
         """
         Send valve opening command to WCS
@@ -152,7 +533,7 @@ class SerialHandler:
             opening: Valve opening percentage (0-100)
             
         Returns:
-            True if sent successfully, False otherwise
+            True if queued (or already in effect on the WCS), False otherwise
         """
         if not (config.VALVE_MIN <= opening <= config.VALVE_MAX):
             logger.error(f"Invalid valve opening value: {opening}")
@@ -168,16 +549,8 @@ class SerialHandler:
                 'type': 'valve',
                 'value': opening
             }
-            message = json.dumps(command) + '\n'
-            
-            logger.debug(f"SERIAL WRITE (valve): {message.strip()}")
-            
-            # Thread-safe write
-            with self._write_lock:
-                self.serial_port.write(message.encode('utf-8'))
-                self.serial_port.flush()
-            
-            logger.info(f"Sent valve command to WCS: {opening}%")
+            if self._submit('valve', command, OP_VALVE, bytes([opening])):
+                logger.info(f"Sent valve command to WCS: {opening}%")
             return True
             
         except Exception as e:
@@ -193,7 +566,7 @@ class SerialHandler:
             valve_opening: Current valve opening
             
         Returns:
-            True if sent successfully, False otherwise
+            True if queued (or already in effect on the WCS), False otherwise
         """
         if not self.serial_port or not self.serial_port.is_open:
             logger.error("Serial port not open, cannot send display update")
@@ -206,14 +579,13 @@ class SerialHandler:
                 'mode': mode,
                 'valve': valve_opening
             }
-            message = json.dumps(command) + '\n'
-            
-            # Thread-safe write
-            with self._write_lock:
-                self.serial_port.write(message.encode('utf-8'))
-                self.serial_port.flush()
+            # Out of range values go as JSON so that the WCS NACKs them
+            opcode, payload = None, b""
+            if mode in MODE_CODES and config.VALVE_MIN <= valve_opening <= config.VALVE_MAX:
+                opcode, payload = OP_DISPLAY, bytes([MODE_CODES[mode], valve_opening])
             
-            logger.debug(f"Sent display update to WCS: {mode}, {valve_opening}%")
+            if self._submit('display', command, opcode, payload):
+                logger.debug(f"Sent display update to WCS: {mode}, {valve_opening}%")
             return True
             
         except Exception as e:
@@ -7,14 +7,25 @@
 #define WIFI_TIMEOUT 20000                   // WiFi connection timeout (ms)
 
 // ===== MQTT Configuration =====
-#define MQTT_BROKER "broker.mqtt-dashboard.com"  // MQTT broker host
-#define MQTT_PORT 1883                       // MQTT broker port
+#define MQTT_BROKERS { { "broker.mqtt-dashboard.com", 1883 }, { "broker.hivemq.com", 1883 } }  // Must share topics
 #define MQTT_CLIENT_ID "TMS_ESP32"           // MQTT client ID
 #define MQTT_TOPIC "tms/rainwater/level"    // MQTT topic for water level data
 #define MQTT_USERNAME ""                     // MQTT username (empty if not required)
 #define MQTT_PASSWORD ""                     // MQTT password (empty if not required)
-#define MQTT_RECONNECT_DELAY 5000            // MQTT reconnection delay (ms)
-#define MQTT_MAX_RECONNECT_DELAY 60000       // Maximum reconnection delay (ms)
+#define MQTT_RECONNECT_DELAY 5000            // MQTT reconnection delay (ms), default of reconnect_delay
+#define MQTT_MAX_RECONNECT_DELAY 60000       // Maximum reconnection delay (ms), default of max_reconnect_delay
+#define MQTT_BUFFER_SIZE 512                 // PubSubClient packet buffer (bytes), fits one trace chunk
+#define MQTT_MAX_SUBSCRIPTIONS 4             // Topics the TMS can subscribe to
+#define NTP_SERVER "pool.ntp.org"            // Wall clock for the history log (UTC)
+
+// ===== Broker Selection =====
+#define BROKER_PROBE_INTERVAL 5000           // One broker pinged per interval, in turn (ms)
+#define BROKER_PING_TIMEOUT 1000             // PINGRESP, TCP connects and CONNACK, probes and client (ms)
+#define BROKER_FAILOVER_TIMEOUTS 3           // Consecutive timeouts (pings, connects, lost sessions) that fail a broker
+#define BROKER_RECOVERY_PINGS 3              // Consecutive answered pings before a failed broker is used again
+#define BROKER_FAILBACK_MARGIN 25            // % lower smoothed RTT another broker needs to be preferred
+#define BROKER_FAILBACK_PINGS 3              // ... in that many consecutive pings of it
+#define BROKER_MIN_DWELL 60000               // No RTT-based switch sooner after a switch (ms)
 
 // ===== Pin Configuration =====
 #define SONAR_TRIG_PIN 13                     // Sonar trigger pin
@@ -23,16 +34,83 @@
 #define RED_LED_PIN 19                        // Red LED pin (network error)
 
 // ===== System Parameters =====
-#define SAMPLING_FREQUENCY 1000              // F = 1 Hz (1000ms period)
-#define TANK_HEIGHT 200.0                    // Tank height in cm
+#define SAMPLING_FREQUENCY 1000              // F = 1 Hz (1000ms period), default of sampling_period
+#define TANK_HEIGHT 200.0                    // Tank height in cm, default of tank_height
 #define SONAR_TIMEOUT 30000                  // Sonar timeout in microseconds
 #define DISCONNECT_TIMEOUT 10000             // Time to consider disconnected (ms)
 #define LED_BLINK_PERIOD 500                 // LED blink period for init state (ms)
+#define LEVEL_CODEC_SCALE 10                 // Fixed-point steps per cm of buffered levels (1 mm)
+
+// ===== Sonar Trace =====
+#define TRACE_CAPACITY 4096                  // Raw echo records kept (4 bytes each), oldest overwritten
+#define TRACE_AUTOSTART true                 // Record from boot, so odd readings are already in the trace
+#define TRACE_CHUNK_RECORDS 32               // Records per exported chunk
+#define TRACE_CMD_TOPIC "tms/trace/cmd"      // start / stop / clear / dump
+#define TRACE_DATA_TOPIC "tms/trace/data"    // Exported chunks
+
+// ===== Flight Recorder =====
+#define FLIGHT_CAPACITY 128                  // Records kept in RTC memory (16 bytes each)
+#define FLIGHT_DEFAULT_RECORDS 32            // Records sent when a request gives no "last"
+#define FLIGHT_REQUEST_TOPIC "tms/flight/req"   // {"id": n, "last": n}, retained by the requester
+#define FLIGHT_RESPONSE_TOPIC "tms/flight/data" // Retained answer
+
+// ===== History Log =====
+#define HISTORY_INTERVAL 10                  // Seconds between readings kept in flash
+#define HISTORY_BLOCK_SIZE 256               // Encoded readings buffered in RAM per flash write (bytes)
+#define HISTORY_FLUSH_INTERVAL 600           // Maximum age of the buffered readings (s)
+#define HISTORY_SEGMENTS 32                  // Segment files on LittleFS, the oldest reused
+#define HISTORY_SEGMENT_SIZE 16384           // Bytes per segment file (512 KB in all)
+#define HISTORY_PAGE_SAMPLES 60              // Readings per response page
+#define HISTORY_REQUEST_TOPIC "tms/history/req"    // {"id": n, "from": epoch, "to": epoch}
+#define HISTORY_RESPONSE_TOPIC "tms/history/data"  // One message per page
+
+// ===== Level Summary =====
+#define SUMMARY_TOPIC "tms/rainwater/summary"   // Rolling-window statistics, retained
+#define SUMMARY_WINDOWS { 60, 600, 3600 }    // Window lengths (s), 6 bytes per reading at SAMPLING_PERIOD_MIN each
+#define SUMMARY_HISTOGRAM_BIN 1              // p95 histogram bin width (cm)
+
+// ===== Runtime Configuration =====
+#define CONFIG_TOPIC "tms/" MQTT_CLIENT_ID "/config"          // {"version": n, ...}, retained by the operator
+#define CONFIG_ACK_TOPIC "tms/" MQTT_CLIENT_ID "/config/ack"  // Retained answer: applied or rejected
+#define CONFIG_NVS_NAMESPACE "tms"           // Preferences namespace of the settings in force
+#define SAMPLING_PERIOD_MIN 500              // Sampling period range (ms); the minimum sizes the summary windows
+#define SAMPLING_PERIOD_MAX 60000
+#define SAMPLING_PERIOD_STEP 100             // Sampling periods are multiples of it (sensing group period)
+#define TANK_HEIGHT_MIN 20.0                 // Tank height range (cm); the maximum sizes the p95 histograms
+#define TANK_HEIGHT_MAX 400.0
+#define RECONNECT_DELAY_MIN 1000             // Reconnection backoff range (ms)
+#define RECONNECT_DELAY_MAX 600000
+
+// ===== Zone Trace (builds with -DZONE_TRACE only) =====
+#define ZONE_TRACE_NAME "TMS"                // Firmware name in the dump header
+#define ZONE_TRACE_SIZE 256                  // Zone begin/end events kept (16 bytes each)
+#define ZONE_TRACE_DUMP_INTERVAL 10000       // Minimum time between overrun dumps (ms)
+
+// ===== FreeRTOS Tasks (not with -DTMS_COOPERATIVE) =====
+#define SENSING_PRIORITY 3                   // MonitoringTask: never waits for the network
+#define NETWORK_PRIORITY 2                   // MQTT client users: connect, publish, requests
+#define LED_PRIORITY 1                       // LEDTask, woken on state changes (Arduino loop is 1 too)
+#define PROBE_PRIORITY 1                     // ProbeTask: blocks in its own sockets
+#define SENSING_STACK_SIZE 4096              // Task stacks (bytes)
+#define NETWORK_STACK_SIZE 8192
+#define LED_STACK_SIZE 2048
+#define PROBE_STACK_SIZE 4096
+#define TASK_CORE 1                          // Application core; Wi-Fi and lwIP run on core 0
+#define NETWORK_GROUP_PERIOD 100             // Base period of the network tasks (ms)
+#define READING_QUEUE_LENGTH 32              // Readings waiting for the network tasks (16 bytes each)
+#define LOOP_TASK_PERIOD 100                 // Arduino loop: zone trace flush and status (ms)
 
 // ===== Task Periods =====
-#define MONITORING_TASK_PERIOD SAMPLING_FREQUENCY
+#define MONITORING_TASK_PERIOD SAMPLING_FREQUENCY   // Default, sampling_period at runtime
+#define PUBLISH_TASK_PERIOD 100              // Publish task period (ms): drains the reading queue
 #define MQTT_TASK_PERIOD 100                 // MQTT task period (ms)
 #define LED_TASK_PERIOD 200                  // LED task period (ms)
+#define TRACE_TASK_PERIOD 100                // Trace task period (ms): commands, one chunk per tick
+#define FLIGHT_TASK_PERIOD 500               // Flight recorder request period (ms)
+#define HISTORY_TASK_PERIOD 100              // History task period (ms): one page per tick
+#define SUMMARY_TASK_PERIOD 60000            // Level summary period (ms)
+#define CONFIG_TASK_PERIOD 500               // Runtime configuration period (ms): apply and acknowledge
+#define PROBE_TASK_PERIOD BROKER_PROBE_INTERVAL   // Broker probe period (ms): one broker per tick
 
 // ===== Debug Configuration =====
 #define DEBUG_ENABLED true                   // Enable/disable serial debug output
@@ -1,9 +1,10 @@
 #include "Sonar.h"
 
 #include "Arduino.h"
+#include "kernel/ZoneTrace.h"
 
 
-Sonar::Sonar(int echoP, int trigP, long maxTime) : echoPin(echoP), trigPin(trigP), timeOut(maxTime){
+Sonar::Sonar(int echoP, int trigP, long maxTime) : echoPin(echoP), trigPin(trigP), timeOut(maxTime), lastEcho(0){
   pinMode(trigPin, OUTPUT);
   pinMode(echoPin, INPUT);  
   temperature = 20; // default value
@@ -16,7 +17,12 @@ float Sonar::getSoundSpeed(){
   return 331.5 + 0.6*temperature;   
 }
 
+unsigned long Sonar::getLastEcho() const{
+  return lastEcho;
+}
+
 float Sonar::getDistance(){
+    TRACE_SCOPE("sonar");
     digitalWrite(trigPin,LOW);
     delayMicroseconds(2);
     digitalWrite(trigPin,HIGH);
@@ -24,7 +30,8 @@ float Sonar::getDistance(){
     digitalWrite(trigPin,LOW);
     
     // pulseIn returns duration in microseconds
-    float tUS = pulseIn(echoPin, HIGH, timeOut);
+    lastEcho = pulseIn(echoPin, HIGH, timeOut);
+    float tUS = lastEcho;
     
     if (tUS == 0) {
         return NO_OBJ_DETECTED;
@@ -12,6 +12,11 @@ public:
   float getDistance();
   void setTemperature(float temp);  
 
+  /**
+   * Echo duration (us) behind the last getDistance(), 0 if none came back
+   */
+  unsigned long getLastEcho() const;
+
 private:
     const float vs = 331.5 + 0.6*20;
     float getSoundSpeed();
@@ -19,6 +24,7 @@ private:
     float temperature;    
     int echoPin, trigPin;
     long timeOut;
+    unsigned long lastEcho;
 };
 
 #endif 
@@ -0,0 +1,140 @@
+#include "BrokerSelector.h"
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+
+#define BROKER_RTT_GAIN 4   // The smoothed RTT moves 1/4 of the way to each new sample
+
+// Pings are recorded by the probe group, the rest by the network group
+static portMUX_TYPE selectorMux = portMUX_INITIALIZER_UNLOCKED;
+
+BrokerSelector::BrokerSelector(const BrokerAddress* brokers, uint8_t nBrokers)
+  : brokers(brokers), nBrokers(nBrokers), active(0), lastSwitch(0), switches(0) {
+  stats = new BrokerStats[nBrokers];
+  memset(stats, 0, nBrokers * sizeof(BrokerStats));
+  for (uint8_t i = 0; i < nBrokers; i++) {
+    stats[i].healthy = true;
+  }
+}
+
+void BrokerSelector::onAnswer(uint8_t broker, unsigned long rtt) {
+  portENTER_CRITICAL(&selectorMux);
+  BrokerStats& s = stats[broker];
+  s.pings++;
+  s.lastRtt = rtt;
+  s.consecutiveTimeouts = 0;
+  if (s.consecutiveAnswers < 255) {
+    s.consecutiveAnswers++;
+  }
+  if (s.srtt == 0) {
+    s.srtt = rtt;
+  } else {
+    s.srtt = (long)s.srtt + ((long)rtt - (long)s.srtt) / BROKER_RTT_GAIN;
+  }
+  if (!s.healthy && s.consecutiveAnswers >= BROKER_RECOVERY_PINGS) {
+    s.healthy = true;
+  }
+
+  const BrokerStats& a = stats[active];
+  if (broker != active && s.healthy && a.srtt > 0 &&
+      s.srtt * 100 <= a.srtt * (100 - BROKER_FAILBACK_MARGIN)) {
+    if (s.better < 255) {
+      s.better++;
+    }
+  } else {
+    s.better = 0;
+  }
+  portEXIT_CRITICAL(&selectorMux);
+}
+
+void BrokerSelector::onTimeout(uint8_t broker) {
+  portENTER_CRITICAL(&selectorMux);
+  BrokerStats& s = stats[broker];
+  s.timeouts++;
+  s.consecutiveAnswers = 0;
+  s.better = 0;
+  if (s.consecutiveTimeouts < 255) {
+    s.consecutiveTimeouts++;
+  }
+  if (s.healthy && s.consecutiveTimeouts >= BROKER_FAILOVER_TIMEOUTS) {
+    // Measured again from scratch once it answers
+    s.healthy = false;
+    s.srtt = 0;
+  }
+  portEXIT_CRITICAL(&selectorMux);
+}
+
+void BrokerSelector::onConnected(uint8_t broker) {
+  portENTER_CRITICAL(&selectorMux);
+  stats[broker].consecutiveTimeouts = 0;
+  portEXIT_CRITICAL(&selectorMux);
+}
+
+int BrokerSelector::fastest(bool onlyBetter) const {
+  // Healthy brokers other than the active one, measured before unmeasured
+  int best = -1;
+  for (uint8_t i = 0; i < nBrokers; i++) {
+    const BrokerStats& s = stats[i];
+    if (i == active || !s.healthy || (onlyBetter && s.better < BROKER_FAILBACK_PINGS)) {
+      continue;
+    }
+    if (best < 0 || (s.srtt != 0 && (stats[best].srtt == 0 || s.srtt < stats[best].srtt))) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+void BrokerSelector::switchTo(uint8_t broker, unsigned long now) {
+  active = broker;
+  lastSwitch = now;
+  switches++;
+  for (uint8_t i = 0; i < nBrokers; i++) {
+    stats[i].better = 0;
+  }
+}
+
+uint8_t BrokerSelector::select(unsigned long now) {
+  portENTER_CRITICAL(&selectorMux);
+  int next = -1;
+  if (!stats[active].healthy) {
+    // Failover; with no healthy broker left the client stays and backs off
+    next = fastest(false);
+  } else if (now - lastSwitch >= BROKER_MIN_DWELL) {
+    next = fastest(true);
+  }
+  if (next >= 0) {
+    switchTo(next, now);
+  }
+  uint8_t selected = active;
+  portEXIT_CRITICAL(&selectorMux);
+  return selected;
+}
+
+uint8_t BrokerSelector::getActive() const {
+  portENTER_CRITICAL(&selectorMux);
+  uint8_t current = active;
+  portEXIT_CRITICAL(&selectorMux);
+  return current;
+}
+
+uint8_t BrokerSelector::getCount() const {
+  return nBrokers;
+}
+
+const BrokerAddress& BrokerSelector::getAddress(uint8_t broker) const {
+  return brokers[broker];
+}
+
+BrokerStats BrokerSelector::getStats(uint8_t broker) const {
+  portENTER_CRITICAL(&selectorMux);
+  BrokerStats copy = stats[broker];
+  portEXIT_CRITICAL(&selectorMux);
+  return copy;
+}
+
+unsigned long BrokerSelector::getSwitches() const {
+  portENTER_CRITICAL(&selectorMux);
+  unsigned long count = switches;
+  portEXIT_CRITICAL(&selectorMux);
+  return count;
+}
@@ -0,0 +1,85 @@
+#ifndef __BROKER_SELECTOR__
+#define __BROKER_SELECTOR__
+
+#include <stdint.h>
+#include "config.h"
+
+/**
+ * One entry of MQTT_BROKERS
+ */
+struct BrokerAddress {
+  const char* host;
+  uint16_t port;
+};
+
+/**
+ * Health and round-trip time of one broker
+ */
+struct BrokerStats {
+  unsigned long srtt;             // us, smoothed PINGREQ/PINGRESP time, 0 until measured
+  unsigned long lastRtt;          // us
+  unsigned long pings;            // answered
+  unsigned long timeouts;         // pings, connects and sessions
+  uint8_t consecutiveTimeouts;
+  uint8_t consecutiveAnswers;
+  uint8_t better;                 // consecutive pings BROKER_FAILBACK_MARGIN faster than the active broker
+  bool healthy;
+};
+
+/**
+ * Broker Selector
+ * Chooses the broker of the MQTT client from what the client measures;
+ * it does no I/O itself. A broker fails after BROKER_FAILOVER_TIMEOUTS
+ * consecutive timeouts and is healthy again after BROKER_RECOVERY_PINGS
+ * answered pings, with a new RTT. If the active broker fails, the
+ * healthy broker with the lowest smoothed RTT takes over at once. A
+ * healthy broker replaces a healthy active one only when its RTT is
+ * BROKER_FAILBACK_MARGIN lower in BROKER_FAILBACK_PINGS pings in a row and
+ * the last switch is BROKER_MIN_DWELL old, so two brokers of about the
+ * same RTT do not alternate.
+ * Thread-safe: the probes run in a group of their own.
+ */
+class BrokerSelector {
+private:
+  const BrokerAddress* brokers;
+  uint8_t nBrokers;
+  BrokerStats* stats;
+  uint8_t active;
+  unsigned long lastSwitch;       // ms
+  unsigned long switches;
+
+  int fastest(bool onlyBetter) const;
+  void switchTo(uint8_t broker, unsigned long now);
+
+public:
+  BrokerSelector(const BrokerAddress* brokers, uint8_t nBrokers);
+
+  /**
+   * A ping of broker was answered after rtt us
+   */
+  void onAnswer(uint8_t broker, unsigned long rtt);
+
+  /**
+   * A ping, connect or session of broker timed out
+   */
+  void onTimeout(uint8_t broker);
+
+  /**
+   * The client connected to broker
+   */
+  void onConnected(uint8_t broker);
+
+  /**
+   * Switch if the rules above say so, at time now (ms)
+   * Returns: the broker to use
+   */
+  uint8_t select(unsigned long now);
+
+  uint8_t getActive() const;
+  uint8_t getCount() const;
+  const BrokerAddress& getAddress(uint8_t broker) const;
+  BrokerStats getStats(uint8_t broker) const;
+  unsigned long getSwitches() const;
+};
+
+#endif
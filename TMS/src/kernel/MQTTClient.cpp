@@ -1,11 +1,31 @@
 #include "MQTTClient.h"
+#include "ZoneTrace.h"
+#include "model/FlightRecorder.h"
+
+#define MQTT_PACKET_OVERHEAD 7   // PUBLISH fixed header (up to 5 bytes) + topic length
+#define PROBE_CLIENT_ID MQTT_CLIENT_ID "-probe"   // Not ours: the broker would drop our session
+
+static const BrokerAddress brokerList[] = MQTT_BROKERS;
 
 MQTTClient::MQTTClient() 
   : mqttClient(wifiClient), 
+    brokers(brokerList, sizeof(brokerList) / sizeof(brokerList[0])),
+    nextProbe(0),
+    sessionUp(false),
+    connectNow(false),
     lastReconnectAttempt(0), 
     reconnectDelay(MQTT_RECONNECT_DELAY),
-    wifiConnected(false) {
-  mqttClient.setServer(MQTT_BROKER, MQTT_PORT);
+    minReconnectDelay(MQTT_RECONNECT_DELAY),
+    maxReconnectDelay(MQTT_MAX_RECONNECT_DELAY),
+    wifiConnected(false),
+    nSubscriptions(0) {
+  useBroker(brokers.getActive());
+  mqttClient.setBufferSize(MQTT_BUFFER_SIZE);
+  // Also the wait for CONNACK
+  mqttClient.setSocketTimeout(BROKER_PING_TIMEOUT / 1000);
+  mqttClient.setCallback([this](char* topic, uint8_t* payload, unsigned int length) {
+    dispatch(topic, payload, length);
+  });
 }
 
 bool MQTTClient::connectWiFi() {
@@ -30,10 +50,14 @@ bool MQTTClient::connectWiFi() {
     DEBUG_PRINT("IP Address: ");
     DEBUG_PRINTLN(WiFi.localIP());
     wifiConnected = true;
+    flightRecorder.log(FLIGHT_WIFI, 1, WiFi.status());
+    // SNTP runs in the background and sets the clock of the history log
+    configTime(0, 0, NTP_SERVER);
     return true;
   } else {
     DEBUG_PRINTLN("\nWiFi connection failed!");
     wifiConnected = false;
+    flightRecorder.log(FLIGHT_WIFI, 0, WiFi.status());
     return false;
   }
 }
@@ -47,23 +71,37 @@ bool MQTTClient::connectMQTT() {
     return false;
   }
 
+  const BrokerAddress& address = brokers.getAddress(brokers.getActive());
   DEBUG_PRINT("Connecting to MQTT broker: ");
-  DEBUG_PRINTLN(MQTT_BROKER);
+  DEBUG_PRINTLN(address.host);
 
-  bool connected;
-  if (strlen(MQTT_USERNAME) > 0) {
+  // PubSubClient goes on with an open socket. Opened here, a broker that is
+  // down holds up the network group for BROKER_PING_TIMEOUT, not the 3 s
+  // WiFiClient default, before it counts as a timeout.
+  bool socketOpen = wifiClient.connect(address.host, address.port, BROKER_PING_TIMEOUT);
+  bool connected = false;
+  if (socketOpen && strlen(MQTT_USERNAME) > 0) {
     connected = mqttClient.connect(MQTT_CLIENT_ID, MQTT_USERNAME, MQTT_PASSWORD);
-  } else {
+  } else if (socketOpen) {
     connected = mqttClient.connect(MQTT_CLIENT_ID);
   }
 
   if (connected) {
     DEBUG_PRINTLN("MQTT connected!");
-    reconnectDelay = MQTT_RECONNECT_DELAY;
+    reconnectDelay = minReconnectDelay;
+    sessionUp = true;
+    brokers.onConnected(brokers.getActive());
+    flightRecorder.log(FLIGHT_MQTT, 1, mqttClient.state());
+    resubscribe();
     return true;
   } else {
+    // Without a socket PubSubClient did not try and keeps its old state
+    int rc = socketOpen ? mqttClient.state() : MQTT_CONNECT_FAILED;
     DEBUG_PRINT("MQTT connection failed, rc=");
-    DEBUG_PRINTLN(mqttClient.state());
+    DEBUG_PRINTLN(rc);
+    flightRecorder.log(FLIGHT_MQTT, 0, rc);
+    brokers.onTimeout(brokers.getActive());
+    selectBroker();
     return false;
   }
 }
@@ -71,32 +109,156 @@ bool MQTTClient::connectMQTT() {
 bool MQTTClient::reconnect() {
   unsigned long now = millis();
   
-  if (now - lastReconnectAttempt < reconnectDelay) {
+  if (!connectNow && now - lastReconnectAttempt < reconnectDelay) {
     return false;
   }
 
   lastReconnectAttempt = now;
+  connectNow = false;
 
   if (!connectWiFi()) {
-    reconnectDelay = (reconnectDelay * 2 < MQTT_MAX_RECONNECT_DELAY) ? reconnectDelay * 2 : MQTT_MAX_RECONNECT_DELAY;
+    reconnectDelay = (reconnectDelay * 2 < maxReconnectDelay) ? reconnectDelay * 2 : maxReconnectDelay;
     return false;
   }
 
   if (!connectMQTT()) {
-    reconnectDelay = (reconnectDelay * 2 < MQTT_MAX_RECONNECT_DELAY) ? reconnectDelay * 2 : MQTT_MAX_RECONNECT_DELAY;
+    // Unless it failed over to another broker, which is tried at once
+    if (!connectNow) {
+      reconnectDelay = (reconnectDelay * 2 < maxReconnectDelay) ? reconnectDelay * 2 : maxReconnectDelay;
+    }
     return false;
   }
 
   return true;
 }
 
+void MQTTClient::setBackoff(unsigned long delay, unsigned long maxDelay) {
+  minReconnectDelay = delay;
+  maxReconnectDelay = maxDelay;
+  // A backoff in progress goes on within the new bounds
+  if (reconnectDelay < minReconnectDelay) {
+    reconnectDelay = minReconnectDelay;
+  } else if (reconnectDelay > maxReconnectDelay) {
+    reconnectDelay = maxReconnectDelay;
+  }
+}
+
+void MQTTClient::useBroker(uint8_t broker) {
+  const BrokerAddress& address = brokers.getAddress(broker);
+  mqttClient.setServer(address.host, address.port);
+}
+
+void MQTTClient::selectBroker() {
+  uint8_t previous = brokers.getActive();
+  uint8_t active = brokers.select(millis());
+  if (active == previous) {
+    return;
+  }
+  bool failover = !brokers.getStats(previous).healthy;
+  DEBUG_PRINT(failover ? "Broker failed, switching to " : "Faster broker, switching to ");
+  DEBUG_PRINTLN(brokers.getAddress(active).host);
+  flightRecorder.log(FLIGHT_BROKER, active, failover ? 0 : 1);
+
+  // Only the MQTT session: Wi-Fi is up
+  if (mqttClient.connected()) {
+    mqttClient.disconnect();
+  }
+  sessionUp = false;
+  useBroker(active);
+  connectNow = true;
+}
+
+void MQTTClient::probe() {
+  // Not wifiConnected: that belongs to the network group
+  if (brokers.getCount() < 2 || WiFi.status() != WL_CONNECTED) {
+    return;
+  }
+  TRACE_SCOPE("broker_probe");
+  uint8_t broker = nextProbe;
+  nextProbe = (nextProbe + 1) % brokers.getCount();
+
+  unsigned long rtt;
+  if (ping(broker, rtt)) {
+    brokers.onAnswer(broker, rtt);
+  } else {
+    brokers.onTimeout(broker);
+  }
+}
+
+bool MQTTClient::awaitProbe(int bytes, unsigned long start) {
+  while (probeClient.available() < bytes) {
+    if (millis() - start >= BROKER_PING_TIMEOUT || !probeClient.connected()) {
+      return false;
+    }
+    delay(1);
+  }
+  return true;
+}
+
+bool MQTTClient::ping(uint8_t broker, unsigned long& rtt) {
+  const BrokerAddress& address = brokers.getAddress(broker);
+  if (!probeClient.connect(address.host, address.port, BROKER_PING_TIMEOUT)) {
+    return false;
+  }
+
+  // CONNECT: MQTT 3.1.1, clean session, keep alive of a few timeouts
+  const uint8_t idLength = sizeof(PROBE_CLIENT_ID) - 1;
+  const uint16_t keepAlive = 3 * BROKER_PING_TIMEOUT / 1000 + 1;
+  uint8_t packet[14 + idLength];
+  uint8_t n = 0;
+  packet[n++] = 0x10;
+  packet[n++] = 12 + idLength;
+  const uint8_t header[] = { 0x00, 0x04, 'M', 'Q', 'T', 'T', 0x04, 0x02 };
+  memcpy(packet + n, header, sizeof(header));
+  n += sizeof(header);
+  packet[n++] = keepAlive >> 8;
+  packet[n++] = keepAlive & 0xFF;
+  packet[n++] = 0;
+  packet[n++] = idLength;
+  memcpy(packet + n, PROBE_CLIENT_ID, idLength);
+  n += idLength;
+
+  uint8_t answer[4];
+  bool answered = probeClient.write(packet, n) == n && awaitProbe(4, millis()) &&
+                  probeClient.read(answer, 4) == 4 && answer[0] == 0x20 && answer[3] == 0;
+  if (answered) {
+    // PINGREQ, timed until PINGRESP
+    const uint8_t pingReq[] = { 0xC0, 0x00 };
+    unsigned long start = micros();
+    answered = probeClient.write(pingReq, 2) == 2 && awaitProbe(2, millis()) &&
+               probeClient.read(answer, 2) == 2 && answer[0] == 0xD0;
+    rtt = micros() - start;
+  }
+  if (answered) {
+    const uint8_t disconnect[] = { 0xE0, 0x00 };
+    probeClient.write(disconnect, 2);
+  }
+  probeClient.stop();
+  return answered;
+}
+
+const BrokerSelector& MQTTClient::getBrokers() const {
+  return brokers;
+}
+
 bool MQTTClient::publish(const char* topic, const char* payload, bool retain) {
+  TRACE_SCOPE("mqtt_publish");
   if (!mqttClient.connected()) {
     DEBUG_PRINTLN("Cannot publish: MQTT not connected");
+    flightRecorder.log(FLIGHT_PUBLISH_FAIL, 0, mqttClient.state());
     return false;
   }
 
-  bool result = mqttClient.publish(topic, payload, retain);
+  size_t length = strlen(payload);
+  bool result;
+  if (length + strlen(topic) + MQTT_PACKET_OVERHEAD > MQTT_BUFFER_SIZE) {
+    // Too big for the client's packet buffer: stream it to the socket
+    result = mqttClient.beginPublish(topic, length, retain) &&
+             mqttClient.write((const uint8_t*)payload, length) == length &&
+             mqttClient.endPublish();
+  } else {
+    result = mqttClient.publish(topic, payload, retain);
+  }
   
   if (result) {
     DEBUG_PRINT("Published to ");
@@ -105,6 +267,7 @@ bool MQTTClient::publish(const char* topic, const char* payload, bool retain) {
     DEBUG_PRINTLN(payload);
   } else {
     DEBUG_PRINTLN("Publish failed!");
+    flightRecorder.log(FLIGHT_PUBLISH_FAIL, 1, mqttClient.state());
   }
   
   return result;
@@ -114,10 +277,65 @@ bool MQTTClient::publish(const char* topic, const String& payload, bool retain)
   return publish(topic, payload.c_str(), retain);
 }
 
+bool MQTTClient::publish(const char* topic, const uint8_t* payload, unsigned int length, bool retain) {
+  TRACE_SCOPE("mqtt_publish");
+  if (!mqttClient.connected()) {
+    DEBUG_PRINTLN("Cannot publish: MQTT not connected");
+    flightRecorder.log(FLIGHT_PUBLISH_FAIL, 0, mqttClient.state());
+    return false;
+  }
+  if (!mqttClient.publish(topic, payload, length, retain)) {
+    flightRecorder.log(FLIGHT_PUBLISH_FAIL, 1, mqttClient.state());
+    return false;
+  }
+  return true;
+}
+
+bool MQTTClient::subscribe(const char* topic, MQTTMessageHandler* handler) {
+  if (nSubscriptions >= MQTT_MAX_SUBSCRIPTIONS) {
+    return false;
+  }
+  subscriptions[nSubscriptions].topic = topic;
+  subscriptions[nSubscriptions].handler = handler;
+  nSubscriptions++;
+
+  if (mqttClient.connected()) {
+    mqttClient.subscribe(topic);
+  }
+  return true;
+}
+
+void MQTTClient::resubscribe() {
+  // A new session starts without subscriptions
+  for (int i = 0; i < nSubscriptions; i++) {
+    if (!mqttClient.subscribe(subscriptions[i].topic)) {
+      DEBUG_PRINT("Subscription failed: ");
+      DEBUG_PRINTLN(subscriptions[i].topic);
+    }
+  }
+}
+
+void MQTTClient::dispatch(char* topic, uint8_t* payload, unsigned int length) {
+  for (int i = 0; i < nSubscriptions; i++) {
+    if (strcmp(topic, subscriptions[i].topic) == 0) {
+      subscriptions[i].handler->onMessage(topic, payload, length);
+    }
+  }
+}
+
 void MQTTClient::loop() {
   if (mqttClient.connected()) {
     mqttClient.loop();
   }
+  if (sessionUp && !mqttClient.connected()) {
+    // The broker stopped answering, not the access point
+    sessionUp = false;
+    if (WiFi.status() == WL_CONNECTED) {
+      brokers.onTimeout(brokers.getActive());
+    }
+  }
+  // Also acts on what the probes found
+  selectBroker();
 }
 
 bool MQTTClient::isWiFiConnected() {
@@ -128,12 +346,17 @@ bool MQTTClient::isConnected() {
   return mqttClient.connected();
 }
 
+int MQTTClient::getMqttState() {
+  return mqttClient.state();
+}
+
 bool MQTTClient::isFullyConnected() {
   return isWiFiConnected() && isConnected();
 }
 
 void MQTTClient::disconnect() {
   mqttClient.disconnect();
+  sessionUp = false;
   WiFi.disconnect();
   wifiConnected = false;
 }
@@ -4,31 +4,95 @@
 #include <WiFi.h>
 #include <PubSubClient.h>
 #include "config.h"
+#include "BrokerSelector.h"
+
+/**
+ * Receiver of the messages published on a subscribed topic
+ */
+class MQTTMessageHandler {
+public:
+  virtual void onMessage(const char* topic, const uint8_t* payload, unsigned int length) = 0;
+};
 
 /**
  * MQTT Client Wrapper
  * Manages MQTT connection, publishing, and reconnection logic
+ * The broker is one of MQTT_BROKERS, chosen by a BrokerSelector. probe()
+ * pings the brokers in turn over a second, short MQTT session and times
+ * PINGREQ/PINGRESP. Failed pings, connects and lost sessions count as
+ * timeouts. loop() switches brokers when the selector says so. A switch
+ * only drops the MQTT session: Wi-Fi stays up and the new broker is
+ * connected to at once.
  */
 class MQTTClient {
 private:
   WiFiClient wifiClient;
   PubSubClient mqttClient;
+  WiFiClient probeClient;
+  BrokerSelector brokers;
+  uint8_t nextProbe;
+  bool sessionUp;               // connected at the last loop()
+  bool connectNow;              // a new broker: no backoff before connecting
   unsigned long lastReconnectAttempt;
   unsigned long reconnectDelay;
+  unsigned long minReconnectDelay;
+  unsigned long maxReconnectDelay;
   bool wifiConnected;
 
+  struct Subscription {
+    const char* topic;
+    MQTTMessageHandler* handler;
+  };
+  Subscription subscriptions[MQTT_MAX_SUBSCRIPTIONS];
+  int nSubscriptions;
+
+  void useBroker(uint8_t broker);
+  void selectBroker();
+  bool ping(uint8_t broker, unsigned long& rtt);
+  bool awaitProbe(int bytes, unsigned long start);
+  void resubscribe();
+  void dispatch(char* topic, uint8_t* payload, unsigned int length);
+
 public:
   MQTTClient();
   
   bool connectWiFi();
   bool connectMQTT();
   bool reconnect();
+
+  /**
+   * Wait delay ms after a failed attempt, doubled after every further
+   * failure up to maxDelay
+   */
+  void setBackoff(unsigned long delay, unsigned long maxDelay);
+
+  /**
+   * Ping the next broker. Blocks for up to three BROKER_PING_TIMEOUTs, so
+   * it runs in a task group of its own; it only uses its own socket and
+   * the selector.
+   */
+  void probe();
+
+  const BrokerSelector& getBrokers() const;
   bool publish(const char* topic, const char* payload, bool retain = false);
   bool publish(const char* topic, const String& payload, bool retain = false);
+  bool publish(const char* topic, const uint8_t* payload, unsigned int length, bool retain = false);
+
+  /**
+   * Deliver messages on topic to handler, from the next loop() on
+   * The subscription is renewed after every reconnection.
+   */
+  bool subscribe(const char* topic, MQTTMessageHandler* handler);
   void loop();
   bool isWiFiConnected();
   bool isConnected();
   bool isFullyConnected();
+
+  /**
+   * PubSubClient state(): MQTT_CONNECTED, or why the last connection
+   * attempt failed or the connection was lost
+   */
+  int getMqttState();
   void disconnect();
 };
 
@@ -0,0 +1,139 @@
+#include "PriorityScheduler.h"
+
+#ifndef TMS_COOPERATIVE
+#include "Arduino.h"
+#include "config.h"
+
+static portMUX_TYPE statsMux = portMUX_INITIALIZER_UNLOCKED;
+
+PriorityScheduler::PriorityScheduler() : nGroups(0), created(false) {
+}
+
+int PriorityScheduler::addGroup(const char* name, UBaseType_t priority, int period, uint32_t stackSize,
+                                bool event) {
+  if (nGroups >= MAX_GROUPS) {
+    return -1;
+  }
+  Group& group = groups[nGroups];
+  group.name = name;
+  group.priority = priority;
+  group.stackSize = stackSize;
+  group.period = period;
+  group.event = event;
+  group.scheduler.init(period);
+  group.handle = nullptr;
+  memset(&group.stats, 0, sizeof(group.stats));
+  return nGroups++;
+}
+
+bool PriorityScheduler::addTask(int group, Task* task) {
+  if (group < 0 || group >= nGroups) {
+    return false;
+  }
+  return groups[group].scheduler.addTask(task);
+}
+
+bool PriorityScheduler::create() {
+  // Zone trace budgets only for the top priority: the pass of a group below
+  // includes the time it was preempted or blocked in a socket
+  UBaseType_t top = 0;
+  for (int i = 0; i < nGroups; i++) {
+    if (groups[i].priority > top) {
+      top = groups[i].priority;
+    }
+  }
+  bool ok = true;
+  for (int i = 0; i < nGroups; i++) {
+    Group& group = groups[i];
+    group.scheduler.setBudgeted(group.priority == top);
+    if (xTaskCreatePinnedToCore(run, group.name, group.stackSize, &group, group.priority,
+                                &group.handle, TASK_CORE) != pdPASS) {
+      DEBUG_PRINT("Cannot create task group ");
+      DEBUG_PRINTLN(group.name);
+      group.handle = nullptr;
+      ok = false;
+    }
+  }
+  created = true;
+  return ok;
+}
+
+bool PriorityScheduler::start() {
+  bool ok = created || create();
+  for (int i = 0; i < nGroups; i++) {
+    if (groups[i].handle != nullptr) {
+      xTaskNotifyGive(groups[i].handle);
+    }
+  }
+  return ok;
+}
+
+void PriorityScheduler::run(void* arg) {
+  Group* group = (Group*)arg;
+  TickType_t period = pdMS_TO_TICKS(group->period);
+
+  // Created but not released until start()
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  TickType_t release = xTaskGetTickCount();
+
+  while (true) {
+    if (group->event) {
+      ulTaskNotifyTake(pdTRUE, period);
+      release = xTaskGetTickCount();
+    } else {
+      vTaskDelayUntil(&release, period);
+    }
+    TickType_t start = xTaskGetTickCount();
+    group->scheduler.schedule();
+    TickType_t end = xTaskGetTickCount();
+
+    unsigned long lateness = (start - release) * portTICK_PERIOD_MS;
+    unsigned long response = (end - release) * portTICK_PERIOD_MS;
+    portENTER_CRITICAL(&statsMux);
+    GroupStats& stats = group->stats;
+    stats.releases++;
+    if (end - release > period) {
+      stats.deadlineMisses++;
+    }
+    if (lateness > stats.maxLateness) {
+      stats.maxLateness = lateness;
+    }
+    if (response > stats.maxResponse) {
+      stats.maxResponse = response;
+    }
+    portEXIT_CRITICAL(&statsMux);
+  }
+}
+
+TaskHandle_t PriorityScheduler::getHandle(int group) const {
+  return group >= 0 && group < nGroups ? groups[group].handle : nullptr;
+}
+
+const char* PriorityScheduler::getName(int group) const {
+  return group >= 0 && group < nGroups ? groups[group].name : "";
+}
+
+GroupStats PriorityScheduler::getStats(int group) const {
+  GroupStats stats;
+  memset(&stats, 0, sizeof(stats));
+  if (group >= 0 && group < nGroups) {
+    portENTER_CRITICAL(&statsMux);
+    stats = groups[group].stats;
+    portEXIT_CRITICAL(&statsMux);
+  }
+  return stats;
+}
+
+int PriorityScheduler::getNumGroups() const {
+  return nGroups;
+}
+
+int PriorityScheduler::getNumTasks() const {
+  int n = 0;
+  for (int i = 0; i < nGroups; i++) {
+    n += groups[i].scheduler.getNumTasks();
+  }
+  return n;
+}
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef __PRIORITY_SCHEDULER__
+#define __PRIORITY_SCHEDULER__
+
+#ifndef TMS_COOPERATIVE
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "Scheduler.h"
+
+#define MAX_GROUPS 4
+
+/**
+ * Timing of one task group since boot
+ */
+struct GroupStats {
+  unsigned long releases;
+  unsigned long deadlineMisses;   // still running when the next release was due
+  unsigned long maxLateness;      // ms from release to start
+  unsigned long maxResponse;      // ms from release to end
+};
+
+/**
+ * Priority Scheduler
+ * Default scheduler of the TMS (-DTMS_COOPERATIVE keeps the single
+ * Scheduler in loop()). Tasks run in groups, each group a FreeRTOS task of
+ * its own priority that runs a Scheduler with the group's period as base
+ * period, released by vTaskDelayUntil. A released group preempts any group
+ * of lower priority, also one that is blocked in a socket or a delay, so
+ * sensing never waits for the network. Tasks that share state which is
+ * not thread-safe (the MQTT client) must be in the same group. The
+ * deadline of a release is the next release.
+ * An event group is also released by a task notification, for tasks that
+ * react to changes rather than time; the period is then only a timeout.
+ */
+class PriorityScheduler {
+private:
+  struct Group {
+    const char* name;
+    UBaseType_t priority;
+    uint32_t stackSize;
+    int period;
+    bool event;
+    Scheduler scheduler;
+    TaskHandle_t handle;
+    GroupStats stats;
+  };
+
+  Group groups[MAX_GROUPS];
+  int nGroups;
+  bool created;
+
+  static void run(void* group);
+
+public:
+  PriorityScheduler();
+
+  /**
+   * Add a group released every period ms (at the latest, for an event group)
+   * Returns: the group number, or -1 if there are MAX_GROUPS already
+   */
+  int addGroup(const char* name, UBaseType_t priority, int period, uint32_t stackSize, bool event = false);
+
+  /**
+   * Add a task to a group; its period must be a multiple of the group's
+   * Returns: true if added successfully, false if the group is full
+   */
+  bool addTask(int group, Task* task);
+
+  /**
+   * Create the FreeRTOS tasks, pinned to TASK_CORE, without releasing
+   * them: their handles can be handed out (e.g. to StateManager) before
+   * any group runs. Add all groups and tasks before.
+   * Returns: false if a task could not be created
+   */
+  bool create();
+
+  /**
+   * Release the groups, creating their tasks first if create() was not
+   * called
+   * Returns: false if a task could not be created
+   */
+  bool start();
+
+  /**
+   * FreeRTOS task of a group, to notify it; nullptr before create()
+   */
+  TaskHandle_t getHandle(int group) const;
+
+  const char* getName(int group) const;
+  GroupStats getStats(int group) const;
+  int getNumGroups() const;
+  int getNumTasks() const;
+};
+
+#endif
+#endif
@@ -1,8 +1,9 @@
 #include "Arduino.h"
 #include "Scheduler.h"
+#include "ZoneTrace.h"
 
 Scheduler::Scheduler(int basePeriod) 
-  : nTasks(0), basePeriod(basePeriod) {
+  : nTasks(0), basePeriod(basePeriod), budgeted(true) {
 }
 
 void Scheduler::init(int basePeriod) {
@@ -21,6 +22,8 @@ bool Scheduler::addTask(Task* task) {
 }
 
 void Scheduler::schedule() {
+  TRACE_BUDGET(budgeted ? 1000UL * basePeriod : 0);
+  TRACE_SCOPE("schedule");
   for (int i = 0; i < nTasks; i++) {
     if (taskList[i]->isActive()) {
       if (taskList[i]->isPeriodic()) {
@@ -37,6 +40,10 @@ void Scheduler::schedule() {
   }
 }
 
+void Scheduler::setBudgeted(bool budgeted) {
+  this->budgeted = budgeted;
+}
+
 int Scheduler::getBasePeriod() const {
   return basePeriod;
 }
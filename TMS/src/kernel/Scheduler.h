@@ -3,7 +3,7 @@
 
 #include "Task.h"
 
-#define MAX_TASKS 10
+#define MAX_TASKS 12
 
 /**
  * Task Scheduler
@@ -14,6 +14,7 @@ private:
   Task* taskList[MAX_TASKS];
   int nTasks;
   int basePeriod;
+  bool budgeted;
 
 public:
   Scheduler(int basePeriod = 10);
@@ -35,6 +36,13 @@ public:
    */
   virtual void schedule();
 
+  /**
+   * Whether a pass longer than the base period freezes the zone trace
+   * (on by default). The check is on wall time, so it only makes sense for
+   * a scheduler that nothing preempts and that does not block.
+   */
+  void setBudgeted(bool budgeted);
+
   /**
    * Get base period in milliseconds
    */
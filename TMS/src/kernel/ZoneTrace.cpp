@@ -0,0 +1,87 @@
+#include "ZoneTrace.h"
+
+#ifdef ZONE_TRACE
+
+struct ZoneEvent {
+  uint32_t cycles;
+  const char* name;
+  const char* task;   // FreeRTOS task name: the zones of the groups interleave
+  bool end;
+};
+
+static ZoneEvent events[ZONE_TRACE_SIZE];
+static uint16_t head = 0;
+static uint16_t count = 0;
+static const char* pendingReason = nullptr;
+static unsigned long lastDump = 0;
+static bool dumped = false;
+static portMUX_TYPE zoneMux = portMUX_INITIALIZER_UNLOCKED;
+
+void ZoneTrace::record(const char* name, bool end) {
+  uint32_t cycles = ESP.getCycleCount();
+  const char* task = pcTaskGetName(nullptr);
+  portENTER_CRITICAL(&zoneMux);
+  if (pendingReason == nullptr) {
+    ZoneEvent& e = events[head];
+    e.cycles = cycles;
+    e.name = name;
+    e.task = task;
+    e.end = end;
+    head = (head + 1) % ZONE_TRACE_SIZE;
+    if (count < ZONE_TRACE_SIZE) {
+      count++;
+    }
+  }
+  portEXIT_CRITICAL(&zoneMux);
+}
+
+void ZoneTrace::requestDump(const char* reason) {
+  portENTER_CRITICAL(&zoneMux);
+  if (pendingReason == nullptr) {
+    pendingReason = reason;
+  }
+  portEXIT_CRITICAL(&zoneMux);
+}
+
+void ZoneTrace::checkBudget(unsigned long start, unsigned long budget) {
+  if (budget == 0 || micros() - start <= budget) {
+    return;
+  }
+  // The dump itself overruns the next passes: leave time between dumps
+  if (dumped && millis() - lastDump < ZONE_TRACE_DUMP_INTERVAL) {
+    return;
+  }
+  requestDump("overrun");
+}
+
+void ZoneTrace::flush(Print& out) {
+  if (pendingReason == nullptr) {
+    return;
+  }
+
+  // Frozen: nothing writes to the ring until pendingReason is cleared
+  out.print("ZONES " ZONE_TRACE_NAME " ");
+  out.print(ESP.getCpuFreqMHz());
+  out.print(' ');
+  out.println(pendingReason);
+  uint16_t first = (head + ZONE_TRACE_SIZE - count) % ZONE_TRACE_SIZE;
+  for (uint16_t i = 0; i < count; i++) {
+    const ZoneEvent& e = events[(first + i) % ZONE_TRACE_SIZE];
+    out.print("Z ");
+    out.print(e.cycles);
+    out.print(e.end ? " E " : " B ");
+    out.print((const __FlashStringHelper*)e.name);
+    out.print(' ');
+    out.println(e.task);
+  }
+  out.println("ZONES end");
+
+  portENTER_CRITICAL(&zoneMux);
+  count = 0;
+  pendingReason = nullptr;
+  portEXIT_CRITICAL(&zoneMux);
+  lastDump = millis();
+  dumped = true;
+}
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef __ZONE_TRACE__
+#define __ZONE_TRACE__
+
+/**
+ * Zone Trace
+ * Timeline instrumentation for diagnostic builds (-DZONE_TRACE, see the
+ * "trace" PlatformIO environment). TRACE_SCOPE("name") records the CPU
+ * cycle counter and the FreeRTOS task when the enclosing scope is entered
+ * and when it is left, into a ring of ZONE_TRACE_SIZE events shared by all
+ * tasks. TRACE_BUDGET(us) freezes the ring when the enclosing scope took
+ * longer than us of wall time (0: never), so that the pass that blew the
+ * budget is still in it; TRACE_FLUSH(out) prints a frozen ring, and
+ * tools/zonetrace.py turns the printout into a Chrome trace, one thread
+ * per task.
+ * Without the flag the macros compile to nothing.
+ */
+
+#ifdef ZONE_TRACE
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "config.h"
+
+class ZoneTrace {
+public:
+  /**
+   * Append an event; ignored while the ring is frozen
+   */
+  static void record(const char* name, bool end);
+
+  /**
+   * Freeze the ring and have the next flush() print it
+   * reason: short word printed in the dump header ("overrun", "request")
+   */
+  static void requestDump(const char* reason);
+
+  /**
+   * Freeze the ring if a scope started at start (micros) exceeded budget
+   * (us, 0: no budget). Wall time: preemption and blocking count too
+   */
+  static void checkBudget(unsigned long start, unsigned long budget);
+
+  /**
+   * Print a requested dump, then record again
+   */
+  static void flush(Print& out);
+};
+
+class ZoneScope {
+public:
+  explicit ZoneScope(const char* name) : name(name) { ZoneTrace::record(name, false); }
+  ~ZoneScope() { ZoneTrace::record(name, true); }
+private:
+  const char* name;
+};
+
+class ZoneBudget {
+public:
+  explicit ZoneBudget(unsigned long budget) : start(micros()), budget(budget) {}
+  ~ZoneBudget() { ZoneTrace::checkBudget(start, budget); }
+private:
+  unsigned long start;
+  unsigned long budget;
+};
+
+// Declare TRACE_BUDGET before TRACE_SCOPE in the same scope: the zone then
+// ends before the budget is checked
+#define TRACE_SCOPE(name) ZoneScope zoneScope_(PSTR(name))
+#define TRACE_BUDGET(us) ZoneBudget zoneBudget_(us)
+#define TRACE_FLUSH(out) ZoneTrace::flush(out)
+#else
+#define TRACE_SCOPE(name)
+#define TRACE_BUDGET(us)
+#define TRACE_FLUSH(out)
+#endif
+
+#endif
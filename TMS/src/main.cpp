@@ -3,20 +3,54 @@
 #include "model/HWPlatform.h"
 #include "model/TMSState.h"
 #include "model/WaterLevelData.h"
+#include "model/EchoTrace.h"
+#include "model/FlightRecorder.h"
+#include "model/HistoryLog.h"
+#include "model/LevelStats.h"
+#include "model/RuntimeConfig.h"
 #include "kernel/MQTTClient.h"
 #include "kernel/Scheduler.h"
+#include "kernel/PriorityScheduler.h"
+#include "kernel/ZoneTrace.h"
 #include "task/MonitoringTask.h"
+#include "task/PublishTask.h"
 #include "task/MQTTTask.h"
 #include "task/LEDTask.h"
+#include "task/TraceTask.h"
+#include "task/FlightTask.h"
+#include "task/HistoryTask.h"
+#include "task/SummaryTask.h"
+#include "task/ConfigTask.h"
+#include "task/ProbeTask.h"
 
 StateManager* stateManager;
 MQTTClient* mqttClient;
+#ifdef TMS_COOPERATIVE
 Scheduler* scheduler;
+#else
+PriorityScheduler* scheduler;
+int sensingGroup;
+int networkGroup;
+int ledGroup;
+int probeGroup;
+#endif
 HWPlatform* hw;
+EchoTrace* echoTrace;
+HistoryLog* historyLog;
+LevelStats* levelStats;
+RuntimeConfig* runtimeConfig;
+QueueHandle_t readingQueue;
 
 MonitoringTask* monitoringTask;
+PublishTask* publishTask;
 MQTTTask* mqttTask;
 LEDTask* ledTask;
+TraceTask* traceTask;
+FlightTask* flightTask;
+HistoryTask* historyTask;
+SummaryTask* summaryTask;
+ConfigTask* configTask;
+ProbeTask* probeTask;
 
 /**
  * Initialize hardware components
@@ -25,6 +59,7 @@ void initHardware() {
   DEBUG_PRINTLN("=== Initializing Hardware ===");
 
   Serial.begin(SERIAL_BAUD_RATE);
+  flightRecorder.begin();
 
   hw = new HWPlatform();
   DEBUG_PRINTLN("Hardware initialization complete");
@@ -36,16 +71,36 @@ void initHardware() {
 void initSoftware() {
   DEBUG_PRINTLN("=== Initializing Software ===");
 
+  runtimeConfig = new RuntimeConfig();
+  runtimeConfig->begin();
+  RuntimeSettings settings = runtimeConfig->get();
+
   stateManager = new StateManager();
   stateManager->setState(INIT);
   DEBUG_PRINT("Initial state: ");
   DEBUG_PRINTLN(stateToString(stateManager->getState()));
 
   mqttClient = new MQTTClient();
+  mqttClient->setBackoff(settings.reconnectDelay, settings.maxReconnectDelay);
   DEBUG_PRINTLN("MQTT Client initialized");
 
+  echoTrace = new EchoTrace();
+  historyLog = new HistoryLog();
+  historyLog->begin();
+  levelStats = new LevelStats(settings.samplingPeriod);
+  readingQueue = xQueueCreate(READING_QUEUE_LENGTH, sizeof(WaterLevelData));
+
+#ifdef TMS_COOPERATIVE
   scheduler = new Scheduler(10);
   scheduler->init(10);
+#else
+  scheduler = new PriorityScheduler();
+  // Runtime sampling periods are multiples of the group period
+  sensingGroup = scheduler->addGroup("sensing", SENSING_PRIORITY, SAMPLING_PERIOD_STEP, SENSING_STACK_SIZE);
+  networkGroup = scheduler->addGroup("network", NETWORK_PRIORITY, NETWORK_GROUP_PERIOD, NETWORK_STACK_SIZE);
+  ledGroup = scheduler->addGroup("led", LED_PRIORITY, LED_TASK_PERIOD, LED_STACK_SIZE, true);
+  probeGroup = scheduler->addGroup("probe", PROBE_PRIORITY, PROBE_TASK_PERIOD, PROBE_STACK_SIZE);
+#endif
   DEBUG_PRINTLN("Scheduler initialized");
 
   DEBUG_PRINTLN("Software initialization complete");
@@ -57,16 +112,54 @@ void initSoftware() {
 void initTasks() {
   DEBUG_PRINTLN("=== Initializing Tasks ===");
 
-  monitoringTask = new MonitoringTask(hw, mqttClient, stateManager);
+  monitoringTask = new MonitoringTask(hw, echoTrace, readingQueue, runtimeConfig);
+  publishTask = new PublishTask(mqttClient, stateManager, readingQueue, historyLog, levelStats);
   mqttTask = new MQTTTask(mqttClient, stateManager);
   ledTask = new LEDTask(hw, stateManager);
-  monitoringTask->init(MONITORING_TASK_PERIOD);
+  traceTask = new TraceTask(echoTrace, mqttClient);
+  flightTask = new FlightTask(mqttClient);
+  historyTask = new HistoryTask(mqttClient, historyLog);
+  summaryTask = new SummaryTask(mqttClient, levelStats);
+  configTask = new ConfigTask(mqttClient, runtimeConfig, levelStats);
+  probeTask = new ProbeTask(mqttClient);
+  monitoringTask->init(runtimeConfig->get().samplingPeriod);
+  publishTask->init(PUBLISH_TASK_PERIOD);
   mqttTask->init(MQTT_TASK_PERIOD);
   ledTask->init(LED_TASK_PERIOD);
+  traceTask->init(TRACE_TASK_PERIOD);
+  flightTask->init(FLIGHT_TASK_PERIOD);
+  historyTask->init(HISTORY_TASK_PERIOD);
+  summaryTask->init(SUMMARY_TASK_PERIOD);
+  configTask->init(CONFIG_TASK_PERIOD);
+  probeTask->init(PROBE_TASK_PERIOD);
 
+#ifdef TMS_COOPERATIVE
   scheduler->addTask(ledTask);         
   scheduler->addTask(mqttTask);        
   scheduler->addTask(monitoringTask);  
+  scheduler->addTask(publishTask);
+  scheduler->addTask(traceTask);
+  scheduler->addTask(flightTask);
+  scheduler->addTask(historyTask);
+  scheduler->addTask(summaryTask);
+  scheduler->addTask(configTask);
+  // Blocks the loop for up to 3 BROKER_PING_TIMEOUTs per tick; without it a
+  // failed broker never recovers
+  scheduler->addTask(probeTask);
+#else
+  // Everything that uses the MQTT client runs in the network group
+  scheduler->addTask(sensingGroup, monitoringTask);
+  scheduler->addTask(networkGroup, mqttTask);
+  scheduler->addTask(networkGroup, publishTask);
+  scheduler->addTask(networkGroup, traceTask);
+  scheduler->addTask(networkGroup, flightTask);
+  scheduler->addTask(networkGroup, historyTask);
+  scheduler->addTask(networkGroup, summaryTask);
+  scheduler->addTask(networkGroup, configTask);
+  scheduler->addTask(ledGroup, ledTask);
+  // Its own sockets; blocking there must not hold up the MQTT client
+  scheduler->addTask(probeGroup, probeTask);
+#endif
 
   DEBUG_PRINT("Registered ");
   DEBUG_PRINT(scheduler->getNumTasks());
@@ -81,26 +174,97 @@ void setup() {
 
   DEBUG_PRINTLN("\n=== TMS Starting ===");
   DEBUG_PRINTLN("Tank Monitoring Subsystem v1.0");
+  RuntimeSettings settings = runtimeConfig->get();
+  DEBUG_PRINT("Configuration version: ");
+  DEBUG_PRINTLN(settings.version);
   DEBUG_PRINT("Sampling Frequency: ");
-  DEBUG_PRINT(1000.0 / SAMPLING_FREQUENCY);
+  DEBUG_PRINT(1000.0 / settings.samplingPeriod);
   DEBUG_PRINTLN(" Hz");
   DEBUG_PRINT("Tank Height: ");
-  DEBUG_PRINT(TANK_HEIGHT);
+  DEBUG_PRINT(settings.tankHeight);
   DEBUG_PRINTLN(" cm");
-  DEBUG_PRINT("MQTT Broker: ");
-  DEBUG_PRINT(MQTT_BROKER);
-  DEBUG_PRINT(":");
-  DEBUG_PRINTLN(MQTT_PORT);
+  const BrokerSelector& brokers = mqttClient->getBrokers();
+  for (uint8_t i = 0; i < brokers.getCount(); i++) {
+    DEBUG_PRINT("MQTT Broker: ");
+    DEBUG_PRINT(brokers.getAddress(i).host);
+    DEBUG_PRINT(":");
+    DEBUG_PRINTLN(brokers.getAddress(i).port);
+  }
   DEBUG_PRINT("MQTT Topic: ");
   DEBUG_PRINTLN(MQTT_TOPIC);
   DEBUG_PRINTLN("=========================\n");
 
+#ifndef TMS_COOPERATIVE
+  // The LED group listens before any group can change the state
+  scheduler->create();
+  stateManager->addListener(scheduler->getHandle(ledGroup));
+  scheduler->start();
+#endif
+
   DEBUG_PRINTLN("Transitioning to CONNECTING state");
   stateManager->setState(CONNECTING);
 }
 
+/**
+ * Print the sampling jitter and, with FreeRTOS, the timing of the groups
+ */
+void printTiming() {
+  SamplingStats sampling = monitoringTask->getSamplingStats();
+  DEBUG_PRINT("Sampling: ");
+  DEBUG_PRINT(sampling.samples);
+  DEBUG_PRINT(" readings, jitter mean ");
+  DEBUG_PRINT(sampling.samples > 1 ? (unsigned long)(sampling.totalJitter / (sampling.samples - 1)) : 0UL);
+  DEBUG_PRINT(" us, max ");
+  DEBUG_PRINT(sampling.maxJitter);
+  DEBUG_PRINT(" us, ");
+  DEBUG_PRINT(sampling.late);
+  DEBUG_PRINT(" late, ");
+  DEBUG_PRINT(sampling.dropped);
+  DEBUG_PRINTLN(" dropped");
+#ifndef TMS_COOPERATIVE
+  for (int i = 0; i < scheduler->getNumGroups(); i++) {
+    GroupStats stats = scheduler->getStats(i);
+    DEBUG_PRINT("Group ");
+    DEBUG_PRINT(scheduler->getName(i));
+    DEBUG_PRINT(": ");
+    DEBUG_PRINT(stats.deadlineMisses);
+    DEBUG_PRINT(" of ");
+    DEBUG_PRINT(stats.releases);
+    DEBUG_PRINT(" missed, max lateness ");
+    DEBUG_PRINT(stats.maxLateness);
+    DEBUG_PRINT(" ms, max response ");
+    DEBUG_PRINT(stats.maxResponse);
+    DEBUG_PRINTLN(" ms");
+  }
+#endif
+}
+
+/**
+ * Print the smoothed RTT and health of every broker, the active one first
+ */
+void printBrokers() {
+  const BrokerSelector& brokers = mqttClient->getBrokers();
+  for (uint8_t n = 0; n < brokers.getCount(); n++) {
+    uint8_t i = (brokers.getActive() + n) % brokers.getCount();
+    BrokerStats stats = brokers.getStats(i);
+    DEBUG_PRINT(n == 0 ? "Broker: " : "Standby: ");
+    DEBUG_PRINT(brokers.getAddress(i).host);
+    DEBUG_PRINT(stats.healthy ? ", RTT " : ", failed, RTT ");
+    DEBUG_PRINT(stats.srtt / 1000.0);
+    DEBUG_PRINT(" ms, ");
+    DEBUG_PRINT(stats.timeouts);
+    DEBUG_PRINTLN(" timeouts");
+  }
+}
+
 void loop() {
+#ifdef TMS_COOPERATIVE
   scheduler->schedule();
+#else
+  // The task groups do the work; this is the Arduino loop task
+  vTaskDelay(pdMS_TO_TICKS(LOOP_TASK_PERIOD));
+#endif
+  TRACE_FLUSH(Serial);
 
   static unsigned long lastStatusPrint = 0;
   unsigned long now = millis();
@@ -109,20 +273,22 @@ void loop() {
     DEBUG_PRINT("State: ");
     DEBUG_PRINTLN(stateToString(stateManager->getState()));
     DEBUG_PRINT("WiFi: ");
-    DEBUG_PRINTLN(mqttClient->isWiFiConnected() ? "Connected" : "Disconnected");
+    DEBUG_PRINTLN(mqttTask->isWiFiConnected() ? "Connected" : "Disconnected");
     DEBUG_PRINT("MQTT: ");
-    DEBUG_PRINTLN(mqttClient->isConnected() ? "Connected" : "Disconnected");
+    DEBUG_PRINTLN(mqttTask->isConnected() ? "Connected" : "Disconnected");
+    printBrokers();
     DEBUG_PRINT("Uptime: ");
     DEBUG_PRINT(now / 1000);
     DEBUG_PRINTLN(" seconds");
     
-    float distance = hw->getSonar()->getDistance();
-    if (distance >= 0) {
-      float level = TANK_HEIGHT - distance;
+    // The sonar belongs to the sensing task
+    WaterLevelData reading = monitoringTask->getLastReading();
+    if (reading.isValid()) {
       DEBUG_PRINT("Current Water Level: ");
-      DEBUG_PRINT(level);
+      DEBUG_PRINT(reading.level);
       DEBUG_PRINTLN(" cm");
     }
+    printTiming();
     DEBUG_PRINTLN("--------------------\n");
     
     lastStatusPrint = now;
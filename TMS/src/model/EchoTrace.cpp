@@ -0,0 +1,76 @@
+#include "EchoTrace.h"
+#include <freertos/FreeRTOS.h>
+
+// Recorded by the sensing task, read by the trace task
+static portMUX_TYPE traceMux = portMUX_INITIALIZER_UNLOCKED;
+
+EchoTrace::EchoTrace() : recording(false) {
+  clear();
+}
+
+void EchoTrace::start() {
+  recording = true;
+}
+
+void EchoTrace::stop() {
+  recording = false;
+}
+
+void EchoTrace::clear() {
+  portENTER_CRITICAL(&traceMux);
+  head = 0;
+  count = 0;
+  firstTime = 0;
+  lastTime = 0;
+  portEXIT_CRITICAL(&traceMux);
+}
+
+bool EchoTrace::isRecording() const {
+  return recording;
+}
+
+void EchoTrace::record(unsigned long time, unsigned long echoUs) {
+  if (!recording) {
+    return;
+  }
+
+  EchoRecord r;
+  unsigned long dt = count == 0 ? 0 : time - lastTime;
+  r.dt = dt > 0xFFFF ? 0xFFFF : dt;
+  r.echo = echoUs > 0xFFFF ? 0xFFFF : echoUs;
+
+  portENTER_CRITICAL(&traceMux);
+  if (count == 0) {
+    firstTime = time;
+  }
+  if (count < TRACE_CAPACITY) {
+    records[(head + count) % TRACE_CAPACITY] = r;
+    count++;
+  } else {
+    // Drop the oldest: the next one becomes the first, at its own time
+    records[head] = r;
+    head = (head + 1) % TRACE_CAPACITY;
+    firstTime += records[head].dt;
+  }
+  lastTime = time;
+  portEXIT_CRITICAL(&traceMux);
+}
+
+uint16_t EchoTrace::size() const {
+  return count;
+}
+
+unsigned long EchoTrace::getStartTime() const {
+  return firstTime;
+}
+
+uint16_t EchoTrace::read(uint16_t from, EchoRecord* out, uint16_t n) const {
+  uint16_t copied = 0;
+  portENTER_CRITICAL(&traceMux);
+  while (copied < n && from + copied < count) {
+    out[copied] = records[(head + from + copied) % TRACE_CAPACITY];
+    copied++;
+  }
+  portEXIT_CRITICAL(&traceMux);
+  return copied;
+}
@@ -0,0 +1,57 @@
+#ifndef __ECHO_TRACE__
+#define __ECHO_TRACE__
+
+#include <stdint.h>
+#include "config.h"
+
+/**
+ * One raw sonar reading: time since the previous record and echo length
+ */
+struct EchoRecord {
+  uint16_t dt;      // ms since the previous record, saturated at 65535
+  uint16_t echo;    // echo duration (us), 0 if none came back
+};
+
+/**
+ * Sonar Trace
+ * Keeps the last TRACE_CAPACITY raw echo durations with their timing,
+ * 4 bytes per reading, so that a storm seen in the field can be exported
+ * and replayed on the host (see sim/README.md).
+ */
+class EchoTrace {
+private:
+  EchoRecord records[TRACE_CAPACITY];
+  uint16_t head;              // index of the oldest record
+  uint16_t count;
+  unsigned long firstTime;    // ms, time of the oldest record
+  unsigned long lastTime;     // ms, time of the newest record
+  bool recording;
+
+public:
+  EchoTrace();
+
+  void start();
+  void stop();
+  void clear();
+  bool isRecording() const;
+
+  /**
+   * Append a reading taken at time (ms); overwrites the oldest when full
+   */
+  void record(unsigned long time, unsigned long echoUs);
+
+  uint16_t size() const;
+
+  /**
+   * Time (ms) of the oldest record
+   */
+  unsigned long getStartTime() const;
+
+  /**
+   * Copy up to n records from position from (0 = oldest) to out
+   * Returns the number copied
+   */
+  uint16_t read(uint16_t from, EchoRecord* out, uint16_t n) const;
+};
+
+#endif
@@ -0,0 +1,138 @@
+#include "FlightRecorder.h"
+#include <Arduino.h>
+#include <esp_attr.h>
+#include <esp_system.h>
+#include <freertos/FreeRTOS.h>
+
+#define FLIGHT_MAGIC 0x464C5431UL   // "FLT1", changes when the layout does
+
+/**
+ * Everything that has to survive a reset, in one block
+ */
+struct FlightLog {
+  uint32_t magic;
+  uint16_t head;              // index of the oldest record
+  uint16_t count;
+  uint16_t boot;
+  uint32_t answeredRequest;
+  FlightRecord records[FLIGHT_CAPACITY];
+};
+
+static RTC_NOINIT_ATTR FlightLog flightLog;
+static bool started = false;
+// Events come from several tasks
+static portMUX_TYPE flightMux = portMUX_INITIALIZER_UNLOCKED;
+
+FlightRecorder flightRecorder;
+
+const char* flightEventToString(uint8_t type) {
+  switch (type) {
+    case FLIGHT_BOOT:          return "boot";
+    case FLIGHT_STATE:         return "state";
+    case FLIGHT_WIFI:          return "wifi";
+    case FLIGHT_MQTT:          return "mqtt";
+    case FLIGHT_LINK_LOST:     return "link_lost";
+    case FLIGHT_PUBLISH_FAIL:  return "publish_fail";
+    case FLIGHT_SONAR_TIMEOUT: return "sonar_timeout";
+    case FLIGHT_CONFIG:        return "config";
+    case FLIGHT_BROKER:        return "broker";
+    default:                   return "unknown";
+  }
+}
+
+void FlightRecorder::begin() {
+  esp_reset_reason_t reason = esp_reset_reason();
+
+  // After power-up the memory holds noise, which could still pass the
+  // magic check; a reset in the middle of log() can leave head or count
+  // out of range
+  if (reason == ESP_RST_POWERON || flightLog.magic != FLIGHT_MAGIC ||
+      flightLog.head >= FLIGHT_CAPACITY || flightLog.count > FLIGHT_CAPACITY) {
+    flightLog.magic = FLIGHT_MAGIC;
+    flightLog.head = 0;
+    flightLog.count = 0;
+    flightLog.boot = 0;
+    flightLog.answeredRequest = 0;
+  }
+  flightLog.boot++;
+  started = true;
+
+  log(FLIGHT_BOOT, (uint8_t)reason, flightLog.boot);
+  DEBUG_PRINT("Flight recorder: boot ");
+  DEBUG_PRINT(flightLog.boot);
+  DEBUG_PRINT(", ");
+  DEBUG_PRINT(flightLog.count);
+  DEBUG_PRINTLN(" records");
+}
+
+void FlightRecorder::log(FlightEvent type, uint8_t code, int32_t value) {
+  if (!started) {
+    return;
+  }
+
+  uint32_t now = millis();
+  portENTER_CRITICAL(&flightMux);
+  if (flightLog.count > 0) {
+    FlightRecord& last = flightLog.records[(flightLog.head + flightLog.count - 1) % FLIGHT_CAPACITY];
+    if (last.type == type && last.code == code && last.value == value) {
+      if (last.repeat < UINT16_MAX) {
+        last.repeat++;
+      }
+      portEXIT_CRITICAL(&flightMux);
+      return;
+    }
+  }
+
+  uint16_t index;
+  if (flightLog.count < FLIGHT_CAPACITY) {
+    index = (flightLog.head + flightLog.count) % FLIGHT_CAPACITY;
+  } else {
+    index = flightLog.head;
+  }
+  FlightRecord& r = flightLog.records[index];
+  r.time = now;
+  r.type = type;
+  r.code = code;
+  r.repeat = 0;
+  r.value = value;
+
+  // Publish the record only once it is complete
+  if (flightLog.count < FLIGHT_CAPACITY) {
+    flightLog.count++;
+  } else {
+    flightLog.head = (flightLog.head + 1) % FLIGHT_CAPACITY;
+  }
+  portEXIT_CRITICAL(&flightMux);
+}
+
+uint16_t FlightRecorder::size() const {
+  return started ? flightLog.count : 0;
+}
+
+uint16_t FlightRecorder::getBoot() const {
+  return started ? flightLog.boot : 0;
+}
+
+uint16_t FlightRecorder::readLast(FlightRecord* out, uint16_t n) const {
+  portENTER_CRITICAL(&flightMux);
+  uint16_t count = size();
+  if (n > count) {
+    n = count;
+  }
+  uint16_t first = flightLog.head + count - n;
+  for (uint16_t i = 0; i < n; i++) {
+    out[i] = flightLog.records[(first + i) % FLIGHT_CAPACITY];
+  }
+  portEXIT_CRITICAL(&flightMux);
+  return n;
+}
+
+uint32_t FlightRecorder::getAnsweredRequest() const {
+  return started ? flightLog.answeredRequest : 0;
+}
+
+void FlightRecorder::setAnsweredRequest(uint32_t id) {
+  if (started) {
+    flightLog.answeredRequest = id;
+  }
+}
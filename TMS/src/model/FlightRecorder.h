@@ -0,0 +1,78 @@
+#ifndef __FLIGHT_RECORDER__
+#define __FLIGHT_RECORDER__
+
+#include <stdint.h>
+#include "config.h"
+
+/**
+ * Events kept by the flight recorder; code and value depend on the type
+ */
+enum FlightEvent : uint8_t {
+  FLIGHT_BOOT,            // code: esp_reset_reason(), value: boot number
+  FLIGHT_STATE,           // code: new TMSState, value: previous TMSState
+  FLIGHT_WIFI,            // code: 1 connected / 0 failed, value: WiFi.status()
+  FLIGHT_MQTT,            // code: 1 connected / 0 failed, value: PubSubClient state()
+  FLIGHT_LINK_LOST,       // code: 1 WiFi still up / 0 down, value: PubSubClient state()
+  FLIGHT_PUBLISH_FAIL,    // code: 1 refused / 0 not connected, value: PubSubClient state()
+  FLIGHT_SONAR_TIMEOUT,   // no echo within SONAR_TIMEOUT
+  FLIGHT_CONFIG,          // code: 1 applied / 0 rejected, value: requested version
+  FLIGHT_BROKER           // code: new broker (MQTT_BROKERS index), value: 0 failover / 1 lower RTT
+};
+
+/**
+ * Name of an event type for the exported records
+ */
+const char* flightEventToString(uint8_t type);
+
+/**
+ * One flight recorder entry, 12 bytes
+ */
+struct FlightRecord {
+  uint32_t time;      // ms since boot of the first occurrence
+  uint8_t type;       // FlightEvent
+  uint8_t code;
+  uint16_t repeat;    // further identical events right after it, saturated
+  int32_t value;
+};
+
+/**
+ * Flight Recorder
+ * Always-on log of the last FLIGHT_CAPACITY connection and sensor events.
+ * The records live in RTC memory that is not initialised at boot, so they
+ * survive a watchdog, panic or software reset; they are only lost on power
+ * loss. An event identical to the newest record only bumps its repeat
+ * count, so a long sonar or broker outage cannot flush older evidence.
+ */
+class FlightRecorder {
+public:
+  /**
+   * Adopt the records of the previous run if they are intact, otherwise
+   * start empty, then log the boot. Events before begin() are ignored.
+   */
+  void begin();
+
+  void log(FlightEvent type, uint8_t code = 0, int32_t value = 0);
+
+  uint16_t size() const;
+
+  /**
+   * Starts since the log was last empty (this one included)
+   */
+  uint16_t getBoot() const;
+
+  /**
+   * Copy up to n records, the oldest first, starting n records before the
+   * newest one. Returns the number copied.
+   */
+  uint16_t readLast(FlightRecord* out, uint16_t n) const;
+
+  /**
+   * Request id answered last, kept across resets like the records
+   */
+  uint32_t getAnsweredRequest() const;
+  void setAnsweredRequest(uint32_t id);
+};
+
+extern FlightRecorder flightRecorder;
+
+#endif
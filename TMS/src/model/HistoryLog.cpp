@@ -0,0 +1,294 @@
+#include "HistoryLog.h"
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <time.h>
+#include <string.h>
+
+#define HISTORY_MAGIC 0x4C48            // "HL"
+#define HISTORY_CLOCK_VALID 1700000000UL  // Below this the clock has not been set yet
+
+static void segmentPath(char* path, uint8_t slot) {
+  snprintf(path, 16, "/history%02u", slot);
+}
+
+HistoryLog::HistoryLog()
+  : current(0), newest(0), encoder(block, HISTORY_BLOCK_SIZE), blockFirst(0),
+    blockLast(0), lastRecord(0), mounted(false) {
+  memset(index, 0, sizeof(index));
+}
+
+bool HistoryLog::begin() {
+  mounted = LittleFS.begin(true);
+  if (!mounted) {
+    DEBUG_PRINTLN("History log: LittleFS not available");
+    return false;
+  }
+
+  for (uint8_t slot = 0; slot < HISTORY_SEGMENTS; slot++) {
+    scan(slot);
+    if (index[slot].sequence > newest) {
+      newest = index[slot].sequence;
+      current = slot;
+    }
+  }
+
+  DEBUG_PRINT("History log: oldest reading ");
+  DEBUG_PRINTLN(getOldest());
+  return true;
+}
+
+void HistoryLog::scan(uint8_t slot) {
+  char path[16];
+  segmentPath(path, slot);
+  HistorySegment& segment = index[slot];
+  memset(&segment, 0, sizeof(segment));
+
+  File f = LittleFS.open(path, "r");
+  if (!f) {
+    return;
+  }
+  size_t fileSize = f.size();
+  HistoryBlockHeader header;
+  while (segment.size + sizeof(header) <= fileSize) {
+    if (!f.seek(segment.size) ||
+        f.read((uint8_t*)&header, sizeof(header)) != sizeof(header) ||
+        header.magic != HISTORY_MAGIC ||
+        segment.size + sizeof(header) + header.length > fileSize) {
+      // Blocks are committed whole, so this is not a block of this log
+      break;
+    }
+    if (segment.size == 0) {
+      segment.sequence = header.segment;
+      segment.first = header.first;
+    }
+    segment.last = header.last;
+    segment.size += sizeof(header) + header.length;
+  }
+  f.close();
+}
+
+uint32_t HistoryLog::now() {
+  time_t t = time(nullptr);
+  return t >= (time_t)HISTORY_CLOCK_VALID ? (uint32_t)t : 0;
+}
+
+void HistoryLog::record(const WaterLevelData& data) {
+  uint32_t t = now();
+  if (!mounted || t == 0) {
+    return;
+  }
+  if (t >= lastRecord && t - lastRecord < HISTORY_INTERVAL) {
+    return;
+  }
+  if (t < lastRecord) {
+    // The clock was set back: timestamps within a block must not decrease
+    write();
+  }
+
+  WaterLevelData sample = data;
+  if (encoder.count() == 0) {
+    blockFirst = t;
+  }
+  sample.timestamp = t - blockFirst;
+  if (!encoder.append(sample)) {
+    write();
+    blockFirst = t;
+    sample.timestamp = 0;
+    encoder.append(sample);
+  }
+  blockLast = t;
+  lastRecord = t;
+
+  if (blockLast - blockFirst >= HISTORY_FLUSH_INTERVAL) {
+    write();
+  }
+}
+
+void HistoryLog::flush() {
+  write();
+}
+
+bool HistoryLog::write() {
+  if (!mounted || encoder.count() == 0) {
+    return true;
+  }
+
+  HistoryBlockHeader header;
+  header.magic = HISTORY_MAGIC;
+  header.length = (uint16_t)encoder.size();
+  header.first = blockFirst;
+  header.last = blockLast;
+  header.count = (uint16_t)encoder.count();
+  header.reserved = 0;
+
+  if (index[current].size > 0 &&
+      index[current].size + sizeof(header) + header.length > HISTORY_SEGMENT_SIZE) {
+    rotate();
+  }
+  HistorySegment& segment = index[current];
+  if (segment.size == 0) {
+    segment.sequence = ++newest;
+    segment.first = blockFirst;
+  }
+  header.segment = segment.sequence;
+
+  char path[16];
+  segmentPath(path, current);
+  File f = LittleFS.open(path, "a");
+  bool written = f &&
+                 f.write((const uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+                 f.write(block, header.length) == header.length;
+  if (f) {
+    f.close();
+  }
+  // The readings are dropped either way: retrying would block every reading after them
+  encoder.clear();
+  if (!written) {
+    DEBUG_PRINTLN("History log: write failed");
+    // Keep the blocks before the damage and never append after it
+    scan(current);
+    rotate();
+    return false;
+  }
+  segment.last = blockLast;
+  segment.size += sizeof(header) + header.length;
+  return true;
+}
+
+void HistoryLog::rotate() {
+  // The next slot holds the oldest segment
+  current = (current + 1) % HISTORY_SEGMENTS;
+  char path[16];
+  segmentPath(path, current);
+  LittleFS.remove(path);
+  memset(&index[current], 0, sizeof(index[current]));
+}
+
+int HistoryLog::findSegment(uint32_t sequence) const {
+  for (uint8_t slot = 0; slot < HISTORY_SEGMENTS; slot++) {
+    if (index[slot].size > 0 && index[slot].sequence == sequence) {
+      return slot;
+    }
+  }
+  return -1;
+}
+
+int HistoryLog::nextSegment(uint32_t after, uint32_t from) const {
+  int best = -1;
+  for (uint8_t slot = 0; slot < HISTORY_SEGMENTS; slot++) {
+    const HistorySegment& s = index[slot];
+    if (s.size > 0 && s.sequence > after && s.last >= from &&
+        (best < 0 || s.sequence < index[best].sequence)) {
+      best = slot;
+    }
+  }
+  return best;
+}
+
+uint32_t HistoryLog::getOldest() const {
+  int oldest = nextSegment(0, 0);
+  if (oldest >= 0) {
+    return index[oldest].first;
+  }
+  return encoder.count() > 0 ? blockFirst : 0;
+}
+
+HistoryReader::HistoryReader(HistoryLog* log)
+  : log(log), from(0), to(0), sequence(0), offset(0), bufferedRead(true),
+    done(true), base(0), decoder(nullptr, 0) {
+}
+
+void HistoryReader::start(uint32_t from, uint32_t to) {
+  this->from = from;
+  this->to = to;
+  sequence = 0;
+  offset = 0;
+  bufferedRead = false;
+  done = false;
+  decoder = LevelDecoder(nullptr, 0);
+}
+
+bool HistoryReader::next(WaterLevelData& out) {
+  while (!done) {
+    if (decoder.next(out)) {
+      uint32_t t = base + out.timestamp;
+      if (t < from) {
+        continue;
+      }
+      if (t > to) {
+        done = true;
+        return false;
+      }
+      out.timestamp = t;
+      return true;
+    }
+    if (!load()) {
+      done = true;
+    }
+  }
+  return false;
+}
+
+bool HistoryReader::load() {
+  HistoryBlockHeader header;
+  char path[16];
+
+  // The RAM block comes last. A flush while its copy is being served
+  // appends the same readings to flash: the walk ends here
+  if (bufferedRead) {
+    return false;
+  }
+
+  while (true) {
+    int slot = sequence != 0 ? log->findSegment(sequence) : -1;
+    if (slot < 0 || offset >= log->index[slot].size) {
+      // Finished, or reused for newer readings meanwhile: go on with the
+      // next segment that reaches into the range
+      slot = log->nextSegment(sequence, from);
+      if (slot < 0) {
+        break;
+      }
+      sequence = log->index[slot].sequence;
+      offset = 0;
+    }
+
+    segmentPath(path, slot);
+    File f = LittleFS.open(path, "r");
+    bool ok = f && f.seek(offset) &&
+              f.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+              header.magic == HISTORY_MAGIC && header.length <= HISTORY_BLOCK_SIZE;
+    if (!ok) {
+      if (f) {
+        f.close();
+      }
+      offset = log->index[slot].size;
+      continue;
+    }
+    offset += sizeof(header) + header.length;
+    if (header.last < from) {
+      f.close();
+      continue;
+    }
+    if (header.first > to) {
+      f.close();
+      return false;
+    }
+    ok = f.read(block, header.length) == header.length;
+    f.close();
+    if (ok) {
+      decoder = LevelDecoder(block, header.length);
+      base = header.first;
+      return true;
+    }
+  }
+
+  // After the flash the readings not written yet
+  bufferedRead = true;
+  if (log->encoder.count() > 0 && log->blockLast >= from && log->blockFirst <= to) {
+    memcpy(block, log->block, log->encoder.size());
+    decoder = LevelDecoder(block, log->encoder.size());
+    base = log->blockFirst;
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,127 @@
+#ifndef __HISTORY_LOG__
+#define __HISTORY_LOG__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "config.h"
+#include "WaterLevelData.h"
+#include "LevelCodec.h"
+
+/**
+ * Header of one block in a segment file, followed by length bytes of
+ * LevelCodec stream whose timestamps count from first
+ */
+struct HistoryBlockHeader {
+  uint16_t magic;
+  uint16_t length;
+  uint32_t segment;     // sequence number of the segment it was written to
+  uint32_t first;       // epoch (s) of the first and last reading
+  uint32_t last;
+  uint16_t count;
+  uint16_t reserved;
+};
+
+/**
+ * Time index entry of one segment file, rebuilt at boot from the block
+ * headers. sequence 0 marks an unused slot.
+ */
+struct HistorySegment {
+  uint32_t sequence;
+  uint32_t first;
+  uint32_t last;
+  uint32_t size;
+};
+
+/**
+ * History Log
+ * Readings kept on LittleFS for long-term history: one every
+ * HISTORY_INTERVAL seconds, stamped with the NTP wall clock. They are
+ * encoded in RAM (LevelCodec) and written as one block when the block is
+ * full or HISTORY_FLUSH_INTERVAL old. Blocks are appended to
+ * HISTORY_SEGMENTS fixed segment files; when the current one is full the
+ * oldest is truncated and reused, so writes rotate over the whole
+ * partition. A reset loses at most the readings still in RAM.
+ */
+class HistoryLog {
+private:
+  friend class HistoryReader;
+
+  HistorySegment index[HISTORY_SEGMENTS];
+  uint8_t current;              // slot written to
+  uint32_t newest;              // highest segment sequence number in use
+  uint8_t block[HISTORY_BLOCK_SIZE];
+  LevelEncoder encoder;
+  uint32_t blockFirst;
+  uint32_t blockLast;
+  uint32_t lastRecord;          // epoch of the last reading kept
+  bool mounted;
+
+  void scan(uint8_t slot);
+  bool write();
+  void rotate();
+  int findSegment(uint32_t sequence) const;
+  int nextSegment(uint32_t after, uint32_t from) const;
+
+public:
+  HistoryLog();
+
+  /**
+   * Mount LittleFS (formatting it if it cannot be mounted) and rebuild the
+   * time index. The log stays disabled if that fails.
+   */
+  bool begin();
+
+  /**
+   * Keep the reading if HISTORY_INTERVAL has passed since the last one kept
+   * and the clock is set
+   */
+  void record(const WaterLevelData& data);
+
+  /**
+   * Write the readings buffered in RAM
+   */
+  void flush();
+
+  /**
+   * Epoch of the oldest reading kept, 0 if there is none
+   */
+  uint32_t getOldest() const;
+
+  /**
+   * Current wall clock (s since 1970), 0 until NTP has set it
+   */
+  static uint32_t now();
+};
+
+/**
+ * Forward-only walk over the readings of a time range, one block in RAM
+ * at a time. Segments reused while it runs are skipped.
+ */
+class HistoryReader {
+private:
+  HistoryLog* log;
+  uint32_t from;
+  uint32_t to;
+  uint32_t sequence;        // segment being read, 0 before the first
+  uint32_t offset;          // next block in it
+  bool bufferedRead;        // the RAM block has been copied, the walk is over
+  bool done;
+  uint8_t block[HISTORY_BLOCK_SIZE];
+  uint32_t base;
+  LevelDecoder decoder;
+
+  bool load();
+
+public:
+  HistoryReader(HistoryLog* log);
+
+  void start(uint32_t from, uint32_t to);
+
+  /**
+   * Next reading of the range, timestamp as epoch
+   * Returns: false at the end of the range
+   */
+  bool next(WaterLevelData& out);
+};
+
+#endif
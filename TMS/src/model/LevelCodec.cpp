@@ -0,0 +1,183 @@
+#include "LevelCodec.h"
+#include <math.h>
+#include <string.h>
+
+static uint64_t zigzag(int64_t v) {
+  return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v) {
+  return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static size_t putVarint(uint8_t* out, uint64_t v) {
+  size_t n = 0;
+  while (v >= 0x80) {
+    out[n++] = (uint8_t)v | 0x80;
+    v >>= 7;
+  }
+  out[n++] = (uint8_t)v;
+  return n;
+}
+
+static int32_t toFixed(float level) {
+  return (int32_t)lroundf(level * LEVEL_CODEC_SCALE);
+}
+
+LevelEncoder::LevelEncoder(uint8_t* buffer, size_t capacity)
+  : buffer(buffer), capacity(capacity) {
+  clear();
+}
+
+void LevelEncoder::clear() {
+  used = 0;
+  runPos = 0;
+  runLength = 0;
+  samples = 0;
+  prevTime = 0;
+  prevLevel = 0;
+  step = 0;
+  state = 0;
+  height = toFixed(TANK_HEIGHT);
+}
+
+bool LevelEncoder::append(const WaterLevelData& data) {
+  int32_t level = toFixed(data.level);
+  int32_t dt = (int32_t)(data.timestamp - prevTime);
+  uint8_t newState = (uint8_t)data.state;
+  int32_t newHeight = data.level >= 0 ? toFixed(data.level + data.distance) : height;
+  uint8_t token[32];
+  size_t n = 0;
+
+  if (samples > 0 && newState == state && newHeight == height && level == prevLevel && dt == step) {
+    // Same as the previous sample: one more in the run
+    size_t pos = runLength > 0 ? runPos : used;
+    n = putVarint(token, (uint64_t)(runLength + 1) << 2 | LEVEL_TOKEN_RUN);
+    if (pos + n > capacity) {
+      return false;
+    }
+    memcpy(buffer + pos, token, n);
+    runPos = pos;
+    runLength++;
+    used = pos + n;
+  } else {
+    if (newHeight != height) {
+      n += putVarint(token + n, (uint64_t)(newState | LEVEL_STATE_HEIGHT) << 2 | LEVEL_TOKEN_STATE);
+      n += putVarint(token + n, zigzag(newHeight));
+    } else if (samples == 0 || newState != state) {
+      n += putVarint(token + n, (uint64_t)newState << 2 | LEVEL_TOKEN_STATE);
+    }
+    uint64_t dLevel = zigzag((int64_t)level - prevLevel);
+    if (samples > 0 && dt == step) {
+      n += putVarint(token + n, dLevel << 2 | LEVEL_TOKEN_SAMPLE);
+    } else {
+      n += putVarint(token + n, dLevel << 2 | LEVEL_TOKEN_STEP);
+      n += putVarint(token + n, zigzag(dt));
+    }
+    if (used + n > capacity) {
+      return false;
+    }
+    memcpy(buffer + used, token, n);
+    used += n;
+    runLength = 0;
+    state = newState;
+    height = newHeight;
+    prevLevel = level;
+    step = dt;
+  }
+
+  prevTime = data.timestamp;
+  samples++;
+  return true;
+}
+
+size_t LevelEncoder::size() const {
+  return used;
+}
+
+uint32_t LevelEncoder::count() const {
+  return samples;
+}
+
+LevelDecoder::LevelDecoder(const uint8_t* data, size_t length)
+  : data(data), length(length), pos(0), runLeft(0), time(0), level(0),
+    step(0), state(0), height(toFixed(TANK_HEIGHT)), failed(false) {
+}
+
+bool LevelDecoder::readVarint(uint64_t& value) {
+  value = 0;
+  for (uint8_t shift = 0; shift < 64 && pos < length; shift += 7) {
+    uint8_t b = data[pos++];
+    value |= (uint64_t)(b & 0x7F) << shift;
+    if ((b & 0x80) == 0) {
+      return true;
+    }
+  }
+  failed = true;
+  return false;
+}
+
+void LevelDecoder::emit(WaterLevelData& out) {
+  time += step;
+  out.timestamp = time;
+  out.level = (float)level / LEVEL_CODEC_SCALE;
+  out.distance = out.level >= 0 ? (float)(height - level) / LEVEL_CODEC_SCALE : -1;
+  out.state = (TMSState)state;
+}
+
+bool LevelDecoder::next(WaterLevelData& out) {
+  if (runLeft > 0) {
+    runLeft--;
+    emit(out);
+    return true;
+  }
+
+  while (pos < length) {
+    uint64_t token;
+    if (!readVarint(token)) {
+      return false;
+    }
+    uint64_t value = token >> 2;
+    switch (token & 3) {
+      case LEVEL_TOKEN_STATE:
+        if (value & LEVEL_STATE_HEIGHT) {
+          uint64_t h;
+          if (!readVarint(h)) {
+            return false;
+          }
+          height = (int32_t)unzigzag(h);
+        }
+        state = (uint8_t)(value & ~LEVEL_STATE_HEIGHT);
+        continue;
+
+      case LEVEL_TOKEN_RUN:
+        if (value == 0) {
+          failed = true;
+          return false;
+        }
+        runLeft = (uint32_t)value - 1;
+        break;
+
+      case LEVEL_TOKEN_STEP: {
+        uint64_t dt;
+        if (!readVarint(dt)) {
+          return false;
+        }
+        level += (int32_t)unzigzag(value);
+        step = (int32_t)unzigzag(dt);
+        break;
+      }
+
+      default:
+        level += (int32_t)unzigzag(value);
+        break;
+    }
+    emit(out);
+    return true;
+  }
+  return false;
+}
+
+bool LevelDecoder::isCorrupt() const {
+  return failed;
+}
@@ -0,0 +1,107 @@
+#ifndef __LEVEL_CODEC__
+#define __LEVEL_CODEC__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "WaterLevelData.h"
+
+/**
+ * Level Codec
+ * Compact byte stream of WaterLevelData for buffered readings. Every
+ * sample is a delta to the previous one (the first to an all-zero sample):
+ * the level in fixed point (LEVEL_CODEC_SCALE steps per cm) and the
+ * timestamp, as zig-zag varints. Each token is one varint whose two low
+ * bits are its tag:
+ *   SAMPLE  dLevel << 2 | 0             next timestamp step as before
+ *   STEP    dLevel << 2 | 1, step        new timestamp step (zig-zag varint)
+ *   RUN     n << 2 | 2                   n samples equal to the previous one,
+ *                                        one step apart
+ *   STATE   state << 2 | 3               state of the following samples;
+ *                                        with LEVEL_STATE_HEIGHT set in
+ *                                        state, a tank height (varint,
+ *                                        fixed point) follows
+ * Levels are rounded to the fixed-point step. The encoder takes the tank
+ * height as level + distance of each valid sample and writes it whenever it
+ * changes (runtime tank_height, or a level clamped at 0), so the decoder
+ * rebuilds the distance as height - level (-1 when the level is invalid).
+ * Streams without a height use the default TANK_HEIGHT.
+ */
+enum LevelToken : uint8_t {
+  LEVEL_TOKEN_SAMPLE,
+  LEVEL_TOKEN_STEP,
+  LEVEL_TOKEN_RUN,
+  LEVEL_TOKEN_STATE
+};
+
+static const uint8_t LEVEL_STATE_HEIGHT = 0x40;
+
+/**
+ * Appends samples to a caller-provided buffer. The buffer holds a complete
+ * stream after every append: a run is extended in place.
+ */
+class LevelEncoder {
+private:
+  uint8_t* buffer;
+  size_t capacity;
+  size_t used;
+  size_t runPos;            // offset of the RUN token being extended
+  uint32_t runLength;       // 0 when the last token is not a RUN
+  uint32_t samples;
+  unsigned long prevTime;
+  int32_t prevLevel;
+  int32_t step;
+  uint8_t state;
+  int32_t height;           // tank height, fixed point
+
+public:
+  LevelEncoder(uint8_t* buffer, size_t capacity);
+
+  /**
+   * Start a new stream in the same buffer
+   */
+  void clear();
+
+  /**
+   * Append one sample
+   * Returns: false, leaving the stream unchanged, if it does not fit
+   */
+  bool append(const WaterLevelData& data);
+
+  size_t size() const;
+  uint32_t count() const;
+};
+
+/**
+ * Reads back a stream sample by sample
+ */
+class LevelDecoder {
+private:
+  const uint8_t* data;
+  size_t length;
+  size_t pos;
+  uint32_t runLeft;
+  unsigned long time;
+  int32_t level;
+  int32_t step;
+  uint8_t state;
+  int32_t height;
+  bool failed;
+
+  bool readVarint(uint64_t& value);
+  void emit(WaterLevelData& out);
+
+public:
+  LevelDecoder(const uint8_t* data, size_t length);
+
+  /**
+   * Returns: false at the end of the stream or on malformed data
+   */
+  bool next(WaterLevelData& out);
+
+  /**
+   * True if next() stopped on malformed data rather than at the end
+   */
+  bool isCorrupt() const;
+};
+
+#endif
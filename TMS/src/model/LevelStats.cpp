@@ -0,0 +1,156 @@
+#include "LevelStats.h"
+#include <math.h>
+#include <string.h>
+
+#define LEVEL_STATS_SCALE 10      // Ring values per cm (1 mm)
+#define LEVEL_STATS_RANK 0.95     // Quantile reported as p95
+
+static const uint16_t windowSeconds[] = SUMMARY_WINDOWS;
+
+RollingWindow::RollingWindow(const int16_t* ring, uint16_t ringSize, uint16_t seconds, uint16_t capacity)
+  : ring(ring), ringSize(ringSize), seconds(seconds) {
+  minQueue = new uint16_t[capacity];
+  maxQueue = new uint16_t[capacity];
+  reset(capacity);
+}
+
+void RollingWindow::reset(uint16_t length) {
+  // The deques wrap at length, which is within their capacity
+  this->length = length;
+  count = 0;
+  sum = 0;
+  sumSquares = 0;
+  minHead = minCount = 0;
+  maxHead = maxCount = 0;
+  memset(histogram, 0, sizeof(histogram));
+}
+
+bool RollingWindow::expired(uint16_t pos, uint16_t newest) const {
+  // 0 means a full ring ago: the position has just been written over
+  uint16_t age = (newest + ringSize - pos) % ringSize;
+  return age == 0 || age >= length;
+}
+
+uint16_t RollingWindow::bin(int16_t level) const {
+  int b = level / (SUMMARY_HISTOGRAM_BIN * LEVEL_STATS_SCALE);
+  return b < 0 ? 0 : (b >= LEVEL_STATS_BINS ? LEVEL_STATS_BINS - 1 : b);
+}
+
+void RollingWindow::add(uint16_t pos, int16_t replaced) {
+  if (count == length) {
+    int16_t leaving = length == ringSize ? replaced : ring[(pos + ringSize - length) % ringSize];
+    sum -= leaving;
+    sumSquares -= (int32_t)leaving * leaving;
+    histogram[bin(leaving)]--;
+  } else {
+    count++;
+  }
+
+  int16_t level = ring[pos];
+  sum += level;
+  sumSquares += (int32_t)level * level;
+  histogram[bin(level)]++;
+
+  // Drop what left the window from the front, then what the new reading
+  // hides from the back: the front is then the window's min (max)
+  while (minCount > 0 && expired(minQueue[minHead], pos)) {
+    minHead = (minHead + 1) % length;
+    minCount--;
+  }
+  while (minCount > 0 && ring[minQueue[(minHead + minCount - 1) % length]] >= level) {
+    minCount--;
+  }
+  minQueue[(minHead + minCount++) % length] = pos;
+
+  while (maxCount > 0 && expired(maxQueue[maxHead], pos)) {
+    maxHead = (maxHead + 1) % length;
+    maxCount--;
+  }
+  while (maxCount > 0 && ring[maxQueue[(maxHead + maxCount - 1) % length]] <= level) {
+    maxCount--;
+  }
+  maxQueue[(maxHead + maxCount++) % length] = pos;
+}
+
+void RollingWindow::summarize(WindowSummary& out) const {
+  out.seconds = seconds;
+  out.count = count;
+  if (count == 0) {
+    out.min = out.max = out.mean = out.stddev = out.p95 = 0;
+    return;
+  }
+
+  int16_t min = ring[minQueue[minHead]];
+  int16_t max = ring[maxQueue[maxHead]];
+  double mean = (double)sum / count;
+  double variance = (double)sumSquares / count - mean * mean;
+
+  // Rank of the quantile, then linear within the bin that holds it
+  uint16_t rank = (uint16_t)ceil(LEVEL_STATS_RANK * count);
+  uint16_t below = 0;
+  uint16_t b = 0;
+  while (b < LEVEL_STATS_BINS - 1 && below + histogram[b] < rank) {
+    below += histogram[b++];
+  }
+  double p95 = (b + (double)(rank - below) / histogram[b]) * SUMMARY_HISTOGRAM_BIN * LEVEL_STATS_SCALE;
+  p95 = p95 < min ? min : (p95 > max ? max : p95);
+
+  out.min = (float)min / LEVEL_STATS_SCALE;
+  out.max = (float)max / LEVEL_STATS_SCALE;
+  out.mean = mean / LEVEL_STATS_SCALE;
+  out.stddev = variance > 0 ? sqrt(variance) / LEVEL_STATS_SCALE : 0;
+  out.p95 = p95 / LEVEL_STATS_SCALE;
+}
+
+uint16_t LevelStats::lengthOf(uint8_t window, uint32_t period) {
+  uint32_t length = (uint32_t)windowSeconds[window] * 1000 / period;
+  return length > 0 ? length : 1;
+}
+
+LevelStats::LevelStats(uint32_t period) {
+  nWindows = sizeof(windowSeconds) / sizeof(windowSeconds[0]);
+  ringSize = 1;
+  for (uint8_t i = 0; i < nWindows; i++) {
+    if (lengthOf(i, SAMPLING_PERIOD_MIN) > ringSize) {
+      ringSize = lengthOf(i, SAMPLING_PERIOD_MIN);
+    }
+  }
+
+  ring = new int16_t[ringSize];
+  memset(ring, 0, ringSize * sizeof(int16_t));
+  newest = ringSize - 1;
+  windows = new RollingWindow*[nWindows];
+  for (uint8_t i = 0; i < nWindows; i++) {
+    windows[i] = new RollingWindow(ring, ringSize, windowSeconds[i], lengthOf(i, SAMPLING_PERIOD_MIN));
+  }
+  setPeriod(period);
+}
+
+void LevelStats::setPeriod(uint32_t period) {
+  // The ring keeps its content; a window only looks back at readings
+  // added after its reset
+  for (uint8_t i = 0; i < nWindows; i++) {
+    windows[i]->reset(lengthOf(i, period));
+  }
+}
+
+void LevelStats::record(const WaterLevelData& data) {
+  if (!data.isValid()) {
+    return;
+  }
+  uint16_t pos = (newest + 1) % ringSize;
+  int16_t replaced = ring[pos];
+  ring[pos] = (int16_t)lroundf(data.level * LEVEL_STATS_SCALE);
+  newest = pos;
+  for (uint8_t i = 0; i < nWindows; i++) {
+    windows[i]->add(pos, replaced);
+  }
+}
+
+uint8_t LevelStats::getWindowCount() const {
+  return nWindows;
+}
+
+void LevelStats::summarize(uint8_t window, WindowSummary& out) const {
+  windows[window]->summarize(out);
+}
@@ -0,0 +1,108 @@
+#ifndef __LEVEL_STATS__
+#define __LEVEL_STATS__
+
+#include <stdint.h>
+#include "config.h"
+#include "WaterLevelData.h"
+
+#define LEVEL_STATS_BINS ((int)(TANK_HEIGHT_MAX / SUMMARY_HISTOGRAM_BIN) + 1)
+
+/**
+ * Statistics of one window, levels in cm
+ */
+struct WindowSummary {
+  uint16_t seconds;     // window length
+  uint16_t count;       // readings in the window, less than full after boot
+  float min;
+  float max;
+  float mean;
+  float stddev;
+  float p95;            // approximate, see RollingWindow
+};
+
+/**
+ * Rolling Window
+ * Aggregates over the last length readings of a ring shared with longer
+ * windows. Each reading is added in O(1):
+ * - min and max come from monotonic deques of ring positions,
+ * - mean and standard deviation from running sums of the exact
+ *   fixed-point levels,
+ * - p95 from a histogram of SUMMARY_HISTOGRAM_BIN wide bins, interpolated
+ *   within the bin and clamped to min/max; only reading it walks the bins.
+ */
+class RollingWindow {
+private:
+  const int16_t* ring;
+  uint16_t ringSize;
+  uint16_t length;
+  uint16_t seconds;
+  uint16_t count;
+  int64_t sum;
+  int64_t sumSquares;
+  uint16_t* minQueue;       // positions with increasing levels, oldest first, capacity of the ring
+  uint16_t minHead;
+  uint16_t minCount;
+  uint16_t* maxQueue;       // positions with decreasing levels, oldest first
+  uint16_t maxHead;
+  uint16_t maxCount;
+  uint16_t histogram[LEVEL_STATS_BINS];
+
+  bool expired(uint16_t pos, uint16_t newest) const;
+  uint16_t bin(int16_t level) const;
+
+public:
+  /**
+   * Window of at most capacity readings of the ring, empty until reset()
+   */
+  RollingWindow(const int16_t* ring, uint16_t ringSize, uint16_t seconds, uint16_t capacity);
+
+  /**
+   * Empty the window and make it length readings long
+   */
+  void reset(uint16_t length);
+
+  /**
+   * The reading at ring position pos was just written over replaced,
+   * which is what leaves a full window as long as the ring
+   */
+  void add(uint16_t pos, int16_t replaced);
+
+  void summarize(WindowSummary& out) const;
+};
+
+/**
+ * Level Statistics
+ * Rolling min, max, mean, standard deviation and p95 of the valid levels
+ * over the SUMMARY_WINDOWS, in fixed memory: one ring of the longest
+ * window (2 bytes per reading) and, per window, two deques of 2 bytes per
+ * reading and the histogram, all sized for SAMPLING_PERIOD_MIN. Windows
+ * count readings, so gaps in the readings stretch them.
+ */
+class LevelStats {
+private:
+  int16_t* ring;            // levels in mm
+  uint16_t ringSize;
+  uint16_t newest;
+  uint8_t nWindows;
+  RollingWindow** windows;
+
+  static uint16_t lengthOf(uint8_t window, uint32_t period);
+
+public:
+  /**
+   * Windows for readings every period ms
+   */
+  LevelStats(uint32_t period);
+
+  /**
+   * Readings now come every period ms: the windows start again empty
+   */
+  void setPeriod(uint32_t period);
+
+  void record(const WaterLevelData& data);
+
+  uint8_t getWindowCount() const;
+  void summarize(uint8_t window, WindowSummary& out) const;
+};
+
+#endif
@@ -0,0 +1,112 @@
+#include "RuntimeConfig.h"
+#include <Arduino.h>
+#include <Preferences.h>
+#include <freertos/FreeRTOS.h>
+
+#define CONFIG_MAGIC 0x43464731UL   // "CFG1", changes when RuntimeSettings does
+#define CONFIG_KEY "settings"
+
+/**
+ * NVS blob of the settings in force
+ */
+struct StoredSettings {
+  uint32_t magic;
+  RuntimeSettings settings;
+};
+
+// Written by the network group, read by the others
+static portMUX_TYPE configMux = portMUX_INITIALIZER_UNLOCKED;
+
+RuntimeConfig::RuntimeConfig() {
+  settings = defaults();
+}
+
+RuntimeSettings RuntimeConfig::defaults() {
+  RuntimeSettings d;
+  d.version = 0;
+  d.samplingPeriod = MONITORING_TASK_PERIOD;
+  d.tankHeight = TANK_HEIGHT;
+  d.reconnectDelay = MQTT_RECONNECT_DELAY;
+  d.maxReconnectDelay = MQTT_MAX_RECONNECT_DELAY;
+  return d;
+}
+
+void RuntimeConfig::begin() {
+  Preferences preferences;
+  StoredSettings stored;
+  bool found = false;
+  if (preferences.begin(CONFIG_NVS_NAMESPACE, true)) {
+    found = preferences.getBytesLength(CONFIG_KEY) == sizeof(stored) &&
+            preferences.getBytes(CONFIG_KEY, &stored, sizeof(stored)) == sizeof(stored) &&
+            stored.magic == CONFIG_MAGIC;
+    preferences.end();
+  }
+
+  if (!found) {
+    DEBUG_PRINTLN("Runtime configuration: defaults");
+    return;
+  }
+  const char* error = validate(stored.settings);
+  if (error != nullptr) {
+    DEBUG_PRINT("Stored configuration ignored: ");
+    DEBUG_PRINTLN(error);
+    return;
+  }
+  portENTER_CRITICAL(&configMux);
+  settings = stored.settings;
+  portEXIT_CRITICAL(&configMux);
+  DEBUG_PRINT("Runtime configuration: version ");
+  DEBUG_PRINTLN(stored.settings.version);
+}
+
+RuntimeSettings RuntimeConfig::get() const {
+  portENTER_CRITICAL(&configMux);
+  RuntimeSettings copy = settings;
+  portEXIT_CRITICAL(&configMux);
+  return copy;
+}
+
+uint32_t RuntimeConfig::getVersion() const {
+  portENTER_CRITICAL(&configMux);
+  uint32_t version = settings.version;
+  portEXIT_CRITICAL(&configMux);
+  return version;
+}
+
+bool RuntimeConfig::apply(const RuntimeSettings& settings) {
+  portENTER_CRITICAL(&configMux);
+  this->settings = settings;
+  portEXIT_CRITICAL(&configMux);
+
+  // Flash is written outside the critical section
+  Preferences preferences;
+  StoredSettings stored;
+  memset(&stored, 0, sizeof(stored));
+  stored.magic = CONFIG_MAGIC;
+  stored.settings = settings;
+  if (!preferences.begin(CONFIG_NVS_NAMESPACE, false)) {
+    return false;
+  }
+  bool written = preferences.putBytes(CONFIG_KEY, &stored, sizeof(stored)) == sizeof(stored);
+  preferences.end();
+  return written;
+}
+
+const char* RuntimeConfig::validate(const RuntimeSettings& settings) {
+  if (settings.samplingPeriod < SAMPLING_PERIOD_MIN || settings.samplingPeriod > SAMPLING_PERIOD_MAX) {
+    return "sampling_period out of range";
+  }
+  if (settings.samplingPeriod % SAMPLING_PERIOD_STEP != 0) {
+    return "sampling_period not a multiple of the step";
+  }
+  if (!(settings.tankHeight >= TANK_HEIGHT_MIN && settings.tankHeight <= TANK_HEIGHT_MAX)) {
+    return "tank_height out of range";
+  }
+  if (settings.reconnectDelay < RECONNECT_DELAY_MIN || settings.reconnectDelay > RECONNECT_DELAY_MAX) {
+    return "reconnect_delay out of range";
+  }
+  if (settings.maxReconnectDelay < settings.reconnectDelay || settings.maxReconnectDelay > RECONNECT_DELAY_MAX) {
+    return "max_reconnect_delay out of range";
+  }
+  return nullptr;
+}
@@ -0,0 +1,57 @@
+#ifndef __RUNTIME_CONFIG__
+#define __RUNTIME_CONFIG__
+
+#include <stdint.h>
+#include "config.h"
+
+/**
+ * Settings that can be changed without reflashing
+ */
+struct RuntimeSettings {
+  uint32_t version;             // set by the operator; 0 for the config.h defaults
+  uint32_t samplingPeriod;      // ms between sonar readings
+  float tankHeight;             // cm
+  uint32_t reconnectDelay;      // ms, first MQTT reconnection backoff
+  uint32_t maxReconnectDelay;   // ms, the backoff doubles up to it
+};
+
+/**
+ * Runtime Configuration
+ * The settings in force. They start from the config.h defaults and are
+ * kept in NVS (Preferences, CONFIG_NVS_NAMESPACE), so they survive resets
+ * and power loss. Stored settings that are no longer valid, e.g. after a
+ * firmware with narrower ranges, are ignored.
+ * The ConfigTask changes them; tasks in other groups take a copy with
+ * get() when getVersion() changes.
+ */
+class RuntimeConfig {
+private:
+  RuntimeSettings settings;
+
+public:
+  RuntimeConfig();
+
+  /**
+   * Load the stored settings; the defaults if there are none
+   */
+  void begin();
+
+  RuntimeSettings get() const;
+  uint32_t getVersion() const;
+
+  /**
+   * Put settings in force and store them
+   * Returns: false if they could not be stored; they are in force anyway
+   */
+  bool apply(const RuntimeSettings& settings);
+
+  /**
+   * Check the ranges of settings
+   * Returns: nullptr if valid, otherwise what is wrong
+   */
+  static const char* validate(const RuntimeSettings& settings);
+
+  static RuntimeSettings defaults();
+};
+
+#endif
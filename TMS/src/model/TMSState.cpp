@@ -1,5 +1,6 @@
 #include "TMSState.h"
 #include <Arduino.h>
+#include "FlightRecorder.h"
 
 const char* stateToString(TMSState state) {
   switch (state) {
@@ -13,7 +14,7 @@ const char* stateToString(TMSState state) {
 }
 
 
-StateManager::StateManager() : currentState(INIT), lastTransitionTime(0) {}
+StateManager::StateManager() : currentState(INIT), lastTransitionTime(0), nListeners(0) {}
 
 TMSState StateManager::getState() const {
   return currentState;
@@ -21,11 +22,23 @@ TMSState StateManager::getState() const {
 
 void StateManager::setState(TMSState newState) {
   if (currentState != newState) {
+    flightRecorder.log(FLIGHT_STATE, newState, currentState);
     currentState = newState;
     lastTransitionTime = millis();
+    for (uint8_t i = 0; i < nListeners; i++) {
+      xTaskNotifyGive(listeners[i]);
+    }
   }
 }
 
+bool StateManager::addListener(TaskHandle_t task) {
+  if (task == nullptr || nListeners >= STATE_MAX_LISTENERS) {
+    return false;
+  }
+  listeners[nListeners++] = task;
+  return true;
+}
+
 unsigned long StateManager::getTimeInState() const {
   return millis() - lastTransitionTime;
 }
@@ -1,6 +1,12 @@
 #ifndef __TMS_STATE__
 #define __TMS_STATE__
 
+#include <stdint.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#define STATE_MAX_LISTENERS 2
+
 /**
  * Finite State Machine States for Tank Monitoring Subsystem
  */
@@ -19,12 +25,16 @@ const char* stateToString(TMSState state);
 
 /**
  * State Manager Class
- * Manages FSM state transitions and provides state query methods
+ * Manages FSM state transitions and provides state query methods.
+ * FreeRTOS tasks that follow the state register as listeners and get a
+ * notification on every change instead of polling.
  */
 class StateManager {
 private:
-  TMSState currentState;
+  volatile TMSState currentState;
   unsigned long lastTransitionTime;
+  TaskHandle_t listeners[STATE_MAX_LISTENERS];
+  uint8_t nListeners;
 
 public:
   StateManager();
@@ -39,6 +49,12 @@ public:
    */
   void setState(TMSState newState);
 
+  /**
+   * Notify task (xTaskNotifyGive) on every state change
+   * Returns: false if there are STATE_MAX_LISTENERS already
+   */
+  bool addListener(TaskHandle_t task);
+
   /**
    * Get time elapsed in current state (ms)
    */
@@ -2,6 +2,7 @@
 #include <ArduinoJson.h>
 #include "config.h"
 #include "TMSState.h"
+#include "kernel/ZoneTrace.h"
 
 void WaterLevelData::calculateLevel(float tankHeight) {
   if (distance >= 0) {
@@ -14,6 +15,7 @@ void WaterLevelData::calculateLevel(float tankHeight) {
 }
 
 String WaterLevelData::toJson() {
+  TRACE_SCOPE("level_json");
   JsonDocument doc;
   
   doc["distance"] = distance;
@@ -0,0 +1,134 @@
+#include "Arduino.h"
+#include "ConfigTask.h"
+#include <ArduinoJson.h>
+#include "kernel/ZoneTrace.h"
+#include "model/FlightRecorder.h"
+
+ConfigTask::ConfigTask(MQTTClient* mqttClient, RuntimeConfig* config, LevelStats* stats)
+  : mqttClient(mqttClient), config(config), stats(stats), requestPending(false) {
+  requested = config->get();
+  error[0] = '\0';
+}
+
+static bool sameSettings(const RuntimeSettings& a, const RuntimeSettings& b) {
+  return a.samplingPeriod == b.samplingPeriod && a.tankHeight == b.tankHeight &&
+         a.reconnectDelay == b.reconnectDelay && a.maxReconnectDelay == b.maxReconnectDelay;
+}
+
+void ConfigTask::init(int period) {
+  Task::init(period);
+  mqttClient->subscribe(CONFIG_TOPIC, this);
+  DEBUG_PRINTLN("ConfigTask initialized");
+}
+
+void ConfigTask::onMessage(const char* topic, const uint8_t* payload, unsigned int length) {
+  if (length == 0) {
+    // The retained configuration was deleted; the settings stay
+    return;
+  }
+
+  // Applied on the next tick, outside the MQTT client's callback; a
+  // newer message replaces one not applied yet
+  requestPending = true;
+  requested = config->get();
+  requested.version = 0;
+  error[0] = '\0';
+
+  JsonDocument doc;
+  if (deserializeJson(doc, (const char*)payload, length) || !doc.is<JsonObject>()) {
+    strcpy(error, "not a JSON object");
+    return;
+  }
+  if (!doc["version"].is<uint32_t>()) {
+    strcpy(error, "no version");
+    return;
+  }
+  requested.version = doc["version"].as<uint32_t>();
+
+  for (JsonPair setting : doc.as<JsonObject>()) {
+    const char* key = setting.key().c_str();
+    JsonVariant value = setting.value();
+    if (strcmp(key, "version") == 0) {
+      continue;
+    } else if (strcmp(key, "sampling_period") == 0 && value.is<uint32_t>()) {
+      requested.samplingPeriod = value.as<uint32_t>();
+    } else if (strcmp(key, "tank_height") == 0 && value.is<float>()) {
+      requested.tankHeight = value.as<float>();
+    } else if (strcmp(key, "reconnect_delay") == 0 && value.is<uint32_t>()) {
+      requested.reconnectDelay = value.as<uint32_t>();
+    } else if (strcmp(key, "max_reconnect_delay") == 0 && value.is<uint32_t>()) {
+      requested.maxReconnectDelay = value.as<uint32_t>();
+    } else {
+      // Unknown, or not a number of the right kind: nothing is applied
+      snprintf(error, sizeof(error), "bad setting %s", key);
+      return;
+    }
+  }
+}
+
+void ConfigTask::tick() {
+  TRACE_SCOPE("config_tick");
+  if (requestPending) {
+    requestPending = false;
+    apply();
+  }
+  if (pendingAck.length() > 0 && mqttClient->isConnected() &&
+      mqttClient->publish(CONFIG_ACK_TOPIC, pendingAck, true)) {
+    pendingAck = "";
+  }
+}
+
+void ConfigTask::apply() {
+  RuntimeSettings previous = config->get();
+  const char* reason = error[0] != '\0' ? error : RuntimeConfig::validate(requested);
+  if (reason == nullptr && requested.version == 0) {
+    reason = "version 0 is the defaults";
+  } else if (reason == nullptr && requested.version < previous.version) {
+    reason = "older than the version in force";
+  } else if (reason == nullptr && requested.version == previous.version &&
+             !sameSettings(requested, previous)) {
+    // Another change under the version in force: not applied, so the ack
+    // must not say it was
+    reason = "stale version";
+  }
+  if (reason != nullptr) {
+    DEBUG_PRINT("Configuration rejected: ");
+    DEBUG_PRINTLN(reason);
+    flightRecorder.log(FLIGHT_CONFIG, 0, requested.version);
+    buildAck("rejected", reason);
+    return;
+  }
+  if (requested.version == previous.version) {
+    // Already in force, e.g. the retained message after a reconnection
+    buildAck("applied", nullptr);
+    return;
+  }
+
+  bool stored = config->apply(requested);
+  mqttClient->setBackoff(requested.reconnectDelay, requested.maxReconnectDelay);
+  if (requested.samplingPeriod != previous.samplingPeriod) {
+    stats->setPeriod(requested.samplingPeriod);
+  }
+  DEBUG_PRINT("Configuration applied: version ");
+  DEBUG_PRINTLN(requested.version);
+  flightRecorder.log(FLIGHT_CONFIG, 1, requested.version);
+  buildAck("applied", stored ? nullptr : "not stored, lost at reset");
+}
+
+void ConfigTask::buildAck(const char* status, const char* reason) {
+  RuntimeSettings active = config->get();
+  JsonDocument doc;
+  doc["version"] = requested.version;
+  doc["status"] = status;
+  if (reason != nullptr) {
+    doc["error"] = reason;
+  }
+  JsonObject settings = doc["active"].to<JsonObject>();
+  settings["version"] = active.version;
+  settings["sampling_period"] = active.samplingPeriod;
+  settings["tank_height"] = active.tankHeight;
+  settings["reconnect_delay"] = active.reconnectDelay;
+  settings["max_reconnect_delay"] = active.maxReconnectDelay;
+  pendingAck = "";
+  serializeJson(doc, pendingAck);
+}
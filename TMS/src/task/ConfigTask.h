@@ -0,0 +1,45 @@
+#ifndef __CONFIG_TASK__
+#define __CONFIG_TASK__
+
+#include "kernel/Task.h"
+#include "kernel/MQTTClient.h"
+#include "model/RuntimeConfig.h"
+#include "model/LevelStats.h"
+#include "config.h"
+
+/**
+ * Config Task
+ * Changes the runtime configuration from CONFIG_TOPIC, e.g.
+ * {"version": 3, "sampling_period": 2000, "tank_height": 180}. Settings
+ * left out keep their value; the version must be higher than the one in
+ * force (0 is the defaults'). The same version with the same settings is
+ * only acknowledged again (the operator's retained message comes back on
+ * every reconnection); with other settings it is rejected. A change is checked
+ * as a whole and either applied and stored, or rejected; both are
+ * acknowledged on CONFIG_ACK_TOPIC with the settings in force.
+ * The MQTT backoff and the summary windows, in this group, are changed
+ * here; the MonitoringTask picks up the new settings at its next reading.
+ */
+class ConfigTask : public Task, public MQTTMessageHandler {
+private:
+  MQTTClient* mqttClient;
+  RuntimeConfig* config;
+  LevelStats* stats;
+  bool requestPending;
+  RuntimeSettings requested;
+  char error[48];           // why the request cannot be applied, "" if it parsed
+  String pendingAck;        // built but not published yet
+
+  void apply();
+  void buildAck(const char* status, const char* reason);
+
+public:
+  ConfigTask(MQTTClient* mqttClient, RuntimeConfig* config, LevelStats* stats);
+
+  void init(int period);
+  void tick();
+
+  void onMessage(const char* topic, const uint8_t* payload, unsigned int length);
+};
+
+#endif
@@ -0,0 +1,79 @@
+#include "Arduino.h"
+#include "FlightTask.h"
+#include <ArduinoJson.h>
+#include "kernel/ZoneTrace.h"
+
+FlightTask::FlightTask(MQTTClient* mqttClient)
+  : mqttClient(mqttClient), requestPending(false), requestId(0),
+    requestRecords(FLIGHT_DEFAULT_RECORDS) {
+}
+
+void FlightTask::init(int period) {
+  Task::init(period);
+  mqttClient->subscribe(FLIGHT_REQUEST_TOPIC, this);
+  DEBUG_PRINTLN("FlightTask initialized");
+}
+
+void FlightTask::onMessage(const char* topic, const uint8_t* payload, unsigned int length) {
+  if (length == 0) {
+    // The retained request was deleted
+    return;
+  }
+
+  JsonDocument doc;
+  if (deserializeJson(doc, (const char*)payload, length)) {
+    DEBUG_PRINTLN("Invalid flight recorder request");
+    return;
+  }
+  uint32_t id = doc["id"] | 0UL;
+  if (id != 0 && id == flightRecorder.getAnsweredRequest()) {
+    return;
+  }
+
+  // Answered on the next tick, outside the MQTT client's callback
+  unsigned long records = doc["last"] | (unsigned long)FLIGHT_DEFAULT_RECORDS;
+  requestRecords = records < FLIGHT_CAPACITY ? records : FLIGHT_CAPACITY;
+  requestId = id;
+  requestPending = true;
+}
+
+void FlightTask::tick() {
+  TRACE_SCOPE("flight_tick");
+  if (requestPending && mqttClient->isConnected()) {
+    respond();
+  }
+}
+
+void FlightTask::respond() {
+  static FlightRecord records[FLIGHT_CAPACITY];
+  uint16_t n = flightRecorder.readLast(records, requestRecords);
+
+  JsonDocument doc;
+  doc["id"] = requestId;
+  doc["boot"] = flightRecorder.getBoot();
+  doc["uptime"] = millis();
+  doc["total"] = flightRecorder.size();
+  JsonArray list = doc["records"].to<JsonArray>();
+  for (uint16_t i = 0; i < n; i++) {
+    JsonArray r = list.add<JsonArray>();
+    r.add(records[i].time);
+    r.add(flightEventToString(records[i].type));
+    r.add(records[i].code);
+    r.add(records[i].value);
+    r.add(records[i].repeat);
+  }
+  String json;
+  serializeJson(doc, json);
+
+  if (!mqttClient->publish(FLIGHT_RESPONSE_TOPIC, json, true)) {
+    // Tried again on the next tick
+    return;
+  }
+  requestPending = false;
+  if (requestId != 0) {
+    flightRecorder.setAnsweredRequest(requestId);
+  }
+  DEBUG_PRINT("Flight recorder: sent ");
+  DEBUG_PRINT(n);
+  DEBUG_PRINTLN(" records");
+}
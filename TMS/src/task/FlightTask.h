@@ -0,0 +1,35 @@
+#ifndef __FLIGHT_TASK__
+#define __FLIGHT_TASK__
+
+#include "kernel/Task.h"
+#include "kernel/MQTTClient.h"
+#include "model/FlightRecorder.h"
+#include "config.h"
+
+/**
+ * Flight Task
+ * Answers flight recorder requests. A request on FLIGHT_REQUEST_TOPIC,
+ * {"id": 7, "last": 50}, is answered with the last records on
+ * FLIGHT_RESPONSE_TOPIC, retained. Requests are meant to be retained too,
+ * so a TMS that is offline answers as soon as it is back; the id keeps it
+ * from answering the same request again after every reconnection.
+ */
+class FlightTask : public Task, public MQTTMessageHandler {
+private:
+  MQTTClient* mqttClient;
+  bool requestPending;
+  uint32_t requestId;
+  uint16_t requestRecords;
+
+  void respond();
+
+public:
+  FlightTask(MQTTClient* mqttClient);
+
+  void init(int period);
+  void tick();
+
+  void onMessage(const char* topic, const uint8_t* payload, unsigned int length);
+};
+
+#endif
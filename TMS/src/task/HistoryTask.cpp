@@ -0,0 +1,88 @@
+#include "Arduino.h"
+#include "HistoryTask.h"
+#include <ArduinoJson.h>
+#include "kernel/ZoneTrace.h"
+
+HistoryTask::HistoryTask(MQTTClient* mqttClient, HistoryLog* history)
+  : mqttClient(mqttClient), history(history), reader(history),
+    requestPending(false), streaming(false), requestId(0), requestFrom(0),
+    requestTo(0), page(0), sent(0), lastPage(false) {
+}
+
+void HistoryTask::init(int period) {
+  Task::init(period);
+  mqttClient->subscribe(HISTORY_REQUEST_TOPIC, this);
+  DEBUG_PRINTLN("HistoryTask initialized");
+}
+
+void HistoryTask::onMessage(const char* topic, const uint8_t* payload, unsigned int length) {
+  JsonDocument doc;
+  if (length == 0 || deserializeJson(doc, (const char*)payload, length)) {
+    DEBUG_PRINTLN("Invalid history request");
+    return;
+  }
+
+  // Started on the next tick, outside the MQTT client's callback
+  requestId = doc["id"] | 0UL;
+  requestFrom = doc["from"] | 0UL;
+  requestTo = doc["to"] | 0xFFFFFFFFUL;
+  requestPending = true;
+}
+
+void HistoryTask::tick() {
+  TRACE_SCOPE("history_tick");
+  if (requestPending) {
+    requestPending = false;
+    reader.start(requestFrom, requestTo);
+    streaming = true;
+    page = 0;
+    sent = 0;
+    pendingPage = "";
+  }
+  if (!streaming || !mqttClient->isConnected()) {
+    return;
+  }
+
+  if (pendingPage.length() == 0) {
+    buildPage();
+  }
+  if (!mqttClient->publish(HISTORY_RESPONSE_TOPIC, pendingPage)) {
+    // The same page is sent again on the next tick
+    return;
+  }
+  pendingPage = "";
+  page++;
+  if (lastPage) {
+    streaming = false;
+    DEBUG_PRINT("History: sent ");
+    DEBUG_PRINT(sent);
+    DEBUG_PRINTLN(" readings");
+  }
+}
+
+void HistoryTask::buildPage() {
+  JsonDocument doc;
+  doc["id"] = requestId;
+  doc["page"] = page;
+  if (page == 0) {
+    doc["oldest"] = history->getOldest();
+  }
+  JsonArray samples = doc["samples"].to<JsonArray>();
+  WaterLevelData data;
+  uint16_t n = 0;
+  while (n < HISTORY_PAGE_SAMPLES && reader.next(data)) {
+    JsonArray s = samples.add<JsonArray>();
+    s.add(data.timestamp);
+    s.add(data.level);
+    n++;
+  }
+  sent += n;
+
+  // A full page may be followed by an empty last one
+  lastPage = n < HISTORY_PAGE_SAMPLES;
+  doc["more"] = !lastPage;
+  if (lastPage) {
+    doc["count"] = sent;
+  }
+  serializeJson(doc, pendingPage);
+}
@@ -0,0 +1,44 @@
+#ifndef __HISTORY_TASK__
+#define __HISTORY_TASK__
+
+#include "kernel/Task.h"
+#include "kernel/MQTTClient.h"
+#include "model/HistoryLog.h"
+#include "config.h"
+
+/**
+ * History Task
+ * Answers range queries on the history log. A request on
+ * HISTORY_REQUEST_TOPIC, {"id": 7, "from": 1760000000, "to": 1760086400}
+ * (epoch seconds, both optional), is answered on HISTORY_RESPONSE_TOPIC
+ * with one page of at most HISTORY_PAGE_SAMPLES readings per tick, read
+ * from flash as they are sent, until a page with "more": false. A new
+ * request replaces the one being answered.
+ */
+class HistoryTask : public Task, public MQTTMessageHandler {
+private:
+  MQTTClient* mqttClient;
+  HistoryLog* history;
+  HistoryReader reader;
+  bool requestPending;
+  bool streaming;
+  uint32_t requestId;
+  uint32_t requestFrom;
+  uint32_t requestTo;
+  uint16_t page;
+  uint32_t sent;
+  String pendingPage;     // built but not published yet
+  bool lastPage;
+
+  void buildPage();
+
+public:
+  HistoryTask(MQTTClient* mqttClient, HistoryLog* history);
+
+  void init(int period);
+  void tick();
+
+  void onMessage(const char* topic, const uint8_t* payload, unsigned int length);
+};
+
+#endif
@@ -1,5 +1,6 @@
 #include "Arduino.h"
 #include "LEDTask.h"
+#include "kernel/ZoneTrace.h"
 
 LEDTask::LEDTask(HWPlatform* hw, StateManager* stateManager) 
   : hw(hw), stateManager(stateManager),
@@ -14,6 +15,7 @@ void LEDTask::init(int period) {
 }
 
 void LEDTask::tick() {
+  TRACE_SCOPE("led_tick");
   TMSState currentState = stateManager->getState();
   unsigned long now = millis();
 
@@ -1,9 +1,11 @@
 #include "Arduino.h"
 #include "MQTTTask.h"
+#include "kernel/ZoneTrace.h"
+#include "model/FlightRecorder.h"
 
 MQTTTask::MQTTTask(MQTTClient* mqttClient, StateManager* stateManager) 
   : mqttClient(mqttClient), stateManager(stateManager), 
-    lastConnectionCheck(0), wasConnected(false) {
+    lastConnectionCheck(0), wasConnected(false), wifiUp(false), mqttUp(false) {
 }
 
 void MQTTTask::init(int period) {
@@ -12,6 +14,7 @@ void MQTTTask::init(int period) {
 }
 
 void MQTTTask::tick() {
+  TRACE_SCOPE("mqtt_tick");
   TMSState currentState = stateManager->getState();
   
   mqttClient->loop();
@@ -19,6 +22,7 @@ void MQTTTask::tick() {
   bool isConnected = mqttClient->isFullyConnected();
 
   if (currentState == INIT) {
+    takeSnapshot();
     return;
   }
 
@@ -40,6 +44,7 @@ void MQTTTask::tick() {
   else if (currentState == MONITORING) {
     if (!isConnected) {
       DEBUG_PRINTLN("Connection lost! Transitioning to DISCONNECTED");
+      flightRecorder.log(FLIGHT_LINK_LOST, mqttClient->isWiFiConnected(), mqttClient->getMqttState());
       stateManager->setState(DISCONNECTED);
     }
   }
@@ -51,11 +56,21 @@ void MQTTTask::tick() {
   }
 
   wasConnected = isConnected;
+  takeSnapshot();
   lastConnectionCheck = millis();
 }
 
-bool MQTTTask::isConnected() {
-  return mqttClient->isFullyConnected();
+void MQTTTask::takeSnapshot() {
+  wifiUp = mqttClient->isWiFiConnected();
+  mqttUp = mqttClient->isConnected();
+}
+
+bool MQTTTask::isWiFiConnected() const {
+  return wifiUp;
+}
+
+bool MQTTTask::isConnected() const {
+  return mqttUp;
 }
 
 unsigned long MQTTTask::getTimeSinceCheck() const {
@@ -8,7 +8,9 @@
 
 /**
  * MQTT Task
- * Manages MQTT connection, reconnection, and connection health monitoring
+ * Manages MQTT connection, reconnection, and connection health monitoring.
+ * The MQTT client belongs to the network group; other tasks read the
+ * connection status from the snapshot taken every tick.
  */
 class MQTTTask : public Task {
 private:
@@ -16,6 +18,10 @@ private:
   StateManager* stateManager;
   unsigned long lastConnectionCheck;
   bool wasConnected;
+  volatile bool wifiUp;         // snapshot for other tasks
+  volatile bool mqttUp;
+
+  void takeSnapshot();
 
 public:
   MQTTTask(MQTTClient* mqttClient, StateManager* stateManager);
@@ -24,9 +30,10 @@ public:
   void tick();
 
   /**
-   * Check if currently connected
+   * WiFi and MQTT status as of the last tick; safe from any task
    */
-  bool isConnected();
+  bool isWiFiConnected() const;
+  bool isConnected() const;
 
   /**
    * Get time since last connection check
@@ -1,9 +1,18 @@
 #include "Arduino.h"
 #include "MonitoringTask.h"
+#include "kernel/ZoneTrace.h"
+#include "model/FlightRecorder.h"
 
-MonitoringTask::MonitoringTask(HWPlatform* hw, MQTTClient* mqttClient, StateManager* stateManager) 
-  : hw(hw), mqttClient(mqttClient), stateManager(stateManager) {
+// Guards lastReading and stats, read by other tasks
+static portMUX_TYPE monitoringMux = portMUX_INITIALIZER_UNLOCKED;
+
+MonitoringTask::MonitoringTask(HWPlatform* hw, EchoTrace* trace, QueueHandle_t readings, RuntimeConfig* config)
+  : hw(hw), trace(trace), readings(readings), config(config), lastSample(0) {
+  RuntimeSettings settings = config->get();
+  configVersion = settings.version;
+  tankHeight = settings.tankHeight;
   lastReading = WaterLevelData::invalid();
+  memset(&stats, 0, sizeof(stats));
 }
 
 void MonitoringTask::init(int period) {
@@ -11,54 +20,68 @@ void MonitoringTask::init(int period) {
   DEBUG_PRINTLN("MonitoringTask initialized");
 }
 
+void MonitoringTask::reconfigure() {
+  RuntimeSettings settings = config->get();
+  configVersion = settings.version;
+  tankHeight = settings.tankHeight;
+  if ((int)settings.samplingPeriod != getPeriod()) {
+    // The next reading comes one new period after this one
+    Task::init(settings.samplingPeriod);
+  }
+}
+
 void MonitoringTask::tick() {
-  if (stateManager->getState() != MONITORING) {
-    return;
+  TRACE_SCOPE("monitoring_tick");
+  unsigned long start = micros();
+  unsigned long period = 1000UL * getPeriod();    // that ends with this reading
+  if (config->getVersion() != configVersion) {
+    reconfigure();
   }
 
   float distance = hw->getSonar()->getDistance();
+  trace->record(millis(), hw->getSonar()->getLastEcho());
+  if (hw->getSonar()->getLastEcho() == 0) {
+    flightRecorder.log(FLIGHT_SONAR_TIMEOUT);
+  }
   
-  WaterLevelData data;
+  WaterLevelData data = WaterLevelData::invalid();
   data.distance = distance;
-  data.calculateLevel(TANK_HEIGHT);
+  data.calculateLevel(tankHeight);
   data.timestamp = millis() / 1000;
-  data.state = stateManager->getState();
 
-  lastReading = data;
+  bool queued = xQueueSend(readings, &data, 0) == pdPASS;
 
-  if (data.isValid()) {
-    DEBUG_PRINT("Water Level: ");
-    DEBUG_PRINT(data.level);
-    DEBUG_PRINT(" cm (Distance: ");
-    DEBUG_PRINT(data.distance);
-    DEBUG_PRINTLN(" cm)");
-  } else {
-    DEBUG_PRINT("Sonar Read Failure. Distance: ");
-    DEBUG_PRINTLN(distance);
-  }
-
-  if (mqttClient->isConnected()) {
-    String jsonData = data.toJson();
-    
-    DEBUG_PRINTLN("\n===========================");
-    DEBUG_PRINTLN("DEBUG [TMS-MQTT]: Publishing to CUS");
-    DEBUG_PRINT("  Level: ");
-    DEBUG_PRINT(data.level);
-    DEBUG_PRINTLN(" cm");
-    DEBUG_PRINT("  JSON: ");
-    DEBUG_PRINTLN(jsonData);
-    DEBUG_PRINTLN("===========================\n");
-    
-    bool published = mqttClient->publish(MQTT_TOPIC, jsonData);
-    
-    if (!published) {
-      DEBUG_PRINTLN("Failed to publish water level data");
+  portENTER_CRITICAL(&monitoringMux);
+  lastReading = data;
+  if (stats.samples > 0) {
+    unsigned long interval = start - lastSample;
+    unsigned long jitter = interval > period ? interval - period : period - interval;
+    stats.totalJitter += jitter;
+    if (jitter > stats.maxJitter) {
+      stats.maxJitter = jitter;
+    }
+    if (interval >= period + period / 2) {
+      stats.late++;
     }
-  } else {
-    DEBUG_PRINTLN("Cannot publish: MQTT not connected");
   }
+  stats.samples++;
+  if (!queued) {
+    stats.dropped++;
+  }
+  lastSample = start;
+  portEXIT_CRITICAL(&monitoringMux);
 }
 
 WaterLevelData MonitoringTask::getLastReading() const {
-  return lastReading;
+  portENTER_CRITICAL(&monitoringMux);
+  WaterLevelData reading = lastReading;
+  portEXIT_CRITICAL(&monitoringMux);
+  return reading;
+}
+
+SamplingStats MonitoringTask::getSamplingStats() const {
+  portENTER_CRITICAL(&monitoringMux);
+  SamplingStats copy = stats;
+  portEXIT_CRITICAL(&monitoringMux);
+  return copy;
 }
@@ -1,26 +1,52 @@
 #ifndef __MONITORING_TASK__
 #define __MONITORING_TASK__
 
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
 #include "kernel/Task.h"
 #include "model/HWPlatform.h"
 #include "model/WaterLevelData.h"
-#include "model/TMSState.h"
-#include "kernel/MQTTClient.h"
+#include "model/EchoTrace.h"
+#include "model/RuntimeConfig.h"
 #include "config.h"
 
+/**
+ * Timing of the sonar readings since boot
+ */
+struct SamplingStats {
+  unsigned long samples;
+  unsigned long late;                 // intervals of 1.5 periods or more: a reading was missed
+  unsigned long dropped;              // readings lost to a full queue
+  unsigned long maxJitter;            // us, largest |interval - period|
+  unsigned long long totalJitter;     // us, sum of |interval - period|
+};
+
 /**
  * Monitoring Task
- * Periodically reads water level from sonar and publishes to MQTT
+ * Periodically reads water level from sonar, in every state, and puts the
+ * reading on the reading queue for the PublishTask, so that sampling never
+ * waits for the network. Every raw echo also goes to the sonar trace.
+ * Keeps the sampling jitter: how far each interval between two readings
+ * is from the period.
+ * A new runtime configuration takes effect at the next reading: the tank
+ * height at once, a new sampling period from the reading after it.
  */
 class MonitoringTask : public Task {
 private:
   HWPlatform* hw;
-  MQTTClient* mqttClient;
-  StateManager* stateManager;
+  EchoTrace* trace;
+  QueueHandle_t readings;
+  RuntimeConfig* config;
+  uint32_t configVersion;             // of the settings below
+  float tankHeight;
   WaterLevelData lastReading;
+  SamplingStats stats;
+  unsigned long lastSample;           // micros() at the start of the last reading
+
+  void reconfigure();
 
 public:
-  MonitoringTask(HWPlatform* hw, MQTTClient* mqttClient, StateManager* stateManager);
+  MonitoringTask(HWPlatform* hw, EchoTrace* trace, QueueHandle_t readings, RuntimeConfig* config);
   
   void init(int period);
 
@@ -30,6 +56,8 @@ public:
    * Get last water level reading
    */
   WaterLevelData getLastReading() const;
+
+  SamplingStats getSamplingStats() const;
 };
 
 #endif
@@ -0,0 +1,16 @@
+#include "Arduino.h"
+#include "ProbeTask.h"
+#include "kernel/ZoneTrace.h"
+
+ProbeTask::ProbeTask(MQTTClient* mqttClient) : mqttClient(mqttClient) {
+}
+
+void ProbeTask::init(int period) {
+  Task::init(period);
+  DEBUG_PRINTLN("ProbeTask initialized");
+}
+
+void ProbeTask::tick() {
+  TRACE_SCOPE("probe_tick");
+  mqttClient->probe();
+}
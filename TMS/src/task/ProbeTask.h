@@ -0,0 +1,26 @@
+#ifndef __PROBE_TASK__
+#define __PROBE_TASK__
+
+#include "kernel/Task.h"
+#include "kernel/MQTTClient.h"
+#include "config.h"
+
+/**
+ * Probe Task
+ * Pings one of MQTT_BROKERS per tick for the broker selection. A ping
+ * blocks for a few round trips, more if the broker is slow, so the task
+ * runs in a group of its own below the network group; the MQTTTask acts
+ * on the results.
+ */
+class ProbeTask : public Task {
+private:
+  MQTTClient* mqttClient;
+
+public:
+  ProbeTask(MQTTClient* mqttClient);
+
+  void init(int period);
+  void tick();
+};
+
+#endif
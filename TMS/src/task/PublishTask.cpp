@@ -0,0 +1,63 @@
+#include "Arduino.h"
+#include "PublishTask.h"
+#include "kernel/ZoneTrace.h"
+
+PublishTask::PublishTask(MQTTClient* mqttClient, StateManager* stateManager, QueueHandle_t readings,
+                         HistoryLog* history, LevelStats* stats)
+  : mqttClient(mqttClient), stateManager(stateManager), readings(readings), history(history),
+    stats(stats) {
+}
+
+void PublishTask::init(int period) {
+  Task::init(period);
+  DEBUG_PRINTLN("PublishTask initialized");
+}
+
+void PublishTask::tick() {
+  TRACE_SCOPE("publish_tick");
+  WaterLevelData data;
+  while (xQueueReceive(readings, &data, 0) == pdPASS) {
+    handle(data);
+  }
+}
+
+void PublishTask::handle(WaterLevelData& data) {
+  data.state = stateManager->getState();
+
+  if (data.isValid()) {
+    stats->record(data);
+    history->record(data);
+    DEBUG_PRINT("Water Level: ");
+    DEBUG_PRINT(data.level);
+    DEBUG_PRINT(" cm (Distance: ");
+    DEBUG_PRINT(data.distance);
+    DEBUG_PRINTLN(" cm)");
+  } else {
+    DEBUG_PRINT("Sonar Read Failure. Distance: ");
+    DEBUG_PRINTLN(data.distance);
+  }
+
+  if (data.state != MONITORING) {
+    return;
+  }
+  if (mqttClient->isConnected()) {
+    String jsonData = data.toJson();
+    
+    DEBUG_PRINTLN("\n===========================");
+    DEBUG_PRINTLN("DEBUG [TMS-MQTT]: Publishing to CUS");
+    DEBUG_PRINT("  Level: ");
+    DEBUG_PRINT(data.level);
+    DEBUG_PRINTLN(" cm");
+    DEBUG_PRINT("  JSON: ");
+    DEBUG_PRINTLN(jsonData);
+    DEBUG_PRINTLN("===========================\n");
+    
+    bool published = mqttClient->publish(MQTT_TOPIC, jsonData);
+    
+    if (!published) {
+      DEBUG_PRINTLN("Failed to publish water level data");
+    }
+  } else {
+    DEBUG_PRINTLN("Cannot publish: MQTT not connected");
+  }
+}
@@ -0,0 +1,39 @@
+#ifndef __PUBLISH_TASK__
+#define __PUBLISH_TASK__
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include "kernel/Task.h"
+#include "kernel/MQTTClient.h"
+#include "model/WaterLevelData.h"
+#include "model/HistoryLog.h"
+#include "model/LevelStats.h"
+#include "model/TMSState.h"
+#include "config.h"
+
+/**
+ * Publish Task
+ * Takes the readings of the MonitoringTask off the reading queue. Every
+ * valid reading goes to the rolling statistics and the history log (which
+ * keeps one per HISTORY_INTERVAL); each reading is published to MQTT while
+ * the TMS is MONITORING. Runs with the other users of the MQTT client.
+ */
+class PublishTask : public Task {
+private:
+  MQTTClient* mqttClient;
+  StateManager* stateManager;
+  QueueHandle_t readings;
+  HistoryLog* history;
+  LevelStats* stats;
+
+  void handle(WaterLevelData& data);
+
+public:
+  PublishTask(MQTTClient* mqttClient, StateManager* stateManager, QueueHandle_t readings,
+              HistoryLog* history, LevelStats* stats);
+
+  void init(int period);
+  void tick();
+};
+
+#endif
@@ -0,0 +1,54 @@
+#include "Arduino.h"
+#include "SummaryTask.h"
+#include <ArduinoJson.h>
+#include "kernel/ZoneTrace.h"
+
+SummaryTask::SummaryTask(MQTTClient* mqttClient, LevelStats* stats)
+  : mqttClient(mqttClient), stats(stats) {
+}
+
+void SummaryTask::init(int period) {
+  Task::init(period);
+  DEBUG_PRINTLN("SummaryTask initialized");
+}
+
+static float tenths(float value) {
+  return roundf(value * 10) / 10;
+}
+
+void SummaryTask::tick() {
+  TRACE_SCOPE("summary_tick");
+  if (!mqttClient->isConnected()) {
+    return;
+  }
+
+  JsonDocument doc;
+  doc["timestamp"] = millis() / 1000;
+  for (uint8_t i = 0; i < stats->getWindowCount(); i++) {
+    WindowSummary w;
+    stats->summarize(i, w);
+    if (w.count == 0) {
+      continue;
+    }
+    // "1m", "10m", "1h"
+    char name[8];
+    if (w.seconds % 3600 == 0) {
+      snprintf(name, sizeof(name), "%uh", w.seconds / 3600);
+    } else if (w.seconds % 60 == 0) {
+      snprintf(name, sizeof(name), "%um", w.seconds / 60);
+    } else {
+      snprintf(name, sizeof(name), "%us", w.seconds);
+    }
+    JsonObject o = doc[name].to<JsonObject>();
+    o["n"] = w.count;
+    o["min"] = tenths(w.min);
+    o["max"] = tenths(w.max);
+    o["mean"] = tenths(w.mean);
+    o["std"] = roundf(w.stddev * 100) / 100;
+    o["p95"] = tenths(w.p95);
+  }
+
+  String json;
+  serializeJson(doc, json);
+  mqttClient->publish(SUMMARY_TOPIC, json, true);
+}
@@ -0,0 +1,27 @@
+#ifndef __SUMMARY_TASK__
+#define __SUMMARY_TASK__
+
+#include "kernel/Task.h"
+#include "kernel/MQTTClient.h"
+#include "model/LevelStats.h"
+#include "config.h"
+
+/**
+ * Summary Task
+ * Publishes the rolling-window level statistics every SUMMARY_PERIOD on
+ * SUMMARY_TOPIC, retained, for consumers that need trends rather than
+ * every reading.
+ */
+class SummaryTask : public Task {
+private:
+  MQTTClient* mqttClient;
+  LevelStats* stats;
+
+public:
+  SummaryTask(MQTTClient* mqttClient, LevelStats* stats);
+
+  void init(int period);
+  void tick();
+};
+
+#endif
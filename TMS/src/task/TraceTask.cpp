@@ -0,0 +1,172 @@
+#include "Arduino.h"
+#include "TraceTask.h"
+#include <ArduinoJson.h>
+#include "kernel/ZoneTrace.h"
+
+#define SERIAL_COMMAND_PREFIX "trace "
+#define SERIAL_LINE_MAX 32
+#define SERIAL_CHUNK_PREFIX "TRACE "
+
+static const char BASE64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/**
+ * Base64 of the records, little endian: dt, echo
+ */
+static String encodeRecords(const EchoRecord* records, uint16_t n) {
+  uint8_t bytes[TRACE_CHUNK_RECORDS * sizeof(EchoRecord)];
+  unsigned int len = 0;
+  for (uint16_t i = 0; i < n; i++) {
+    bytes[len++] = records[i].dt & 0xFF;
+    bytes[len++] = records[i].dt >> 8;
+    bytes[len++] = records[i].echo & 0xFF;
+    bytes[len++] = records[i].echo >> 8;
+  }
+
+  String out;
+  out.reserve((len + 2) / 3 * 4);
+  for (unsigned int i = 0; i < len; i += 3) {
+    uint32_t v = (uint32_t)bytes[i] << 16;
+    if (i + 1 < len) v |= (uint32_t)bytes[i + 1] << 8;
+    if (i + 2 < len) v |= bytes[i + 2];
+    out += BASE64[(v >> 18) & 0x3F];
+    out += BASE64[(v >> 12) & 0x3F];
+    out += i + 1 < len ? BASE64[(v >> 6) & 0x3F] : '=';
+    out += i + 2 < len ? BASE64[v & 0x3F] : '=';
+  }
+  return out;
+}
+
+TraceTask::TraceTask(EchoTrace* trace, MQTTClient* mqttClient)
+  : trace(trace), mqttClient(mqttClient), pendingTarget(NONE),
+    dumpTarget(NONE), dumpNext(0), dumpChunk(0), dumpChunks(0),
+    resumeRecording(false) {
+  pendingCommand[0] = '\0';
+}
+
+void TraceTask::init(int period) {
+  Task::init(period);
+  mqttClient->subscribe(TRACE_CMD_TOPIC, this);
+  if (TRACE_AUTOSTART) {
+    trace->start();
+  }
+  DEBUG_PRINTLN("TraceTask initialized");
+}
+
+void TraceTask::onMessage(const char* topic, const uint8_t* payload, unsigned int length) {
+  // Handled on the next tick, outside the MQTT client's callback
+  unsigned int n = length < sizeof(pendingCommand) - 1 ? length : sizeof(pendingCommand) - 1;
+  memcpy(pendingCommand, payload, n);
+  pendingCommand[n] = '\0';
+  pendingTarget = TO_MQTT;
+}
+
+void TraceTask::tick() {
+  TRACE_SCOPE("trace_tick");
+  readSerial();
+
+  if (pendingTarget != NONE) {
+    execute(pendingCommand, pendingTarget);
+    pendingTarget = NONE;
+  }
+
+  if (dumpTarget != NONE) {
+    sendChunk();
+  }
+}
+
+void TraceTask::readSerial() {
+  while (Serial.available() > 0) {
+    char c = Serial.read();
+    if (c == '\n' || c == '\r') {
+      if (serialLine.startsWith(SERIAL_COMMAND_PREFIX)) {
+        execute(serialLine.c_str() + strlen(SERIAL_COMMAND_PREFIX), TO_SERIAL);
+      }
+      serialLine = "";
+    } else if (serialLine.length() < SERIAL_LINE_MAX) {
+      serialLine += c;
+    }
+  }
+}
+
+void TraceTask::execute(const char* command, Target target) {
+  if (strcmp(command, "start") == 0) {
+    trace->start();
+  } else if (strcmp(command, "stop") == 0) {
+    trace->stop();
+  } else if (strcmp(command, "clear") == 0) {
+    trace->clear();
+  } else if (strcmp(command, "dump") == 0) {
+    startDump(target);
+    return;
+#ifdef ZONE_TRACE
+  } else if (strcmp(command, "zones") == 0) {
+    // Printed on Serial by the main loop, whichever way the command came
+    ZoneTrace::requestDump("request");
+    return;
+#endif
+  } else {
+    DEBUG_PRINT("Unknown trace command: ");
+    DEBUG_PRINTLN(command);
+    return;
+  }
+  DEBUG_PRINT("Trace ");
+  DEBUG_PRINT(command);
+  DEBUG_PRINT(", ");
+  DEBUG_PRINT(trace->size());
+  DEBUG_PRINTLN(" records");
+}
+
+void TraceTask::startDump(Target target) {
+  if (dumpTarget == NONE) {
+    // Freeze the trace so that the chunks describe one consistent snapshot
+    resumeRecording = trace->isRecording();
+    trace->stop();
+  }
+  dumpTarget = target;
+  dumpNext = 0;
+  dumpChunk = 0;
+  dumpChunks = (trace->size() + TRACE_CHUNK_RECORDS - 1) / TRACE_CHUNK_RECORDS;
+  if (dumpChunks == 0) {
+    dumpChunks = 1;   // an empty chunk tells the receiver the trace is empty
+  }
+}
+
+void TraceTask::sendChunk() {
+  EchoRecord records[TRACE_CHUNK_RECORDS];
+  uint16_t n = trace->read(dumpNext, records, TRACE_CHUNK_RECORDS);
+
+  TRACE_SCOPE("chunk_json");
+  JsonDocument doc;
+  doc["chunk"] = dumpChunk;
+  doc["chunks"] = dumpChunks;
+  doc["t0"] = trace->getStartTime();
+  doc["records"] = n;
+  doc["data"] = encodeRecords(records, n);
+  String json;
+  serializeJson(doc, json);
+
+  if (dumpTarget == TO_MQTT) {
+    if (!mqttClient->publish(TRACE_DATA_TOPIC, json)) {
+      // The requester sees the gap in the chunk numbers and asks again
+      DEBUG_PRINTLN("Trace dump aborted");
+      finishDump();
+      return;
+    }
+  } else {
+    Serial.print(SERIAL_CHUNK_PREFIX);
+    Serial.println(json);
+  }
+
+  dumpNext += n;
+  dumpChunk++;
+  if (dumpChunk >= dumpChunks) {
+    finishDump();
+  }
+}
+
+void TraceTask::finishDump() {
+  dumpTarget = NONE;
+  if (resumeRecording) {
+    trace->start();
+  }
+}
@@ -0,0 +1,47 @@
+#ifndef __TRACE_TASK__
+#define __TRACE_TASK__
+
+#include "kernel/Task.h"
+#include "kernel/MQTTClient.h"
+#include "model/EchoTrace.h"
+#include "config.h"
+
+/**
+ * Trace Task
+ * Controls the sonar trace and exports it. Commands ("start", "stop",
+ * "clear", "dump") arrive on TRACE_CMD_TOPIC or as "trace <command>" lines
+ * on Serial; a dump goes back the way the command came, one chunk of
+ * TRACE_CHUNK_RECORDS per tick. Recording pauses while a dump is running.
+ */
+class TraceTask : public Task, public MQTTMessageHandler {
+private:
+  enum Target { NONE, TO_SERIAL, TO_MQTT };
+
+  EchoTrace* trace;
+  MQTTClient* mqttClient;
+  String serialLine;
+  char pendingCommand[8];
+  Target pendingTarget;
+
+  Target dumpTarget;
+  uint16_t dumpNext;
+  uint16_t dumpChunk;
+  uint16_t dumpChunks;
+  bool resumeRecording;
+
+  void readSerial();
+  void execute(const char* command, Target target);
+  void startDump(Target target);
+  void sendChunk();
+  void finishDump();
+
+public:
+  TraceTask(EchoTrace* trace, MQTTClient* mqttClient);
+
+  void init(int period);
+  void tick();
+
+  void onMessage(const char* topic, const uint8_t* payload, unsigned int length);
+};
+
+#endif
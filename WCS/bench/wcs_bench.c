@@ -0,0 +1,482 @@
+/*
+ * Cycle benchmark of the WCS firmware on simavr
+ *
+ * Runs the firmware ELF built with -DWCS_BENCH (PlatformIO env "bench") on a
+ * simulated ATmega328P at 16 MHz and replays a scenario: UART input from a
+ * scripted CUS, potentiometer voltage and button level. The firmware marks
+ * the zones of ../src/kernel/Bench.h by writing GPIOR0; every zone entry and
+ * exit is timestamped in CPU cycles. The scripted peer answers pings so that
+ * the link watchdog stays quiet.
+ *
+ * Usage: wcs_bench [-t thresholds | -w thresholds] firmware.elf scenario.txt
+ *   -t  compare against a thresholds file, exit 1 on regression or on a
+ *       zone without a threshold
+ *   -w  write a thresholds file from this run (measured values + 10%)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "sim_io.h"
+#include "avr_uart.h"
+#include "avr_adc.h"
+#include "avr_ioport.h"
+
+#include "../src/kernel/Bench.h"
+
+#define CPU_FREQ      16000000UL
+#define CYCLES_PER_MS (CPU_FREQ / 1000)
+#define GPIOR0_ADDR   0x3E            /* data space address of GPIOR0 */
+#define BUTTON_PORT   'B'             /* BUTTON_PIN 9 = PB1 */
+#define BUTTON_BIT    1
+#define MAX_ZONES     128
+#define MAX_DEPTH     8
+#define MAX_EVENTS    256
+#define MAX_LINE      256
+
+/* ===== Zone statistics ===== */
+
+struct zone_stats {
+	const char *name;
+	uint64_t count;
+	uint64_t sum;       /* inclusive cycles */
+	uint64_t sum_excl;  /* minus nested zones (interrupts included) */
+	uint64_t min;
+	uint64_t max;
+};
+
+struct open_zone {
+	uint8_t zone;
+	avr_cycle_count_t start;
+	avr_cycle_count_t nested;
+};
+
+static struct zone_stats zones[MAX_ZONES];
+static struct open_zone stack[MAX_DEPTH];
+static int depth;
+static unsigned long marker_errors;
+
+static void init_zones(void)
+{
+#define X(id, value, label) zones[value].name = label;
+	BENCH_ZONES(X)
+#undef X
+}
+
+static void gpior_write(struct avr_t *avr, avr_io_addr_t addr, uint8_t v, void *param)
+{
+	uint8_t zone = v & ~BENCH_END;
+	(void)param;
+	avr->data[addr] = v;
+
+	if (zone >= MAX_ZONES || zones[zone].name == NULL) {
+		marker_errors++;
+		return;
+	}
+	if (!(v & BENCH_END)) {
+		if (depth == MAX_DEPTH) {
+			marker_errors++;
+			return;
+		}
+		stack[depth].zone = zone;
+		stack[depth].start = avr->cycle;
+		stack[depth].nested = 0;
+		depth++;
+		return;
+	}
+	if (depth == 0 || stack[depth - 1].zone != zone) {
+		marker_errors++;
+		return;
+	}
+
+	depth--;
+	avr_cycle_count_t cycles = avr->cycle - stack[depth].start;
+	struct zone_stats *z = &zones[zone];
+	if (z->count == 0 || cycles < z->min)
+		z->min = cycles;
+	if (cycles > z->max)
+		z->max = cycles;
+	z->count++;
+	z->sum += cycles;
+	z->sum_excl += cycles - stack[depth].nested;
+	if (depth > 0)
+		stack[depth - 1].nested += cycles;
+}
+
+/* ===== Scripted CUS on UART0 ===== */
+
+static avr_irq_t *uart_in;
+static uint8_t rx_line[MAX_LINE];
+static int rx_len;
+static int rx_json;
+static unsigned long rx_frames, rx_json_lines, pings;
+
+static uint16_t crc16(const uint8_t *data, int len)
+{
+	uint16_t crc = 0xFFFF;
+	for (int i = 0; i < len; i++) {
+		crc ^= (uint16_t)data[i] << 8;
+		for (int b = 0; b < 8; b++)
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+	}
+	return crc;
+}
+
+static void uart_send(const uint8_t *data, int len)
+{
+	for (int i = 0; i < len; i++)
+		avr_raise_irq(uart_in, data[i]);
+}
+
+/* COBS(opcode | payload | crc16) + 0x00, as WCS/src/kernel/FrameCodec */
+static void send_frame(const uint8_t *raw, int len)
+{
+	uint8_t buf[32], out[40];
+	int n = 0, code_idx = 0, code = 1;
+
+	memcpy(buf, raw, len);
+	uint16_t crc = crc16(buf, len);
+	buf[len++] = crc >> 8;
+	buf[len++] = crc & 0xFF;
+
+	out[n++] = 0;
+	for (int i = 0; i < len; i++) {
+		if (buf[i] == 0) {
+			out[code_idx] = code;
+			code_idx = n++;
+			code = 1;
+		} else {
+			out[n++] = buf[i];
+			code++;
+		}
+	}
+	out[code_idx] = code;
+	out[n++] = 0;
+	uart_send(out, n);
+}
+
+static void send_json(const char *text)
+{
+	uart_send((const uint8_t *)text, strlen(text));
+	uart_send((const uint8_t *)"\n", 1);
+}
+
+/* Decode the opcode of a received frame (COBS only; the CRC is not checked) */
+static int frame_opcode(const uint8_t *wire, int len)
+{
+	if (len < 2)
+		return -1;
+	return wire[0] > 1 ? wire[1] : 0;
+}
+
+static void uart_output(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+	uint8_t c = value;
+	(void)irq;
+	(void)param;
+
+	if (rx_json) {
+		if (c == '\n') {
+			rx_line[rx_len] = 0;
+			rx_json_lines++;
+			if (strstr((char *)rx_line, "\"ping\"")) {
+				pings++;
+				send_json("{\"type\":\"pong\"}");
+			}
+			rx_json = 0;
+			rx_len = 0;
+		} else if (rx_len < MAX_LINE - 1) {
+			rx_line[rx_len++] = c;
+		}
+		return;
+	}
+	if (c == 0) {
+		if (rx_len > 0) {
+			rx_frames++;
+			if (frame_opcode(rx_line, rx_len) == 0x14) {   /* OP_PING */
+				uint8_t pong = 0x03;                      /* OP_PONG */
+				pings++;
+				send_frame(&pong, 1);
+			}
+		}
+		rx_len = 0;
+		return;
+	}
+	if (rx_len == 0 && c == '{') {
+		rx_json = 1;
+		rx_line[rx_len++] = c;
+		return;
+	}
+	if (rx_len == 0 && (c == '\r' || c == '\n'))
+		return;
+	if (rx_len < MAX_LINE - 1)
+		rx_line[rx_len++] = c;
+}
+
+/* ===== Scenario ===== */
+
+enum event_kind { EV_JSON, EV_FRAME, EV_POT, EV_BUTTON, EV_END };
+
+struct event {
+	avr_cycle_count_t at;
+	enum event_kind kind;
+	char text[MAX_LINE];
+	uint8_t raw[16];
+	int len;
+	int value;
+};
+
+static struct event events[MAX_EVENTS];
+static int n_events;
+
+static int load_scenario(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	char line[MAX_LINE + 64];
+	int lineno = 0;
+
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		unsigned long ms;
+		char verb[16];
+		int off;
+		lineno++;
+
+		if (line[0] == '#')
+			continue;
+		if (sscanf(line, "%lu %15s %n", &ms, verb, &off) < 2)
+			continue;
+		if (n_events == MAX_EVENTS) {
+			fprintf(stderr, "%s: too many events\n", path);
+			break;
+		}
+
+		struct event *e = &events[n_events];
+		char *args = line + off;
+		args[strcspn(args, "\r\n")] = 0;
+		e->at = (avr_cycle_count_t)ms * CYCLES_PER_MS;
+
+		if (!strcmp(verb, "json")) {
+			e->kind = EV_JSON;
+			snprintf(e->text, sizeof(e->text), "%s", args);
+		} else if (!strcmp(verb, "frame")) {
+			/* hex bytes: opcode then payload, comments allowed after '#' */
+			char *tok = strtok(args, " \t");
+			e->kind = EV_FRAME;
+			e->len = 0;
+			while (tok && *tok != '#' && e->len < (int)sizeof(e->raw)) {
+				e->raw[e->len++] = strtoul(tok, NULL, 16);
+				tok = strtok(NULL, " \t");
+			}
+		} else if (!strcmp(verb, "pot")) {
+			e->kind = EV_POT;
+			e->value = atoi(args);
+		} else if (!strcmp(verb, "button")) {
+			e->kind = EV_BUTTON;
+			e->value = atoi(args);
+		} else if (!strcmp(verb, "end")) {
+			e->kind = EV_END;
+		} else {
+			fprintf(stderr, "%s:%d: unknown action '%s'\n", path, lineno, verb);
+			fclose(f);
+			return -1;
+		}
+		n_events++;
+	}
+	fclose(f);
+	return 0;
+}
+
+/* ===== Thresholds ===== */
+
+static int check_thresholds(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	char line[MAX_LINE], name[64];
+	unsigned long long mean_max, peak_max;
+	int listed[MAX_ZONES] = {0};
+	int failures = 0;
+
+	if (!f) {
+		perror(path);
+		return 1;
+	}
+	printf("\n%-16s %10s %10s %10s %10s\n", "zone", "mean", "limit", "max", "limit");
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] == '#' || sscanf(line, "%63s %llu %llu", name, &mean_max, &peak_max) != 3)
+			continue;
+
+		struct zone_stats *z = NULL;
+		for (int i = 0; i < MAX_ZONES; i++)
+			if (zones[i].name && !strcmp(zones[i].name, name)) {
+				z = &zones[i];
+				listed[i] = 1;
+			}
+
+		if (!z || z->count == 0) {
+			printf("%-16s not exercised by the scenario  FAIL\n", name);
+			failures++;
+			continue;
+		}
+		uint64_t mean = z->sum / z->count;
+		int fail = mean > mean_max || z->max > peak_max;
+		printf("%-16s %10llu %10llu %10llu %10llu  %s\n", name,
+		       (unsigned long long)mean, mean_max,
+		       (unsigned long long)z->max, peak_max, fail ? "FAIL" : "ok");
+		failures += fail;
+	}
+	fclose(f);
+
+	/* A zone without a budget is a failure, not a pass */
+	for (int i = 0; i < MAX_ZONES; i++) {
+		if (zones[i].name && !listed[i]) {
+			printf("%-16s no threshold in %s (make baseline)  FAIL\n", zones[i].name, path);
+			failures++;
+		}
+	}
+	return failures ? 1 : 0;
+}
+
+static int write_thresholds(const char *path, const char *scenario)
+{
+	FILE *f = fopen(path, "w");
+	if (!f) {
+		perror(path);
+		return 1;
+	}
+	fprintf(f, "# WCS cycle budgets (16 MHz), checked by `make run`\n");
+	fprintf(f, "# Written by `make baseline` from %s with 10%% headroom;\n", scenario);
+	fprintf(f, "# review changes to this file like code.\n");
+	fprintf(f, "# zone            mean_cycles   max_cycles\n");
+	for (int i = 0; i < MAX_ZONES; i++) {
+		struct zone_stats *z = &zones[i];
+		if (!z->name || z->count == 0)
+			continue;
+		fprintf(f, "%-16s %12llu %12llu\n", z->name,
+		        (unsigned long long)(z->sum / z->count * 11 / 10 + 1),
+		        (unsigned long long)(z->max * 11 / 10 + 1));
+	}
+	fclose(f);
+	printf("\nThresholds written to %s\n", path);
+	return 0;
+}
+
+/* ===== Main ===== */
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-t thresholds | -w thresholds] firmware.elf scenario.txt\n", prog);
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *check_path = NULL, *write_path = NULL;
+	elf_firmware_t firmware = {{0}};
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:w:")) != -1) {
+		if (opt == 't')
+			check_path = optarg;
+		else if (opt == 'w')
+			write_path = optarg;
+		else
+			usage(argv[0]);
+	}
+	if (argc - optind != 2)
+		usage(argv[0]);
+
+	const char *elf = argv[optind], *scenario = argv[optind + 1];
+	if (elf_read_firmware(elf, &firmware) != 0) {
+		fprintf(stderr, "%s: cannot read firmware\n", elf);
+		return 2;
+	}
+	if (load_scenario(scenario) != 0)
+		return 2;
+
+	avr_t *avr = avr_make_mcu_by_name("atmega328p");
+	if (!avr) {
+		fprintf(stderr, "simavr has no atmega328p core\n");
+		return 2;
+	}
+	avr_init(avr);
+	avr->frequency = CPU_FREQ;
+	avr->vcc = avr->avcc = avr->aref = 5000;
+	avr_load_firmware(avr, &firmware);
+
+	init_zones();
+	avr_register_io_write(avr, GPIOR0_ADDR, gpior_write, NULL);
+
+	/* UART0: no stdio echo, collect output in uart_output() */
+	uint32_t flags = 0;
+	avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+	flags &= ~AVR_UART_FLAG_STDIO;
+	avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+	uart_in = avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_INPUT);
+	avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT),
+	                        uart_output, NULL);
+
+	avr_irq_t *pot = avr_io_getirq(avr, AVR_IOCTL_ADC_GETIRQ, ADC_IRQ_ADC0);
+	avr_irq_t *button = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(BUTTON_PORT), BUTTON_BIT);
+	avr_raise_irq(pot, 2500);
+	avr_raise_irq(button, 0);
+
+	int next = 0, state = cpu_Running;
+	while (state != cpu_Done && state != cpu_Crashed) {
+		if (next < n_events && avr->cycle >= events[next].at) {
+			struct event *e = &events[next++];
+			if (e->kind == EV_END)
+				break;
+			switch (e->kind) {
+			case EV_JSON:   send_json(e->text); break;
+			case EV_FRAME:  send_frame(e->raw, e->len); break;
+			case EV_POT:    avr_raise_irq(pot, (uint32_t)e->value * 5000 / 1023); break;
+			case EV_BUTTON: avr_raise_irq(button, e->value ? 1 : 0); break;
+			default:        break;
+			}
+			continue;
+		}
+		if (next == n_events)
+			break;
+		state = avr_run(avr);
+	}
+
+	printf("WCS bench: %s, %.1f ms simulated%s\n", scenario,
+	       (double)avr->cycle / CYCLES_PER_MS, state == cpu_Crashed ? " (CRASHED)" : "");
+	printf("UART: %lu frames, %lu JSON lines, %lu pings answered; %lu marker errors\n\n",
+	       rx_frames, rx_json_lines, pings, marker_errors);
+	printf("%-16s %8s %10s %10s %10s %10s %9s\n",
+	       "zone", "count", "mean", "min", "max", "mean_excl", "max_us");
+	for (int i = 0; i < MAX_ZONES; i++) {
+		struct zone_stats *z = &zones[i];
+		if (!z->name)
+			continue;
+		if (z->count == 0) {
+			printf("%-16s %8d\n", z->name, 0);
+			continue;
+		}
+		printf("%-16s %8llu %10llu %10llu %10llu %10llu %9.1f\n", z->name,
+		       (unsigned long long)z->count,
+		       (unsigned long long)(z->sum / z->count),
+		       (unsigned long long)z->min,
+		       (unsigned long long)z->max,
+		       (unsigned long long)(z->sum_excl / z->count),
+		       z->max * 1e6 / CPU_FREQ);
+	}
+
+	if (state == cpu_Crashed)
+		return 1;
+	if (write_path)
+		return write_thresholds(write_path, scenario);
+	if (check_path)
+		return check_thresholds(check_path);
+	return 0;
+}
@@ -7,24 +7,46 @@
 #define POT_PIN A0           // Potentiometer for manual control
 
 // ===== Serial Configuration =====
-#define SERIAL_BAUD 9600   // Match CUS serial configuration
+#define SERIAL_BAUD 9600   // Initial rate, match CUS serial configuration
+#define SERIAL_BINARY_ENABLED true  // Accept binary framing when CUS negotiates it
+#define SERIAL_SUPPORTED_RATES { 9600, 19200, 38400, 57600, 115200 }  // Rates offered in link-rate negotiation
+#define SERIAL_RATE_PROBE_TIMEOUT 1000  // ms to wait for the probe before falling back to SERIAL_BAUD
+#define TX_QUEUE_SIZE 8      // Outgoing messages waiting for the UART
+#define TX_NACK_BACKLOG 3    // Queued messages above which NACKs are dropped
+#define LINK_PING_INTERVAL 1000  // ms of silence from the CUS before pinging it (and between pings)
+#define LINK_TIMEOUT 3000        // ms of silence after which the WCS fails safe to UNCONNECTED
 
 // ===== System Parameters =====
 #define VALVE_MIN 0          // Minimum valve percentage
 #define VALVE_MAX 100        // Maximum valve percentage
 #define POT_MIN 0            // Potentiometer ADC min
 #define POT_MAX 1023         // Potentiometer ADC max
+#define POT_OVERSAMPLE_BITS 1  // 4^n ADC samples per decimated pot reading (n extra bits)
+#define POT_IIR_SHIFT 3        // IIR smoothing: each reading moves the output by 1/2^k
+#define POT_EVENT_STEP 4       // ADC steps the filtered reading must move to wake the task
+#define POT_HYSTERESIS 7       // tenths of a % beyond the next step the knob must move to report a change
 #define SERVO_MIN_ANGLE 0    // Servo minimum angle (0% = closed)
 #define SERVO_MAX_ANGLE 90   // Servo maximum angle (100% = open) - Per assignment specs
 
+// ===== Button =====
+#define BUTTON_DEBOUNCE_MS 30       // Edges closer than this to the last accepted one are bounce
+#define BUTTON_LONG_PRESS_MS 1500   // Hold time reported as a long press
+
 // ===== Update Intervals =====
-#define MANUAL_UPDATE_INTERVAL 500  // ms between potentiometer updates
-#define SERIAL_CHECK_INTERVAL 50    // ms between serial message checks
+#define SERIAL_CHECK_INTERVAL 50    // ms between housekeeping serial checks (input is event driven)
+#define SERIAL_DRAIN_LIMIT 8        // messages handled per serial event or check, the rest waits for the next pass
 
 // ===== LCD Configuration =====
 #define LCD_I2C_ADDRESS 0x27  // I2C address for LCD
 #define LCD_COLS 16           // LCD columns
 #define LCD_ROWS 2            // LCD rows
+#define LCD_UPDATE_BUDGET 4000  // us of I2C display traffic allowed per WCS tick
+
+// ===== Zone Trace (builds with -DZONE_TRACE only) =====
+#define ZONE_TRACE_NAME "WCS"         // Firmware name in the dump header
+#define ZONE_TRACE_SIZE 24            // Zone begin/end events kept (7 bytes of RAM each)
+#define ZONE_TRACE_DUMP_INTERVAL 10000  // Minimum time between overrun dumps (ms)
+#define ZONE_TRACE_IDLE_TIME 300      // Quiet link before a requested dump is printed (ms)
 
 // ===== Debug Configuration =====
 #define DEBUG_ENABLED true    // Enable/disable debug logging
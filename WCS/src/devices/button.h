@@ -1,9 +1,20 @@
 #ifndef __BUTTON__
 #define __BUTTON__
 
+#include <stdint.h>
+
+enum ButtonEvent : uint8_t {
+    BUTTON_PRESSED,
+    BUTTON_RELEASED,
+    BUTTON_LONG_PRESS     // still held BUTTON_LONG_PRESS_MS after the press
+};
+
 class button{
     public:
         virtual bool isPressed() = 0;
+
+        /* next queued event, false if there is none */
+        virtual bool pollEvent(ButtonEvent& event) = 0;
 };
 
-#endif
\ No newline at end of file
+#endif
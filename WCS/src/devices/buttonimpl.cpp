@@ -1,10 +1,96 @@
 #include "buttonimpl.h"
+#include "config.h"
 #include <Arduino.h>
+#include <util/atomic.h>
+#include <EnableInterrupt.h>
+#include "kernel/EventQueue.h"
+
+ButtonImpl* ButtonImpl::instance = nullptr;
 
 ButtonImpl::ButtonImpl(int pin) : pin(pin) {
     pinMode(pin, INPUT);
+    inputReg = portInputRegister(digitalPinToPort(pin));
+    bitMask = digitalPinToBitMask(pin);
+
+    stablePressed = (*inputReg & bitMask) != 0;
+    lastAccepted = millis();
+    pressTime = lastAccepted;
+    longPressReported = stablePressed;
+    eventHead = 0;
+    eventCount = 0;
+
+    instance = this;
+    enableInterrupt(pin, onChange, CHANGE);
+}
+
+void ButtonImpl::onChange() {
+    if (instance != nullptr) {
+        instance->handleEdge(millis());
+    }
+}
+
+void ButtonImpl::handleEdge(unsigned long now) {
+    // Contact bounce right after an accepted edge is ignored; pollEvent()
+    // catches a level that settled differently once the window is over
+    bool pressed = (*inputReg & bitMask) != 0;
+    if (pressed != stablePressed && now - lastAccepted >= BUTTON_DEBOUNCE_MS) {
+        accept(pressed, now);
+        eventQueue.post(EVENT_BUTTON);
+    }
+}
+
+void ButtonImpl::accept(bool pressed, unsigned long now) {
+    stablePressed = pressed;
+    lastAccepted = now;
+    if (pressed) {
+        pressTime = now;
+    }
+    push(pressed ? BUTTON_PRESSED : BUTTON_RELEASED);
+}
+
+void ButtonImpl::push(ButtonEvent event) {
+    if (eventCount < EVENT_QUEUE_SIZE) {
+        events[(eventHead + eventCount) % EVENT_QUEUE_SIZE] = event;
+        eventCount++;
+    }
 }
 
 bool ButtonImpl::isPressed() {
-    return digitalRead(pin) == HIGH;
-}
\ No newline at end of file
+    return stablePressed;
+}
+
+bool ButtonImpl::pollEvent(ButtonEvent& event) {
+    unsigned long now = millis();
+
+    // Copies taken with the edge interrupt off: pressTime is four bytes and
+    // must not be read halfway through an update
+    bool held;
+    unsigned long heldSince;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        bool pressed = (*inputReg & bitMask) != 0;
+        if (pressed != stablePressed && now - lastAccepted >= BUTTON_DEBOUNCE_MS) {
+            accept(pressed, now);
+        }
+        held = stablePressed;
+        heldSince = pressTime;
+    }
+
+    if (!held) {
+        longPressReported = false;
+    } else if (!longPressReported && now - heldSince >= BUTTON_LONG_PRESS_MS) {
+        longPressReported = true;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            push(BUTTON_LONG_PRESS);
+        }
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (eventCount == 0) {
+            return false;
+        }
+        event = events[eventHead];
+        eventHead = (eventHead + 1) % EVENT_QUEUE_SIZE;
+        eventCount--;
+    }
+    return true;
+}
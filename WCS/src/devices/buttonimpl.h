@@ -3,14 +3,40 @@
 
 #include "button.h"
 
+/**
+ * Edge-triggered button (pin change interrupt via EnableInterrupt)
+ * The ISR timestamps edges, debounces them and queues press/release
+ * events and posts EVENT_BUTTON; pollEvent() adds long-press events. Only one instance is
+ * supported, as the interrupt handler has no context argument.
+ */
 class ButtonImpl: public button {
  
 public: 
   ButtonImpl(int pin);
   bool isPressed();
+  bool pollEvent(ButtonEvent& event);
 
 private:
+  static const uint8_t EVENT_QUEUE_SIZE = 4;
+
+  static void onChange();
+  void handleEdge(unsigned long now);
+  void accept(bool pressed, unsigned long now);
+  void push(ButtonEvent event);
+
   int pin;
+  volatile uint8_t* inputReg;
+  uint8_t bitMask;
+
+  volatile bool stablePressed;        // debounced level
+  volatile unsigned long lastAccepted; // time of the last accepted edge
+  volatile unsigned long pressTime;
+  bool longPressReported;
+
+  volatile ButtonEvent events[EVENT_QUEUE_SIZE];
+  volatile uint8_t eventHead;
+  volatile uint8_t eventCount;
 
+  static ButtonImpl* instance;
 };
-#endif
\ No newline at end of file
+#endif
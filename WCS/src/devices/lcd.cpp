@@ -1,6 +1,7 @@
 #include "lcd.h"
-#include "config.h"
 #include <LiquidCrystal_I2C.h>
+#include "kernel/Bench.h"
+#include "kernel/ZoneTrace.h"
 
 // Create LCD object
 LiquidCrystal_I2C lcd(LCD_I2C_ADDRESS, LCD_COLS, LCD_ROWS);
@@ -13,38 +14,84 @@ Lcd::Lcd() {
     delay(50);
     lcd.clear();
     
-    modeMessage = "";
-    percMessage = "";
-    msg = "";
+    memset(frame, ' ', sizeof(frame));
+    memset(shown, ' ', sizeof(shown));
+    cursorRow = NO_CURSOR;
+    cursorCol = NO_CURSOR;
+    scanPos = 0;
 }
 
-void Lcd::writeModeMessage(String message) {
-    modeMessage = message;
-    refresh();
+void Lcd::writeModeMessage(const char* message) {
+    setRow(0, PSTR("Mode: "), message, false);
 }
 
-void Lcd::writePercMessage(String message) {
-    percMessage = message;
-    refresh();
+void Lcd::writeModeMessage(const __FlashStringHelper* message) {
+    setRow(0, PSTR("Mode: "), (const char*)message, true);
 }
 
-void Lcd::writeMessage(String message) {
-    msg = message;
-    refresh();
+void Lcd::writePercMessage(const char* message) {
+    setRow(1, PSTR(""), message, false);
 }
 
-void Lcd::refresh() {
-    lcd.clear();
-    
-    // Line 1: Mode message
-    lcd.setCursor(0, 0);
-    lcd.print("Mode: " + modeMessage);
-    
-    // Line 2: Percentage message
-    lcd.setCursor(0, 1);
-    lcd.print(percMessage);
-
-    // Line 3: Message
-    lcd.setCursor(0, 2);
-    lcd.print(msg);
-}
\ No newline at end of file
+void Lcd::writeMessage(const char* message) {
+    setRow(2, PSTR(""), message, false);
+}
+
+void Lcd::setRow(uint8_t row, PGM_P prefix, const char* text, bool textInFlash) {
+    if (row >= LCD_ROWS) {
+        return;
+    }
+
+    uint8_t col = 0;
+    char c;
+    while ((c = pgm_read_byte(prefix++)) && col < LCD_COLS) {
+        frame[row][col++] = c;
+    }
+    while ((c = textInFlash ? pgm_read_byte(text) : *text) && col < LCD_COLS) {
+        frame[row][col++] = c;
+        text++;
+    }
+    while (col < LCD_COLS) {
+        frame[row][col++] = ' ';
+    }
+}
+
+bool Lcd::update(unsigned long budgetUs) {
+    BENCH_ZONE(BENCH_LCD_UPDATE);
+    TRACE_SCOPE("lcd_update");
+    unsigned long start = micros();
+    bool wrote = false;
+
+    // One pass over all cells at most: a full pass without differences
+    // means the display is in sync
+    for (uint8_t n = 0; n < LCD_ROWS * LCD_COLS; n++) {
+        uint8_t row = scanPos / LCD_COLS;
+        uint8_t col = scanPos % LCD_COLS;
+
+        if (frame[row][col] != shown[row][col]) {
+            if (wrote && micros() - start >= budgetUs) {
+                return false;
+            }
+            // The display auto-increments the cursor: only move it when
+            // the changed cell is not the next one
+            if (row != cursorRow || col != cursorCol) {
+                lcd.setCursor(col, row);
+                cursorRow = row;
+            }
+            lcd.write(frame[row][col]);
+            shown[row][col] = frame[row][col];
+            cursorCol = col + 1;
+            wrote = true;
+        }
+
+        scanPos = (scanPos + 1) % (LCD_ROWS * LCD_COLS);
+    }
+    // In sync: the next change is scanned from the top left, so a run of
+    // changed cells is not split at an old resume position
+    scanPos = 0;
+    return true;
+}
+
+void Lcd::flush() {
+    while (!update(0xFFFFFFFFUL)) {}
+}
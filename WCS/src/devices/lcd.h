@@ -2,20 +2,43 @@
 #define MYLCD_H
 
 #include <Arduino.h>
+#include "config.h"
 
+/**
+ * LCD driver with a shadow framebuffer
+ * write*() only format text into the framebuffer and return at once;
+ * update() sends the cells that differ from what the display already shows,
+ * a few at a time, so that I2C traffic can be spread over several ticks.
+ */
 class Lcd {
-private:
 public:
     Lcd();
-    void writeModeMessage(String message);
-    void writePercMessage(String message);
-    void writeMessage(String message);
+    void writeModeMessage(const char* message);   // row 0, "Mode: " prefix
+    void writeModeMessage(const __FlashStringHelper* message);
+    void writePercMessage(const char* message);   // row 1
+    void writeMessage(const char* message);       // row 2, if the display has it
+
+    /**
+     * Send changed cells until budgetUs microseconds have passed (at least
+     * one cell per call), resuming where the previous call stopped
+     * Returns true when the display shows the whole framebuffer
+     */
+    bool update(unsigned long budgetUs);
+
+    /**
+     * Send every changed cell (blocking)
+     */
+    void flush();
 private:
-    void refresh();
+    static const uint8_t NO_CURSOR = 0xFF;
+
+    void setRow(uint8_t row, PGM_P prefix, const char* text, bool textInFlash);
 
-    String modeMessage;
-    String percMessage;
-    String msg;
+    char frame[LCD_ROWS][LCD_COLS];   // wanted content
+    char shown[LCD_ROWS][LCD_COLS];   // content already sent to the display
+    uint8_t cursorRow;
+    uint8_t cursorCol;
+    uint8_t scanPos;                  // next cell to compare, row-major
 };
 
-#endif
\ No newline at end of file
+#endif
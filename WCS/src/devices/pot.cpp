@@ -1,16 +1,70 @@
-#include "Pot.h"
+#include "pot.h"
 #include "Arduino.h"
+#include "config.h"
+#include <util/atomic.h>
+#include "kernel/EventQueue.h"
+
+#define POT_OVERSAMPLE_COUNT (1 << (2 * POT_OVERSAMPLE_BITS))  // 4^n samples per decimated reading
+#define POT_FRACTION_BITS 4                                    // extra fixed point bits kept by the filter
+#define POT_SCALE_BITS (POT_OVERSAMPLE_BITS + POT_FRACTION_BITS)
+#define POT_TRIGGER_COMPARE 128   // Timer0 count that starts a conversion, half a period from the millis() interrupt
+
+static volatile uint16_t accumulator;   // sum of the current oversampling window
+static volatile uint8_t nSamples;
+static volatile int32_t filtered;       // IIR output, (10 + n + fraction) bit fixed point
+static int16_t lastPosted;              // integer reading last announced with EVENT_POT
+
+ISR(ADC_vect){
+  // A conversion starts on the rising edge of OCF0A; no Timer0 compare
+  // interrupt clears the flag, so re-arm the trigger here
+  TIFR0 = _BV(OCF0A);
+  accumulator += ADC;
+  if (++nSamples == POT_OVERSAMPLE_COUNT){
+    // Sum of 4^n samples >> n gives n extra bits of resolution
+    int32_t decimated = (int32_t)(accumulator >> POT_OVERSAMPLE_BITS) << POT_FRACTION_BITS;
+    filtered += (decimated - filtered) >> POT_IIR_SHIFT;
+    accumulator = 0;
+    nSamples = 0;
+
+    // Only a move of POT_EVENT_STEP is worth waking a task for, not the
+    // filtered noise around one reading
+    int16_t reading = filtered >> POT_SCALE_BITS;
+    if (abs(reading - lastPosted) >= POT_EVENT_STEP){
+      lastPosted = reading;
+      eventQueue.post(EVENT_POT);
+    }
+  }
+}
 
 Potentiometer::Potentiometer(int pin){
   this->pin = pin;
+
+  // Seed the filter with a blocking reading so that it starts settled
+  filtered = (int32_t)analogRead(pin) << POT_SCALE_BITS;
+  value = analogRead(pin);
+  lastPosted = filtered >> POT_SCALE_BITS;
+  accumulator = 0;
+  nSamples = 0;
+
+  uint8_t channel = (pin >= A0) ? pin - A0 : pin;
+  ADMUX = _BV(REFS0) | (channel & 0x07);   // AVcc reference, right adjusted
+  ADCSRB = _BV(ADTS1) | _BV(ADTS0);       // auto trigger source: Timer0 compare match A
+  DIDR0 |= _BV(channel);                   // no digital input buffer on the pot pin
+  OCR0A = POT_TRIGGER_COMPARE;             // Timer0 keeps the core's settings; OC0A (pin 6) stays disconnected
+  TIFR0 = _BV(OCF0A);
+  ADCSRA = _BV(ADEN) | _BV(ADATE) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);  // 125 kHz ADC clock
 } 
   
 void Potentiometer::sync(){
-  value = analogRead(pin);  
+  int32_t raw;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    raw = filtered;
+  }
+  value = (raw + (1L << (POT_SCALE_BITS - 1))) >> POT_SCALE_BITS;
   updateSyncTime(millis());
 }
 
-float Potentiometer::getValue(){
+int Potentiometer::getValue(){
   return value;
 }
 
@@ -20,4 +74,4 @@ void Potentiometer::updateSyncTime(long time){
 
 long Potentiometer::getLastSyncTime(){
 	return lastTimeSync;
-}
\ No newline at end of file
+}
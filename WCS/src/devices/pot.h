@@ -1,12 +1,25 @@
 #ifndef __POT__
 #define __POT__
 
+/**
+ * Potentiometer on a timer-triggered ADC
+ * Timer0 compare match A starts a conversion once per Timer0 period
+ * (about 977 Hz with the core's settings, the rate of the millis()
+ * interrupt; Timer1 and Timer2 belong to the scheduler and the servo).
+ * The conversion-complete interrupt accumulates 4^POT_OVERSAMPLE_BITS
+ * samples, decimates them and feeds an IIR low-pass filter; sync() only
+ * copies the filtered value. EVENT_POT is posted when the reading has moved
+ * POT_EVENT_STEP since the last one. The ADC is dedicated to this
+ * potentiometer: analogRead() must not be used elsewhere once it is
+ * constructed.
+ */
 class Potentiometer {
  
 public: 
   Potentiometer(int pin);
   
-  float getValue();
+  /* filtered reading, rounded, same 0..1023 scale as analogRead */
+  int getValue();
 
   virtual void sync();
   long getLastSyncTime();
@@ -20,4 +33,4 @@ private:
   int value;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -1,5 +1,30 @@
 #include "servoMotorImpl.h"
 #include "Arduino.h"
+#include <avr/pgmspace.h>
+
+// Pulse width (us) for each angle: 544 + angle*(2400-544)/180
+// (min is 544, max 2400, see ServoTimer2 doc)
+static const uint16_t PULSE_WIDTH[181] PROGMEM = {
+  544, 554, 564, 574, 585, 595, 605, 616, 626, 636,
+  647, 657, 667, 678, 688, 698, 708, 719, 729, 739,
+  750, 760, 770, 781, 791, 801, 812, 822, 832, 843,
+  853, 863, 873, 884, 894, 904, 915, 925, 935, 946,
+  956, 966, 977, 987, 997, 1008, 1018, 1028, 1038, 1049,
+  1059, 1069, 1080, 1090, 1100, 1111, 1121, 1131, 1142, 1152,
+  1162, 1172, 1183, 1193, 1203, 1214, 1224, 1234, 1245, 1255,
+  1265, 1276, 1286, 1296, 1307, 1317, 1327, 1337, 1348, 1358,
+  1368, 1379, 1389, 1399, 1410, 1420, 1430, 1441, 1451, 1461,
+  1472, 1482, 1492, 1502, 1513, 1523, 1533, 1544, 1554, 1564,
+  1575, 1585, 1595, 1606, 1616, 1626, 1636, 1647, 1657, 1667,
+  1678, 1688, 1698, 1709, 1719, 1729, 1740, 1750, 1760, 1771,
+  1781, 1791, 1801, 1812, 1822, 1832, 1843, 1853, 1863, 1874,
+  1884, 1894, 1905, 1915, 1925, 1936, 1946, 1956, 1966, 1977,
+  1987, 1997, 2008, 2018, 2028, 2039, 2049, 2059, 2070, 2080,
+  2090, 2100, 2111, 2121, 2131, 2142, 2152, 2162, 2173, 2183,
+  2193, 2204, 2214, 2224, 2235, 2245, 2255, 2265, 2276, 2286,
+  2296, 2307, 2317, 2327, 2338, 2348, 2358, 2369, 2379, 2389,
+  2400
+};
 
 
 ServoMotorImpl::ServoMotorImpl(int pin){
@@ -25,11 +50,7 @@ void ServoMotorImpl::setPosition(int angle){
 	} else if (this->angle < 0){
 		this->angle = 0;
 	}
-  // 750 -> 0, 2250 -> 180 
-  // 750 + angle*(2250-750)/180
-  // updated values: min is 544, max 2400 (see ServoTimer2 doc)
-  float coeff = (2400.0-544.0)/180;
-  motor.write(544 + angle*coeff);              
+  motor.write(pgm_read_word(&PULSE_WIDTH[this->angle]));
 }
 
 int ServoMotorImpl::getAngle(){
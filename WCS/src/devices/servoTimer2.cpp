@@ -2,47 +2,69 @@ extern "C" {
   // AVR LibC Includes
   #include <inttypes.h>
   #include <avr/interrupt.h>
+  #include <util/atomic.h>
   // #include "WConstants.h"
 }
 #include <Arduino.h>
 #include "servoTimer2.h"
+#include "kernel/Bench.h"
 static void initISR();   
 static void writeChan(uint8_t chan, int pulsewidth);
 
 #define FRAME_SYNC_INDEX   0		 // frame sync delay is the first entry in the channel array
 #define FRAME_SYNC_PERIOD  20000	   // total frame duration in microseconds 
 #define FRAME_SYNC_DELAY   ((FRAME_SYNC_PERIOD - ( NBR_CHANNELS * DEFAULT_PULSE_WIDTH))/ 128) // number of iterations of the ISR to get the desired frame rate
-#define DELAY_ADJUST	 8		 // number of microseconds of calculation overhead to be subtracted from pulse timings   
+// Microseconds the ISR adds to every pulse, subtracted from the timings.
+// Cycles at 16 MHz, counted on the avr-gcc -Os sequence of the ISR below:
+//   overflow to TCNT2 = remainder on the last iteration   57 (timer ticks lost)
+//   half tick of the remainder (256 - remainder = 2n + 1)   8
+//   overflow to the port write that ends the pulse        74
+//   less TCNT2 = 0 to the port write that starts it      -31
+// 108 cycles, 6.75 us; 7.25 us when the overflow wakes the CPU from idle.
+// With digitalWrite (about 50 cycles to the port write, at both ends, and a
+// longer prologue for the call) the same count gave about 10 us.
+#define DELAY_ADJUST	 7
 
 static servo_t servos[NBR_CHANNELS+1];    // static array holding servo data for all channels
 
 static volatile uint8_t Channel;   // counter holding the channel being pulsed
 static volatile uint8_t ISRCount;  // iteration counter used in the interrupt routines;
+static volatile boolean timingsPending = false; // next* timings waiting for the frame boundary
 uint8_t ChannelCount = 0;	    // counter holding the number of attached channels
 static boolean isStarted = false;  // flag to indicate if the ISR has been initialised
 
 ISR (TIMER2_OVF_vect)
 { 
+  BENCH_ZONE(BENCH_SERVO_ISR);
+  servo_t *s = &servos[Channel];
   ++ISRCount; // increment the overlflow counter
-  if (ISRCount ==  servos[Channel].counter ) // are we on the final iteration for this channel
+  if (ISRCount == s->counter ) // are we on the final iteration for this channel
   {
-	TCNT2 =  servos[Channel].remainder;   // yes, set count for overflow after remainder ticks
+	TCNT2 = s->remainder;   // yes, set count for overflow after remainder ticks
   }  
-  else if(ISRCount >  servos[Channel].counter)  
+  else if(ISRCount > s->counter)  
   {
 	// we have finished timing the channel so pulse it low and move on
-	if(servos[Channel].Pin.isActive == true)	     // check if activated
-	    digitalWrite( servos[Channel].Pin.nbr,LOW); // pulse this channel low if active   
+	if(s->Pin.isActive == true)	     // check if activated
+	    *s->port &= ~s->bitMask;    // pulse this channel low if active (direct port access, no digitalWrite)
 
 	  Channel++;    // increment to the next channel
 	ISRCount = 0; // reset the isr iteration counter 
 	TCNT2 = 0;    // reset the clock counter register
 	if( (Channel != FRAME_SYNC_INDEX) && (Channel <= NBR_CHANNELS) ){	     // check if we need to pulse this channel    
-	    if(servos[Channel].Pin.isActive == true)	   // check if activated
-		 digitalWrite( servos[Channel].Pin.nbr,HIGH); // its an active channel so pulse it high   
+	    s = &servos[Channel];
+	    if(s->Pin.isActive == true)	   // check if activated
+		 *s->port |= s->bitMask;    // its an active channel so pulse it high   
 	}
 	else if(Channel > NBR_CHANNELS){ 
 	   Channel = 0; // all done so start over		   
+	   if(timingsPending){  // frame boundary: no pulse is running, take the new timings
+		 for(uint8_t i=1; i <= NBR_CHANNELS; i++){
+		   servos[i].counter = servos[i].nextCounter;
+		   servos[i].remainder = servos[i].nextRemainder;
+		 }
+		 timingsPending = false;
+	   }
 	} 
    }  
 }
@@ -63,8 +85,12 @@ uint8_t ServoTimer2::attach(int pin)
 	{
 	 //debug("attaching chan = ", chanIndex);
 	 pinMode( pin, OUTPUT) ;  // set servo pin to output
-	 servos[this->chanIndex].Pin.nbr = pin;  
-	 servos[this->chanIndex].Pin.isActive = true;  
+	 ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+	   servos[this->chanIndex].Pin.nbr = pin;  
+	   servos[this->chanIndex].port = portOutputRegister(digitalPinToPort(pin));
+	   servos[this->chanIndex].bitMask = digitalPinToBitMask(pin);
+	   servos[this->chanIndex].Pin.isActive = true;  
+	 }
 	} 
 	return this->chanIndex ;
 }
@@ -83,7 +109,7 @@ int ServoTimer2::read()
 {
   unsigned int pulsewidth;
    if( this->chanIndex > 0)
-	pulsewidth =  servos[this->chanIndex].counter * 128 + ((255 - servos[this->chanIndex].remainder) / 2) + DELAY_ADJUST ;
+	pulsewidth =  servos[this->chanIndex].nextCounter * 128 + ((255 - servos[this->chanIndex].nextRemainder) / 2) + DELAY_ADJUST ;
    else 
 	 pulsewidth  = 0;
    return pulsewidth;   
@@ -104,9 +130,14 @@ static void writeChan(uint8_t chan, int pulsewidth)
 	else if( pulsewidth > MAX_PULSE_WIDTH )
 	    pulsewidth = MAX_PULSE_WIDTH;	 
 	
-	  pulsewidth -=DELAY_ADJUST;			 // subtract the time it takes to process the start and end pulses (mostly from digitalWrite) 
-	servos[chan].counter = pulsewidth / 128;	
-	servos[chan].remainder = 255 - (2 * (pulsewidth - ( servos[chan].counter * 128)));  // the number of 0.5us ticks for timer overflow	   
+	  pulsewidth -=DELAY_ADJUST;			 // subtract the time it takes to process the start and end pulses
+	byte counter = pulsewidth / 128;
+	byte remainder = 255 - (2 * (pulsewidth - ( counter * 128)));  // the number of 0.5us ticks for timer overflow	   
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {  // the ISR must never see half of an update
+	  servos[chan].nextCounter = counter;	
+	  servos[chan].nextRemainder = remainder;
+	  timingsPending = true;
+	}
    }
 }
 
@@ -114,7 +145,10 @@ static void initISR()
 {   
 	for(uint8_t i=1; i <= NBR_CHANNELS; i++) {  // channels start from 1    
 	   writeChan(i, DEFAULT_PULSE_WIDTH);  // store default values	    
+	   servos[i].counter = servos[i].nextCounter;  // the ISR is not running yet: use them right away
+	   servos[i].remainder = servos[i].nextRemainder;
 	}
+	timingsPending = false;
 	servos[FRAME_SYNC_INDEX].counter = FRAME_SYNC_DELAY;   // store the frame sync period	 
 
 	Channel = 0;  // clear the channel index  
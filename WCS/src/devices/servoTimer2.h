@@ -104,10 +104,18 @@ typedef struct {
 
   ServoPin_t Pin;
 
-  byte counter;
+  volatile uint8_t *port;     // output register of the pin, resolved at attach
+
+  uint8_t bitMask;            // bit of the pin in port
+
+  byte counter;               // timings used by the ISR for the current frame
 
   byte remainder;
 
+  byte nextCounter;           // timings written by write(), swapped in at the next frame boundary
+
+  byte nextRemainder;
+
 }  servo_t;
 
 class ServoTimer2
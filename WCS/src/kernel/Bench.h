@@ -0,0 +1,43 @@
+#ifndef __BENCH__
+#define __BENCH__
+
+/**
+ * Cycle benchmark zones (see WCS/bench)
+ * In the PlatformIO "bench" environment (-DWCS_BENCH) BENCH_ZONE(id) writes
+ * id to GPIOR0 when the enclosing scope is entered and id | BENCH_END when
+ * it is left; the simavr harness timestamps these writes. Each marker costs
+ * two cycles. In normal builds BENCH_ZONE compiles to nothing.
+ * The host harness includes this header too, for the zone table.
+ */
+
+#define BENCH_ZONES(X) \
+  X(BENCH_WCS_TICK,        1, "wcs_tick")        \
+  X(BENCH_RECEIVE_MESSAGE, 2, "receive_message") \
+  X(BENCH_MESSAGE_LOOKUP,  3, "message_lookup")  \
+  X(BENCH_SERVO_ISR,       4, "servo_isr")       \
+  X(BENCH_LCD_UPDATE,      5, "lcd_update")        \
+  X(BENCH_COMMAND,         6, "command_dispatch")
+
+#define BENCH_END 0x80
+
+#define X(id, value, name) id = value,
+enum BenchZoneId { BENCH_ZONES(X) };
+#undef X
+
+#if defined(WCS_BENCH) && defined(__cplusplus)
+#include <avr/io.h>
+
+class BenchScope {
+public:
+  explicit BenchScope(uint8_t zone) : zone(zone) { GPIOR0 = zone; }
+  ~BenchScope() { GPIOR0 = zone | BENCH_END; }
+private:
+  uint8_t zone;
+};
+
+#define BENCH_ZONE(id) BenchScope benchScope_(id)
+#else
+#define BENCH_ZONE(id)
+#endif
+
+#endif
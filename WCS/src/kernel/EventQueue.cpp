@@ -0,0 +1,52 @@
+#include "EventQueue.h"
+#include <util/atomic.h>
+
+EventQueue eventQueue;
+
+EventQueue::EventQueue() : head(0), count(0), queuedTypes(0), coalesced(0) {}
+
+bool EventQueue::post(uint8_t type, uint8_t arg){
+  uint8_t mask = 1 << type;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    if (queuedTypes & mask){
+      coalesced++;
+      return false;
+    }
+    volatile Event& e = items[(head + count) % QUEUE_SIZE];
+    e.type = type;
+    e.arg = arg;
+    count++;
+    queuedTypes |= mask;
+  }
+  return true;
+}
+
+bool EventQueue::pop(Event& event){
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    if (count == 0){
+      return false;
+    }
+    event.type = items[head].type;
+    event.arg = items[head].arg;
+    head = (head + 1) % QUEUE_SIZE;
+    count--;
+    queuedTypes &= ~(1 << event.type);
+  }
+  return true;
+}
+
+bool EventQueue::isEmpty() const {
+  return count == 0;
+}
+
+uint8_t EventQueue::size() const {
+  return count;
+}
+
+unsigned int EventQueue::getCoalesced() const {
+  unsigned int n;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    n = coalesced;
+  }
+  return n;
+}
@@ -0,0 +1,57 @@
+#ifndef __EVENT_QUEUE__
+#define __EVENT_QUEUE__
+
+#include <stdint.h>
+
+/**
+ * Event sources dispatched by the scheduler (see Task::handleEvent)
+ */
+enum EventType : uint8_t {
+  EVENT_SERIAL_RX,   // bytes waiting in the UART receive buffer
+  EVENT_BUTTON,      // debounced button edge queued by the pin change ISR
+  EVENT_POT,         // filtered potentiometer reading changed (ADC ISR)
+  EVENT_TYPES
+};
+
+struct Event {
+  uint8_t type;
+  uint8_t arg;
+};
+
+/**
+ * Queue of events posted by interrupt handlers (or the main loop) and
+ * drained by the scheduler. An event type is queued at most once: a
+ * handler reads the current state of its source, so a second post before
+ * dispatch carries no information. The queue therefore never overflows.
+ */
+class EventQueue {
+public:
+  EventQueue();
+
+  /* safe to call from an ISR; false if an event of this type is already queued */
+  bool post(uint8_t type, uint8_t arg = 0);
+
+  /* remove the oldest event, false if the queue is empty */
+  bool pop(Event& event);
+
+  bool isEmpty() const;
+
+  /* events queued */
+  uint8_t size() const;
+
+  /* posts merged into an event already queued */
+  unsigned int getCoalesced() const;
+
+private:
+  static const uint8_t QUEUE_SIZE = EVENT_TYPES;
+
+  volatile Event items[QUEUE_SIZE];
+  volatile uint8_t head;
+  volatile uint8_t count;
+  volatile uint8_t queuedTypes;   // bit n set while an event of type n is queued
+  volatile unsigned int coalesced;
+};
+
+extern EventQueue eventQueue;
+
+#endif
@@ -0,0 +1,94 @@
+#include "FrameCodec.h"
+
+uint16_t FrameCodec::crc16(const uint8_t* data, uint8_t len) {
+    uint16_t crc = 0xFFFF;
+    for (uint8_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+uint8_t FrameCodec::cobsEncode(const uint8_t* src, uint8_t len, uint8_t* dst) {
+    uint8_t codeIdx = 0;
+    uint8_t code = 1;
+    uint8_t out = 1;
+
+    for (uint8_t i = 0; i < len; i++) {
+        if (src[i] == 0) {
+            dst[codeIdx] = code;
+            codeIdx = out++;
+            code = 1;
+        } else {
+            dst[out++] = src[i];
+            code++;
+        }
+    }
+    dst[codeIdx] = code;
+    return out;
+}
+
+uint8_t FrameCodec::cobsDecode(const uint8_t* src, uint8_t len, uint8_t* dst) {
+    uint8_t in = 0;
+    uint8_t out = 0;
+
+    while (in < len) {
+        uint8_t code = src[in++];
+        if (code == 0 || in + code - 1 > len) {
+            return 0;
+        }
+        for (uint8_t i = 1; i < code; i++) {
+            dst[out++] = src[in++];
+        }
+        if (in < len) {
+            dst[out++] = 0;
+        }
+    }
+    return out;
+}
+
+uint8_t FrameCodec::encode(uint8_t opcode, const uint8_t* payload, uint8_t len, uint8_t* out) {
+    if (len > MAX_PAYLOAD) {
+        return 0;
+    }
+
+    uint8_t raw[MAX_RAW];
+    raw[0] = opcode;
+    for (uint8_t i = 0; i < len; i++) {
+        raw[1 + i] = payload[i];
+    }
+    uint16_t crc = crc16(raw, len + 1);
+    raw[len + 1] = crc >> 8;
+    raw[len + 2] = crc & 0xFF;
+
+    uint8_t n = cobsEncode(raw, len + 3, out);
+    out[n++] = 0;
+    return n;
+}
+
+bool FrameCodec::decode(const uint8_t* wire, uint8_t len,
+                        uint8_t& opcode, uint8_t* payload, uint8_t& payloadLen) {
+    if (len < 2 || len > MAX_WIRE - 1) {
+        return false;
+    }
+
+    uint8_t raw[MAX_WIRE];
+    uint8_t n = cobsDecode(wire, len, raw);
+    if (n < 3) {
+        return false;
+    }
+
+    uint16_t crc = ((uint16_t)raw[n - 2] << 8) | raw[n - 1];
+    if (crc16(raw, n - 2) != crc) {
+        return false;
+    }
+
+    opcode = raw[0];
+    payloadLen = n - 3;
+    for (uint8_t i = 0; i < payloadLen; i++) {
+        payload[i] = raw[1 + i];
+    }
+    return true;
+}
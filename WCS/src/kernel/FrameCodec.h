@@ -0,0 +1,42 @@
+#ifndef __FRAME_CODEC__
+#define __FRAME_CODEC__
+
+#include <stdint.h>
+
+/**
+ * Reference codec for the binary serial protocol
+ * A frame is opcode + payload + CRC-16/CCITT (big endian), COBS encoded
+ * and terminated by a single 0x00 byte.
+ */
+class FrameCodec {
+public:
+    // Largest payload carried by a frame. Keeping frames this short means the
+    // COBS code byte is always < 10, so it never looks like '{' or '\n'.
+    static const uint8_t MAX_PAYLOAD = 5;
+    static const uint8_t MAX_RAW = MAX_PAYLOAD + 3;   // opcode + payload + crc
+    static const uint8_t MAX_WIRE = MAX_RAW + 2;      // COBS overhead + delimiter
+
+    /**
+     * CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF)
+     */
+    static uint16_t crc16(const uint8_t* data, uint8_t len);
+
+    /**
+     * Encode a frame into out (at least MAX_WIRE bytes)
+     * Returns the number of bytes to send, delimiter included, 0 on error
+     */
+    static uint8_t encode(uint8_t opcode, const uint8_t* payload, uint8_t len, uint8_t* out);
+
+    /**
+     * Decode the bytes received before a delimiter (delimiter excluded)
+     * Returns false on COBS, length or CRC errors
+     */
+    static bool decode(const uint8_t* wire, uint8_t len,
+                       uint8_t& opcode, uint8_t* payload, uint8_t& payloadLen);
+
+private:
+    static uint8_t cobsEncode(const uint8_t* src, uint8_t len, uint8_t* dst);
+    static uint8_t cobsDecode(const uint8_t* src, uint8_t len, uint8_t* dst);
+};
+
+#endif
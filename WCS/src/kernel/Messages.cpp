@@ -0,0 +1,75 @@
+#include "Messages.h"
+#include "PerfectHash.h"
+#include "Bench.h"
+#include <avr/pgmspace.h>
+
+// Compile-time copies of the tables, only used to build the hash
+#define X(id, name) name,
+constexpr const char* const MESSAGE_NAMES[] = { WCS_MESSAGE_TABLE(X) };
+constexpr const char* const MODE_NAMES[] = { WCS_MODE_TABLE(X) };
+#undef X
+
+// Mode codes index the mode table
+#define X(id, name) MODE_POS_##id,
+enum { WCS_MODE_TABLE(X) };
+#undef X
+#define X(id, name) static_assert(id == MODE_POS_##id, "mode codes must follow WCS_MODE_TABLE");
+WCS_MODE_TABLE(X)
+#undef X
+
+static const uint8_t MESSAGE_BITS = 3;   // 8 slots
+static const uint8_t MODE_BITS = 2;      // 4 slots
+constexpr uint8_t MESSAGE_MULT = PerfectHash::findMultiplier(MESSAGE_NAMES, MESSAGE_BITS);
+constexpr uint8_t MODE_MULT = PerfectHash::findMultiplier(MODE_NAMES, MODE_BITS);
+static_assert(MESSAGE_MULT != 0, "no perfect hash for WCS_MESSAGE_TABLE, add a slot bit");
+static_assert(MODE_MULT != 0, "no perfect hash for WCS_MODE_TABLE, add a slot bit");
+
+// Slot -> table index (table size if empty)
+#define MSG_SLOT(s) PerfectHash::owner(MESSAGE_NAMES, MESSAGE_MULT, MESSAGE_BITS, s)
+#define MODE_SLOT(s) PerfectHash::owner(MODE_NAMES, MODE_MULT, MODE_BITS, s)
+static const uint8_t messageSlots[1 << MESSAGE_BITS] PROGMEM = {
+  MSG_SLOT(0), MSG_SLOT(1), MSG_SLOT(2), MSG_SLOT(3),
+  MSG_SLOT(4), MSG_SLOT(5), MSG_SLOT(6), MSG_SLOT(7)
+};
+static const uint8_t modeSlots[1 << MODE_BITS] PROGMEM = {
+  MODE_SLOT(0), MODE_SLOT(1), MODE_SLOT(2), MODE_SLOT(3)
+};
+#undef MSG_SLOT
+#undef MODE_SLOT
+
+// Names kept at runtime, in flash only
+#define X(id, name) static const char name_##id[] PROGMEM = name;
+WCS_MESSAGE_TABLE(X)
+WCS_MODE_TABLE(X)
+#undef X
+
+#define X(id, name) name_##id,
+static const char* const messageNames[] PROGMEM = { WCS_MESSAGE_TABLE(X) };
+static const char* const modeNames[] PROGMEM = { WCS_MODE_TABLE(X) };
+#undef X
+
+static uint8_t lookup(const char* name, uint8_t mult, uint8_t bits,
+                      const uint8_t* slots, const char* const* names, uint8_t count){
+  uint8_t i = pgm_read_byte(&slots[PerfectHash::slot(name, mult, bits)]);
+  if (i < count && strcmp_P(name, (const char*)pgm_read_word(&names[i])) == 0){
+    return i;
+  }
+  return count;
+}
+
+uint8_t messageType(const char* name){
+  BENCH_ZONE(BENCH_MESSAGE_LOOKUP);
+  return lookup(name, MESSAGE_MULT, MESSAGE_BITS, messageSlots, messageNames, MSG_TYPES);
+}
+
+uint8_t modeCode(const char* name){
+  uint8_t code = lookup(name, MODE_MULT, MODE_BITS, modeSlots, modeNames, MODE_COUNT);
+  return code < MODE_COUNT ? code : MODE_CODE_UNKNOWN;
+}
+
+const __FlashStringHelper* modeName(uint8_t code){
+  if (code >= MODE_COUNT){
+    return F("UNKNOWN");
+  }
+  return (const __FlashStringHelper*)pgm_read_word(&modeNames[code]);
+}
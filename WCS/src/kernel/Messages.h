@@ -0,0 +1,64 @@
+#ifndef __MESSAGES__
+#define __MESSAGES__
+
+#include <Arduino.h>
+#include "Protocol.h"
+
+/**
+ * Message types and mode names, each defined once in the tables below
+ * Names are perfect-hashed at compile time (see PerfectHash.h) and kept in
+ * PROGMEM: mapping a received name to its enum costs one hash, one flash
+ * read and one strcmp_P, and no RAM.
+ */
+
+// Commands handled by WCSTask first, then link control handled by SerialComm
+#define WCS_MESSAGE_TABLE(X) \
+  X(MSG_VALVE,   "valve")    \
+  X(MSG_DISPLAY, "display")  \
+  X(MSG_HELLO,   "hello")    \
+  X(MSG_RATES,   "rates")    \
+  X(MSG_PROBE,   "probe")    \
+  X(MSG_PONG,    "pong")     \
+  X(MSG_TRACE,   "trace")
+
+// Mode codes (Protocol.h) in table order
+#define WCS_MODE_TABLE(X) \
+  X(MODE_CODE_AUTOMATIC,   "AUTOMATIC")   \
+  X(MODE_CODE_MANUAL,      "MANUAL")      \
+  X(MODE_CODE_UNCONNECTED, "UNCONNECTED")
+
+enum MessageType : uint8_t {
+#define X(id, name) id,
+  WCS_MESSAGE_TABLE(X)
+#undef X
+  MSG_TYPES,
+  MSG_UNKNOWN = MSG_TYPES,
+  MSG_COMMANDS = MSG_HELLO     // MSG_VALVE and MSG_DISPLAY
+};
+
+#define X(id, name) + 1
+static const uint8_t MODE_COUNT = 0 WCS_MODE_TABLE(X);
+#undef X
+
+#define MODE_CODE_UNKNOWN 0xFF
+
+/**
+ * A command from the CUS, as decoded from a binary frame or JSON
+ */
+struct Command {
+  uint8_t type;    // MSG_VALVE or MSG_DISPLAY
+  uint8_t seq;     // SEQ_NONE for unsequenced JSON commands
+  uint8_t mode;    // display: MODE_CODE_*, MODE_CODE_UNKNOWN if not recognised
+  int valve;       // percentage, -1 if absent (display keeps the position)
+};
+
+/* MSG_UNKNOWN if the name is not in the table */
+uint8_t messageType(const char* name);
+
+/* MODE_CODE_UNKNOWN if the name is not in the table */
+uint8_t modeCode(const char* name);
+
+/* name of a mode code, in flash; "UNKNOWN" outside the table */
+const __FlashStringHelper* modeName(uint8_t code);
+
+#endif
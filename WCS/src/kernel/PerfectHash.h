@@ -0,0 +1,49 @@
+#ifndef __PERFECT_HASH__
+#define __PERFECT_HASH__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Compile-time perfect hashing of small string tables
+ * hash() is x = (x ^ c) * m over the characters (8 bit), the slot is its
+ * top `bits` bits. findMultiplier() searches the odd multipliers for one
+ * that gives every name of a table its own slot, so a lookup costs one
+ * hash, one slot table read and one string compare.
+ */
+namespace PerfectHash {
+
+constexpr uint8_t hash(const char* s, uint8_t m, uint8_t x = 0) {
+  return *s ? hash(s + 1, m, (uint8_t)((x ^ (uint8_t)*s) * m)) : x;
+}
+
+constexpr uint8_t slot(const char* s, uint8_t m, uint8_t bits) {
+  return hash(s, m) >> (8 - bits);
+}
+
+/* true if names[i] shares its slot with none of names[j..N) */
+template <size_t N>
+constexpr bool uniqueFrom(const char* const (&names)[N], uint8_t m, uint8_t bits, size_t i, size_t j) {
+  return j >= N || (slot(names[i], m, bits) != slot(names[j], m, bits) && uniqueFrom(names, m, bits, i, j + 1));
+}
+
+template <size_t N>
+constexpr bool isPerfect(const char* const (&names)[N], uint8_t m, uint8_t bits, size_t i = 0) {
+  return i >= N || (uniqueFrom(names, m, bits, i, i + 1) && isPerfect(names, m, bits, i + 1));
+}
+
+/* first odd multiplier that hashes the table without collisions, 0 if none */
+template <size_t N>
+constexpr uint8_t findMultiplier(const char* const (&names)[N], uint8_t bits, unsigned int m = 1) {
+  return m > 255 ? 0 : isPerfect(names, (uint8_t)m, bits) ? (uint8_t)m : findMultiplier(names, bits, m + 2);
+}
+
+/* index of the name hashed to slot s, N if the slot is empty */
+template <size_t N>
+constexpr uint8_t owner(const char* const (&names)[N], uint8_t m, uint8_t bits, uint8_t s, size_t i = 0) {
+  return i >= N ? N : slot(names[i], m, bits) == s ? i : owner(names, m, bits, s, i + 1);
+}
+
+}
+
+#endif
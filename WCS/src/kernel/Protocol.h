@@ -0,0 +1,38 @@
+#ifndef __PROTOCOL__
+#define __PROTOCOL__
+
+/**
+ * Binary serial protocol shared with the CUS (see CUS/src/frame_codec.py)
+ * Wire format: COBS(opcode | payload | crc16) followed by a 0x00 delimiter
+ */
+
+// Value of the JSON "hello" message announcing binary protocol v2
+// (v2: sequenced commands acknowledged with OP_ACK / OP_NACK)
+#define PROTO_HELLO_BINARY "bin2"
+
+// Commands carry a sequence number 1..255 (wrapping, 0 is skipped).
+// SEQ_NONE marks an unsequenced JSON command, applied without duplicate check.
+#define SEQ_NONE 0
+
+// ===== Opcodes: CUS -> WCS =====
+#define OP_VALVE            0x01   // [seq, percentage]
+#define OP_DISPLAY          0x02   // [seq, mode code, percentage]
+#define OP_PONG             0x03   // [] answer to OP_PING
+
+// ===== Opcodes: WCS -> CUS =====
+#define OP_MODE             0x11   // [mode code]
+#define OP_VALVE_REPORT     0x12   // [percentage]
+#define OP_PING             0x14   // [] link liveness check
+#define OP_ACK              0x15   // [seq, mode code, percentage] cumulative
+#define OP_NACK             0x16   // [seq, reason]
+
+// ===== Mode codes (same values as the JSON "mode" report) =====
+#define MODE_CODE_AUTOMATIC   0
+#define MODE_CODE_MANUAL      1
+#define MODE_CODE_UNCONNECTED 2
+
+// ===== NACK reasons =====
+#define NACK_RANGE 0x01   // valve percentage out of range
+#define NACK_MODE  0x02   // unknown mode
+
+#endif
@@ -1,33 +1,167 @@
 #include "SerialComm.h"
+#include "Protocol.h"
+#include "config.h"
+#include "Bench.h"
+#include "ZoneTrace.h"
 
-SerialComm::SerialComm() : inputBuffer("") {}
+SerialComm::SerialComm()
+    : inputBuffer(""), jsonOpen(false), frameLen(0), frameOverflow(false),
+      frameHead(0), frameCount(0), binaryMode(false), frameErrors(0), lastSeq(SEQ_NONE), seqValid(false), lastRxTime(0),
+      txLen(0), txPos(0),
+      baudRate(SERIAL_BAUD), rateProbePending(false), rateSwitchTime(0), traceRequested(false) {}
+
+static const unsigned long supportedRates[] = SERIAL_SUPPORTED_RATES;
 
 void SerialComm::init(unsigned long baudRate) {
+    this->baudRate = baudRate;
     Serial.begin(baudRate);
     inputBuffer.reserve(JSON_BUFFER_SIZE);
+    lastRxTime = millis();
 }
 
 void SerialComm::update() {
-    while (Serial.available() > 0) {
-        char c = (char)Serial.read();
-        
-        if (inputBuffer.length() == 0 && (c == '\n' || c == '\r' || c == '\t' || c == ' ')) {
-            continue;
+    if (rateProbePending && millis() - rateSwitchTime >= SERIAL_RATE_PROBE_TIMEOUT) {
+        // The CUS never confirmed the new rate: both sides fall back
+        rateProbePending = false;
+        switchRate(SERIAL_BAUD);
+    }
+
+    // Leave bytes in the UART buffer rather than dropping decoded frames
+    while (Serial.available() > 0 && frameCount < FRAME_QUEUE_SIZE) {
+        processByte((char)Serial.read());
+    }
+
+    pumpTx();
+
+#ifdef ZONE_TRACE
+    // Plain text, so only when asked for and with nothing else on the link.
+    // The closing delimiter makes a listening CUS drop it as a broken frame
+    if (traceRequested && ZoneTrace::isDumpPending() && txQueue.isEmpty() && txPos == txLen &&
+        Serial.available() == 0 && frameLen == 0 && frameCount == 0 && !jsonOpen &&
+        inputBuffer.length() == 0 && millis() - lastRxTime >= ZONE_TRACE_IDLE_TIME) {
+        traceRequested = false;
+        ZoneTrace::flush(Serial);
+        Serial.write((uint8_t)0);
+    }
+#endif
+}
+
+void SerialComm::processByte(char c) {
+    if (jsonOpen) {
+        if (c == 0) {
+            // JSON never contains a frame delimiter: the '{' was a corrupted
+            // frame byte. Drop the open object (it follows the last complete
+            // one) and start a frame here.
+            int keep = 0;
+            for (int i = inputBuffer.indexOf('}'); i >= 0; i = inputBuffer.indexOf('}', i + 1)) {
+                keep = i + 1;
+            }
+            inputBuffer = inputBuffer.substring(0, keep);
+            jsonOpen = false;
+            frameErrors++;
+            frameLen = 0;
+            frameOverflow = false;
+            return;
         }
-            
         inputBuffer += c;
-        
+        if (c == '}') {
+            jsonOpen = false;
+        }
         if (inputBuffer.length() >= JSON_BUFFER_SIZE) {
-            inputBuffer = "";  
+            inputBuffer = "";
+            jsonOpen = false;
+        }
+        return;
+    }
+
+    if (c == 0) {
+        if (frameLen > 0 || frameOverflow) {
+            completeFrame();
         }
+        return;
+    }
+
+    if (frameOverflow && c == '\n') {
+        // A JSON line whose '{' was corrupted: without this a JSON-only CUS,
+        // which never sends 0x00, would not be heard again
+        frameErrors++;
+        frameOverflow = false;
+        return;
+    }
+
+    if (frameLen == 0 && !frameOverflow) {
+        // Between messages: '{' opens a JSON object, line endings are skipped,
+        // anything else is the COBS code byte of a binary frame
+        if (c == '{') {
+            jsonOpen = true;
+            inputBuffer += c;
+            return;
+        }
+        if (c == '\n' || c == '\r' || c == ' ') {
+            return;
+        }
+    }
+
+    if (frameLen < FrameCodec::MAX_WIRE) {
+        frameBuffer[frameLen++] = (uint8_t)c;
+    } else {
+        // Too long to be a valid frame: discard up to the next delimiter
+        frameLen = 0;
+        frameOverflow = true;
     }
 }
 
+void SerialComm::completeFrame() {
+    if (frameOverflow || frameCount >= FRAME_QUEUE_SIZE) {
+        frameErrors++;
+    } else {
+        Frame& f = frameQueue[(frameHead + frameCount) % FRAME_QUEUE_SIZE];
+        if (FrameCodec::decode(frameBuffer, frameLen, f.opcode, f.payload, f.len)) {
+            lastRxTime = millis();
+            frameCount++;
+        } else {
+            frameErrors++;
+        }
+    }
+    frameLen = 0;
+    frameOverflow = false;
+}
+
 bool SerialComm::messageAvailable() {
-    return inputBuffer.length() > 0 && inputBuffer.indexOf('}') >= 0;
+    return frameCount > 0 || (inputBuffer.length() > 0 && inputBuffer.indexOf('}') >= 0);
+}
+
+bool SerialComm::receiveMessage(Command& cmd) {
+    BENCH_ZONE(BENCH_RECEIVE_MESSAGE);
+    TRACE_SCOPE("receive_message");
+    if (frameCount > 0) {
+        return receiveFrame(cmd);
+    }
+    return receiveJson(cmd);
+}
+
+bool SerialComm::receiveFrame(Command& cmd) {
+    Frame& f = frameQueue[frameHead];
+    frameHead = (frameHead + 1) % FRAME_QUEUE_SIZE;
+    frameCount--;
+
+    if (f.opcode == OP_VALVE && f.len >= 2) {
+        cmd.type = MSG_VALVE;
+        cmd.seq = f.payload[0];
+        cmd.valve = f.payload[1];
+        return true;
+    }
+    if (f.opcode == OP_DISPLAY && f.len >= 3) {
+        cmd.type = MSG_DISPLAY;
+        cmd.seq = f.payload[0];
+        cmd.mode = f.payload[1] < MODE_COUNT ? f.payload[1] : MODE_CODE_UNKNOWN;
+        cmd.valve = f.payload[2];
+        return true;
+    }
+    return false;
 }
 
-bool SerialComm::receiveMessage(String& type, String& value) {
+bool SerialComm::receiveJson(Command& cmd) {
     if (!messageAvailable()) {
         return false;
     }
@@ -45,48 +179,279 @@ bool SerialComm::receiveMessage(String& type, String& value) {
         return false;
     }
     
-    if (doc["type"].isNull()) {
-        inputBuffer = inputBuffer.substring(endIdx + 1);
-        return false;
-    }
-    
-    type = doc["type"].as<String>();
-    
-    if (!doc["mode"].isNull() && !doc["valve"].isNull()) {
-        value = doc["mode"].as<String>() + "|" + doc["valve"].as<String>();
-    } else if (!doc["value"].isNull()) {
-        value = doc["value"].as<String>();
-    } else if (!doc["mode"].isNull()) {
-        value = doc["mode"].as<String>();
-    } else if (!doc["valve"].isNull()) {
-        value = doc["valve"].as<String>();
-    } else {
-        value = "";
-    }
+    lastRxTime = millis();
     
     inputBuffer = inputBuffer.substring(endIdx + 1);
     
     inputBuffer.trim();
     
-    return true;
+    cmd.type = messageType(doc["type"] | "");
+    cmd.seq = doc["seq"] | SEQ_NONE;
+    
+    switch (cmd.type) {
+        case MSG_VALVE:
+            cmd.valve = doc["value"] | (doc["valve"] | -1);
+            return true;
+            
+        case MSG_DISPLAY:
+            cmd.mode = modeCode(doc["mode"] | (doc["value"] | ""));
+            cmd.valve = doc["valve"] | -1;
+            return true;
+            
+        case MSG_HELLO:
+            handleHello(doc["value"] | "");
+            return false;
+            
+        case MSG_RATES:
+            handleRates(doc["value"] | "");
+            return false;
+            
+        case MSG_PROBE:
+            rateProbePending = false;
+            sendReply("probe", (long)baudRate);
+            return false;
+
+        case MSG_TRACE:
+#ifdef ZONE_TRACE
+            // Freezes the ring unless an overrun already did; update()
+            // prints it once the link is idle
+            ZoneTrace::requestDump(PSTR("request"));
+            traceRequested = true;
+#endif
+            return false;
+            
+        default:
+            // MSG_PONG only refreshes lastRxTime; unknown types are ignored
+            return false;
+    }
 }
 
-void SerialComm::sendMessage(const String& type, int value) {
+void SerialComm::handleHello(const char* value) {
+    // The hello reply is always JSON so that a CUS without binary support
+    // (or a restarted one) can still read it
+    bool binary = SERIAL_BINARY_ENABLED && strcmp(value, PROTO_HELLO_BINARY) == 0;
+    binaryMode = false;
+    seqValid = false;
+    sendReply("hello", binary ? PROTO_HELLO_BINARY : "json");
+    binaryMode = binary;
+}
+
+void SerialComm::handleRates(const char* value) {
+    unsigned long rate = chooseRate(value);
+
+    // The reply goes out at the old rate, everything after it at the new one
+    sendReply("rate", (long)rate);
+    if (rate != baudRate) {
+        switchRate(rate);
+        rateProbePending = true;
+        rateSwitchTime = millis();
+    }
+}
+
+void SerialComm::switchRate(unsigned long rate) {
+    finishTx();
+    Serial.flush();
+    Serial.end();
+    Serial.begin(rate);
+    baudRate = rate;
+
+    inputBuffer = "";
+    jsonOpen = false;
+    frameLen = 0;
+    frameOverflow = false;
+}
+
+unsigned long SerialComm::chooseRate(const char* offered) {
+    unsigned long best = SERIAL_BAUD;
+
+    while (*offered) {
+        char* end;
+        unsigned long rate = strtoul(offered, &end, 10);
+        if (end == offered) {
+            // Separator
+            offered++;
+            continue;
+        }
+        for (uint8_t i = 0; i < sizeof(supportedRates) / sizeof(supportedRates[0]); i++) {
+            if (supportedRates[i] == rate && rate > best) {
+                best = rate;
+            }
+        }
+        offered = end;
+    }
+    return best;
+}
+
+void SerialComm::pumpTx() {
+    while (true) {
+        if (txPos == txLen) {
+            TxQueue::Message msg;
+            if (!txQueue.pop(msg)) {
+                return;
+            }
+            txLen = encodeMessage(msg);
+            txPos = 0;
+        }
+
+        int room = Serial.availableForWrite();
+        if (room <= 0) {
+            return;
+        }
+        uint8_t n = txLen - txPos;
+        if (n > room) {
+            n = room;
+        }
+        Serial.write(txBuffer + txPos, n);
+        txPos += n;
+    }
+}
+
+void SerialComm::finishTx() {
+    // Direct writes must not split a queued message already half sent
+    if (txPos < txLen) {
+        Serial.write(txBuffer + txPos, txLen - txPos);
+    }
+    txPos = txLen = 0;
+}
+
+uint8_t SerialComm::encodeMessage(const TxQueue::Message& msg) {
+    if (binaryMode) {
+        uint8_t payload[3] = { msg.seq, msg.value, msg.value2 };
+        switch (msg.kind) {
+            case TxQueue::MODE:
+                return FrameCodec::encode(OP_MODE, &msg.value, 1, txBuffer);
+            case TxQueue::VALVE:
+                return FrameCodec::encode(OP_VALVE_REPORT, &msg.value, 1, txBuffer);
+            case TxQueue::PING:
+                return FrameCodec::encode(OP_PING, payload, 0, txBuffer);
+            case TxQueue::ACK:
+                return FrameCodec::encode(OP_ACK, payload, 3, txBuffer);
+            default:
+                return FrameCodec::encode(OP_NACK, payload, 2, txBuffer);
+        }
+    }
+
+    TRACE_SCOPE("json_encode");
+    JsonDocument doc;
+    switch (msg.kind) {
+        case TxQueue::MODE:
+            doc["type"] = "mode";
+            doc["value"] = msg.value;
+            break;
+        case TxQueue::VALVE:
+            doc["type"] = "valve";
+            doc["value"] = msg.value;
+            break;
+        case TxQueue::PING:
+            doc["type"] = "ping";
+            break;
+        case TxQueue::ACK:
+            doc["type"] = "ack";
+            doc["seq"] = msg.seq;
+            doc["mode"] = msg.value;
+            doc["valve"] = msg.value2;
+            break;
+        default:
+            doc["type"] = "nack";
+            doc["seq"] = msg.seq;
+            doc["value"] = msg.value;
+            break;
+    }
+
+    size_t n = serializeJson(doc, (char*)txBuffer, TX_BUFFER_SIZE - 2);
+    txBuffer[n++] = '\r';
+    txBuffer[n++] = '\n';
+    return n;
+}
+
+void SerialComm::sendMode(uint8_t mode) {
+    txQueue.push(TxQueue::MODE, SEQ_NONE, mode);
+    pumpTx();
+}
+
+void SerialComm::sendValve(uint8_t valve) {
+    txQueue.push(TxQueue::VALVE, SEQ_NONE, valve);
+    pumpTx();
+}
+
+// Handshake replies bypass the queue: they must leave before a rate switch
+void SerialComm::sendReply(const char* type, long value) {
+    finishTx();
+    TRACE_SCOPE("json_send");
     JsonDocument doc;
     doc["type"] = type;
     doc["value"] = value;
     
     serializeJson(doc, Serial);
     Serial.println(); 
-    Serial.flush();
 }
 
-void SerialComm::sendMessage(const String& type, const String& value) {
+void SerialComm::sendReply(const char* type, const char* value) {
+    finishTx();
+    TRACE_SCOPE("json_send");
     JsonDocument doc;
     doc["type"] = type;
     doc["value"] = value;
     
     serializeJson(doc, Serial);
     Serial.println(); 
-    Serial.flush();
+}
+
+void SerialComm::sendAck(uint8_t seq, uint8_t mode, uint8_t valve) {
+    txQueue.push(TxQueue::ACK, seq, mode, valve);
+    pumpTx();
+}
+
+void SerialComm::sendNack(uint8_t seq, uint8_t reason) {
+    txQueue.push(TxQueue::NACK, seq, reason);
+    pumpTx();
+}
+
+bool SerialComm::acceptSeq(uint8_t seq) {
+    // Newer means 1..127 ahead of the last one, so wrapping is fine
+    uint8_t ahead = seq - lastSeq;
+    if (seqValid && (ahead == 0 || ahead >= 128)) {
+        return false;
+    }
+    lastSeq = seq;
+    seqValid = true;
+    return true;
+}
+
+uint8_t SerialComm::getLastSeq() const {
+    return lastSeq;
+}
+
+void SerialComm::sendPing() {
+    txQueue.push(TxQueue::PING, SEQ_NONE, 0);
+    pumpTx();
+}
+
+unsigned long SerialComm::getLastRxTime() const {
+    return lastRxTime;
+}
+
+void SerialComm::onLinkLost() {
+    rateProbePending = false;
+    // A CUS that restarted meanwhile counts from 1 again
+    seqValid = false;
+    if (baudRate != SERIAL_BAUD) {
+        switchRate(SERIAL_BAUD);
+    }
+}
+
+const TxQueue& SerialComm::getTxQueue() const {
+    return txQueue;
+}
+
+unsigned long SerialComm::getBaudRate() const {
+    return baudRate;
+}
+
+bool SerialComm::isBinaryMode() const {
+    return binaryMode;
+}
+
+unsigned int SerialComm::getFrameErrors() const {
+    return frameErrors;
 }
@@ -3,16 +3,89 @@
 
 #include <Arduino.h>
 #include <ArduinoJson.h>
+#include "FrameCodec.h"
+#include "TxQueue.h"
+#include "Messages.h"
 
 /**
  * Serial Communication Handler
- * Manages JSON-based communication with CUS via Serial
+ * Manages communication with CUS via Serial.
+ * JSON is always accepted; the compact binary framing (see Protocol.h)
+ * is used for outgoing messages once the CUS negotiates it with "hello".
+ *
+ * Link-rate negotiation (all JSON, starting at SERIAL_BAUD):
+ *   CUS -> {"type":"rates","value":"9600,57600,..."}
+ *   WCS -> {"type":"rate","value":57600}, then switches to that rate
+ *   CUS -> {"type":"probe"} at the new rate
+ *   WCS -> {"type":"probe","value":57600}
+ * Without a probe within SERIAL_RATE_PROBE_TIMEOUT the WCS returns to SERIAL_BAUD.
+ * The probe only proves that the CUS reached the new rate, not that it got
+ * the reply, so the WCS also returns to SERIAL_BAUD when the link is lost
+ * (onLinkLost()): a CUS that fell back or restarted is heard again.
+ *
+ * Commands carry sequence numbers (see Protocol.h): acceptSeq() tells new
+ * commands from retransmissions, sendAck() / sendNack() answer them. The
+ * sequence restarts with every "hello" and after a link loss.
+ *
+ * Link liveness: any valid frame or JSON message refreshes getLastRxTime();
+ * sendPing() asks the CUS for a "pong" when the link has been quiet.
+ *
+ * Mode, valve and status reports never block: they go through a TxQueue
+ * and are copied into the UART buffer only as space frees up, leaving the
+ * UART TX interrupt to send them.
  */
 class SerialComm {
 private:
     static const size_t JSON_BUFFER_SIZE = 256;
+    static const uint8_t FRAME_QUEUE_SIZE = 4;
+    static const uint8_t TX_BUFFER_SIZE = 64;
+
+    struct Frame {
+        uint8_t opcode;
+        uint8_t payload[FrameCodec::MAX_PAYLOAD];
+        uint8_t len;
+    };
+
     String inputBuffer;
-    
+    bool jsonOpen;
+
+    uint8_t frameBuffer[FrameCodec::MAX_WIRE];
+    uint8_t frameLen;
+    bool frameOverflow;
+
+    Frame frameQueue[FRAME_QUEUE_SIZE];
+    uint8_t frameHead;
+    uint8_t frameCount;
+
+    bool binaryMode;
+    unsigned int frameErrors;
+    uint8_t lastSeq;
+    bool seqValid;
+    unsigned long lastRxTime;
+
+    TxQueue txQueue;
+    uint8_t txBuffer[TX_BUFFER_SIZE];   // message being copied to the UART
+    uint8_t txLen;
+    uint8_t txPos;
+
+    unsigned long baudRate;
+    bool rateProbePending;
+    unsigned long rateSwitchTime;
+    bool traceRequested;   // zone trace dump asked for (-DZONE_TRACE only)
+
+    void processByte(char c);
+    void completeFrame();
+    bool receiveFrame(Command& cmd);
+    bool receiveJson(Command& cmd);
+    void handleHello(const char* value);
+    void handleRates(const char* value);
+    void switchRate(unsigned long rate);
+    void sendReply(const char* type, const char* value);
+    void sendReply(const char* type, long value);
+    void pumpTx();
+    void finishTx();
+    uint8_t encodeMessage(const TxQueue::Message& msg);
+
 public:
     SerialComm();
     
@@ -27,22 +100,93 @@ public:
     bool messageAvailable();
     
     /**
-     * Receive and parse JSON message
-     * Returns true if message was successfully parsed
+     * Receive and parse a JSON message or binary frame
+     * Returns true if it was a command (link control messages are handled
+     * here and return false)
+     */
+    bool receiveMessage(Command& cmd);
+
+    /**
+     * Record the sequence number of a received command
+     * Returns false for a retransmission (not newer than the last accepted
+     * one); the sequence restarts with every "hello"
      */
-    bool receiveMessage(String& type, String& value);
+    bool acceptSeq(uint8_t seq);
+
+    /**
+     * Sequence number of the newest accepted command
+     */
+    uint8_t getLastSeq() const;
     
     /**
-     * Send JSON message to CUS
-     * Format: {"type": "...", "value": "..."}
+     * Queue a mode report (MODE_CODE_* from Protocol.h)
+     */
+    void sendMode(uint8_t mode);
+
+    /**
+     * Queue a valve position report (percent)
+     */
+    void sendValve(uint8_t valve);
+
+    /**
+     * Queue a cumulative acknowledgement of every command up to seq,
+     * carrying the resulting mode and valve position
+     */
+    void sendAck(uint8_t seq, uint8_t mode, uint8_t valve);
+
+    /**
+     * Queue the rejection of command seq (NACK_* reason from Protocol.h)
      */
-    void sendMessage(const String& type, const String& value);
-    void sendMessage(const String& type, int value);
+    void sendNack(uint8_t seq, uint8_t reason);
+
+    /**
+     * Queue a liveness check, answered by the CUS with a pong
+     */
+    void sendPing();
+
+    /**
+     * millis() of the last valid message from the CUS (pongs included)
+     */
+    unsigned long getLastRxTime() const;
+
+    /**
+     * Called by the link watchdog after LINK_TIMEOUT of silence: returns
+     * to SERIAL_BAUD, where a CUS starts and falls back to, and accepts
+     * any sequence number next
+     */
+    void onLinkLost();
     
     /**
-     * Process incoming serial data (call frequently)
+     * Process incoming serial data and move queued messages to the UART
+     * (call frequently)
      */
     void update();
+
+    /**
+     * Outgoing message queue statistics
+     */
+    const TxQueue& getTxQueue() const;
+
+    /**
+     * True once the CUS has negotiated the binary protocol
+     */
+    bool isBinaryMode() const;
+
+    /**
+     * Current link rate (changes after a successful rate negotiation)
+     */
+    unsigned long getBaudRate() const;
+
+    /**
+     * Highest rate in a comma separated list that the WCS also supports,
+     * SERIAL_BAUD if there is none
+     */
+    static unsigned long chooseRate(const char* offered);
+
+    /**
+     * Number of binary frames dropped because of COBS/CRC errors
+     */
+    unsigned int getFrameErrors() const;
 };
 
 #endif
@@ -1,6 +1,8 @@
 #ifndef __TASK__
 #define __TASK__
 
+#include "EventQueue.h"
+
 class Task {
 
 public:
@@ -26,6 +28,9 @@ public:
 
   virtual void tick() = 0;
 
+  /* called by the scheduler for every event, as soon as it is dispatched */
+  virtual void handleEvent(const Event& event){}
+
   bool updateAndCheckTime(int basePeriod){
     timeElapsed += basePeriod;
     if (timeElapsed >= myPeriod){
@@ -0,0 +1,83 @@
+#include "TxQueue.h"
+
+TxQueue::TxQueue() : head(0), count(0), coalesced(0), dropped(0) {}
+
+TxQueue::Message& TxQueue::at(uint8_t pos) {
+    return items[(head + pos) % TX_QUEUE_SIZE];
+}
+
+bool TxQueue::push(uint8_t kind, uint8_t seq, uint8_t value, uint8_t value2) {
+    if (kind == NACK) {
+        if (count >= TX_NACK_BACKLOG) {
+            dropped++;
+            return false;
+        }
+    } else {
+        for (uint8_t i = 0; i < count; i++) {
+            if (at(i).kind == kind) {
+                // The newer one goes to the tail, so that the CUS still gets
+                // reports in the order the state changed
+                remove(i);
+                coalesced++;
+                break;
+            }
+        }
+        if (count >= TX_QUEUE_SIZE && !evictNack()) {
+            dropped++;
+            return false;
+        }
+    }
+
+    Message& m = at(count);
+    m.kind = kind;
+    m.seq = seq;
+    m.value = value;
+    m.value2 = value2;
+    count++;
+    return true;
+}
+
+bool TxQueue::evictNack() {
+    // Drop the newest NACK to make room for a state report
+    for (uint8_t i = count; i > 0; i--) {
+        if (at(i - 1).kind == NACK) {
+            remove(i - 1);
+            dropped++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void TxQueue::remove(uint8_t pos) {
+    for (uint8_t j = pos; j + 1 < count; j++) {
+        at(j) = at(j + 1);
+    }
+    count--;
+}
+
+bool TxQueue::pop(Message& msg) {
+    if (count == 0) {
+        return false;
+    }
+    msg = items[head];
+    head = (head + 1) % TX_QUEUE_SIZE;
+    count--;
+    return true;
+}
+
+bool TxQueue::isEmpty() const {
+    return count == 0;
+}
+
+uint8_t TxQueue::size() const {
+    return count;
+}
+
+unsigned int TxQueue::getCoalesced() const {
+    return coalesced;
+}
+
+unsigned int TxQueue::getDropped() const {
+    return dropped;
+}
@@ -0,0 +1,70 @@
+#ifndef __TX_QUEUE__
+#define __TX_QUEUE__
+
+#include <stdint.h>
+#include "config.h"
+
+/**
+ * Bounded queue of outgoing messages to the CUS
+ * Only the latest unsent mode report, valve report, ping and ACK are kept
+ * (a newer one removes the queued one and goes to the tail; ACKs are
+ * cumulative);
+ * NACKs are low priority and are dropped once the backlog exceeds
+ * TX_NACK_BACKLOG.
+ */
+class TxQueue {
+public:
+    enum Kind : uint8_t {
+        MODE,       // value: mode code
+        VALVE,      // value: valve percentage
+        PING,       // no arguments
+        ACK,        // seq, value: mode code, value2: valve percentage
+        NACK        // seq, value: NACK_* reason from Protocol.h
+    };
+
+    struct Message {
+        uint8_t kind;
+        uint8_t seq;
+        uint8_t value;
+        uint8_t value2;
+    };
+
+    TxQueue();
+
+    /**
+     * Queue a message, coalescing or dropping it as described above
+     * Returns false if the message was dropped
+     */
+    bool push(uint8_t kind, uint8_t seq, uint8_t value, uint8_t value2 = 0);
+
+    /**
+     * Remove the oldest message, false if the queue is empty
+     */
+    bool pop(Message& msg);
+
+    bool isEmpty() const;
+    uint8_t size() const;
+
+    /**
+     * Messages replaced by a newer one before being sent
+     */
+    unsigned int getCoalesced() const;
+
+    /**
+     * NACKs dropped because of backlog
+     */
+    unsigned int getDropped() const;
+
+private:
+    Message items[TX_QUEUE_SIZE];
+    uint8_t head;
+    uint8_t count;
+    unsigned int coalesced;
+    unsigned int dropped;
+
+    Message& at(uint8_t pos);
+    void remove(uint8_t pos);
+    bool evictNack();
+};
+
+#endif
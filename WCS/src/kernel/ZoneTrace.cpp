@@ -0,0 +1,84 @@
+#include "ZoneTrace.h"
+
+#ifdef ZONE_TRACE
+#include <util/atomic.h>
+
+struct ZoneEvent {
+  unsigned long time;
+  const char* name;   // in flash
+  bool end;
+};
+
+static ZoneEvent events[ZONE_TRACE_SIZE];
+static uint8_t head = 0;
+static uint8_t count = 0;
+static const char* volatile pendingReason = nullptr;
+static unsigned long lastDump = 0;
+static bool dumped = false;
+
+void ZoneTrace::record(const char* name, bool end){
+  unsigned long time = micros();
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    if (pendingReason == nullptr){
+      ZoneEvent& e = events[head];
+      e.time = time;
+      e.name = name;
+      e.end = end;
+      head = (head + 1) % ZONE_TRACE_SIZE;
+      if (count < ZONE_TRACE_SIZE){
+        count++;
+      }
+    }
+  }
+}
+
+void ZoneTrace::requestDump(const char* reason){
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    if (pendingReason == nullptr){
+      pendingReason = reason;
+    }
+  }
+}
+
+void ZoneTrace::checkBudget(unsigned long start, unsigned long budget){
+  if (micros() - start <= budget){
+    return;
+  }
+  // The dump itself overruns the next passes: leave time between dumps
+  if (dumped && millis() - lastDump < ZONE_TRACE_DUMP_INTERVAL){
+    return;
+  }
+  requestDump(PSTR("overrun"));
+}
+
+bool ZoneTrace::isDumpPending(){
+  return pendingReason != nullptr;
+}
+
+void ZoneTrace::flush(Print& out){
+  if (pendingReason == nullptr){
+    return;
+  }
+
+  // Frozen: nothing writes to the ring until pendingReason is cleared
+  out.print(F("ZONES " ZONE_TRACE_NAME " 1 "));
+  out.println((const __FlashStringHelper*)pendingReason);
+  uint8_t first = (head + ZONE_TRACE_SIZE - count) % ZONE_TRACE_SIZE;
+  for (uint8_t i = 0; i < count; i++){
+    const ZoneEvent& e = events[(first + i) % ZONE_TRACE_SIZE];
+    out.print(F("Z "));
+    out.print(e.time);
+    out.print(e.end ? F(" E ") : F(" B "));
+    out.println((const __FlashStringHelper*)e.name);
+  }
+  out.println(F("ZONES end"));
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    count = 0;
+    pendingReason = nullptr;
+  }
+  lastDump = millis();
+  dumped = true;
+}
+
+#endif
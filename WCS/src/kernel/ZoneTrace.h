@@ -0,0 +1,65 @@
+#ifndef __ZONE_TRACE__
+#define __ZONE_TRACE__
+
+/**
+ * Zone Trace
+ * Timeline instrumentation for diagnostic builds (-DZONE_TRACE, see the
+ * "trace" PlatformIO environment). TRACE_SCOPE("name") records micros()
+ * when the enclosing scope is entered and when it is left, into a ring of
+ * ZONE_TRACE_SIZE events; the name stays in flash. TRACE_BUDGET(us)
+ * freezes the ring when the enclosing scope took longer than us, so that
+ * the pass that blew the budget is still in it. SerialComm prints a frozen
+ * ring when the serial peer asks for it ({"type":"trace"}, which also
+ * freezes the ring) and the link is idle; tools/zonetrace.py turns the
+ * printout into a Chrome trace. Without the flag the macros compile to nothing.
+ * For cycle counts of single zones see Bench.h.
+ */
+
+#ifdef ZONE_TRACE
+#include <Arduino.h>
+#include "config.h"
+
+class ZoneTrace {
+public:
+  /* appends an event (ISR safe); ignored while the ring is frozen */
+  static void record(const char* name, bool end);
+
+  /* freezes the ring and marks it for printing */
+  static void requestDump(const char* reason);
+
+  /* freezes the ring if a scope started at start (micros) exceeded budget (us) */
+  static void checkBudget(unsigned long start, unsigned long budget);
+
+  static bool isDumpPending();
+
+  /* prints the frozen ring, then records again */
+  static void flush(Print& out);
+};
+
+class ZoneScope {
+public:
+  explicit ZoneScope(const char* name) : name(name) { ZoneTrace::record(name, false); }
+  ~ZoneScope() { ZoneTrace::record(name, true); }
+private:
+  const char* name;
+};
+
+class ZoneBudget {
+public:
+  explicit ZoneBudget(unsigned long budget) : start(micros()), budget(budget) {}
+  ~ZoneBudget() { ZoneTrace::checkBudget(start, budget); }
+private:
+  unsigned long start;
+  unsigned long budget;
+};
+
+// Declare TRACE_BUDGET before TRACE_SCOPE in the same scope: the zone then
+// ends before the budget is checked
+#define TRACE_SCOPE(name) ZoneScope zoneScope_(PSTR(name))
+#define TRACE_BUDGET(us) ZoneBudget zoneBudget_(us)
+#else
+#define TRACE_SCOPE(name)
+#define TRACE_BUDGET(us)
+#endif
+
+#endif
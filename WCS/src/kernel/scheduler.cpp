@@ -1,19 +1,25 @@
 #include "scheduler.h"
+#include <Arduino.h>
+#include <avr/sleep.h>
 #include <TimerOne.h>
+#include "ZoneTrace.h"
 
-volatile bool timerFlag;
+volatile uint8_t pendingTicks;
 
 void timerHandler(void){
-  timerFlag = true;
+  if (pendingTicks < 255){
+    pendingTicks++;
+  }
 }
 
 void Scheduler::init(int basePeriod){
   this->basePeriod = basePeriod;
-  timerFlag = false;
+  pendingTicks = 0;
   long period = 1000l*basePeriod;
   Timer1.initialize(period);
   Timer1.attachInterrupt(timerHandler);
   nTasks = 0;
+  resetStats();
 }
 
 bool Scheduler::addTask(Task* task){
@@ -27,13 +33,67 @@ bool Scheduler::addTask(Task* task){
 }
   
 void Scheduler::schedule(){   
-  while (!timerFlag){}
-  timerFlag = false;
+  // Idle sleep until the timer tick or an event. Every interrupt wakes the
+  // CPU (Timer0 included), so check again after each wake-up. sei() delays
+  // interrupts by one instruction, so nothing can slip in before sleep_cpu().
+  // The UART receive ISR belongs to the Arduino core: bytes it buffered are
+  // turned into an event here, right after the wake-up they caused.
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  cli();
+  while (pendingTicks == 0 && eventQueue.isEmpty() && Serial.available() == 0){
+    sleep_enable();
+    sei();
+    sleep_cpu();
+    sleep_disable();
+    cli();
+  }
+  uint8_t ticks = pendingTicks;
+  pendingTicks = 0;
+  sei();
+
+  TRACE_BUDGET(1000ul*basePeriod);
+  TRACE_SCOPE("schedule");
+  unsigned long start = micros();
+
+  if (Serial.available() > 0){
+    eventQueue.post(EVENT_SERIAL_RX);
+  }
+  dispatchEvents();
+
+  if (ticks > 0){
+    // More than one pending tick means the previous run overran basePeriod:
+    // count it and let tasks catch up on the time that really elapsed
+    missedTicks += ticks - 1;
+    elapsedTicks += ticks;
+    runTasks(ticks);
+  }
 
+  unsigned long busy = micros() - start;
+  busyTime += busy;
+  if (busy > maxBusyTime){
+    maxBusyTime = busy;
+  }
+}
+
+void Scheduler::dispatchEvents(){
+  // Only the events queued so far: one that a handler posts again waits for
+  // the next pass, after the due tasks
+  uint8_t n = eventQueue.size();
+  Event event;
+  while (n-- > 0 && eventQueue.pop(event)){
+    for (int i = 0; i < nTasks; i++){
+      if (taskList[i]->isActive()){
+        taskList[i]->handleEvent(event);
+      }
+    }
+  }
+}
+
+void Scheduler::runTasks(uint8_t ticks){
   for (int i = 0; i < nTasks; i++){
     if (taskList[i]->isActive()){
       if (taskList[i]->isPeriodic()){
-        if (taskList[i]->updateAndCheckTime(basePeriod)){
+        if (taskList[i]->updateAndCheckTime(basePeriod*ticks)){
           taskList[i]->tick();
         }
       } else {
@@ -44,4 +104,26 @@ void Scheduler::schedule(){
       }
     }
   }
-}
\ No newline at end of file
+}
+
+unsigned long Scheduler::getMissedTicks(){
+  return missedTicks;
+}
+
+unsigned long Scheduler::getMaxBusyTime(){
+  return maxBusyTime;
+}
+
+float Scheduler::getUtilisation(){
+  if (elapsedTicks == 0){
+    return 0;
+  }
+  return 100.0 * busyTime / (1000.0 * basePeriod * elapsedTicks);
+}
+
+void Scheduler::resetStats(){
+  missedTicks = 0;
+  elapsedTicks = 0;
+  busyTime = 0;
+  maxBusyTime = 0;
+}
@@ -11,10 +11,33 @@ class Scheduler {
   int nTasks;
   Task* taskList[MAX_TASKS];  
 
+  // Load statistics since init() / resetStats()
+  unsigned long missedTicks;
+  unsigned long elapsedTicks;
+  unsigned long busyTime;
+  unsigned long maxBusyTime;
+
+  void dispatchEvents();
+  void runTasks(uint8_t ticks);
+
 public:
   void init(int basePeriod);  
   virtual bool addTask(Task* task);  
+
+  /* sleeps (AVR idle mode) until the next timer tick or event, dispatches
+     queued events to the active tasks, then runs the due tasks on a tick */
   virtual void schedule();
+
+  /* ticks that elapsed while the previous tick was still running */
+  unsigned long getMissedTicks();
+
+  /* longest time spent running tasks in a single tick (us) */
+  unsigned long getMaxBusyTime();
+
+  /* share of time spent running tasks (percent) */
+  float getUtilisation();
+
+  void resetStats();
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -1,6 +1,6 @@
 #include <Arduino.h>
 #include "config.h"
-#include "kernel/Scheduler.h"
+#include "kernel/scheduler.h"
 #include "kernel/SerialComm.h"
 #include "model/HWPlatform.h"
 #include "tasks/WCSTask.h"
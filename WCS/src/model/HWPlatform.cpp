@@ -49,5 +49,6 @@ void HWPlatform::test(){
 
   this->lcd->writeModeMessage("TEST");
   this->lcd->writePercMessage("TEST");
+  this->lcd->flush();
   
 }
\ No newline at end of file
@@ -1,15 +1,19 @@
 #include "WCSTask.h"
 #include "config.h"
+#include "kernel/Bench.h"
+#include "kernel/ZoneTrace.h"
 
 WCSTask::WCSTask(HWPlatform* pHW, SerialComm* pSerial)
     : state(AUTOMATIC), justEntered(true),
       pHW(pHW), pSerial(pSerial),
-      lastValvePercentage(0), lastPotUpdate(0), lastSerialCheck(0) {}
+      lastValvePercentage(0), lastSerialCheck(0),
+      coalescedCommands(0), duplicateCommands(0), lastPing(0), linkLost(false),
+      stateBeforeLinkLoss(AUTOMATIC) {}
 
 void WCSTask::init(int period) {
     Task::init(period); 
     
-    updateLCDDisplay("STARTING", 0);
+    updateLCDDisplay(F("STARTING"), 0);
     
     setState(AUTOMATIC);
     
@@ -18,6 +22,8 @@ void WCSTask::init(int period) {
 }
 
 void WCSTask::tick() {
+    BENCH_ZONE(BENCH_WCS_TICK);
+    TRACE_SCOPE("wcs_tick");
     unsigned long now = millis();
     
     if (now - lastSerialCheck >= SERIAL_CHECK_INTERVAL) {
@@ -26,8 +32,42 @@ void WCSTask::tick() {
         lastSerialCheck = now;
     }
     
+    checkLink();
+    
     checkButtonPress();
     
+    runStateMachine();
+
+    // Display traffic last and time-boxed, so that actuation and serial
+    // handling never wait for text to reach the LCD
+    pHW->getLCD()->update(LCD_UPDATE_BUDGET);
+}
+
+void WCSTask::handleEvent(const Event& event) {
+    // Inputs are handled as soon as their interrupt fires; tick() only does
+    // housekeeping (outgoing queue, link supervision, long presses, display)
+    switch (event.type) {
+        case EVENT_SERIAL_RX:
+            pSerial->update();
+            processSerialMessages();
+            break;
+            
+        case EVENT_BUTTON:
+            checkButtonPress();
+            break;
+            
+        case EVENT_POT:
+            if (state == MANUAL) {
+                processPotentiometerInput();
+            }
+            break;
+    }
+    
+    // Entry actions of a state the event switched to (mode report, LCD)
+    runStateMachine();
+}
+
+void WCSTask::runStateMachine() {
     switch (state) {
         case AUTOMATIC:
             handleAutomaticMode();
@@ -45,100 +85,190 @@ void WCSTask::tick() {
 
 void WCSTask::handleAutomaticMode() {
     if (checkAndSetJustEntered()) {
-        updateLCDDisplay("AUTOMATIC", lastValvePercentage);
+        updateLCDDisplay(modeName(MODE_CODE_AUTOMATIC), lastValvePercentage);
 
-        pSerial->sendMessage("mode", 0);
+        pSerial->sendMode(MODE_CODE_AUTOMATIC);
     }
 }
 
 void WCSTask::handleManualMode() {
     if (checkAndSetJustEntered()) {
-        updateLCDDisplay("MANUAL", lastValvePercentage);
+        updateLCDDisplay(modeName(MODE_CODE_MANUAL), lastValvePercentage);
         
-        pSerial->sendMessage("mode", 1);
-    }
-    
-    unsigned long now = millis();
-    if (now - lastPotUpdate >= MANUAL_UPDATE_INTERVAL) {
+        pSerial->sendMode(MODE_CODE_MANUAL);
+        
+        // The knob may have moved while it was ignored
         processPotentiometerInput();
-        lastPotUpdate = now;
     }
 }
 
 void WCSTask::handleUnconnectedMode() {
     if (checkAndSetJustEntered()) {
-        updateLCDDisplay("UNCONNECTED", 0);
+        updateLCDDisplay(modeName(MODE_CODE_UNCONNECTED), 0);
         
         pHW->getMotor()->setPosition(0);
         lastValvePercentage = 0;
     }
 }
 
+// Indexed by MessageType, MSG_VALVE .. MSG_DISPLAY
+const WCSTask::CommandHandler WCSTask::commandHandlers[MSG_COMMANDS] = {
+    &WCSTask::handleValveCommand,
+    &WCSTask::handleDisplayUpdate
+};
+
 void WCSTask::processSerialMessages() {
-    String type, value;
+    Command cmd;
+    Command latest[MSG_COMMANDS];
+    unsigned int arrival[MSG_COMMANDS] = {};   // 0: none received
+    unsigned int received = 0;
+    bool ackNeeded = false;
+    uint8_t ackSeq = SEQ_NONE;
     
-    while (pSerial->messageAvailable()) {
-        if (pSerial->receiveMessage(type, value)) {
+    // Reduce the backlog to the latest command of each kind: a burst of
+    // setpoints moves the servo, rewrites the LCD and is acknowledged once.
+    // At most SERIAL_DRAIN_LIMIT messages per call, so that a CUS that never
+    // pauses cannot keep the scheduler here; the rest is handled on the next
+    // pass (see the end of this function)
+    for (uint8_t n = 0; n < SERIAL_DRAIN_LIMIT && pSerial->messageAvailable(); n++) {
+        if (pSerial->receiveMessage(cmd)) {
             
-            if (type == "valve") {
-                handleValveCommand(value);
-            } else if (type == "display") {
-                handleDisplayUpdate(value);
+            if (cmd.seq != SEQ_NONE && !pSerial->acceptSeq(cmd.seq)) {
+                // Retransmission of a command already applied: drop it, but
+                // acknowledge again in case the first ACK was lost
+                duplicateCommands++;
+                ackNeeded = true;
+                ackSeq = pSerial->getLastSeq();
+            } else if (cmd.type < MSG_COMMANDS) {
+                if (arrival[cmd.type] != 0) coalescedCommands++;
+                latest[cmd.type] = cmd;
+                arrival[cmd.type] = ++received;
             }
         }
+        // Refill: update() stops reading while its frame queue is full
+        pSerial->update();
     }
-}
-
-void WCSTask::handleValveCommand(const String& value) {
-    int percentage = value.toInt();
     
-    if (percentage < VALVE_MIN || percentage > VALVE_MAX) {
-        return;
+    // Apply in arrival order, so that the newest valve position wins
+    while (true) {
+        uint8_t next = MSG_COMMANDS;
+        for (uint8_t t = 0; t < MSG_COMMANDS; t++) {
+            if (arrival[t] != 0 && (next == MSG_COMMANDS || arrival[t] < arrival[next])) {
+                next = t;
+            }
+        }
+        if (next == MSG_COMMANDS) {
+            break;
+        }
+        arrival[next] = 0;
+        
+        BENCH_ZONE(BENCH_COMMAND);
+        if ((this->*commandHandlers[next])(latest[next])) {
+            ackNeeded = true;
+            ackSeq = latest[next].seq;
+        }
     }
     
-    int angle = mapPercentageToAngle(percentage);
-    pHW->getMotor()->setPosition(angle);
-    lastValvePercentage = percentage;
+    // One cumulative ACK for the batch, up to the newest applied command
+    if (ackNeeded) {
+        pSerial->sendAck(ackSeq, state, lastValvePercentage);
+    }
     
-    String modeStr = "UNKNOWN";
-    if (state == AUTOMATIC) modeStr = "AUTOMATIC";
-    else if (state == MANUAL) modeStr = "MANUAL";
-    else if (state == UNCONNECTED) modeStr = "UNCONNECTED";
+    // Messages already decoded do not wake the scheduler, unlike bytes in
+    // the UART buffer: ask for the next pass, or the newest setpoint waits
+    // for tick()
+    if (pSerial->messageAvailable()) {
+        eventQueue.post(EVENT_SERIAL_RX);
+    }
+}
+
+unsigned int WCSTask::getCoalescedCommands() const {
+    return coalescedCommands;
+}
+
+unsigned int WCSTask::getDuplicateCommands() const {
+    return duplicateCommands;
+}
+
+bool WCSTask::handleValveCommand(const Command& cmd) {
+    if (cmd.valve < VALVE_MIN || cmd.valve > VALVE_MAX) {
+        pSerial->sendNack(cmd.seq, NACK_RANGE);
+        return false;
+    }
     
-    updateLCDDisplay(modeStr, percentage);
+    int angle = mapPercentageToAngle(cmd.valve);
+    pHW->getMotor()->setPosition(angle);
+    lastValvePercentage = cmd.valve;
     
-    pSerial->sendMessage("status", "Valve set to " + String(percentage) + "%");
+    updateLCDDisplay(modeName(state), cmd.valve);
+    return true;
 }
 
-void WCSTask::handleDisplayUpdate(const String& value) {
-    String modeStr = value;
-    int valveVal = lastValvePercentage;
+bool WCSTask::handleDisplayUpdate(const Command& cmd) {
+    int valveVal = cmd.valve < 0 ? lastValvePercentage : cmd.valve;
     
-    int pipeIdx = value.indexOf('|');
-    if (pipeIdx != -1) {
-        modeStr = value.substring(0, pipeIdx);
-        valveVal = value.substring(pipeIdx + 1).toInt();
-        lastValvePercentage = valveVal;
+    if (cmd.mode == MODE_CODE_UNKNOWN) {
+        pSerial->sendNack(cmd.seq, NACK_MODE);
+        return false;
     }
-    
-    if (modeStr == "AUTOMATIC") {
-        setState(AUTOMATIC);
-    } else if (modeStr == "MANUAL") {
-        setState(MANUAL);
-    } else if (modeStr == "UNCONNECTED") {
-        setState(UNCONNECTED);
+    if (valveVal < VALVE_MIN || valveVal > VALVE_MAX) {
+        pSerial->sendNack(cmd.seq, NACK_RANGE);
+        return false;
     }
     
+    // An explicit state from the CUS takes over from the link watchdog
+    linkLost = false;
+    setState((WCSState)cmd.mode);
+    
     int angle = mapPercentageToAngle(valveVal);
     pHW->getMotor()->setPosition(angle);
+    lastValvePercentage = valveVal;
+    
+    updateLCDDisplay(modeName(cmd.mode), valveVal);
+    return true;
+}
+
+void WCSTask::checkLink() {
+    unsigned long now = millis();
+    unsigned long silence = now - pSerial->getLastRxTime();
+    
+    if (silence < LINK_PING_INTERVAL) {
+        if (linkLost) {
+            // The CUS is back: return to the mode the link loss interrupted
+            linkLost = false;
+            setState(stateBeforeLinkLoss);
+            runStateMachine();
+            if (state == MANUAL) {
+                // The fail-safe closed the valve: follow the knob again
+                processPotentiometerInput(true);
+            }
+        }
+        return;
+    }
     
-    updateLCDDisplay(modeStr, valveVal);
+    // Fail safe within LINK_TIMEOUT (+ one task period) of the last
+    // message, whatever the CUS is doing
+    if (silence >= LINK_TIMEOUT && !linkLost) {
+        linkLost = true;
+        stateBeforeLinkLoss = state;
+        setState(UNCONNECTED);
+        // The CUS may be talking at another rate (lost probe reply, restart)
+        pSerial->onLinkLost();
+    }
     
-    pSerial->sendMessage("status", "Display synced: " + modeStr);
+    if (now - lastPing >= LINK_PING_INTERVAL) {
+        pSerial->sendPing();
+        lastPing = now;
+    }
 }
 
 void WCSTask::checkButtonPress() {
-    if (pHW->getButton()->isPressed()) {
+    ButtonEvent event;
+    
+    while (pHW->getButton()->pollEvent(event)) {
+        if (event != BUTTON_PRESSED) {
+            continue;
+        }
         if (state == AUTOMATIC) {
             setState(MANUAL);
         } else if (state == MANUAL) {
@@ -147,26 +277,27 @@ void WCSTask::checkButtonPress() {
     }
 }
 
-void WCSTask::processPotentiometerInput() {
+void WCSTask::processPotentiometerInput(bool force) {
     pHW->getPot()->sync();
     int potValue = pHW->getPot()->getValue();
     
-    int percentage = mapPotToPercentage(potValue);
+    // Hysteresis: the knob has to move past the next step by POT_HYSTERESIS,
+    // so noise around a step boundary does not produce messages to the CUS
+    if (!force && abs(mapPotToPerMille(potValue) - lastPhysicalPotPercentage * 10) < 5 + POT_HYSTERESIS) {
+        return;
+    }
     
-    int delta = abs(percentage - lastPhysicalPotPercentage);
+    int percentage = mapPotToPercentage(potValue);
+    lastPhysicalPotPercentage = percentage;
     
-    if (delta >= 2) { 
-        lastPhysicalPotPercentage = percentage;
+    if (percentage != lastValvePercentage) {
+        int angle = mapPercentageToAngle(percentage);
+        pHW->getMotor()->setPosition(angle);
+        lastValvePercentage = percentage;
         
-        if (percentage != lastValvePercentage) {
-            int angle = mapPercentageToAngle(percentage);
-            pHW->getMotor()->setPosition(angle);
-            lastValvePercentage = percentage;
-            
-            updateLCDDisplay("MANUAL", percentage);
-            
-            pSerial->sendMessage("valve", percentage);
-        }
+        updateLCDDisplay(modeName(MODE_CODE_MANUAL), percentage);
+        
+        pSerial->sendValve((uint8_t)percentage);
     }
 }
 
@@ -186,12 +317,21 @@ int WCSTask::mapPercentageToAngle(int percentage) {
 }
 
 int WCSTask::mapPotToPercentage(int potValue) {
-    return map(potValue, POT_MIN, POT_MAX, VALVE_MIN, VALVE_MAX);
+    long span = POT_MAX - POT_MIN;
+    long steps = (long)(constrain(potValue, POT_MIN, POT_MAX) - POT_MIN) * (VALVE_MAX - VALVE_MIN);
+    return (steps + span / 2) / span + VALVE_MIN;
 }
 
-void WCSTask::updateLCDDisplay(const String& mode, int valve) {
+int WCSTask::mapPotToPerMille(int potValue) {
+    long span = POT_MAX - POT_MIN;
+    long steps = (long)(constrain(potValue, POT_MIN, POT_MAX) - POT_MIN) * (VALVE_MAX - VALVE_MIN) * 10;
+    return (steps + span / 2) / span + VALVE_MIN * 10;
+}
+
+void WCSTask::updateLCDDisplay(const __FlashStringHelper* mode, int valve) {
+    char valveStr[LCD_COLS + 1];
+    snprintf(valveStr, sizeof(valveStr), "Valve: %d%%", valve);
+
     pHW->getLCD()->writeModeMessage(mode);
-    
-    String valveStr = "Valve: " + String(valve) + "%";
     pHW->getLCD()->writePercMessage(valveStr);
 }
\ No newline at end of file
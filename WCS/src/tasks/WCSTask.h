@@ -3,6 +3,8 @@
 
 #include "kernel/Task.h"
 #include "kernel/SerialComm.h"
+#include "kernel/Protocol.h"
+#include "kernel/Messages.h"
 #include "model/HWPlatform.h"
 #include <Arduino.h>
 
@@ -16,12 +18,23 @@ public:
     
     void init(int period) override;
     void tick() override;
+    void handleEvent(const Event& event) override;
+
+    /**
+     * Commands superseded by a newer one of the same kind before being applied
+     */
+    unsigned int getCoalescedCommands() const;
+
+    /**
+     * Retransmitted commands dropped as already applied
+     */
+    unsigned int getDuplicateCommands() const;
 
 private:
     enum WCSState {
-        AUTOMATIC,      // CUS controls valve automatically
-        MANUAL,         // User controls valve via potentiometer
-        UNCONNECTED     // CUS disconnected
+        AUTOMATIC = MODE_CODE_AUTOMATIC,    // CUS controls valve automatically
+        MANUAL = MODE_CODE_MANUAL,          // User controls valve via potentiometer
+        UNCONNECTED = MODE_CODE_UNCONNECTED // CUS disconnected
     };
     
     WCSState state;
@@ -34,33 +47,45 @@ private:
     // State tracking
     int lastValvePercentage;
     int lastPhysicalPotPercentage;
-    unsigned long lastPotUpdate;
     unsigned long lastSerialCheck;
+    unsigned int coalescedCommands;
+    unsigned int duplicateCommands;
+    unsigned long lastPing;
+    bool linkLost;
+    WCSState stateBeforeLinkLoss;       // restored when the CUS is heard again
     
     // State machine methods
+    void runStateMachine();
     void setState(WCSState newState);
     bool checkAndSetJustEntered();
     
     // Message handling
     void processSerialMessages();
-    void handleValveCommand(const String& value);
-    void handleDisplayUpdate(const String& value);
+    // Apply a command, or NACK it and return false if it is invalid
+    typedef bool (WCSTask::*CommandHandler)(const Command& cmd);
+    static const CommandHandler commandHandlers[MSG_COMMANDS];
+    bool handleValveCommand(const Command& cmd);
+    bool handleDisplayUpdate(const Command& cmd);
     
     // Mode-specific logic
     void handleAutomaticMode();
     void handleManualMode();
     void handleUnconnectedMode();
     
+    // Link supervision
+    void checkLink();
+    
     // Button handling
     void checkButtonPress();
     
-    // Potentiometer handling
-    void processPotentiometerInput();
+    // Potentiometer handling (force: apply the knob even inside the hysteresis)
+    void processPotentiometerInput(bool force = false);
     
     // Utilities
     int mapPercentageToAngle(int percentage);
     int mapPotToPercentage(int potValue);
-    void updateLCDDisplay(const String& mode, int valve);
+    int mapPotToPerMille(int potValue);   // tenths of a percent
+    void updateLCDDisplay(const __FlashStringHelper* mode, int valve);
 };
 
 #endif
\ No newline at end of file
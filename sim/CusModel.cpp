@@ -0,0 +1,395 @@
+#include "CusModel.h"
+#include "SimConfig.h"
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "kernel/Protocol.h"
+
+// The WCS reference codec, compiled in wcs_unit.cpp
+namespace wcs {
+#include "kernel/FrameCodec.h"
+}
+using wcs::FrameCodec;
+
+#define HANDSHAKE_DELAY 1000000ULL     // us after start, the WCS has finished setup()
+#define HANDSHAKE_TIMEOUT 1000000ULL   // us, CUS SERIAL_HANDSHAKE_TIMEOUT
+#define TIMEOUT_CHECK_PERIOD 50000ULL  // us, how often the read loop looks at timeouts
+
+static const char* const MODE_NAMES[] = { "AUTOMATIC", "MANUAL", "UNCONNECTED" };
+
+CusModel::CusModel(Simulation& sim, SimNetwork& network, bool binary)
+    : sim(sim), network(network), binary(binary), handshakeDone(false),
+      mode(AUTOMATIC), valve(0), haveLevel(false), level(0), levelSampleTime(0), lastLevelTime(0),
+      l1Timing(false), l1Start(0),
+      nextSeq(1), lastSentSeq(-1), wcsKnown(false), wcsMode(0), wcsValve(0), rxJson(false) {
+    pending[VALVE] = pending[DISPLAY] = false;
+    memset(&stats, 0, sizeof(stats));
+}
+
+void CusModel::start() {
+    network.subscribe(LEVEL_TOPIC, [this](const std::string& topic, const std::string& payload, uint64_t sentAt) {
+        onLevel(payload, sentAt);
+    }, sim.now());
+
+    sim.after(HANDSHAKE_DELAY, [this]() {
+        sendJson(std::string("{\"type\":\"hello\",\"value\":\"") + (binary ? PROTO_HELLO_BINARY : "json") + "\"}");
+        sim.after(HANDSHAKE_TIMEOUT, [this]() {
+            if (!handshakeDone) {
+                this->binary = false;
+                handshakeDone = true;
+                pump();
+            }
+        });
+    });
+    sim.every(CUS_LOOP_PERIOD, [this]() { businessLoop(); });
+    sim.every(CUS_SYNC_PERIOD, [this]() { submit(DISPLAY); });
+    sim.every(TIMEOUT_CHECK_PERIOD, [this]() { checkTimeouts(); });
+}
+
+const CusModel::Stats& CusModel::getStats() const {
+    return stats;
+}
+
+const char* CusModel::getMode() const {
+    return MODE_NAMES[mode];
+}
+
+// ===== Business logic =====
+
+void CusModel::onLevel(const std::string& payload, uint64_t sentAt) {
+    JsonDocument doc;
+    if (deserializeJson(doc, payload.c_str())) {
+        return;
+    }
+    stats.levelMessages++;
+    level = doc["level"] | -1.0;
+    haveLevel = true;
+    levelSampleTime = sentAt;
+    lastLevelTime = sim.now();
+    if (mode == UNCONNECTED) {
+        setMode(AUTOMATIC);
+    }
+    if (mode == AUTOMATIC) {
+        applyPolicy();
+    }
+    submit(DISPLAY);
+}
+
+void CusModel::businessLoop() {
+    if (haveLevel && mode != UNCONNECTED && sim.now() - lastLevelTime > CUS_T2) {
+        stats.unconnected++;
+        setMode(UNCONNECTED);
+        setValve(0);
+        submit(DISPLAY);
+    }
+    if (mode == AUTOMATIC) {
+        applyPolicy();
+    }
+}
+
+void CusModel::applyPolicy() {
+    if (!haveLevel) {
+        return;
+    }
+    if (level >= CUS_L2) {
+        setValve(CUS_L2_OPENING);
+        l1Timing = false;
+        return;
+    }
+    if (level >= CUS_L1) {
+        if (!l1Timing) {
+            l1Timing = true;
+            l1Start = sim.now();
+        }
+        if (sim.now() - l1Start >= CUS_T1) {
+            setValve(CUS_L1_OPENING);
+        }
+        return;
+    }
+    l1Timing = false;
+    setValve(0);
+}
+
+void CusModel::setValve(int opening) {
+    if (opening == valve) {
+        return;
+    }
+    valve = opening;
+    if (onDecision) {
+        onDecision(opening, levelSampleTime);
+    }
+    submit(VALVE);
+}
+
+void CusModel::setMode(Mode newMode) {
+    mode = newMode;
+    if (mode == AUTOMATIC) {
+        l1Timing = false;
+    }
+}
+
+// ===== Serial link =====
+
+bool CusModel::seqNotAfter(uint8_t a, uint8_t b) {
+    // a is b or up to 127 behind it
+    return (uint8_t)(b - a) < 128;
+}
+
+bool CusModel::isRedundant(Kind kind) const {
+    if (!wcsKnown) {
+        return false;
+    }
+    if (kind == VALVE) {
+        return wcsValve == valve;
+    }
+    return wcsMode == mode && wcsValve == valve;
+}
+
+void CusModel::submit(Kind kind) {
+    pending[kind] = true;
+    pump();
+}
+
+void CusModel::pump() {
+    if (!handshakeDone) {
+        return;
+    }
+    for (int k = VALVE; k <= DISPLAY; k++) {
+        Kind kind = (Kind)k;
+        if (!pending[kind] || inFlight.size() >= CUS_WINDOW) {
+            continue;
+        }
+        pending[kind] = false;
+        if (isRedundant(kind)) {
+            continue;
+        }
+        // A newer command of the same kind supersedes one still in flight
+        for (std::map<uint8_t, Command>::iterator it = inFlight.begin(); it != inFlight.end(); ++it) {
+            if (it->second.kind == kind) {
+                inFlight.erase(it);
+                break;
+            }
+        }
+        Command cmd;
+        cmd.kind = kind;
+        cmd.seq = nextSeq;
+        lastSentSeq = nextSeq;
+        cmd.mode = mode;
+        cmd.valve = valve;
+        cmd.retries = 0;
+        nextSeq = nextSeq == 255 ? 1 : nextSeq + 1;
+        transmit(cmd);
+        inFlight[cmd.seq] = cmd;
+        if (kind == VALVE) {
+            stats.valveCommands++;
+        } else {
+            stats.displayCommands++;
+        }
+    }
+}
+
+void CusModel::transmit(Command& cmd) {
+    cmd.sentAt = sim.now();
+    if (binary) {
+        if (cmd.kind == VALVE) {
+            uint8_t payload[2] = { cmd.seq, (uint8_t)cmd.valve };
+            sendFrame(OP_VALVE, payload, 2);
+        } else {
+            uint8_t payload[3] = { cmd.seq, (uint8_t)cmd.mode, (uint8_t)cmd.valve };
+            sendFrame(OP_DISPLAY, payload, 3);
+        }
+        return;
+    }
+    char json[96];
+    if (cmd.kind == VALVE) {
+        snprintf(json, sizeof(json), "{\"type\":\"valve\",\"value\":%d,\"seq\":%d}", cmd.valve, cmd.seq);
+    } else {
+        snprintf(json, sizeof(json), "{\"type\":\"display\",\"mode\":\"%s\",\"valve\":%d,\"seq\":%d}",
+                 MODE_NAMES[cmd.mode], cmd.valve, cmd.seq);
+    }
+    sendJson(json);
+}
+
+void CusModel::checkTimeouts() {
+    std::map<uint8_t, Command>::iterator it = inFlight.begin();
+    while (it != inFlight.end()) {
+        Command& cmd = it->second;
+        if (sim.now() - cmd.sentAt < CUS_ACK_TIMEOUT) {
+            ++it;
+            continue;
+        }
+        if (cmd.retries >= CUS_MAX_RETRIES) {
+            stats.dropped++;
+            it = inFlight.erase(it);
+            continue;
+        }
+        cmd.retries++;
+        stats.retransmissions++;
+        transmit(cmd);
+        ++it;
+    }
+    pump();
+}
+
+void CusModel::handleAck(uint8_t seq, int mode, int valve) {
+    // Not one of ours: the WCS still counts from before the restart
+    if (lastSentSeq < 0 || !seqNotAfter(seq, (uint8_t)lastSentSeq)) {
+        return;
+    }
+    stats.acks++;
+    wcsKnown = true;
+    wcsMode = mode;
+    wcsValve = valve;
+    std::map<uint8_t, Command>::iterator it = inFlight.begin();
+    while (it != inFlight.end()) {
+        if (seqNotAfter(it->first, seq)) {
+            it = inFlight.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    pump();
+}
+
+void CusModel::handleNack(uint8_t seq) {
+    stats.nacks++;
+    inFlight.erase(seq);
+    pump();
+}
+
+void CusModel::handleMessage(const std::string& type, int seq, int value, int mode, int valveValue) {
+    if (type == "ack") {
+        handleAck(seq, mode, valveValue);
+    } else if (type == "nack") {
+        handleNack(seq);
+    } else if (type == "ping") {
+        stats.pings++;
+        sendPong();
+    } else if (type == "mode") {
+        // Button on the WCS: business_logic.switch_mode, then a display update
+        stats.modeReports++;
+        if (wcsKnown) {
+            wcsMode = value;
+        }
+        if (this->mode != UNCONNECTED && (value == MODE_CODE_AUTOMATIC || value == MODE_CODE_MANUAL)) {
+            setMode(value == MODE_CODE_AUTOMATIC ? AUTOMATIC : MANUAL);
+            submit(DISPLAY);
+        }
+    } else if (type == "valve") {
+        // Potentiometer in MANUAL mode
+        stats.valveReports++;
+        if (wcsKnown) {
+            wcsValve = value;
+        }
+        if (this->mode == MANUAL) {
+            valve = value;
+        }
+    } else if (type == "hello") {
+        handshakeDone = true;
+        inFlight.clear();
+        wcsKnown = false;
+        nextSeq = 1;
+        lastSentSeq = -1;
+        pump();
+    }
+}
+
+void CusModel::handleJsonLine(const std::string& line) {
+    JsonDocument doc;
+    if (deserializeJson(doc, line.c_str())) {
+        return;
+    }
+    std::string type = doc["type"] | "";
+    if (type == "hello") {
+        binary = binary && strcmp(doc["value"] | "", PROTO_HELLO_BINARY) == 0;
+    }
+    handleMessage(type, doc["seq"] | 0, doc["value"] | 0, doc["mode"] | 0, doc["valve"] | 0);
+}
+
+void CusModel::handleFrame(const std::string& wire) {
+    uint8_t opcode;
+    uint8_t payload[FrameCodec::MAX_PAYLOAD];
+    uint8_t len;
+    if (wire.size() > FrameCodec::MAX_WIRE ||
+        !FrameCodec::decode((const uint8_t*)wire.data(), wire.size(), opcode, payload, len)) {
+        return;
+    }
+    switch (opcode) {
+        case OP_ACK:
+            if (len >= 3) handleMessage("ack", payload[0], 0, payload[1], payload[2]);
+            break;
+        case OP_NACK:
+            if (len >= 2) handleMessage("nack", payload[0], payload[1], 0, 0);
+            break;
+        case OP_PING:
+            handleMessage("ping", 0, 0, 0, 0);
+            break;
+        case OP_MODE:
+            if (len >= 1) handleMessage("mode", 0, payload[0], 0, 0);
+            break;
+        case OP_VALVE_REPORT:
+            if (len >= 1) handleMessage("valve", 0, payload[0], 0, 0);
+            break;
+    }
+}
+
+void CusModel::receive(uint8_t c) {
+    stats.rxBytes++;
+    if (rxJson) {
+        if (c == '\n') {
+            handleJsonLine(rxLine);
+            rxLine.clear();
+            rxJson = false;
+        } else if (c == 0) {
+            // A corrupted frame byte looked like '{'
+            rxLine.clear();
+            rxJson = false;
+        } else {
+            rxLine += (char)c;
+        }
+        return;
+    }
+    if (c == 0) {
+        if (!rxFrame.empty()) {
+            handleFrame(rxFrame);
+        }
+        rxFrame.clear();
+        return;
+    }
+    if (rxFrame.empty() && c == '{') {
+        rxJson = true;
+        rxLine = "{";
+        return;
+    }
+    if (rxFrame.empty() && (c == '\r' || c == '\n')) {
+        return;
+    }
+    rxFrame += (char)c;
+    if (rxFrame.size() > 64) {
+        rxFrame.clear();
+    }
+}
+
+void CusModel::sendPong() {
+    if (binary) {
+        sendFrame(OP_PONG, nullptr, 0);
+    } else {
+        sendJson("{\"type\":\"pong\"}");
+    }
+}
+
+void CusModel::sendJson(const std::string& json) {
+    std::string line = json + "\n";
+    stats.txBytes += line.size();
+    if (send) {
+        send((const uint8_t*)line.data(), line.size());
+    }
+}
+
+void CusModel::sendFrame(uint8_t opcode, const uint8_t* payload, uint8_t len) {
+    uint8_t wire[FrameCodec::MAX_WIRE];
+    uint8_t n = FrameCodec::encode(opcode, payload, len, wire);
+    stats.txBytes += n;
+    if (send && n > 0) {
+        send(wire, n);
+    }
+}
@@ -0,0 +1,119 @@
+#ifndef __CUS_MODEL__
+#define __CUS_MODEL__
+
+#include <stdint.h>
+#include <functional>
+#include <map>
+#include <string>
+#include "Simulation.h"
+#include "Network.h"
+
+/**
+ * Control Unit stand-in
+ * Applies the policy of CUS/src/business_logic.py to the levels published
+ * by the TMS and drives the WCS over the serial link like
+ * CUS/src/serial_handler.py: sequenced commands, at most CUS_WINDOW in
+ * flight, cumulative ACKs, retransmission after CUS_ACK_TIMEOUT, no command
+ * that the last ACK shows in effect, pongs to pings.
+ */
+class CusModel {
+public:
+    struct Stats {
+        unsigned long levelMessages;
+        unsigned long valveCommands;
+        unsigned long displayCommands;
+        unsigned long retransmissions;
+        unsigned long dropped;           // given up after CUS_MAX_RETRIES
+        unsigned long acks;
+        unsigned long nacks;
+        unsigned long pings;
+        unsigned long modeReports;
+        unsigned long valveReports;
+        unsigned long rxBytes;
+        unsigned long txBytes;
+        unsigned long unconnected;       // T2 timeouts
+    };
+
+    CusModel(Simulation& sim, SimNetwork& network, bool binary);
+
+    /* start the loops and the serial handshake */
+    void start();
+
+    /* a byte from the WCS finished arriving */
+    void receive(uint8_t c);
+
+    /* bytes for the WCS, sent now */
+    std::function<void(const uint8_t* data, size_t len)> send;
+
+    /* the policy changed the valve target; sampleTime is the TMS time of
+       the reading behind the decision */
+    std::function<void(int valve, uint64_t sampleTime)> onDecision;
+
+    const Stats& getStats() const;
+    const char* getMode() const;
+
+private:
+    enum Mode { AUTOMATIC, MANUAL, UNCONNECTED };
+    enum Kind { VALVE, DISPLAY };
+
+    struct Command {
+        Kind kind;
+        uint8_t seq;
+        int mode;
+        int valve;
+        uint64_t sentAt;
+        uint8_t retries;
+    };
+
+    Simulation& sim;
+    SimNetwork& network;
+    bool binary;
+    bool handshakeDone;
+
+    // Business logic state
+    Mode mode;
+    int valve;
+    bool haveLevel;
+    double level;
+    uint64_t levelSampleTime;
+    uint64_t lastLevelTime;
+    bool l1Timing;
+    uint64_t l1Start;
+
+    // Serial state
+    uint8_t nextSeq;
+    int lastSentSeq;    // -1 until a command is sent after (re)start
+    bool pending[2];
+    std::map<uint8_t, Command> inFlight;
+    bool wcsKnown;
+    int wcsMode;
+    int wcsValve;
+    std::string rxLine;
+    std::string rxFrame;
+    bool rxJson;
+
+    Stats stats;
+
+    void onLevel(const std::string& payload, uint64_t sentAt);
+    void businessLoop();
+    void applyPolicy();
+    void setValve(int opening);
+    void setMode(Mode newMode);
+
+    void submit(Kind kind);
+    void pump();
+    bool isRedundant(Kind kind) const;
+    void transmit(Command& cmd);
+    void checkTimeouts();
+    void handleAck(uint8_t seq, int mode, int valve);
+    void handleNack(uint8_t seq);
+    void handleMessage(const std::string& type, int seq, int value, int mode, int valveValue);
+    void handleJsonLine(const std::string& line);
+    void handleFrame(const std::string& wire);
+    void sendPong();
+    void sendJson(const std::string& json);
+    void sendFrame(uint8_t opcode, const uint8_t* payload, uint8_t len);
+    static bool seqNotAfter(uint8_t a, uint8_t b);
+};
+
+#endif
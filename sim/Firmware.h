@@ -0,0 +1,62 @@
+#ifndef __FIRMWARE__
+#define __FIRMWARE__
+
+#include <stdint.h>
+
+class SimBoard;
+
+/**
+ * Entry points of the two firmwares, compiled into the namespaces tms and
+ * wcs by tms_unit.cpp and wcs_unit.cpp. Except tms::start(), they must run
+ * inside SimBoard::run() of their board.
+ */
+
+struct TmsStats {
+    const char* state;
+    bool publishing;                  // MONITORING with the broker connected
+    const char* scheduler;            // "FreeRTOS" or "cooperative"
+    unsigned long samples;            // sonar readings
+    unsigned long lateSamples;        // 1.5 periods or more after the previous one
+    unsigned long droppedReadings;    // reading queue full
+    unsigned long maxJitterUs;        // largest |interval - period|
+    double meanJitterUs;
+    unsigned long deadlineMisses;     // task group releases, all groups
+    const char* broker;               // host of the active broker
+    unsigned long brokerSwitches;
+};
+
+struct WcsStats {
+    unsigned int coalescedCommands;   // superseded before being applied
+    unsigned int duplicateCommands;   // retransmissions dropped
+    unsigned int frameErrors;
+    unsigned int coalescedEvents;
+    unsigned long missedTicks;
+    unsigned long maxBusyUs;
+    float utilisation;
+};
+
+namespace tms {
+    void setup();
+    void loop();
+
+    /* boot on board: setup(), then loop() every loopPeriod (us), or the
+       Arduino loop task under SimRtos */
+    void start(SimBoard& board, uint64_t loopPeriod);
+
+    TmsStats getStats();
+}
+
+namespace wcs {
+    void setup();
+    void loop();
+
+    /* true if loop() would not go back to sleep at once */
+    bool hasWork();
+
+    /* n timer-triggered ADC conversions of the selected channel */
+    void convertAdc(unsigned int n);
+
+    WcsStats getStats();
+}
+
+#endif
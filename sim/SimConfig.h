@@ -0,0 +1,71 @@
+#ifndef __SIM_CONFIG__
+#define __SIM_CONFIG__
+
+// ===== Wiring (must match TMS/src/config.h and WCS/src/config.h) =====
+#define TMS_SONAR_ECHO_PIN 14
+#define WCS_SERVO_PIN 3
+#define WCS_BUTTON_PIN 9
+#define WCS_POT_CHANNEL 0
+#define LEVEL_TOPIC "tms/rainwater/level"
+#define TRACE_CMD_TOPIC "tms/trace/cmd"
+#define TRACE_DATA_TOPIC "tms/trace/data"
+#define FLIGHT_REQUEST_TOPIC "tms/flight/req"
+#define FLIGHT_RESPONSE_TOPIC "tms/flight/data"
+#define SUMMARY_TOPIC "tms/rainwater/summary"
+#define HISTORY_REQUEST_TOPIC "tms/history/req"
+#define HISTORY_RESPONSE_TOPIC "tms/history/data"
+#define CONFIG_TOPIC "tms/TMS_ESP32/config"
+#define CONFIG_ACK_TOPIC "tms/TMS_ESP32/config/ack"
+#define SIM_PRIMARY_BROKER "broker.mqtt-dashboard.com"   // first of MQTT_BROKERS
+#define SIM_SECONDARY_BROKER "broker.hivemq.com"         // second of MQTT_BROKERS
+
+// ===== Firmware timing =====
+#define TMS_LOOP_PERIOD 10000         // us between TMS loop() calls, cooperative build (its scheduler's base period)
+#define ADC_BURST_PERIOD 10240        // us of timer-triggered ADC simulated per burst
+#define ADC_BURST_CONVERSIONS 10      // conversions in ADC_BURST_PERIOD (one per 1024 us Timer0 period)
+#define ADC_SETTLE_BURSTS 30          // bursts run after every potentiometer change (filter settled to 0.01%)
+#define TRACE_DUMP_TIMEOUT 60000000ULL  // us allowed for a sonar trace dump
+#define FLIGHT_REQUEST_TIMEOUT 60000000ULL  // us allowed for the flight recorder response
+#define FLIGHT_REQUEST_RECORDS 128    // records asked for (the TMS keeps FLIGHT_CAPACITY)
+#define HISTORY_REQUEST_TIMEOUT 600000000ULL  // us allowed for the whole history query
+
+// ===== CUS policy (must match CUS/src/config.py) =====
+#define CUS_L1 30.0                   // cm
+#define CUS_L2 50.0                   // cm
+#define CUS_T1 10000000ULL            // us above L1 before opening to CUS_L1_OPENING
+#define CUS_T2 30000000ULL            // us without TMS data before UNCONNECTED
+#define CUS_L1_OPENING 50             // %
+#define CUS_L2_OPENING 100            // %
+#define CUS_LOOP_PERIOD 500000ULL     // us, business logic loop
+#define CUS_SYNC_PERIOD 2000000ULL    // us, display sync loop
+#define CUS_WINDOW 4                  // commands in flight
+#define CUS_ACK_TIMEOUT 500000ULL     // us
+#define CUS_MAX_RETRIES 3
+#define CUS_BAUD 9600
+
+// ===== Plant =====
+#define TANK_HEIGHT 200.0             // cm, as TMS TANK_HEIGHT
+#define TANK_STEP 1000000ULL          // us, integration step
+#define VALVE_FLOW_COEFF 0.283        // cm/min per sqrt(cm) at 100%: drains 2 cm/min at 50 cm
+#define SERVO_SLEW 400.0              // degrees per second (0.15 s / 60 deg)
+#define SERVO_OPEN_ANGLE 90.0         // angle of a fully open valve (WCS SERVO_MAX_ANGLE)
+#define SERVO_PULSE_MIN 544           // us at 0 degrees (ServoMotorImpl table)
+#define SERVO_PULSE_MAX 2400          // us at 180 degrees
+#define SOUND_SPEED 0.03435           // cm/us at 20 C, as the TMS Sonar default
+
+// ===== Default scenario =====
+#define SIM_DAYS 7
+#define SIM_STORMS_PER_DAY 3.0
+#define SIM_STORM_MIN_MINUTES 20
+#define SIM_STORM_MAX_MINUTES 180
+#define SIM_STORM_MAX_INFLOW 3.0      // cm/min at the peak of the heaviest storm
+#define SIM_NETWORK_LATENCY 20000     // us, MQTT one way
+#define SIM_SECONDARY_LATENCY_FACTOR 2  // the secondary broker is this many times farther
+#define SIM_SLOW_LATENCY 400000       // us, one way through the primary broker while it is slow
+#define SIM_SLOW_MIN_MINUTES 10
+#define SIM_SLOW_MAX_MINUTES 60
+#define SIM_SONAR_NOISE 0.3           // cm, uniform +-
+#define SIM_SONAR_DROPOUT 0.01        // probability of a missing echo
+#define SIM_CONFIG_INTERVAL 3600000000ULL  // us between two -C configurations
+
+#endif
@@ -0,0 +1,53 @@
+#include "Tank.h"
+#include "SimConfig.h"
+#include <math.h>
+
+Tank::Tank(Inflow inflow, double level)
+    : inflow(inflow), time(0), level(level), angle(0), targetAngle(0), overflowTime(0) {}
+
+void Tank::advance(uint64_t t) {
+    while (time + TANK_STEP <= t) {
+        double dt = TANK_STEP / 1e6;
+
+        double maxMove = SERVO_SLEW * dt;
+        double move = targetAngle - angle;
+        angle += move > maxMove ? maxMove : (move < -maxMove ? -maxMove : move);
+
+        double rate = inflow(time) - getValveOpening() * VALVE_FLOW_COEFF * sqrt(level);
+        level += rate * dt / 60.0;
+        if (level < 0) {
+            level = 0;
+        }
+        if (level >= TANK_HEIGHT) {
+            // Spills over the top
+            level = TANK_HEIGHT;
+            overflowTime += TANK_STEP;
+        }
+
+        time += TANK_STEP;
+        if (onStep) {
+            onStep(time, level);
+        }
+    }
+}
+
+void Tank::setServoPulse(int pulseUs) {
+    targetAngle = (pulseUs - SERVO_PULSE_MIN) * 180.0 / (SERVO_PULSE_MAX - SERVO_PULSE_MIN);
+}
+
+double Tank::getLevel() const {
+    return level;
+}
+
+double Tank::getValveAngle() const {
+    return angle;
+}
+
+double Tank::getValveOpening() const {
+    double opening = angle / SERVO_OPEN_ANGLE;
+    return opening < 0 ? 0 : (opening > 1 ? 1 : opening);
+}
+
+uint64_t Tank::getOverflowTime() const {
+    return overflowTime;
+}
@@ -0,0 +1,45 @@
+#ifndef __TANK__
+#define __TANK__
+
+#include <stdint.h>
+#include <functional>
+
+/**
+ * Rainwater tank drained through the WCS valve
+ * Rain raises the level at inflow(t) cm/min; the valve drains
+ * opening * VALVE_FLOW_COEFF * sqrt(level) cm/min (Torricelli). The valve
+ * follows the servo at SERVO_SLEW. Integrated in TANK_STEP steps up to
+ * the time asked for, so it costs nothing between queries.
+ */
+class Tank {
+public:
+    typedef std::function<double(uint64_t t)> Inflow;
+
+    Tank(Inflow inflow, double level);
+
+    /* integrate up to time t (us) */
+    void advance(uint64_t t);
+
+    /* servo pulse width (us) from the WCS */
+    void setServoPulse(int pulseUs);
+
+    double getLevel() const;
+    double getValveAngle() const;
+    double getValveOpening() const;
+
+    /* time the tank spent full (us) */
+    uint64_t getOverflowTime() const;
+
+    /* called after every integration step */
+    std::function<void(uint64_t t, double level)> onStep;
+
+private:
+    Inflow inflow;
+    uint64_t time;
+    double level;
+    double angle;
+    double targetAngle;
+    uint64_t overflowTime;
+};
+
+#endif
@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "TraceFile.h"
+
+static int base64Value(char c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+}
+
+static std::vector<uint8_t> base64Decode(const char* text) {
+    std::vector<uint8_t> out;
+    uint32_t v = 0;
+    int bits = 0;
+    for (const char* p = text; *p != '\0' && *p != '='; p++) {
+        int d = base64Value(*p);
+        if (d < 0) {
+            continue;
+        }
+        v = (v << 6) | d;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out.push_back((v >> bits) & 0xFF);
+        }
+    }
+    return out;
+}
+
+std::vector<TraceRecord> loadTrace(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (f == nullptr) {
+        perror(path);
+        exit(1);
+    }
+
+    std::map<int, std::vector<uint8_t> > chunks;
+    int expected = -1;
+    unsigned long t0 = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), f) != nullptr) {
+        // Serial logs prefix chunks with "TRACE ", mosquitto_sub -v with the topic
+        const char* json = strchr(line, '{');
+        if (json == nullptr) {
+            continue;
+        }
+        JsonDocument doc;
+        if (deserializeJson(doc, json) || doc["chunk"].isNull() || doc["data"].isNull()) {
+            continue;
+        }
+        int chunk = doc["chunk"] | 0;
+        if (chunk == 0) {
+            // A new dump starts: keep only the last one in the file
+            chunks.clear();
+        }
+        expected = doc["chunks"] | 0;
+        t0 = doc["t0"] | 0UL;
+        std::vector<uint8_t> bytes = base64Decode(doc["data"] | "");
+        if ((int)bytes.size() != 4 * (doc["records"] | 0)) {
+            fprintf(stderr, "%s: chunk %d is damaged\n", path, chunk);
+            exit(1);
+        }
+        chunks[chunk] = bytes;
+    }
+    fclose(f);
+
+    if (expected < 0) {
+        fprintf(stderr, "%s: no trace chunks\n", path);
+        exit(1);
+    }
+    std::vector<TraceRecord> records;
+    uint64_t time = t0;
+    for (int i = 0; i < expected; i++) {
+        if (chunks.find(i) == chunks.end()) {
+            fprintf(stderr, "%s: chunk %d of %d missing\n", path, i, expected);
+            exit(1);
+        }
+        const std::vector<uint8_t>& b = chunks[i];
+        for (size_t j = 0; j + 3 < b.size(); j += 4) {
+            unsigned dt = b[j] | (b[j + 1] << 8);
+            unsigned echo = b[j + 2] | (b[j + 3] << 8);
+            // The first record's dt refers to a reading no longer in the trace
+            if (!records.empty()) {
+                time += dt;
+            }
+            TraceRecord r = { time, echo };
+            records.push_back(r);
+        }
+    }
+    return records;
+}
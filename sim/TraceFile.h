@@ -0,0 +1,22 @@
+#ifndef __TRACE_FILE__
+#define __TRACE_FILE__
+
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Sonar trace files, as exported by the TMS (see TMS/README.md): chunk
+ * lines from tms/trace/data or "TRACE " lines of a serial log
+ */
+struct TraceRecord {
+    uint64_t time;      // ms, TMS clock
+    unsigned long echo; // us, 0 if none
+};
+
+/**
+ * The records of the last dump in the file, in order
+ * Exits with a message if the file cannot be read or a chunk is missing.
+ */
+std::vector<TraceRecord> loadTrace(const char* path);
+
+#endif
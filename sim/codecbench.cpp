@@ -0,0 +1,190 @@
+/*
+ * Level codec benchmark
+ * Runs the TMS LevelCodec (TMS/src/model/LevelCodec.h) over recorded
+ * readings: a sonar trace exported by the TMS, turned into readings the
+ * way MonitoringTask does, or the levels.csv written by replay -o.
+ * Reports the compression against the in-memory WaterLevelData and the
+ * JSON messages, encode and decode throughput, and checks that every
+ * sample decodes back with level and distance within the fixed-point step.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "TraceFile.h"
+
+namespace tms {
+#include "model/LevelCodec.h"
+}
+
+#define RAW_SAMPLE_BYTES 16         // sizeof(WaterLevelData) on the ESP32
+#define SOUND_SPEED_CM_US 0.03435   // Sonar default (20 C)
+#define MIN_BENCH_TIME 0.5          // s of encoding (and of decoding) per measurement
+
+typedef std::chrono::steady_clock Clock;
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+            "usage: %s [-v] file\n"
+            "  file  sonar trace (chunk lines or 'TRACE ' serial lines), or\n"
+            "        levels.csv from replay -o\n"
+            "  -v    print the decoded samples\n",
+            prog);
+    exit(2);
+}
+
+static bool isLevelsCsv(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (f == nullptr) {
+        perror(path);
+        exit(1);
+    }
+    char line[64] = "";
+    bool csv = fgets(line, sizeof(line), f) != nullptr && strncmp(line, "time_s,", 7) == 0;
+    fclose(f);
+    return csv;
+}
+
+/* readings as MonitoringTask would have produced them from the echoes */
+static std::vector<tms::WaterLevelData> fromTrace(const char* path) {
+    std::vector<TraceRecord> trace = loadTrace(path);
+    std::vector<tms::WaterLevelData> samples;
+    for (size_t i = 0; i < trace.size(); i++) {
+        tms::WaterLevelData d;
+        d.distance = trace[i].echo == 0 ? -1.0f : (float)(trace[i].echo / 2.0 * SOUND_SPEED_CM_US);
+        d.calculateLevel(TANK_HEIGHT);
+        d.timestamp = trace[i].time / 1000;
+        d.state = tms::MONITORING;
+        samples.push_back(d);
+    }
+    return samples;
+}
+
+static std::vector<tms::WaterLevelData> fromCsv(const char* path) {
+    FILE* f = fopen(path, "r");
+    std::vector<tms::WaterLevelData> samples;
+    char line[128];
+    fgets(line, sizeof(line), f);
+    double time, level, distance;
+    while (fgets(line, sizeof(line), f) != nullptr) {
+        if (sscanf(line, "%lf,%lf,%lf", &time, &level, &distance) != 3) {
+            continue;
+        }
+        tms::WaterLevelData d;
+        d.distance = distance;
+        d.level = level;
+        d.timestamp = (unsigned long)time;
+        d.state = tms::MONITORING;
+        samples.push_back(d);
+    }
+    fclose(f);
+    return samples;
+}
+
+int main(int argc, char** argv) {
+    bool verbose = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "v")) != -1) {
+        switch (opt) {
+            case 'v': verbose = true; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+    }
+    const char* path = argv[optind];
+    std::vector<tms::WaterLevelData> samples = isLevelsCsv(path) ? fromCsv(path) : fromTrace(path);
+    if (samples.empty()) {
+        fprintf(stderr, "%s: no readings\n", path);
+        return 1;
+    }
+
+    // Worst case per sample: STATE, STEP with a 32-bit level delta and step
+    std::vector<uint8_t> buffer(samples.size() * 16 + 16);
+    tms::LevelEncoder encoder(buffer.data(), buffer.size());
+    size_t jsonBytes = 0;
+    for (size_t i = 0; i < samples.size(); i++) {
+        if (!encoder.append(samples[i])) {
+            fprintf(stderr, "encoder full after %zu samples\n", i);
+            return 1;
+        }
+        jsonBytes += samples[i].toJson().length();
+    }
+    size_t encoded = encoder.size();
+
+    // Round trip: timestamps and states exact, levels within half a step,
+    // distances (height - level) within a step
+    tms::LevelDecoder decoder(buffer.data(), encoded);
+    tms::WaterLevelData d;
+    size_t decoded = 0;
+    double maxError = 0;
+    double maxDistanceError = 0;
+    bool exact = true;
+    while (decoder.next(d)) {
+        if (decoded < samples.size()) {
+            const tms::WaterLevelData& s = samples[decoded];
+            maxError = std::max(maxError, fabs((double)d.level - s.level));
+            maxDistanceError = std::max(maxDistanceError, s.level >= 0 ? fabs((double)d.distance - s.distance) : 0.0);
+            exact = exact && d.timestamp == s.timestamp && d.state == s.state;
+        }
+        if (verbose) {
+            printf("%lu,%.1f,%.1f,%d\n", d.timestamp, d.level, d.distance, (int)d.state);
+        }
+        decoded++;
+    }
+    bool ok = !decoder.isCorrupt() && decoded == samples.size() && exact &&
+              maxError <= 0.5 / LEVEL_CODEC_SCALE + 1e-4 &&
+              maxDistanceError <= 1.0 / LEVEL_CODEC_SCALE + 1e-4;
+
+    // Throughput, repeated until the measurement is long enough
+    unsigned long rounds = 0;
+    double encodeTime = 0;
+    while (encodeTime < MIN_BENCH_TIME) {
+        Clock::time_point start = Clock::now();
+        encoder.clear();
+        for (size_t i = 0; i < samples.size(); i++) {
+            encoder.append(samples[i]);
+        }
+        encodeTime += std::chrono::duration<double>(Clock::now() - start).count();
+        rounds++;
+    }
+    double encodeRate = rounds * samples.size() / encodeTime;
+
+    rounds = 0;
+    double decodeTime = 0;
+    volatile unsigned long sink = 0;
+    while (decodeTime < MIN_BENCH_TIME) {
+        Clock::time_point start = Clock::now();
+        tms::LevelDecoder bench(buffer.data(), encoded);
+        while (bench.next(d)) {
+            sink += d.timestamp;
+        }
+        decodeTime += std::chrono::duration<double>(Clock::now() - start).count();
+        rounds++;
+    }
+    double decodeRate = rounds * samples.size() / decodeTime;
+
+    size_t raw = samples.size() * RAW_SAMPLE_BYTES;
+    printf("%-28s %zu\n", "samples", samples.size());
+    printf("%-28s %zu bytes (%d per sample)\n", "WaterLevelData", raw, RAW_SAMPLE_BYTES);
+    printf("%-28s %zu bytes\n", "JSON messages", jsonBytes);
+    printf("%-28s %zu bytes, %.3f per sample\n", "encoded", encoded, (double)encoded / samples.size());
+    printf("%-28s %.1fx vs WaterLevelData, %.1fx vs JSON\n", "compression ratio",
+           (double)raw / encoded, (double)jsonBytes / encoded);
+    printf("%-28s %.1f M samples/s, %.1f MB/s of WaterLevelData\n", "encode",
+           encodeRate / 1e6, encodeRate * RAW_SAMPLE_BYTES / 1e6);
+    printf("%-28s %.1f M samples/s, %.1f MB/s of WaterLevelData\n", "decode",
+           decodeRate / 1e6, decodeRate * RAW_SAMPLE_BYTES / 1e6);
+    printf("%-28s %s, max level error %.3f cm, max distance error %.3f cm\n", "round trip",
+           ok ? "ok" : "FAILED", maxError, maxDistanceError);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,573 @@
+/*
+ * Co-simulation of the whole system
+ * The TMS and WCS firmwares run on simulated boards, the CUS policy and
+ * serial protocol on CusModel, the sonar looks at a rainwater tank filled
+ * by random storms and drained through the valve the WCS servo drives.
+ * A week of operation runs in seconds; the report covers actuation
+ * latency, overshoot above L2 and the traffic on both links.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <random>
+#include <vector>
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "SimConfig.h"
+#include "Simulation.h"
+#include "SimBoard.h"
+#include "Network.h"
+#include "Firmware.h"
+#include "Tank.h"
+#include "CusModel.h"
+
+#define DAY_US 86400000000ULL
+#define MINUTE_US 60000000ULL
+#define OUTAGE_MIN_MINUTES 1
+#define OUTAGE_MAX_MINUTES 10
+#define STATUS_POLL_PERIOD 1000000ULL   // us between TMS state polls
+
+struct Options {
+    double days;
+    unsigned long seed;
+    bool binary;
+    double stormsPerDay;
+    uint64_t latency;
+    double outagesPerDay;
+    double primaryOutagesPerDay;
+    double slowdownsPerDay;
+    double byteErrors;
+    bool manual;
+    bool verbose;
+    const char* tracePath;
+    const char* flightPath;
+    const char* historyPath;
+    std::vector<const char*> configs;
+};
+
+struct Storm {
+    uint64_t start;
+    uint64_t duration;
+    double peak;     // cm/min
+};
+
+/* count, mean, p95 and max of a series of durations */
+class Series {
+public:
+    void add(double v) { values.push_back(v); }
+
+    void print(const char* name, double scale, const char* unit) {
+        if (values.empty()) {
+            printf("%-34s -\n", name);
+            return;
+        }
+        std::sort(values.begin(), values.end());
+        double sum = 0;
+        for (size_t i = 0; i < values.size(); i++) {
+            sum += values[i];
+        }
+        size_t p95 = (size_t)ceil(0.95 * values.size()) - 1;
+        printf("%-34s n=%zu mean=%.1f p95=%.1f max=%.1f %s\n", name, values.size(),
+               sum / values.size() / scale, values[p95] / scale, values.back() / scale, unit);
+    }
+
+private:
+    std::vector<double> values;
+};
+
+/* a valve target decided by the CUS, waiting for the servo to follow */
+struct Decision {
+    int valve;
+    uint64_t decidedAt;
+    uint64_t sampledAt;
+};
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+            "usage: %s [-d days] [-s seed] [-b] [-n storms/day] [-l latency ms]\n"
+            "          [-o broker outages/day] [-p primary broker outages/day]\n"
+            "          [-j primary broker slowdowns/day] [-e byte error probability] [-m] [-v]\n"
+            "          [-t trace] [-f flight] [-H history] [-C config]\n"
+            "  -b  binary serial protocol (default JSON)\n"
+            "  -o  all brokers down at once; -p only the primary one\n"
+            "  -j  the primary broker gets slow (SIM_SLOW_LATENCY) but keeps working\n"
+            "  -m  use the button and potentiometer once a day\n"
+            "  -v  echo the TMS debug output\n"
+            "  -t  at the end, dump the TMS sonar trace over MQTT into a file\n"
+            "  -f  at the end, request the TMS flight recorder into a file\n"
+            "  -H  at the end, query the whole TMS history log into a CSV file\n"
+            "  -C  retained TMS runtime configuration (JSON) on the broker from the start;\n"
+            "      each further -C replaces it one hour later\n",
+            prog);
+    exit(2);
+}
+
+static Options parseOptions(int argc, char** argv) {
+    Options options;
+    options.days = SIM_DAYS;
+    options.seed = 1;
+    options.binary = false;
+    options.stormsPerDay = SIM_STORMS_PER_DAY;
+    options.latency = SIM_NETWORK_LATENCY;
+    options.outagesPerDay = 0;
+    options.primaryOutagesPerDay = 0;
+    options.slowdownsPerDay = 0;
+    options.byteErrors = 0;
+    options.manual = false;
+    options.verbose = false;
+    options.tracePath = nullptr;
+    options.flightPath = nullptr;
+    options.historyPath = nullptr;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:s:bn:l:o:p:j:e:mvt:f:H:C:")) != -1) {
+        switch (opt) {
+            case 'd': options.days = atof(optarg); break;
+            case 's': options.seed = strtoul(optarg, nullptr, 10); break;
+            case 'b': options.binary = true; break;
+            case 'n': options.stormsPerDay = atof(optarg); break;
+            case 'l': options.latency = (uint64_t)(atof(optarg) * 1000); break;
+            case 'o': options.outagesPerDay = atof(optarg); break;
+            case 'p': options.primaryOutagesPerDay = atof(optarg); break;
+            case 'j': options.slowdownsPerDay = atof(optarg); break;
+            case 'e': options.byteErrors = atof(optarg); break;
+            case 'm': options.manual = true; break;
+            case 'v': options.verbose = true; break;
+            case 't': options.tracePath = optarg; break;
+            case 'f': options.flightPath = optarg; break;
+            case 'H': options.historyPath = optarg; break;
+            case 'C': options.configs.push_back(optarg); break;
+            default: usage(argv[0]);
+        }
+    }
+    return options;
+}
+
+/* Poisson arrivals over [0, end) */
+static std::vector<uint64_t> arrivals(std::mt19937_64& rng, double perDay, uint64_t end) {
+    std::vector<uint64_t> times;
+    if (perDay <= 0) {
+        return times;
+    }
+    std::exponential_distribution<double> gap(perDay / DAY_US);
+    double t = gap(rng);
+    while (t < end) {
+        times.push_back((uint64_t)t);
+        t += gap(rng);
+    }
+    return times;
+}
+
+int main(int argc, char** argv) {
+    Options options = parseOptions(argc, argv);
+    uint64_t end = (uint64_t)(options.days * DAY_US);
+    std::mt19937_64 rng(options.seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    // Storms: triangular inflow profiles
+    std::vector<Storm> storms;
+    std::vector<uint64_t> stormStarts = arrivals(rng, options.stormsPerDay, end);
+    for (size_t i = 0; i < stormStarts.size(); i++) {
+        Storm storm;
+        storm.start = stormStarts[i];
+        storm.duration = (uint64_t)((SIM_STORM_MIN_MINUTES +
+                                     uniform(rng) * (SIM_STORM_MAX_MINUTES - SIM_STORM_MIN_MINUTES)) * MINUTE_US);
+        storm.peak = (0.2 + 0.8 * uniform(rng)) * SIM_STORM_MAX_INFLOW;
+        storms.push_back(storm);
+    }
+    Tank::Inflow inflow = [&storms](uint64_t t) {
+        double rate = 0;
+        for (size_t i = 0; i < storms.size(); i++) {
+            const Storm& s = storms[i];
+            if (t < s.start || t >= s.start + s.duration) {
+                continue;
+            }
+            double x = (double)(t - s.start) / s.duration;
+            rate += s.peak * (x < 0.5 ? 2 * x : 2 * (1 - x));
+        }
+        return rate;
+    };
+
+    Simulation sim;
+    SimNetwork network(sim);
+    simNetwork = &network;
+    network.setLatency(options.latency);
+    network.setBrokerLatency(SIM_SECONDARY_BROKER, SIM_SECONDARY_LATENCY_FACTOR * options.latency);
+
+    SimBoard tmsBoard(sim, "TMS");
+    SimBoard wcsBoard(sim, "WCS");
+    Tank tank(inflow, 0);
+    CusModel cus(sim, network, options.binary);
+
+    // ===== Plant metrics =====
+    unsigned long episodes = 0;
+    bool inEpisode = false;
+    double peak = 0, maxOvershoot = 0, sumOvershoot = 0;
+    uint64_t aboveL2 = 0;
+    tank.onStep = [&](uint64_t t, double level) {
+        if (level > CUS_L2) {
+            aboveL2 += TANK_STEP;
+            if (!inEpisode) {
+                inEpisode = true;
+                episodes++;
+                peak = level;
+            }
+            peak = std::max(peak, level);
+        } else if (inEpisode && level < CUS_L1) {
+            // An episode ends once the tank is back below L1
+            inEpisode = false;
+            maxOvershoot = std::max(maxOvershoot, peak - CUS_L2);
+            sumOvershoot += peak - CUS_L2;
+        }
+    };
+
+    // ===== TMS: sonar on the tank =====
+    tmsBoard.onPulseIn = [&](uint8_t pin) -> unsigned long {
+        if (pin != TMS_SONAR_ECHO_PIN) {
+            return 0;
+        }
+        tank.advance(tmsBoard.getTime());
+        if (uniform(rng) < SIM_SONAR_DROPOUT) {
+            return 0;
+        }
+        double distance = TANK_HEIGHT - tank.getLevel() + (2 * uniform(rng) - 1) * SIM_SONAR_NOISE;
+        return (unsigned long)(2 * std::max(distance, 2.0) / SOUND_SPEED);
+    };
+    tmsBoard.onTx = [&](uint8_t c, uint64_t arrival) {
+        if (options.verbose) {
+            putchar(c);
+        }
+    };
+    tms::start(tmsBoard, TMS_LOOP_PERIOD);
+
+    unsigned long tmsDisconnects = 0;
+    bool publishing = false;
+    std::map<std::string, uint64_t> brokerTime;   // publishing through each broker
+    sim.every(STATUS_POLL_PERIOD, [&]() {
+        TmsStats stats = tms::getStats();
+        if (publishing && !stats.publishing) {
+            tmsDisconnects++;
+        }
+        publishing = stats.publishing;
+        if (publishing) {
+            brokerTime[stats.broker] += STATUS_POLL_PERIOD;
+        }
+    });
+
+    // A dashboard that only follows the trends
+    unsigned long summaries = 0, summaryBytes = 0;
+    std::string lastSummary;
+    network.subscribe(SUMMARY_TOPIC, [&](const std::string& topic, const std::string& payload, uint64_t sentAt) {
+        summaries++;
+        summaryBytes += payload.size();
+        lastSummary = payload;
+    }, 0);
+
+    // An operator's change, waiting for the TMS like a fleet rollout
+    unsigned long configAcks = 0;
+    std::string lastConfigAck;
+    if (!options.configs.empty()) {
+        network.subscribe(CONFIG_ACK_TOPIC, [&](const std::string& topic, const std::string& payload, uint64_t sentAt) {
+            configAcks++;
+            lastConfigAck = payload;
+        }, 0);
+        for (size_t i = 0; i < options.configs.size(); i++) {
+            const char* config = options.configs[i];
+            sim.at(i * SIM_CONFIG_INTERVAL, [&network, &sim, config]() {
+                network.publish(CONFIG_TOPIC, config, sim.now(), true);
+            });
+        }
+    }
+
+    // ===== Serial link between CUS and WCS =====
+    uint64_t cusLineFree = 0;
+    unsigned long corrupted = 0;
+    auto corrupt = [&](uint8_t c) -> uint8_t {
+        if (options.byteErrors > 0 && uniform(rng) < options.byteErrors) {
+            corrupted++;
+            return c ^ (1 << (rng() % 8));
+        }
+        return c;
+    };
+    wcsBoard.onTx = [&](uint8_t c, uint64_t arrival) {
+        uint8_t received = corrupt(c);
+        sim.at(arrival, [&cus, received]() { cus.receive(received); });
+    };
+    cus.send = [&](const uint8_t* data, size_t len) {
+        uint64_t byteTime = 10000000ULL / wcsBoard.getBaud();
+        for (size_t i = 0; i < len; i++) {
+            cusLineFree = std::max(cusLineFree, sim.now()) + byteTime;
+            uint8_t received = corrupt(data[i]);
+            sim.at(cusLineFree, [&wcsBoard, received]() { wcsBoard.receive(received); });
+        }
+    };
+
+    // ===== WCS: servo on the valve =====
+    std::deque<Decision> decisions;
+    Series decisionToServo, sampleToServo;
+    cus.onDecision = [&](int valve, uint64_t sampleTime) {
+        Decision d = { valve, sim.now(), sampleTime };
+        decisions.push_back(d);
+    };
+    wcsBoard.onServo = [&](uint8_t pin, int pulseUs) {
+        tank.advance(sim.now());
+        tank.setServoPulse(pulseUs);
+        double angle = (pulseUs - SERVO_PULSE_MIN) * 180.0 / (SERVO_PULSE_MAX - SERVO_PULSE_MIN);
+        int valve = (int)lround(angle * 100 / SERVO_OPEN_ANGLE);
+        // The servo now follows the oldest decision it matches; older ones were superseded
+        for (size_t i = 0; i < decisions.size(); i++) {
+            if (abs(decisions[i].valve - valve) <= 1) {
+                decisionToServo.add(sim.now() - decisions[i].decidedAt);
+                sampleToServo.add(sim.now() - decisions[i].sampledAt);
+                decisions.erase(decisions.begin(), decisions.begin() + i + 1);
+                break;
+            }
+        }
+    };
+
+    // The timer-triggered ADC is simulated in bursts, only while the pot settles
+    int adcBursts = 0;
+    std::function<void()> adcBurst = [&]() {
+        wcsBoard.interrupt([]() { wcs::convertAdc(ADC_BURST_CONVERSIONS); });
+        if (--adcBursts > 0) {
+            sim.after(ADC_BURST_PERIOD, adcBurst);
+        }
+    };
+    auto turnPot = [&](int value) {
+        wcsBoard.setAnalog(WCS_POT_CHANNEL, value);
+        if (adcBursts == 0) {
+            sim.after(ADC_BURST_PERIOD, adcBurst);
+        }
+        adcBursts = ADC_SETTLE_BURSTS;
+    };
+    auto pressButton = [&]() {
+        wcsBoard.setInput(WCS_BUTTON_PIN, true);
+        sim.after(200000, [&]() { wcsBoard.setInput(WCS_BUTTON_PIN, false); });
+    };
+
+    wcsBoard.service = [&]() {
+        // loop() runs again at once while the firmware has work left
+        while (wcs::hasWork()) {
+            wcs::loop();
+        }
+    };
+    wcsBoard.run([]() { wcs::setup(); });
+    turnPot(0);
+
+    if (options.manual) {
+        // Once a day at noon: MANUAL, open to 30% for ten minutes, back to AUTOMATIC
+        for (uint64_t noon = DAY_US / 2; noon < end; noon += DAY_US) {
+            sim.at(noon, pressButton);
+            sim.at(noon + MINUTE_US, [&]() { turnPot(310); });
+            sim.at(noon + 10 * MINUTE_US, [&]() { turnPot(0); });
+            sim.at(noon + 11 * MINUTE_US, pressButton);
+        }
+    }
+
+    // ===== Broker outages =====
+    std::vector<uint64_t> outages = arrivals(rng, options.outagesPerDay, end);
+    for (size_t i = 0; i < outages.size(); i++) {
+        uint64_t length = (uint64_t)((OUTAGE_MIN_MINUTES +
+                                      uniform(rng) * (OUTAGE_MAX_MINUTES - OUTAGE_MIN_MINUTES)) * MINUTE_US);
+        sim.at(outages[i], [&network]() { network.setBrokerUp(false); });
+        sim.at(outages[i] + length, [&network]() { network.setBrokerUp(true); });
+    }
+
+    // The primary broker alone: down, or slow (the TMS should fail over and back)
+    std::vector<uint64_t> primaryOutages = arrivals(rng, options.primaryOutagesPerDay, end);
+    for (size_t i = 0; i < primaryOutages.size(); i++) {
+        uint64_t length = (uint64_t)((OUTAGE_MIN_MINUTES +
+                                      uniform(rng) * (OUTAGE_MAX_MINUTES - OUTAGE_MIN_MINUTES)) * MINUTE_US);
+        sim.at(primaryOutages[i], [&network]() { network.setBrokerUp(SIM_PRIMARY_BROKER, false); });
+        sim.at(primaryOutages[i] + length, [&network]() { network.setBrokerUp(SIM_PRIMARY_BROKER, true); });
+    }
+    std::vector<uint64_t> slowdowns = arrivals(rng, options.slowdownsPerDay, end);
+    for (size_t i = 0; i < slowdowns.size(); i++) {
+        uint64_t length = (uint64_t)((SIM_SLOW_MIN_MINUTES +
+                                      uniform(rng) * (SIM_SLOW_MAX_MINUTES - SIM_SLOW_MIN_MINUTES)) * MINUTE_US);
+        uint64_t latency = options.latency;
+        sim.at(slowdowns[i], [&network]() { network.setBrokerLatency(SIM_PRIMARY_BROKER, SIM_SLOW_LATENCY); });
+        sim.at(slowdowns[i] + length, [&network, latency]() { network.setBrokerLatency(SIM_PRIMARY_BROKER, latency); });
+    }
+
+    cus.start();
+
+    auto wallStart = std::chrono::steady_clock::now();
+    sim.runUntil(end);
+    tank.advance(end);
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    if (inEpisode) {
+        maxOvershoot = std::max(maxOvershoot, peak - CUS_L2);
+        sumOvershoot += peak - CUS_L2;
+    }
+
+    // ===== Report =====
+    const CusModel::Stats& cs = cus.getStats();
+    WcsStats ws;
+    wcsBoard.run([&ws]() { ws = wcs::getStats(); });
+    TmsStats ts;
+    tmsBoard.run([&ts]() { ts = tms::getStats(); });
+
+    printf("%-34s %.2f days, seed %lu, %s serial, %zu storms, %zu broker outages\n", "scenario",
+           options.days, options.seed, options.binary ? "binary" : "JSON", storms.size(), outages.size());
+    printf("%-34s %.2f s (%.0fx real time), %llu events\n", "wall time", wall,
+           end / 1e6 / std::max(wall, 1e-9), sim.getEventCount());
+
+    printf("\n# actuation\n");
+    decisionToServo.print("decision -> servo", 1000, "ms");
+    sampleToServo.print("sonar sample -> servo", 1000, "ms");
+    printf("%-34s %zu\n", "decisions never actuated", decisions.size());
+
+    printf("\n# plant\n");
+    printf("%-34s %lu\n", "episodes above L2", episodes);
+    printf("%-34s %.2f cm\n", "max overshoot above L2", maxOvershoot);
+    printf("%-34s %.2f cm\n", "mean overshoot above L2", episodes ? sumOvershoot / episodes : 0.0);
+    printf("%-34s %.1f min\n", "time above L2", aboveL2 / 6e7);
+    printf("%-34s %.1f min\n", "overflow time", tank.getOverflowTime() / 6e7);
+    printf("%-34s %.2f cm\n", "final level", tank.getLevel());
+
+    printf("\n# MQTT\n");
+    printf("%-34s %lu\n", "published", network.getPublished());
+    printf("%-34s %lu\n", "delivered", network.getDelivered());
+    printf("%-34s %lu\n", "dropped", network.getDropped());
+    printf("%-34s %lu\n", "connects", network.getConnects());
+    printf("%-34s %lu\n", "TMS disconnects", tmsDisconnects);
+    printf("%-34s %lu (%lu bytes)\n", "level summaries", summaries, summaryBytes);
+    printf("%-34s %s\n", "last summary", lastSummary.c_str());
+    printf("%-34s %s\n", "TMS final state", ts.state);
+
+    printf("\n# brokers\n");
+    printf("%-34s %zu / %zu\n", "primary outages / slowdowns", primaryOutages.size(), slowdowns.size());
+    const char* hosts[] = { SIM_PRIMARY_BROKER, SIM_SECONDARY_BROKER };
+    for (const char* host : hosts) {
+        printf("%-34s %lu connects, publishing %.1f min\n", host, network.getConnects(host),
+               brokerTime[host] / 6e7);
+    }
+    printf("%-34s %lu\n", "TMS broker switches", ts.brokerSwitches);
+    printf("%-34s %s\n", "TMS final broker", ts.broker);
+
+    printf("\n# TMS\n");
+    printf("%-34s %s\n", "scheduler", ts.scheduler);
+    printf("%-34s %lu, %lu late, %lu dropped\n", "sonar readings", ts.samples, ts.lateSamples, ts.droppedReadings);
+    printf("%-34s %.0f / %lu us\n", "sampling jitter mean / max", ts.meanJitterUs, ts.maxJitterUs);
+    printf("%-34s %lu\n", "task group deadline misses", ts.deadlineMisses);
+    if (!options.configs.empty()) {
+        printf("%-34s %lu, last %s\n", "config acks", configAcks, lastConfigAck.c_str());
+    }
+
+    printf("\n# serial\n");
+    printf("%-34s %lu\n", "bytes CUS -> WCS", cs.txBytes);
+    printf("%-34s %lu\n", "bytes WCS -> CUS", wcsBoard.getTxBytes());
+    printf("%-34s %lu\n", "corrupted bytes", corrupted);
+    printf("%-34s %lu\n", "WCS RX overruns", wcsBoard.getRxOverruns());
+    printf("%-34s %lu / %lu\n", "valve / display commands", cs.valveCommands, cs.displayCommands);
+    printf("%-34s %lu\n", "retransmissions", cs.retransmissions);
+    printf("%-34s %lu\n", "commands given up", cs.dropped);
+    printf("%-34s %lu / %lu\n", "ACKs / NACKs", cs.acks, cs.nacks);
+    printf("%-34s %lu\n", "pings", cs.pings);
+    printf("%-34s %lu / %lu\n", "mode / valve reports", cs.modeReports, cs.valveReports);
+
+    printf("\n# CUS\n");
+    printf("%-34s %lu\n", "level messages", cs.levelMessages);
+    printf("%-34s %lu\n", "T2 timeouts", cs.unconnected);
+    printf("%-34s %s\n", "final mode", cus.getMode());
+
+    printf("\n# WCS\n");
+    printf("%-34s %u\n", "coalesced commands", ws.coalescedCommands);
+    printf("%-34s %u\n", "duplicate commands", ws.duplicateCommands);
+    printf("%-34s %u\n", "frame errors", ws.frameErrors);
+    printf("%-34s %u\n", "coalesced events", ws.coalescedEvents);
+    printf("%-34s %lu\n", "missed ticks", ws.missedTicks);
+    printf("%-34s %lu us\n", "max busy", ws.maxBusyUs);
+    printf("%-34s %.2f %%\n", "utilisation", ws.utilisation);
+
+    if (options.tracePath != nullptr) {
+        // Ask for the trace like an operator would, and keep the chunks
+        FILE* f = fopen(options.tracePath, "w");
+        if (f == nullptr) {
+            perror(options.tracePath);
+            return 1;
+        }
+        bool done = false;
+        network.subscribe(TRACE_DATA_TOPIC, [&](const std::string& topic, const std::string& payload, uint64_t sentAt) {
+            fprintf(f, "%s\n", payload.c_str());
+            JsonDocument doc;
+            if (!deserializeJson(doc, payload.c_str())) {
+                done = (doc["chunk"] | 0) + 1 >= (doc["chunks"] | 0);
+            }
+        }, sim.now());
+        network.publish(TRACE_CMD_TOPIC, "dump", sim.now());
+        uint64_t deadline = sim.now() + TRACE_DUMP_TIMEOUT;
+        while (!done && sim.now() < deadline) {
+            sim.runUntil(sim.now() + 100000);
+        }
+        fclose(f);
+        printf("\n%-34s %s%s\n", "sonar trace", options.tracePath, done ? "" : " (incomplete)");
+    }
+
+    if (options.flightPath != nullptr) {
+        // A retained request, as an operator would leave for a TMS that may be offline
+        std::string response;
+        network.subscribe(FLIGHT_RESPONSE_TOPIC, [&](const std::string& topic, const std::string& payload, uint64_t sentAt) {
+            response = payload;
+        }, sim.now());
+        char request[64];
+        snprintf(request, sizeof(request), "{\"id\": %lu, \"last\": %d}", (unsigned long)options.seed, FLIGHT_REQUEST_RECORDS);
+        network.publish(FLIGHT_REQUEST_TOPIC, request, sim.now(), true);
+        uint64_t deadline = sim.now() + FLIGHT_REQUEST_TIMEOUT;
+        while (response.empty() && sim.now() < deadline) {
+            sim.runUntil(sim.now() + 100000);
+        }
+        FILE* f = fopen(options.flightPath, "w");
+        if (f == nullptr) {
+            perror(options.flightPath);
+            return 1;
+        }
+        fprintf(f, "%s\n", response.c_str());
+        fclose(f);
+        printf("%-34s %s%s\n", "flight recorder", options.flightPath, response.empty() ? " (no response)" : "");
+    }
+
+    if (options.historyPath != nullptr) {
+        // The whole range, page after page, as a dashboard backfill would
+        FILE* f = fopen(options.historyPath, "w");
+        if (f == nullptr) {
+            perror(options.historyPath);
+            return 1;
+        }
+        fprintf(f, "epoch_s,level_cm\n");
+        bool done = false;
+        unsigned long pages = 0, readings = 0, bytes = 0;
+        network.subscribe(HISTORY_RESPONSE_TOPIC, [&](const std::string& topic, const std::string& payload, uint64_t sentAt) {
+            JsonDocument doc;
+            if (deserializeJson(doc, payload.c_str()) || (doc["id"] | 0UL) != options.seed) {
+                return;
+            }
+            JsonArray samples = doc["samples"];
+            for (JsonArray s : samples) {
+                fprintf(f, "%lu,%.1f\n", s[0] | 0UL, s[1] | -1.0);
+                readings++;
+            }
+            pages++;
+            bytes += payload.size();
+            done = !(doc["more"] | false);
+        }, sim.now());
+        char request[64];
+        snprintf(request, sizeof(request), "{\"id\": %lu}", (unsigned long)options.seed);
+        network.publish(HISTORY_REQUEST_TOPIC, request, sim.now());
+        uint64_t deadline = sim.now() + HISTORY_REQUEST_TIMEOUT;
+        while (!done && sim.now() < deadline) {
+            sim.runUntil(sim.now() + 100000);
+        }
+        fclose(f);
+        printf("%-34s %s, %lu readings in %lu pages (%lu bytes)%s\n", "history log", options.historyPath,
+               readings, pages, bytes, done ? "" : " (incomplete)");
+    }
+    return 0;
+}
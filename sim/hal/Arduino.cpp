@@ -0,0 +1,346 @@
+#include "Arduino.h"
+#include "SimBoard.h"
+
+HardwareSerial Serial;
+
+// ===== Time and pins =====
+
+unsigned long millis() {
+    return simBoard->getTime() / 1000;
+}
+
+unsigned long micros() {
+    return simBoard->getTime();
+}
+
+void delay(unsigned long ms) {
+    simBoard->advance(1000ULL * ms);
+}
+
+void delayMicroseconds(unsigned int us) {
+    simBoard->spin(us);
+}
+
+void yield() {}
+
+void configTime(long gmtOffset, int daylightOffset, const char* server1,
+                const char* server2, const char* server3) {
+    simBoard->setClock();
+}
+
+time_t simTime(time_t* t) {
+    time_t now = simBoard->getTime() / 1000000;
+    if (simBoard->isClockSet()) {
+        now += SIM_EPOCH;
+    }
+    if (t != nullptr) {
+        *t = now;
+    }
+    return now;
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+    simBoard->setPinMode(pin, mode);
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    simBoard->writePin(pin, value != LOW);
+}
+
+int digitalRead(uint8_t pin) {
+    return simBoard->readPin(pin) ? HIGH : LOW;
+}
+
+int analogRead(uint8_t pin) {
+    // Conversion time at the default 125 kHz ADC clock
+    simBoard->advance(104);
+    return simBoard->readAnalog(pin >= A0 ? pin - A0 : pin);
+}
+
+unsigned long pulseIn(uint8_t pin, uint8_t state, unsigned long timeout) {
+    return simBoard->measurePulse(pin, timeout);
+}
+
+long map(long x, long inMin, long inMax, long outMin, long outMax) {
+    return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+volatile uint8_t* portInputRegister(uint8_t port) {
+    return simBoard->inputRegister(port);
+}
+
+// ===== String =====
+
+static std::string formatNumber(unsigned long value, unsigned char base, bool negative) {
+    char buf[8 * sizeof(long) + 2];
+    char* p = buf + sizeof(buf) - 1;
+    *p = 0;
+    if (base < 2) {
+        base = 10;
+    }
+    do {
+        unsigned long digit = value % base;
+        *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+        value /= base;
+    } while (value);
+    if (negative) {
+        *--p = '-';
+    }
+    return p;
+}
+
+String::String(const char* s) : str(s ? s : "") {}
+String::String(const __FlashStringHelper* s) : str(s ? (const char*)s : "") {}
+String::String(const std::string& s) : str(s) {}
+String::String(char c) : str(1, c) {}
+String::String(int value, unsigned char base) : String((long)value, base) {}
+String::String(unsigned int value, unsigned char base) : str(formatNumber(value, base, false)) {}
+
+String::String(long value, unsigned char base) {
+    // Like Arduino: only base 10 shows a sign, other bases the two's complement
+    bool negative = value < 0 && base == 10;
+    str = formatNumber(negative ? 0UL - (unsigned long)value : (unsigned long)value, base, negative);
+}
+
+String::String(unsigned long value, unsigned char base) : str(formatNumber(value, base, false)) {}
+
+String::String(double value, unsigned char decimals) {
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%.*f", decimals, value);
+    str = buf;
+}
+
+String& String::operator=(const char* s) {
+    // ArduinoJson assigns a null pointer to clear a String
+    str = s ? s : "";
+    return *this;
+}
+
+String& String::operator+=(const String& s) {
+    str += s.str;
+    return *this;
+}
+
+String& String::operator+=(const char* s) {
+    concat(s);
+    return *this;
+}
+
+String& String::operator+=(char c) {
+    str += c;
+    return *this;
+}
+
+bool String::concat(const char* s) {
+    if (s) {
+        str += s;
+    }
+    return true;
+}
+
+bool String::concat(char c) {
+    str += c;
+    return true;
+}
+
+unsigned int String::length() const {
+    return str.size();
+}
+
+bool String::reserve(unsigned int size) {
+    str.reserve(size);
+    return true;
+}
+
+const char* String::c_str() const {
+    return str.c_str();
+}
+
+char String::operator[](unsigned int index) const {
+    return index < str.size() ? str[index] : 0;
+}
+
+int String::indexOf(char c, unsigned int from) const {
+    size_t pos = str.find(c, from);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::indexOf(const char* s, unsigned int from) const {
+    size_t pos = str.find(s, from);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+String String::substring(unsigned int from) const {
+    return from < str.size() ? String(str.substr(from)) : String();
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+    if (from > to) {
+        unsigned int t = from;
+        from = to;
+        to = t;
+    }
+    return from < str.size() ? String(str.substr(from, to - from)) : String();
+}
+
+void String::trim() {
+    size_t begin = str.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos) {
+        str.clear();
+        return;
+    }
+    size_t end = str.find_last_not_of(" \t\r\n");
+    str = str.substr(begin, end - begin + 1);
+}
+
+long String::toInt() const {
+    return atol(str.c_str());
+}
+
+float String::toFloat() const {
+    return atof(str.c_str());
+}
+
+bool String::equals(const String& s) const {
+    return str == s.str;
+}
+
+bool String::startsWith(const char* s) const {
+    return str.compare(0, strlen(s), s) == 0;
+}
+
+bool String::operator==(const String& s) const {
+    return str == s.str;
+}
+
+bool String::operator==(const char* s) const {
+    return str == (s ? s : "");
+}
+
+bool String::operator!=(const String& s) const {
+    return !(*this == s);
+}
+
+bool String::operator!=(const char* s) const {
+    return !(*this == s);
+}
+
+String operator+(const String& a, const String& b) {
+    String s(a);
+    s += b;
+    return s;
+}
+
+String operator+(const String& a, const char* b) {
+    String s(a);
+    s += b;
+    return s;
+}
+
+String operator+(const char* a, const String& b) {
+    String s(a);
+    s += b;
+    return s;
+}
+
+// ===== Print =====
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        write(buffer[i]);
+    }
+    return size;
+}
+
+size_t Print::write(const char* s) {
+    return s ? write((const uint8_t*)s, strlen(s)) : 0;
+}
+
+size_t Print::print(const char* s) {
+    return write(s);
+}
+
+size_t Print::print(const String& s) {
+    return write((const uint8_t*)s.c_str(), s.length());
+}
+
+size_t Print::print(const __FlashStringHelper* s) {
+    return write((const char*)s);
+}
+
+size_t Print::print(char c) {
+    return write((uint8_t)c);
+}
+
+size_t Print::print(int value, int base) {
+    return print(String(value, base));
+}
+
+size_t Print::print(unsigned int value, int base) {
+    return print(String(value, base));
+}
+
+size_t Print::print(long value, int base) {
+    return print(String(value, base));
+}
+
+size_t Print::print(unsigned long value, int base) {
+    return print(String(value, base));
+}
+
+size_t Print::print(double value, int decimals) {
+    return print(String(value, decimals));
+}
+
+size_t Print::println() {
+    return write((const uint8_t*)"\r\n", 2);
+}
+
+size_t Print::printf(const char* format, ...) {
+    char buf[256];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    return n > 0 ? write((const uint8_t*)buf, strlen(buf)) : 0;
+}
+
+// ===== HardwareSerial =====
+
+void HardwareSerial::begin(unsigned long baud) {
+    simBoard->uartBegin(baud);
+}
+
+void HardwareSerial::end() {}
+
+int HardwareSerial::available() {
+    return simBoard->uartAvailable();
+}
+
+int HardwareSerial::read() {
+    return simBoard->uartRead();
+}
+
+int HardwareSerial::peek() {
+    return simBoard->uartPeek();
+}
+
+int HardwareSerial::availableForWrite() {
+    return simBoard->uartAvailableForWrite();
+}
+
+void HardwareSerial::flush() {
+    simBoard->uartFlush();
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+    simBoard->uartWrite(c);
+    return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        simBoard->uartWrite(buffer[i]);
+    }
+    return size;
+}
@@ -0,0 +1,178 @@
+#ifndef __SIM_ARDUINO__
+#define __SIM_ARDUINO__
+
+/**
+ * Arduino API of the simulated HAL
+ * Every call acts on simBoard, the board whose firmware is currently
+ * running (see SimBoard.h). Time only passes in calls that block on real
+ * hardware: delay(), delayMicroseconds(), pulseIn(), Serial.flush() and
+ * writes to a full UART buffer.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <string>
+#include <avr/pgmspace.h>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper*>(PSTR(s)))
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+unsigned long pulseIn(uint8_t pin, uint8_t state, unsigned long timeout = 1000000UL);
+long map(long x, long inMin, long inMax, long outMin, long outMax);
+
+/**
+ * ESP32 SNTP: once configTime() has been called, the wall clock of the
+ * board reads SIM_EPOCH plus its simulated time. Before, simTime() counts
+ * seconds since boot, as time() does on an ESP32 that has not synchronised.
+ * The TMS unit maps the firmware's time() to simTime().
+ */
+#define SIM_EPOCH 1767225600ULL   // 2026-01-01 00:00 UTC
+void configTime(long gmtOffset, int daylightOffset, const char* server1,
+                const char* server2 = nullptr, const char* server3 = nullptr);
+time_t simTime(time_t* t);
+
+// One input register per pin, so every pin is bit 0 of its own "port"
+#define digitalPinToPort(pin) (pin)
+#define digitalPinToBitMask(pin) ((uint8_t)1)
+volatile uint8_t* portInputRegister(uint8_t port);
+
+/**
+ * Arduino String on top of std::string
+ */
+class String {
+public:
+    String(const char* s = "");
+    String(const __FlashStringHelper* s);
+    String(const std::string& s);
+    explicit String(char c);
+    String(int value, unsigned char base = 10);
+    String(unsigned int value, unsigned char base = 10);
+    String(long value, unsigned char base = 10);
+    String(unsigned long value, unsigned char base = 10);
+    String(double value, unsigned char decimals = 2);
+
+    String& operator=(const char* s);
+    String& operator+=(const String& s);
+    String& operator+=(const char* s);
+    String& operator+=(char c);
+    bool concat(const char* s);
+    bool concat(char c);
+
+    unsigned int length() const;
+    bool reserve(unsigned int size);
+    const char* c_str() const;
+    char operator[](unsigned int index) const;
+    int indexOf(char c, unsigned int from = 0) const;
+    int indexOf(const char* s, unsigned int from = 0) const;
+    String substring(unsigned int from) const;
+    String substring(unsigned int from, unsigned int to) const;
+    void trim();
+    long toInt() const;
+    float toFloat() const;
+    bool equals(const String& s) const;
+    bool startsWith(const char* s) const;
+
+    bool operator==(const String& s) const;
+    bool operator==(const char* s) const;
+    bool operator!=(const String& s) const;
+    bool operator!=(const char* s) const;
+
+private:
+    std::string str;
+};
+
+String operator+(const String& a, const String& b);
+String operator+(const String& a, const char* b);
+String operator+(const char* a, const String& b);
+
+/**
+ * Arduino Print: formatting on top of write()
+ */
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size);
+    size_t write(const char* s);
+
+    size_t print(const char* s);
+    size_t print(const String& s);
+    size_t print(const __FlashStringHelper* s);
+    size_t print(char c);
+    size_t print(int value, int base = 10);
+    size_t print(unsigned int value, int base = 10);
+    size_t print(long value, int base = 10);
+    size_t print(unsigned long value, int base = 10);
+    size_t print(double value, int decimals = 2);
+
+    size_t println();
+    template <typename T> size_t println(const T& value) {
+        size_t n = print(value);
+        return n + println();
+    }
+    size_t println(double value, int decimals) {
+        size_t n = print(value, decimals);
+        return n + println();
+    }
+
+    size_t printf(const char* format, ...);
+};
+
+/**
+ * UART 0 of simBoard
+ */
+class HardwareSerial : public Print {
+public:
+    void begin(unsigned long baud);
+    void end();
+    int available();
+    int read();
+    int peek();
+    int availableForWrite();
+    void flush();
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+    using Print::write;
+    operator bool() const { return true; }
+};
+
+extern HardwareSerial Serial;
+
+#endif
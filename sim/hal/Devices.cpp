@@ -0,0 +1,113 @@
+#include "Arduino.h"
+#include "SimBoard.h"
+#include "TimerOne.h"
+#include "EnableInterrupt.h"
+#include "LiquidCrystal_I2C.h"
+#include <avr/io.h>
+
+// Bus time of one byte sent by LiquidCrystal_I2C: two nibbles, each
+// written three times (data, enable high, enable low) in its own
+// 100 kHz I2C transaction, plus the enable pulse delays
+#define LCD_BYTE_US 1100
+#define LCD_CLEAR_US 2000
+#define LCD_BYTE_I2C 6      // I2C data bytes per LCD byte: 2 nibbles x 3 expander writes
+
+volatile uint8_t ADMUX;
+volatile uint8_t ADCSRA;
+volatile uint8_t ADCSRB;
+volatile uint8_t DIDR0;
+volatile uint16_t ADC;
+volatile uint8_t OCR0A;
+volatile uint8_t TIFR0;
+
+// ===== Timer1 =====
+
+TimerOne Timer1;
+
+TimerOne::TimerOne() : period(1000000) {}
+
+void TimerOne::initialize(long periodUs) {
+    period = periodUs;
+}
+
+void TimerOne::attachInterrupt(void (*isr)()) {
+    simBoard->startTimer(period, isr);
+}
+
+// ===== EnableInterrupt =====
+
+void enableInterrupt(uint8_t pin, void (*isr)(), uint8_t mode) {
+    simBoard->attachPinInterrupt(pin, isr);
+}
+
+void disableInterrupt(uint8_t pin) {
+    simBoard->attachPinInterrupt(pin, nullptr);
+}
+
+// ===== LiquidCrystal_I2C =====
+
+LiquidCrystal_I2C* LiquidCrystal_I2C::last = nullptr;
+
+LiquidCrystal_I2C::LiquidCrystal_I2C(uint8_t address, uint8_t cols, uint8_t rows)
+    : cols(cols < MAX_COLS ? cols : MAX_COLS), rows(rows < MAX_ROWS ? rows : MAX_ROWS), col(0), row(0),
+      i2cBytes(0) {
+    memset(cells, ' ', sizeof(cells));
+    for (uint8_t r = 0; r < MAX_ROWS; r++) {
+        cells[r][this->cols] = 0;
+    }
+}
+
+void LiquidCrystal_I2C::init() {
+    // The library's power-up sequence waits for the controller
+    delay(50);
+    clear();
+}
+
+void LiquidCrystal_I2C::backlight() {
+    i2cBytes++;
+    delayMicroseconds(LCD_BYTE_US / 4);
+}
+
+void LiquidCrystal_I2C::clear() {
+    for (uint8_t r = 0; r < rows; r++) {
+        memset(cells[r], ' ', cols);
+    }
+    col = row = 0;
+    i2cBytes += LCD_BYTE_I2C;
+    delayMicroseconds(LCD_BYTE_US + LCD_CLEAR_US);
+    last = this;
+}
+
+void LiquidCrystal_I2C::setCursor(uint8_t col, uint8_t row) {
+    this->col = col;
+    this->row = row < rows ? row : rows - 1;
+    i2cBytes += LCD_BYTE_I2C;
+    delayMicroseconds(LCD_BYTE_US);
+}
+
+size_t LiquidCrystal_I2C::write(uint8_t c) {
+    if (col < cols) {
+        cells[row][col] = c;
+    }
+    col++;
+    i2cBytes += LCD_BYTE_I2C;
+    delayMicroseconds(LCD_BYTE_US);
+    last = this;
+    return 1;
+}
+
+size_t LiquidCrystal_I2C::print(const char* s) {
+    size_t n = 0;
+    while (*s) {
+        n += write(*s++);
+    }
+    return n;
+}
+
+const char* LiquidCrystal_I2C::getRow(uint8_t row) const {
+    return row < rows ? cells[row] : "";
+}
+
+unsigned long LiquidCrystal_I2C::getI2cBytes() const {
+    return i2cBytes;
+}
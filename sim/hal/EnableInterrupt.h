@@ -0,0 +1,10 @@
+#ifndef __SIM_ENABLE_INTERRUPT__
+#define __SIM_ENABLE_INTERRUPT__
+
+#include <stdint.h>
+
+/* pin-change interrupt; the simulator raises it on every level change */
+void enableInterrupt(uint8_t pin, void (*isr)(), uint8_t mode);
+void disableInterrupt(uint8_t pin);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef __SIM_LIQUID_CRYSTAL_I2C__
+#define __SIM_LIQUID_CRYSTAL_I2C__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * HD44780 behind a PCF8574 I2C expander
+ * Keeps the character memory and charges the board the time the real
+ * library spends on the 100 kHz bus for each call.
+ */
+class LiquidCrystal_I2C {
+public:
+    static const uint8_t MAX_COLS = 20;
+    static const uint8_t MAX_ROWS = 4;
+
+    LiquidCrystal_I2C(uint8_t address, uint8_t cols, uint8_t rows);
+
+    void init();
+    void backlight();
+    void clear();
+    void setCursor(uint8_t col, uint8_t row);
+    size_t write(uint8_t c);
+    size_t print(const char* s);
+
+    /* row as shown on the display, without trailing NUL handling */
+    const char* getRow(uint8_t row) const;
+
+    /* I2C data bytes sent to the expander so far (address bytes not counted) */
+    unsigned long getI2cBytes() const;
+
+    /* last display written by any instance, for reports */
+    static LiquidCrystal_I2C* last;
+
+private:
+    uint8_t cols, rows;
+    uint8_t col, row;
+    char cells[MAX_ROWS][MAX_COLS + 1];
+    unsigned long i2cBytes;
+};
+
+#endif
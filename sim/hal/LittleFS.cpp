@@ -0,0 +1,94 @@
+#include "LittleFS.h"
+#include <string.h>
+
+LittleFSClass LittleFS;
+
+// ===== File =====
+
+File::File() : pos(0), writable(false) {}
+
+File::File(std::shared_ptr<std::vector<uint8_t>> data, bool writable)
+    : data(data), pos(writable ? data->size() : 0), writable(writable) {}
+
+size_t File::size() const {
+    return data ? data->size() : 0;
+}
+
+size_t File::position() const {
+    return pos;
+}
+
+bool File::seek(size_t pos) {
+    if (!data || pos > data->size()) {
+        return false;
+    }
+    this->pos = pos;
+    return true;
+}
+
+size_t File::read(uint8_t* buffer, size_t n) {
+    if (!data || writable) {
+        return 0;
+    }
+    if (n > data->size() - pos) {
+        n = data->size() - pos;
+    }
+    memcpy(buffer, data->data() + pos, n);
+    pos += n;
+    return n;
+}
+
+size_t File::write(const uint8_t* buffer, size_t n) {
+    if (!data || !writable) {
+        return 0;
+    }
+    // Files are only appended to
+    data->insert(data->end(), buffer, buffer + n);
+    pos = data->size();
+    return n;
+}
+
+void File::close() {
+    data.reset();
+}
+
+File::operator bool() const {
+    return data != nullptr;
+}
+
+// ===== LittleFS =====
+
+bool LittleFSClass::begin(bool formatOnFail) {
+    return true;
+}
+
+File LittleFSClass::open(const char* path, const char* mode) {
+    auto it = files.find(path);
+    if (mode[0] == 'r') {
+        if (it == files.end()) {
+            return File();
+        }
+        // A reader sees the file as it is now
+        return File(std::make_shared<std::vector<uint8_t>>(*it->second), false);
+    }
+    if (it == files.end() || mode[0] == 'w') {
+        files[path] = std::make_shared<std::vector<uint8_t>>();
+    }
+    return File(files[path], true);
+}
+
+bool LittleFSClass::exists(const char* path) const {
+    return files.count(path) > 0;
+}
+
+bool LittleFSClass::remove(const char* path) {
+    return files.erase(path) > 0;
+}
+
+size_t LittleFSClass::usedBytes() const {
+    size_t n = 0;
+    for (auto& f : files) {
+        n += f.second->size();
+    }
+    return n;
+}
@@ -0,0 +1,51 @@
+#ifndef __SIM_LITTLEFS__
+#define __SIM_LITTLEFS__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * LittleFS of the simulated TMS, in memory
+ * Only the calls the firmware makes. There is one file system for the
+ * whole simulation and it is empty at start, like a freshly formatted
+ * partition. Files are written at their end only; a file opened for
+ * reading keeps the content it had when it was opened.
+ */
+class File {
+public:
+    File();
+    File(std::shared_ptr<std::vector<uint8_t>> data, bool writable);
+
+    size_t size() const;
+    size_t position() const;
+    bool seek(size_t pos);
+    size_t read(uint8_t* buffer, size_t n);
+    size_t write(const uint8_t* buffer, size_t n);
+    void close();
+    operator bool() const;
+
+private:
+    std::shared_ptr<std::vector<uint8_t>> data;
+    size_t pos;
+    bool writable;
+};
+
+class LittleFSClass {
+public:
+    bool begin(bool formatOnFail = false);
+    File open(const char* path, const char* mode = "r");
+    bool exists(const char* path) const;
+    bool remove(const char* path);
+    size_t usedBytes() const;
+
+private:
+    std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> files;
+};
+
+extern LittleFSClass LittleFS;
+
+#endif
@@ -0,0 +1,437 @@
+#include "Network.h"
+#include "SimBoard.h"
+#include "WiFi.h"
+#include "PubSubClient.h"
+#include <algorithm>
+
+#define WIFI_JOIN_US 1500000ULL          // association + DHCP
+#define CONNECT_TIMEOUT_US 3000000ULL    // WiFiClient default, when the broker host does not answer
+
+SimNetwork* simNetwork = nullptr;
+
+SimNetwork::SimNetwork(Simulation& sim)
+    : sim(sim), latency(20000), wifiUp(true), brokerUp(true),
+      published(0), delivered(0), dropped(0), connects(0) {}
+
+Simulation& SimNetwork::getSimulation() {
+    return sim;
+}
+
+void SimNetwork::setLatency(uint64_t us) {
+    latency = us;
+}
+
+uint64_t SimNetwork::getLatency() const {
+    return latency;
+}
+
+void SimNetwork::setWiFiUp(bool up) {
+    wifiUp = up;
+}
+
+bool SimNetwork::isWiFiUp() const {
+    return wifiUp;
+}
+
+void SimNetwork::setBrokerUp(bool up) {
+    brokerUp = up;
+}
+
+bool SimNetwork::isBrokerUp() const {
+    return brokerUp;
+}
+
+SimNetwork::Broker& SimNetwork::broker(const std::string& host) {
+    auto it = brokers.find(host);
+    if (it == brokers.end()) {
+        it = brokers.insert(std::make_pair(host, Broker{true, false, 0, 0})).first;
+    }
+    return it->second;
+}
+
+void SimNetwork::setBrokerUp(const std::string& host, bool up) {
+    broker(host).up = up;
+}
+
+bool SimNetwork::isBrokerUp(const std::string& host) const {
+    auto it = brokers.find(host);
+    return brokerUp && (it == brokers.end() || it->second.up);
+}
+
+void SimNetwork::setBrokerLatency(const std::string& host, uint64_t us) {
+    Broker& entry = broker(host);
+    entry.hasLatency = true;
+    entry.latency = us;
+}
+
+uint64_t SimNetwork::getBrokerLatency(const std::string& host) const {
+    auto it = brokers.find(host);
+    return it != brokers.end() && it->second.hasLatency ? it->second.latency : latency;
+}
+
+bool SimNetwork::matches(const std::string& filter, const std::string& topic) {
+    if (!filter.empty() && filter[filter.size() - 1] == '#') {
+        return topic.compare(0, filter.size() - 1, filter, 0, filter.size() - 1) == 0;
+    }
+    return filter == topic;
+}
+
+void SimNetwork::subscribe(const std::string& filter, Handler handler, uint64_t sentAt,
+                           const std::string& broker) {
+    subscriptions.push_back(Subscription{filter, handler, broker});
+    for (size_t i = 0; i < retainedMessages.size(); i++) {
+        if (matches(filter, retainedMessages[i].first)) {
+            std::string topic = retainedMessages[i].first;
+            std::string payload = retainedMessages[i].second;
+            sim.at(sentAt + getBrokerLatency(broker), [handler, topic, payload, sentAt]() {
+                handler(topic, payload, sentAt);
+            });
+        }
+    }
+}
+
+void SimNetwork::publish(const std::string& topic, const std::string& payload, uint64_t sentAt,
+                         bool retained, const std::string& broker) {
+    published++;
+    if (!isBrokerUp(broker)) {
+        dropped++;
+        return;
+    }
+    if (retained) {
+        size_t i = 0;
+        while (i < retainedMessages.size() && retainedMessages[i].first != topic) {
+            i++;
+        }
+        if (i == retainedMessages.size()) {
+            retainedMessages.push_back(std::make_pair(topic, payload));
+        } else {
+            retainedMessages[i].second = payload;
+        }
+    }
+    for (size_t i = 0; i < subscriptions.size(); i++) {
+        if (matches(subscriptions[i].filter, topic)) {
+            Handler handler = subscriptions[i].handler;
+            uint64_t delay = std::max(getBrokerLatency(broker), getBrokerLatency(subscriptions[i].broker));
+            sim.at(sentAt + delay, [this, handler, topic, payload, sentAt]() {
+                delivered++;
+                handler(topic, payload, sentAt);
+            });
+        }
+    }
+}
+
+unsigned long SimNetwork::getPublished() const {
+    return published;
+}
+
+unsigned long SimNetwork::getDelivered() const {
+    return delivered;
+}
+
+unsigned long SimNetwork::getDropped() const {
+    return dropped;
+}
+
+unsigned long SimNetwork::getConnects() const {
+    return connects;
+}
+
+unsigned long SimNetwork::getConnects(const std::string& host) const {
+    auto it = brokers.find(host);
+    return it == brokers.end() ? 0 : it->second.connects;
+}
+
+void SimNetwork::countConnect(const std::string& host) {
+    connects++;
+    broker(host).connects++;
+}
+
+// ===== WiFi =====
+
+WiFiClass WiFi;
+
+WiFiClass::WiFiClass() : joining(false), joined(false), joinTime(0) {}
+
+void WiFiClass::begin(const char* ssid, const char* password) {
+    joining = true;
+    joined = false;
+    joinTime = simBoard->getTime() + WIFI_JOIN_US;
+}
+
+int WiFiClass::status() {
+    if (!simNetwork->isWiFiUp()) {
+        joined = false;
+        return WL_DISCONNECTED;
+    }
+    if (joining && simBoard->getTime() >= joinTime) {
+        joining = false;
+        joined = true;
+    }
+    return joined ? WL_CONNECTED : WL_DISCONNECTED;
+}
+
+String WiFiClass::localIP() {
+    return String("192.168.4.2");
+}
+
+void WiFiClass::disconnect() {
+    joining = false;
+    joined = false;
+}
+
+// ===== WiFiClient =====
+
+WiFiClient::WiFiClient() : open(false) {}
+
+int WiFiClient::connect(const char* host, uint16_t port, int32_t timeout) {
+    stop();
+    if (WiFi.status() != WL_CONNECTED) {
+        return 0;
+    }
+    if (!simNetwork->isBrokerUp(host)) {
+        simBoard->advance(std::min<uint64_t>(timeout * 1000ULL, CONNECT_TIMEOUT_US));
+        return 0;
+    }
+    simBoard->advance(2 * simNetwork->getBrokerLatency(host));
+    this->host = host;
+    open = true;
+    return 1;
+}
+
+uint8_t WiFiClient::connected() {
+    if (open && (WiFi.status() != WL_CONNECTED || !simNetwork->isBrokerUp(host))) {
+        open = false;
+    }
+    return open || available() > 0;
+}
+
+size_t WiFiClient::write(const uint8_t* buffer, size_t size) {
+    if (!connected()) {
+        return 0;
+    }
+    request.append((const char*)buffer, size);
+    // Answer every whole packet: fixed header, remaining length, body
+    while (request.size() >= 2) {
+        size_t length = 0;
+        size_t header = 1;
+        int shift = 0;
+        uint8_t digit;
+        do {
+            if (header >= request.size()) {
+                return size;
+            }
+            digit = request[header++];
+            length |= (size_t)(digit & 0x7F) << shift;
+            shift += 7;
+        } while (digit & 0x80);
+        if (request.size() < header + length) {
+            return size;
+        }
+        uint8_t type = (uint8_t)request[0] & 0xF0;
+        request.erase(0, header + length);
+
+        uint64_t readyAt = simBoard->getTime() + 2 * simNetwork->getBrokerLatency(host);
+        if (type == 0x10) {
+            const uint8_t connack[] = { 0x20, 0x02, 0x00, 0x00 };
+            for (uint8_t b : connack) {
+                replies.push_back(Reply{readyAt, b});
+            }
+        } else if (type == 0xC0) {
+            replies.push_back(Reply{readyAt, 0xD0});
+            replies.push_back(Reply{readyAt, 0x00});
+        } else if (type == 0xE0) {
+            open = false;
+        }
+    }
+    return size;
+}
+
+int WiFiClient::available() {
+    int n = 0;
+    for (size_t i = 0; i < replies.size() && replies[i].readyAt <= simBoard->getTime(); i++) {
+        n++;
+    }
+    return n;
+}
+
+int WiFiClient::read(uint8_t* buffer, size_t size) {
+    size_t n = std::min<size_t>(size, available());
+    for (size_t i = 0; i < n; i++) {
+        buffer[i] = replies.front().byte;
+        replies.pop_front();
+    }
+    return n;
+}
+
+void WiFiClient::stop() {
+    open = false;
+    request.clear();
+    replies.clear();
+}
+
+const std::string& WiFiClient::remoteHost() const {
+    return host;
+}
+
+// ===== PubSubClient =====
+
+PubSubClient::PubSubClient(WiFiClient& client)
+    : client(client), port(1883), bufferSize(256), socketTimeout(MQTT_SOCKET_TIMEOUT), isConnected(false),
+      lastState(MQTT_DISCONNECTED), session(0), outgoingLength(0), outgoingRetained(false) {}
+
+PubSubClient& PubSubClient::setServer(const char* domain, uint16_t port) {
+    host = domain;
+    this->port = port;
+    return *this;
+}
+
+PubSubClient& PubSubClient::setCallback(std::function<void(char*, uint8_t*, unsigned int)> callback) {
+    this->callback = callback;
+    return *this;
+}
+
+bool PubSubClient::setBufferSize(uint16_t size) {
+    bufferSize = size;
+    return true;
+}
+
+PubSubClient& PubSubClient::setSocketTimeout(uint16_t timeout) {
+    socketTimeout = timeout;
+    return *this;
+}
+
+bool PubSubClient::connect(const char* id) {
+    session++;
+    topics.clear();
+    inbox.clear();
+    isConnected = false;
+    // As PubSubClient 2.8: a socket the caller opened to this broker is used as is
+    if ((!client.connected() || client.remoteHost() != host) && !client.connect(host.c_str(), port)) {
+        lastState = MQTT_CONNECT_FAILED;
+        return false;
+    }
+    // CONNECT/CONNACK
+    uint64_t roundTrip = 2 * simNetwork->getBrokerLatency(host);
+    uint64_t timeout = socketTimeout * 1000000ULL;
+    simBoard->advance(std::min(roundTrip, timeout));
+    if (roundTrip > timeout || !client.connected()) {
+        client.stop();
+        lastState = roundTrip > timeout ? MQTT_CONNECTION_TIMEOUT : MQTT_CONNECT_FAILED;
+        return false;
+    }
+    simNetwork->countConnect(host);
+    isConnected = true;
+    lastState = MQTT_CONNECTED;
+    return true;
+}
+
+bool PubSubClient::connect(const char* id, const char* user, const char* pass) {
+    return connect(id);
+}
+
+void PubSubClient::disconnect() {
+    client.stop();
+    session++;
+    isConnected = false;
+    lastState = MQTT_DISCONNECTED;
+}
+
+bool PubSubClient::connected() {
+    if (isConnected && (!simNetwork->isBrokerUp(host) || WiFi.status() != WL_CONNECTED)) {
+        client.stop();
+        session++;
+        isConnected = false;
+        lastState = MQTT_CONNECTION_LOST;
+    }
+    return isConnected;
+}
+
+int PubSubClient::state() {
+    return lastState;
+}
+
+bool PubSubClient::publish(const char* topic, const char* payload) {
+    return publish(topic, payload, false);
+}
+
+bool PubSubClient::publish(const char* topic, const char* payload, bool retained) {
+    return publish(topic, (const uint8_t*)payload, strlen(payload), retained);
+}
+
+bool PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int length, bool retained) {
+    // The library refuses packets that do not fit its buffer
+    if (!connected() || strlen(topic) + length + 7 > bufferSize) {
+        return false;
+    }
+    simNetwork->publish(topic, std::string((const char*)payload, length), simBoard->getTime(), retained, host);
+    return true;
+}
+
+bool PubSubClient::beginPublish(const char* topic, unsigned int length, bool retained) {
+    // Streamed straight to the socket: not limited by the buffer
+    if (!connected()) {
+        return false;
+    }
+    outgoing = Incoming{topic, std::string()};
+    outgoingLength = length;
+    outgoingRetained = retained;
+    return true;
+}
+
+size_t PubSubClient::write(const uint8_t* buffer, size_t size) {
+    outgoing.payload.append((const char*)buffer, size);
+    return size;
+}
+
+int PubSubClient::endPublish() {
+    if (!connected() || outgoing.payload.size() != outgoingLength) {
+        return 0;
+    }
+    simNetwork->publish(outgoing.topic, outgoing.payload, simBoard->getTime(), outgoingRetained, host);
+    return 1;
+}
+
+bool PubSubClient::subscribe(const char* topic) {
+    if (!connected()) {
+        return false;
+    }
+    topics.push_back(topic);
+    unsigned long mySession = session;
+    simNetwork->subscribe(topic, [this, mySession](const std::string& topic, const std::string& payload, uint64_t) {
+        // Bounded like the socket buffer of the device
+        if (session == mySession && inbox.size() < 16) {
+            inbox.push_back(Incoming{topic, payload});
+        }
+    }, simBoard->getTime(), host);
+    return true;
+}
+
+bool PubSubClient::unsubscribe(const char* topic) {
+    for (size_t i = 0; i < topics.size(); i++) {
+        if (topics[i] == topic) {
+            topics.erase(topics.begin() + i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool PubSubClient::loop() {
+    if (!connected()) {
+        return false;
+    }
+    while (!inbox.empty()) {
+        Incoming msg = inbox.front();
+        inbox.pop_front();
+        bool subscribed = false;
+        for (size_t i = 0; i < topics.size(); i++) {
+            subscribed = subscribed || SimNetwork::matches(topics[i], msg.topic);
+        }
+        if (subscribed && callback) {
+            std::vector<char> topic(msg.topic.begin(), msg.topic.end());
+            topic.push_back(0);
+            callback(topic.data(), (uint8_t*)msg.payload.data(), msg.payload.size());
+        }
+    }
+    return true;
+}
@@ -0,0 +1,97 @@
+#ifndef __SIM_NETWORK__
+#define __SIM_NETWORK__
+
+#include <stdint.h>
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Simulation.h"
+
+/**
+ * Wi-Fi access point and MQTT brokers shared by all simulated boards
+ * Messages reach subscribers one network latency after they are
+ * published, in publish order. Host-side models (the CUS) subscribe with
+ * a callback; firmware clients go through PubSubClient.
+ * Firmware clients name a broker host. The brokers are bridged: they share
+ * subscriptions and retained messages. Each can be taken down or given a
+ * latency of its own; a message then takes the larger latency of the
+ * publisher's and the subscriber's broker. Host-side models use the
+ * broker "", which has the network latency.
+ */
+class SimNetwork {
+public:
+    typedef std::function<void(const std::string& topic, const std::string& payload, uint64_t sentAt)> Handler;
+
+    SimNetwork(Simulation& sim);
+
+    Simulation& getSimulation();
+
+    void setLatency(uint64_t us);
+    uint64_t getLatency() const;
+
+    /* access point and broker availability, for outage scenarios;
+       setBrokerUp(up) takes all brokers down (or up) at once */
+    void setWiFiUp(bool up);
+    bool isWiFiUp() const;
+    void setBrokerUp(bool up);
+    bool isBrokerUp() const;
+
+    /* one broker, by host name; a broker never named is up and has the
+       network latency */
+    void setBrokerUp(const std::string& host, bool up);
+    bool isBrokerUp(const std::string& host) const;
+    void setBrokerLatency(const std::string& host, uint64_t us);
+    uint64_t getBrokerLatency(const std::string& host) const;
+
+    /* subscribe; filters support a trailing '#'. Retained messages that
+       match are delivered one latency after sentAt. */
+    void subscribe(const std::string& filter, Handler handler, uint64_t sentAt,
+                   const std::string& broker = "");
+
+    /* publish at time sentAt (the publisher's clock) */
+    void publish(const std::string& topic, const std::string& payload, uint64_t sentAt,
+                 bool retained = false, const std::string& broker = "");
+
+    unsigned long getPublished() const;
+    unsigned long getDelivered() const;
+    unsigned long getDropped() const;
+    unsigned long getConnects() const;
+    unsigned long getConnects(const std::string& host) const;
+    void countConnect(const std::string& host);
+
+    static bool matches(const std::string& filter, const std::string& topic);
+
+private:
+    struct Subscription {
+        std::string filter;
+        Handler handler;
+        std::string broker;
+    };
+
+    struct Broker {
+        bool up;
+        bool hasLatency;
+        uint64_t latency;
+        unsigned long connects;
+    };
+
+    Broker& broker(const std::string& host);
+
+    Simulation& sim;
+    uint64_t latency;
+    bool wifiUp;
+    bool brokerUp;
+    std::vector<Subscription> subscriptions;
+    std::map<std::string, Broker> brokers;   // only those named so far
+    std::vector<std::pair<std::string, std::string> > retainedMessages;
+    unsigned long published;
+    unsigned long delivered;
+    unsigned long dropped;
+    unsigned long connects;
+};
+
+extern SimNetwork* simNetwork;
+
+#endif
@@ -0,0 +1,58 @@
+#include "Preferences.h"
+#include <string.h>
+
+Preferences::Preferences() : open(false), readOnly(true) {}
+
+std::map<std::string, std::vector<uint8_t> >& Preferences::store() {
+    // Keys are "namespace/key"
+    static std::map<std::string, std::vector<uint8_t> > entries;
+    return entries;
+}
+
+bool Preferences::begin(const char* name, bool readOnly) {
+    space = std::string(name) + "/";
+    open = true;
+    this->readOnly = readOnly;
+    return true;
+}
+
+void Preferences::end() {
+    open = false;
+}
+
+size_t Preferences::getBytesLength(const char* key) {
+    if (!open) {
+        return 0;
+    }
+    auto it = store().find(space + key);
+    return it == store().end() ? 0 : it->second.size();
+}
+
+size_t Preferences::getBytes(const char* key, void* buffer, size_t maxLength) {
+    size_t length = getBytesLength(key);
+    if (length == 0 || length > maxLength) {
+        return 0;
+    }
+    memcpy(buffer, store()[space + key].data(), length);
+    return length;
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t length) {
+    if (!open || readOnly) {
+        return 0;
+    }
+    const uint8_t* bytes = (const uint8_t*)value;
+    store()[space + key] = std::vector<uint8_t>(bytes, bytes + length);
+    return length;
+}
+
+bool Preferences::clear() {
+    if (!open || readOnly) {
+        return false;
+    }
+    auto it = store().lower_bound(space);
+    while (it != store().end() && it->first.compare(0, space.size(), space) == 0) {
+        it = store().erase(it);
+    }
+    return true;
+}
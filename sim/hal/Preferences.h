@@ -0,0 +1,35 @@
+#ifndef __SIM_PREFERENCES__
+#define __SIM_PREFERENCES__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * NVS of the simulated TMS, in memory
+ * Only the calls the firmware makes. There is one NVS for the whole
+ * simulation and it is empty at start, like a freshly erased flash.
+ */
+class Preferences {
+public:
+    Preferences();
+
+    bool begin(const char* name, bool readOnly = false);
+    void end();
+
+    size_t getBytesLength(const char* key);
+    size_t getBytes(const char* key, void* buffer, size_t maxLength);
+    size_t putBytes(const char* key, const void* value, size_t length);
+    bool clear();
+
+private:
+    std::string space;
+    bool open;
+    bool readOnly;
+
+    static std::map<std::string, std::vector<uint8_t> >& store();
+};
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef __SIM_PUB_SUB_CLIENT__
+#define __SIM_PUB_SUB_CLIENT__
+
+#include <functional>
+#include <deque>
+#include <string>
+#include <vector>
+#include "Arduino.h"
+#include "WiFi.h"
+
+#define MQTT_CONNECTION_TIMEOUT -4
+#define MQTT_CONNECTION_LOST -3
+#define MQTT_CONNECT_FAILED -2
+#define MQTT_DISCONNECTED -1
+#define MQTT_CONNECTED 0
+
+#define MQTT_SOCKET_TIMEOUT 15            // s, PubSubClient default
+
+#define MQTT_CALLBACK_SIGNATURE std::function<void(char*, uint8_t*, unsigned int)> callback
+
+/**
+ * PubSubClient over the simulated network (see Network.h)
+ * It talks to the broker named by setServer(). connect() opens the socket unless it is already open to that broker,
+ * then takes one round trip for CONNECT/CONNACK, given up after the socket timeout; messages for subscribed topics wait
+ * in the client until loop() hands them to the callback, as on the device.
+ */
+class PubSubClient {
+public:
+    PubSubClient(WiFiClient& client);
+
+    PubSubClient& setServer(const char* domain, uint16_t port);
+    PubSubClient& setCallback(MQTT_CALLBACK_SIGNATURE);
+    bool setBufferSize(uint16_t size);
+    PubSubClient& setSocketTimeout(uint16_t timeout);
+
+    bool connect(const char* id);
+    bool connect(const char* id, const char* user, const char* pass);
+    void disconnect();
+    bool connected();
+    int state();
+
+    bool publish(const char* topic, const char* payload);
+    bool publish(const char* topic, const char* payload, bool retained);
+    bool publish(const char* topic, const uint8_t* payload, unsigned int length, bool retained = false);
+    bool beginPublish(const char* topic, unsigned int length, bool retained);
+    size_t write(const uint8_t* buffer, size_t size);
+    int endPublish();
+    bool subscribe(const char* topic);
+    bool unsubscribe(const char* topic);
+    bool loop();
+
+private:
+    struct Incoming {
+        std::string topic;
+        std::string payload;
+    };
+
+    std::function<void(char*, uint8_t*, unsigned int)> callback;
+    WiFiClient& client;
+    std::string host;
+    uint16_t port;
+    uint16_t bufferSize;
+    uint16_t socketTimeout;           // s
+    bool isConnected;
+    int lastState;
+    unsigned long session;            // bumped on every connect/disconnect
+    std::vector<std::string> topics;
+    std::deque<Incoming> inbox;
+    Incoming outgoing;                // between beginPublish() and endPublish()
+    unsigned int outgoingLength;
+    bool outgoingRetained;
+};
+
+#endif
@@ -0,0 +1,237 @@
+#include "SimBoard.h"
+#include <string.h>
+
+SimBoard* simBoard = nullptr;
+
+SimBoard::SimBoard(Simulation& sim, const char* name)
+    : sim(sim), name(name), now(0), clockSet(false), baud(9600), rxStart(0), lineFree(0), rxOverruns(0), txBytes(0) {
+    for (uint8_t i = 0; i < PIN_COUNT; i++) {
+        pins[i] = 0;
+        modes[i] = 0;
+        pinIsr[i] = nullptr;
+    }
+    for (uint8_t i = 0; i < ANALOG_COUNT; i++) {
+        analog[i] = 0;
+    }
+}
+
+Simulation& SimBoard::getSimulation() {
+    return sim;
+}
+
+const char* SimBoard::getName() const {
+    return name;
+}
+
+void SimBoard::run(const std::function<void()>& fn) {
+    SimBoard* previous = simBoard;
+    simBoard = this;
+    if (now < sim.now()) {
+        now = sim.now();
+    }
+    fn();
+    simBoard = previous;
+}
+
+void SimBoard::interrupt(const std::function<void()>& isr) {
+    run([&]() {
+        isr();
+        if (service) {
+            service();
+        }
+    });
+}
+
+// ===== Firmware side =====
+
+uint64_t SimBoard::getTime() const {
+    return now;
+}
+
+void SimBoard::advance(uint64_t us) {
+    if (us > 0 && onBlock && onBlock(us)) {
+        return;
+    }
+    now += us;
+}
+
+void SimBoard::spin(uint64_t us) {
+    now += us;
+}
+
+void SimBoard::setClock() {
+    clockSet = true;
+}
+
+bool SimBoard::isClockSet() const {
+    return clockSet;
+}
+
+void SimBoard::setPinMode(uint8_t pin, uint8_t mode) {
+    if (pin < PIN_COUNT) {
+        modes[pin] = mode;
+    }
+}
+
+void SimBoard::writePin(uint8_t pin, bool level) {
+    if (pin >= PIN_COUNT || (pins[pin] != 0) == level) {
+        return;
+    }
+    pins[pin] = level;
+    if (onPinWrite) {
+        onPinWrite(pin, level);
+    }
+}
+
+bool SimBoard::readPin(uint8_t pin) const {
+    return pin < PIN_COUNT && pins[pin] != 0;
+}
+
+volatile uint8_t* SimBoard::inputRegister(uint8_t pin) {
+    return pin < PIN_COUNT ? &pins[pin] : nullptr;
+}
+
+int SimBoard::readAnalog(uint8_t channel) const {
+    return channel < ANALOG_COUNT ? analog[channel] : 0;
+}
+
+unsigned long SimBoard::measurePulse(uint8_t pin, unsigned long timeout) {
+    unsigned long width = onPulseIn ? onPulseIn(pin) : 0;
+    if (width == 0 || width > timeout) {
+        spin(timeout);
+        return 0;
+    }
+    spin(width);
+    return width;
+}
+
+void SimBoard::writeServo(uint8_t pin, int pulseUs, uint64_t frameUs) {
+    if (!onServo) {
+        return;
+    }
+    uint64_t frame = (now / frameUs + 1) * frameUs;
+    std::function<void(uint8_t, int)> output = onServo;
+    sim.at(frame, [output, pin, pulseUs]() { output(pin, pulseUs); });
+}
+
+void SimBoard::attachPinInterrupt(uint8_t pin, Isr isr) {
+    if (pin < PIN_COUNT) {
+        pinIsr[pin] = isr;
+    }
+}
+
+void SimBoard::startTimer(unsigned long periodUs, Isr isr) {
+    sim.every(periodUs, [this, isr]() { interrupt(isr); });
+}
+
+// ===== UART =====
+
+uint64_t SimBoard::byteTime() const {
+    // 8N1: start + 8 data + stop bits
+    return 10000000ULL / baud;
+}
+
+void SimBoard::drainTx() {
+    while (!txDone.empty() && txDone.front() <= now) {
+        txDone.pop_front();
+    }
+}
+
+void SimBoard::uartBegin(unsigned long baud) {
+    this->baud = baud;
+    rxStart = now;
+    rx.clear();
+}
+
+int SimBoard::uartAvailable() const {
+    return rx.size();
+}
+
+int SimBoard::uartRead() {
+    if (rx.empty()) {
+        return -1;
+    }
+    uint8_t c = rx.front();
+    rx.pop_front();
+    return c;
+}
+
+int SimBoard::uartPeek() const {
+    return rx.empty() ? -1 : rx.front();
+}
+
+int SimBoard::uartAvailableForWrite() {
+    drainTx();
+    return TX_BUFFER_SIZE - 1 - txDone.size();
+}
+
+void SimBoard::uartWrite(uint8_t c) {
+    drainTx();
+    while (txDone.size() >= TX_BUFFER_SIZE - 1) {
+        // Buffer full: wait for the TX interrupt to make room. A task
+        // sleeps until the buffer is half empty, like the ESP32 driver.
+        uint64_t until = onBlock ? txDone[txDone.size() / 2] : txDone.front();
+        advance(until - now);
+        drainTx();
+    }
+    uint64_t start = lineFree > now ? lineFree : now;
+    lineFree = start + byteTime();
+    txDone.push_back(lineFree);
+    txBytes++;
+    if (onTx) {
+        onTx(c, lineFree);
+    }
+}
+
+void SimBoard::uartFlush() {
+    if (lineFree > now) {
+        advance(lineFree - now);
+    }
+    txDone.clear();
+}
+
+// ===== Model side =====
+
+void SimBoard::setInput(uint8_t pin, bool level) {
+    if (pin >= PIN_COUNT || (pins[pin] != 0) == level) {
+        return;
+    }
+    pins[pin] = level;
+    if (pinIsr[pin] != nullptr) {
+        Isr isr = pinIsr[pin];
+        interrupt([isr]() { isr(); });
+    }
+}
+
+void SimBoard::setAnalog(uint8_t channel, int value) {
+    if (channel < ANALOG_COUNT) {
+        analog[channel] = value;
+    }
+}
+
+void SimBoard::receive(uint8_t c) {
+    uint64_t arrival = sim.now();
+    interrupt([this, c, arrival]() {
+        if (arrival < rxStart) {
+            // Arrived while the firmware was blocked before restarting the UART
+            return;
+        }
+        if (rx.size() < RX_BUFFER_SIZE - 1) {
+            rx.push_back(c);
+        } else {
+            rxOverruns++;
+        }
+    });
+}
+
+unsigned long SimBoard::getBaud() const {
+    return baud;
+}
+
+unsigned long SimBoard::getRxOverruns() const {
+    return rxOverruns;
+}
+
+unsigned long SimBoard::getTxBytes() const {
+    return txBytes;
+}
@@ -0,0 +1,124 @@
+#ifndef __SIM_BOARD__
+#define __SIM_BOARD__
+
+#include <stdint.h>
+#include <deque>
+#include <functional>
+#include "Simulation.h"
+
+/**
+ * One simulated microcontroller
+ * Owns the local clock, pin levels, analog inputs, UART 0, the periodic
+ * timer and the pin-change interrupts of a firmware.
+ *
+ * The local clock never runs behind the simulation. Firmware code runs in
+ * zero time except where it blocks (delay, pulseIn, a full UART); while it
+ * does, the board's clock moves ahead of the simulation and anything that
+ * happens to the board meanwhile is handled when it is free again. Under
+ * an RTOS (onBlock, see SimRtos.h) the calls that block on real hardware
+ * suspend only the calling task; busy waits still hold the whole board.
+ *
+ * service is called after every interrupt: it runs the firmware's main
+ * loop when the firmware has work, as if it had woken from sleep.
+ */
+class SimBoard {
+public:
+    typedef void (*Isr)();
+
+    static const uint8_t PIN_COUNT = 40;
+    static const uint8_t ANALOG_COUNT = 8;
+    static const uint8_t RX_BUFFER_SIZE = 64;   // Arduino core serial buffers
+    static const uint8_t TX_BUFFER_SIZE = 64;
+
+    SimBoard(Simulation& sim, const char* name);
+
+    Simulation& getSimulation();
+    const char* getName() const;
+
+    /* run fn as this board's firmware, on this board's clock */
+    void run(const std::function<void()>& fn);
+
+    /* run an interrupt handler, then let the firmware service it */
+    void interrupt(const std::function<void()>& isr);
+
+    // ===== Firmware side (Arduino API) =====
+    uint64_t getTime() const;
+
+    /* block for us: sleep, socket, UART; other tasks may run meanwhile */
+    void advance(uint64_t us);
+
+    /* busy-wait for us: pulseIn, delayMicroseconds */
+    void spin(uint64_t us);
+
+    /* the wall clock has been set (SNTP) */
+    void setClock();
+    bool isClockSet() const;
+
+    void setPinMode(uint8_t pin, uint8_t mode);
+    void writePin(uint8_t pin, bool level);
+    bool readPin(uint8_t pin) const;
+    volatile uint8_t* inputRegister(uint8_t pin);
+    int readAnalog(uint8_t channel) const;
+    unsigned long measurePulse(uint8_t pin, unsigned long timeout);
+
+    /* servo pulse width, takes effect at the next frameUs boundary */
+    void writeServo(uint8_t pin, int pulseUs, uint64_t frameUs);
+
+    void attachPinInterrupt(uint8_t pin, Isr isr);
+    void startTimer(unsigned long periodUs, Isr isr);
+
+    /* (re)start UART 0; like end() on AVR, drops what was received before */
+    void uartBegin(unsigned long baud);
+    int uartAvailable() const;
+    int uartRead();
+    int uartPeek() const;
+    int uartAvailableForWrite();
+    void uartWrite(uint8_t c);
+    void uartFlush();
+
+    // ===== Model side =====
+    /* drive an input pin; runs its pin-change interrupt */
+    void setInput(uint8_t pin, bool level);
+    void setAnalog(uint8_t channel, int value);
+
+    /* a byte that finished arriving on the RX line */
+    void receive(uint8_t c);
+
+    unsigned long getBaud() const;
+    unsigned long getRxOverruns() const;
+    unsigned long getTxBytes() const;
+
+    std::function<void()> service;
+    std::function<void(uint8_t pin, bool level)> onPinWrite;
+    std::function<unsigned long(uint8_t pin)> onPulseIn;       // echo length (us), 0 if none
+    std::function<void(uint8_t c, uint64_t arrival)> onTx;     // byte leaving on TX
+    std::function<void(uint8_t pin, int pulseUs)> onServo;     // new pulse width on a servo output
+    std::function<bool(uint64_t us)> onBlock;                  // true if an RTOS task slept instead
+
+private:
+    Simulation& sim;
+    const char* name;
+    uint64_t now;
+    bool clockSet;
+
+    volatile uint8_t pins[PIN_COUNT];
+    uint8_t modes[PIN_COUNT];
+    Isr pinIsr[PIN_COUNT];
+    int analog[ANALOG_COUNT];
+
+    unsigned long baud;
+    uint64_t rxStart;              // board time of the last uartBegin()
+    std::deque<uint8_t> rx;
+    std::deque<uint64_t> txDone;   // arrival times of bytes still in the TX buffer
+    uint64_t lineFree;
+    unsigned long rxOverruns;
+    unsigned long txBytes;
+
+    uint64_t byteTime() const;
+    void drainTx();
+};
+
+/* board whose firmware is running, target of the Arduino API */
+extern SimBoard* simBoard;
+
+#endif
@@ -0,0 +1,341 @@
+#include "SimRtos.h"
+#include <string.h>
+
+#define TICK_US (1000000ULL / configTICK_RATE_HZ)
+
+SimRtos* simRtos = nullptr;
+
+SimRtos::SimRtos(SimBoard& board)
+    : board(board), running(nullptr), lastOrder(0), firstOrder(0) {
+    simRtos = this;
+    board.onBlock = [this](uint64_t us) {
+        if (running == nullptr) {
+            return false;
+        }
+        wait(nullptr, this->board.getTime() + us);
+        return true;
+    };
+}
+
+SimBoard& SimRtos::getBoard() {
+    return board;
+}
+
+SimTask* SimRtos::create(TaskFunction_t code, const char* name, void* parameters, UBaseType_t priority) {
+    SimTask* task = new SimTask();
+    task->name = name;
+    task->priority = priority;
+    task->code = code;
+    task->parameters = parameters;
+    task->state = SimTask::BLOCKED;
+    task->wakeAt = NEVER;
+    task->waitingOn = nullptr;
+    task->woken = false;
+    task->notifyValue = 0;
+    task->notifyPending = false;
+    task->stack.resize(STACK_SIZE);
+    getcontext(&task->context);
+    task->context.uc_stack.ss_sp = task->stack.data();
+    task->context.uc_stack.ss_size = task->stack.size();
+    task->context.uc_link = nullptr;
+    makecontext(&task->context, entry, 0);
+    tasks.push_back(task);
+
+    makeReady(task);
+    if (running != nullptr && priority > running->priority) {
+        makeReady(running);
+        running->order = --firstOrder;
+        switchToKernel();
+    } else if (running == nullptr) {
+        scheduleAt(board.getTime());
+    }
+    return task;
+}
+
+void SimRtos::remove(SimTask* task) {
+    task->state = SimTask::DELETED;
+    if (task == running) {
+        // The kernel frees the stack once it is off it
+        switchToKernel();
+    } else {
+        task->stack.clear();
+        task->stack.shrink_to_fit();
+    }
+}
+
+SimTask* SimRtos::current() const {
+    return running;
+}
+
+void SimRtos::entry() {
+    SimTask* task = simRtos->running;
+    task->code(task->parameters);
+    // A FreeRTOS task must not return: treat it as vTaskDelete(NULL)
+    simRtos->remove(task);
+}
+
+bool SimRtos::wait(const void* object, uint64_t until) {
+    SimTask* task = running;
+    if (until <= board.getTime()) {
+        return false;
+    }
+    task->state = SimTask::BLOCKED;
+    task->wakeAt = until;
+    task->waitingOn = object;
+    task->woken = false;
+    switchToKernel();
+    task->waitingOn = nullptr;
+    return task->woken;
+}
+
+void SimRtos::wake(const void* object) {
+    bool woken = false, preempt = false;
+    for (size_t i = 0; i < tasks.size(); i++) {
+        SimTask* task = tasks[i];
+        if (object != nullptr && task->state == SimTask::BLOCKED && task->waitingOn == object) {
+            task->woken = true;
+            makeReady(task);
+            woken = true;
+            preempt = preempt || (running != nullptr && task->priority > running->priority);
+        }
+    }
+    if (preempt) {
+        // Back in front of the tasks of its own priority
+        makeReady(running);
+        running->order = --firstOrder;
+        switchToKernel();
+    } else if (woken && running == nullptr) {
+        scheduleAt(board.getTime());
+    }
+}
+
+uint64_t SimRtos::deadline(TickType_t ticks) const {
+    if (ticks == portMAX_DELAY) {
+        return NEVER;
+    }
+    return (board.getTime() / TICK_US + ticks) * TICK_US;
+}
+
+void SimRtos::makeReady(SimTask* task) {
+    task->state = SimTask::READY;
+    task->order = ++lastOrder;
+}
+
+void SimRtos::switchToKernel() {
+    SimTask* task = running;
+    swapcontext(&task->context, &kernel);
+}
+
+void SimRtos::scheduleAt(uint64_t t) {
+    Simulation& sim = board.getSimulation();
+    if (t < sim.now()) {
+        t = sim.now();
+    }
+    if (scheduled.insert(t).second) {
+        sim.at(t, [this, t]() {
+            scheduled.erase(t);
+            dispatch();
+        });
+    }
+}
+
+void SimRtos::dispatch() {
+    board.run([this]() {
+        while (true) {
+            uint64_t now = board.getTime();
+            SimTask* next = nullptr;
+            for (size_t i = 0; i < tasks.size(); i++) {
+                SimTask* task = tasks[i];
+                if (task->state == SimTask::BLOCKED && task->wakeAt <= now) {
+                    makeReady(task);
+                }
+            }
+            for (size_t i = 0; i < tasks.size(); i++) {
+                SimTask* task = tasks[i];
+                if (task->state == SimTask::READY &&
+                    (next == nullptr || task->priority > next->priority ||
+                     (task->priority == next->priority && task->order < next->order))) {
+                    next = task;
+                }
+            }
+            if (next == nullptr) {
+                break;
+            }
+            next->state = SimTask::RUNNING;
+            running = next;
+            swapcontext(&kernel, &next->context);
+            running = nullptr;
+            if (next->state == SimTask::DELETED) {
+                next->stack.clear();
+                next->stack.shrink_to_fit();
+            }
+        }
+
+        uint64_t first = NEVER;
+        for (size_t i = 0; i < tasks.size(); i++) {
+            if (tasks[i]->state == SimTask::BLOCKED && tasks[i]->wakeAt < first) {
+                first = tasks[i]->wakeAt;
+            }
+        }
+        if (first != NEVER) {
+            scheduleAt(first);
+        }
+    });
+}
+
+// ===== FreeRTOS API =====
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char* name, uint32_t stackDepth,
+                                   void* parameters, UBaseType_t priority, TaskHandle_t* created,
+                                   BaseType_t core) {
+    if (simRtos == nullptr) {
+        return pdFAIL;
+    }
+    SimTask* task = simRtos->create(code, name, parameters, priority);
+    if (created != nullptr) {
+        *created = task;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t code, const char* name, uint32_t stackDepth,
+                       void* parameters, UBaseType_t priority, TaskHandle_t* created) {
+    return xTaskCreatePinnedToCore(code, name, stackDepth, parameters, priority, created, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (simRtos != nullptr) {
+        simRtos->remove(task != nullptr ? task : simRtos->current());
+    }
+}
+
+TickType_t xTaskGetTickCount() {
+    return (TickType_t)(simBoard->getTime() / TICK_US);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    return simRtos != nullptr ? simRtos->current() : nullptr;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    if (simRtos != nullptr && simRtos->current() != nullptr) {
+        simRtos->wait(nullptr, simRtos->deadline(ticks));
+    } else {
+        simBoard->advance(ticks * TICK_US);
+    }
+}
+
+void vTaskDelayUntil(TickType_t* previousWakeTime, TickType_t increment) {
+    TickType_t now = xTaskGetTickCount();
+    TickType_t target = *previousWakeTime + increment;
+    *previousWakeTime = target;
+    // Late: the release has passed already and the task goes on at once
+    if ((int32_t)(target - now) > 0) {
+        vTaskDelay(target - now);
+    }
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action) {
+    switch (action) {
+        case eNoAction: break;
+        case eSetBits: task->notifyValue |= value; break;
+        case eIncrement: task->notifyValue++; break;
+        case eSetValueWithOverwrite: task->notifyValue = value; break;
+        case eSetValueWithoutOverwrite:
+            if (task->notifyPending) {
+                return pdFAIL;
+            }
+            task->notifyValue = value;
+            break;
+    }
+    task->notifyPending = true;
+    simRtos->wake(task);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticksToWait) {
+    SimTask* task = simRtos->current();
+    if (task->notifyValue == 0 && ticksToWait > 0) {
+        simRtos->wait(task, simRtos->deadline(ticksToWait));
+    }
+    uint32_t value = task->notifyValue;
+    if (value != 0) {
+        task->notifyValue = clearOnExit ? 0 : value - 1;
+    }
+    task->notifyPending = false;
+    return value;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clearOnEntry, uint32_t clearOnExit, uint32_t* value,
+                           TickType_t ticksToWait) {
+    SimTask* task = simRtos->current();
+    if (!task->notifyPending) {
+        task->notifyValue &= ~clearOnEntry;
+        if (ticksToWait > 0) {
+            simRtos->wait(task, simRtos->deadline(ticksToWait));
+        }
+    }
+    if (value != nullptr) {
+        *value = task->notifyValue;
+    }
+    if (!task->notifyPending) {
+        return pdFALSE;
+    }
+    task->notifyValue &= ~clearOnExit;
+    task->notifyPending = false;
+    return pdTRUE;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+    SimQueue* queue = new SimQueue();
+    queue->length = length;
+    queue->itemSize = itemSize;
+    return queue;
+}
+
+/* outside the tasks (cooperative firmware, host code) queues never block */
+static bool canWait(TickType_t ticksToWait) {
+    return ticksToWait > 0 && simRtos != nullptr && simRtos->current() != nullptr;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticksToWait) {
+    uint64_t until = canWait(ticksToWait) ? simRtos->deadline(ticksToWait) : 0;
+    while (queue->items.size() >= queue->length) {
+        if (!canWait(ticksToWait) || !simRtos->wait(queue, until)) {
+            if (queue->items.size() >= queue->length) {
+                return errQUEUE_FULL;
+            }
+        }
+    }
+    const uint8_t* bytes = (const uint8_t*)item;
+    queue->items.push_back(std::vector<uint8_t>(bytes, bytes + queue->itemSize));
+    if (simRtos != nullptr) {
+        simRtos->wake(queue);
+    }
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* buffer, TickType_t ticksToWait) {
+    uint64_t until = canWait(ticksToWait) ? simRtos->deadline(ticksToWait) : 0;
+    while (queue->items.empty()) {
+        if (!canWait(ticksToWait) || !simRtos->wait(queue, until)) {
+            if (queue->items.empty()) {
+                return errQUEUE_EMPTY;
+            }
+        }
+    }
+    memcpy(buffer, queue->items.front().data(), queue->itemSize);
+    queue->items.pop_front();
+    if (simRtos != nullptr) {
+        simRtos->wake(queue);
+    }
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    return queue->items.size();
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) {
+    return queue->length - queue->items.size();
+}
@@ -0,0 +1,93 @@
+#ifndef __SIM_RTOS__
+#define __SIM_RTOS__
+
+#include <stdint.h>
+#include <ucontext.h>
+#include <deque>
+#include <set>
+#include <vector>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "SimBoard.h"
+
+struct SimTask {
+    enum State { READY, RUNNING, BLOCKED, DELETED };
+
+    const char* name;
+    UBaseType_t priority;
+    TaskFunction_t code;
+    void* parameters;
+    State state;
+    int64_t order;            // FIFO among ready tasks of equal priority
+    uint64_t wakeAt;          // timeout of a blocked task
+    const void* waitingOn;    // queue, or the task itself for a notification
+    bool woken;               // unblocked before the timeout
+    uint32_t notifyValue;
+    bool notifyPending;
+    ucontext_t context;
+    std::vector<char> stack;
+};
+
+struct SimQueue {
+    UBaseType_t length;
+    UBaseType_t itemSize;
+    std::deque<std::vector<uint8_t> > items;
+};
+
+/**
+ * FreeRTOS kernel of one simulated board
+ * Tasks are coroutines on the board's clock. A task runs in zero time
+ * until it blocks: vTaskDelay, a queue or notification wait, or a HAL call
+ * that blocks on real hardware (delay(), a socket connect, a full UART).
+ * The kernel then runs the highest-priority ready task, and when none is
+ * left it comes back at the earliest timeout. Waking a task of higher
+ * priority preempts the running one at once. Busy waits (pulseIn,
+ * delayMicroseconds) keep the CPU, so the tasks after them start late, as
+ * on one core. Time slicing between equal priorities is not modelled.
+ */
+class SimRtos {
+public:
+    static const uint64_t NEVER = UINT64_MAX;
+    static const size_t STACK_SIZE = 256 * 1024;   // host stack of a task
+
+    /* the firmware of board gets the FreeRTOS API; one board per run */
+    SimRtos(SimBoard& board);
+
+    SimBoard& getBoard();
+    SimTask* create(TaskFunction_t code, const char* name, void* parameters, UBaseType_t priority);
+    void remove(SimTask* task);
+
+    /* running task, nullptr outside the tasks */
+    SimTask* current() const;
+
+    /* block the running task until time until (us) or until a wake() of
+       object; returns true if it was woken */
+    bool wait(const void* object, uint64_t until);
+
+    /* make the tasks waiting on object ready */
+    void wake(const void* object);
+
+    /* timeout of a wait of ticks, counted from the current tick */
+    uint64_t deadline(TickType_t ticks) const;
+
+private:
+    SimBoard& board;
+    std::vector<SimTask*> tasks;
+    SimTask* running;
+    ucontext_t kernel;
+    int64_t lastOrder;
+    int64_t firstOrder;
+    std::set<uint64_t> scheduled;
+
+    static void entry();
+    void dispatch();
+    void scheduleAt(uint64_t t);
+    void makeReady(SimTask* task);
+    void switchToKernel();
+};
+
+/* kernel behind the FreeRTOS API, nullptr if the firmware has none */
+extern SimRtos* simRtos;
+
+#endif
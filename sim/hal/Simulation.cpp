@@ -0,0 +1,38 @@
+#include "Simulation.h"
+
+Simulation::Simulation() : time(0), nextOrder(0), eventCount(0) {}
+
+uint64_t Simulation::now() const {
+    return time;
+}
+
+void Simulation::at(uint64_t t, Action action) {
+    events.push(Event{t < time ? time : t, nextOrder++, action});
+}
+
+void Simulation::after(uint64_t delay, Action action) {
+    at(time + delay, action);
+}
+
+void Simulation::every(uint64_t period, Action action) {
+    after(period, [this, period, action]() {
+        action();
+        every(period, action);
+    });
+}
+
+void Simulation::runUntil(uint64_t t) {
+    while (!events.empty() && events.top().time <= t) {
+        // Copy out before pop: the action may schedule new events
+        Event e = events.top();
+        events.pop();
+        time = e.time;
+        eventCount++;
+        e.action();
+    }
+    time = t;
+}
+
+unsigned long long Simulation::getEventCount() const {
+    return eventCount;
+}
@@ -0,0 +1,55 @@
+#ifndef __SIMULATION__
+#define __SIMULATION__
+
+#include <stdint.h>
+#include <functional>
+#include <queue>
+#include <vector>
+
+/**
+ * Discrete-event simulation clock
+ * Callbacks run in time order (FIFO for equal times); simulated time only
+ * advances from one event to the next, so idle periods cost nothing.
+ * Times are in microseconds.
+ */
+class Simulation {
+public:
+    typedef std::function<void()> Action;
+
+    Simulation();
+
+    uint64_t now() const;
+
+    /* run action at time t (not before now) */
+    void at(uint64_t t, Action action);
+
+    /* run action delay microseconds from now */
+    void after(uint64_t delay, Action action);
+
+    /* run action every period microseconds, first at now + period */
+    void every(uint64_t period, Action action);
+
+    /* process events up to and including time t, then set the clock to t */
+    void runUntil(uint64_t t);
+
+    unsigned long long getEventCount() const;
+
+private:
+    struct Event {
+        uint64_t time;
+        uint64_t order;
+        Action action;
+    };
+    struct Later {
+        bool operator()(const Event& a, const Event& b) const {
+            return a.time != b.time ? a.time > b.time : a.order > b.order;
+        }
+    };
+
+    std::priority_queue<Event, std::vector<Event>, Later> events;
+    uint64_t time;
+    uint64_t nextOrder;
+    unsigned long long eventCount;
+};
+
+#endif
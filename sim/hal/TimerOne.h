@@ -0,0 +1,19 @@
+#ifndef __SIM_TIMER_ONE__
+#define __SIM_TIMER_ONE__
+
+/**
+ * Timer1 periodic interrupt, driven by the simulation clock
+ */
+class TimerOne {
+public:
+    TimerOne();
+    void initialize(long periodUs = 1000000);
+    void attachInterrupt(void (*isr)());
+
+private:
+    long period;
+};
+
+extern TimerOne Timer1;
+
+#endif
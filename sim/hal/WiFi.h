@@ -0,0 +1,63 @@
+#ifndef __SIM_WIFI__
+#define __SIM_WIFI__
+
+#include <deque>
+#include <string>
+#include "Arduino.h"
+
+#define WL_IDLE_STATUS 0
+#define WL_CONNECTED 3
+#define WL_CONNECT_FAILED 4
+#define WL_DISCONNECTED 6
+
+/**
+ * Station interface joined to the simulated access point
+ * Joining takes WIFI_JOIN_US after begin() while the access point is up.
+ */
+class WiFiClass {
+public:
+    WiFiClass();
+    void begin(const char* ssid, const char* password);
+    int status();
+    String localIP();
+    void disconnect();
+
+private:
+    bool joining;
+    bool joined;
+    uint64_t joinTime;
+};
+
+extern WiFiClass WiFi;
+
+/**
+ * TCP socket to a simulated broker
+ * Only what the firmware's broker probes need: the broker answers MQTT
+ * CONNECT with a CONNACK and PINGREQ with a PINGRESP, one round trip of
+ * its latency after the packet is written. A broker that is down does not
+ * answer the SYN, so connect() waits for its timeout.
+ */
+class WiFiClient {
+public:
+    WiFiClient();
+    int connect(const char* host, uint16_t port, int32_t timeout = 3000);
+    uint8_t connected();
+    size_t write(const uint8_t* buffer, size_t size);
+    int available();
+    int read(uint8_t* buffer, size_t size);
+    void stop();
+    const std::string& remoteHost() const;
+
+private:
+    struct Reply {
+        uint64_t readyAt;
+        uint8_t byte;
+    };
+
+    std::string host;
+    bool open;
+    std::string request;              // written, not a whole packet yet
+    std::deque<Reply> replies;
+};
+
+#endif
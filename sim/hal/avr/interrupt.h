@@ -0,0 +1,11 @@
+#ifndef __SIM_AVR_INTERRUPT__
+#define __SIM_AVR_INTERRUPT__
+
+// An interrupt handler becomes an ordinary function of the firmware's
+// namespace; the simulator calls it when the interrupt fires
+#define ISR(vector, ...) void vector(void)
+
+inline void sei() {}
+inline void cli() {}
+
+#endif
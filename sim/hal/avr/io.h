@@ -0,0 +1,33 @@
+#ifndef __SIM_AVR_IO__
+#define __SIM_AVR_IO__
+
+#include <stdint.h>
+
+/**
+ * The ATmega328P registers touched by the WCS drivers, as plain variables
+ * The ADC result register is written by the simulator before it calls
+ * the conversion-complete handler (see SimBoard::convertAdc).
+ */
+#define _BV(bit) (1 << (bit))
+
+extern volatile uint8_t ADMUX;
+extern volatile uint8_t ADCSRA;
+extern volatile uint8_t ADCSRB;
+extern volatile uint8_t DIDR0;
+extern volatile uint16_t ADC;
+extern volatile uint8_t OCR0A;
+extern volatile uint8_t TIFR0;
+
+#define REFS0 6
+#define ADEN  7
+#define ADSC  6
+#define ADATE 5
+#define ADIE  3
+#define ADPS2 2
+#define ADPS1 1
+#define ADPS0 0
+#define ADTS1 1
+#define ADTS0 0
+#define OCF0A 1
+
+#endif
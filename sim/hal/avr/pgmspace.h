@@ -0,0 +1,21 @@
+#ifndef __SIM_PGMSPACE__
+#define __SIM_PGMSPACE__
+
+#include <string.h>
+#include <stdint.h>
+
+// Host memory is flat: "flash" is ordinary const data. pgm_read_word keeps
+// the element type so that tables of pointers survive 64-bit addresses.
+#define PROGMEM
+#define PGM_P const char*
+#define PSTR(s) (s)
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#define pgm_read_word(addr) (*(addr))
+#define pgm_read_ptr(addr) (*(addr))
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strcpy_P strcpy
+#define memcpy_P memcpy
+
+#endif
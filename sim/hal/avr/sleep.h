@@ -0,0 +1,13 @@
+#ifndef __SIM_AVR_SLEEP__
+#define __SIM_AVR_SLEEP__
+
+// The simulator only enters a firmware's loop() when it has work, so the
+// firmware never actually sleeps
+#define SLEEP_MODE_IDLE 0
+
+inline void set_sleep_mode(int mode) {}
+inline void sleep_enable() {}
+inline void sleep_disable() {}
+inline void sleep_cpu() {}
+
+#endif
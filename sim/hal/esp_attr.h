@@ -0,0 +1,8 @@
+#ifndef __SIM_ESP_ATTR__
+#define __SIM_ESP_ATTR__
+
+// The simulated boards never reset: RTC memory is ordinary memory
+#define RTC_NOINIT_ATTR
+#define RTC_DATA_ATTR
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef __SIM_ESP_SYSTEM__
+#define __SIM_ESP_SYSTEM__
+
+typedef enum {
+    ESP_RST_UNKNOWN,
+    ESP_RST_POWERON,
+    ESP_RST_EXT,
+    ESP_RST_SW,
+    ESP_RST_PANIC,
+    ESP_RST_INT_WDT,
+    ESP_RST_TASK_WDT,
+    ESP_RST_WDT,
+    ESP_RST_DEEPSLEEP,
+    ESP_RST_BROWNOUT,
+    ESP_RST_SDIO
+} esp_reset_reason_t;
+
+// Every simulated run starts from power-up
+inline esp_reset_reason_t esp_reset_reason() {
+    return ESP_RST_POWERON;
+}
+
+#endif
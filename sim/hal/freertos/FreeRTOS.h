@@ -0,0 +1,35 @@
+#ifndef __SIM_FREERTOS__
+#define __SIM_FREERTOS__
+
+/**
+ * FreeRTOS of the simulated TMS (ESP-IDF flavour), see SimRtos.h
+ * Only the types and calls the firmware uses.
+ */
+
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdFAIL 0
+#define pdPASS 1
+#define errQUEUE_FULL 0
+#define errQUEUE_EMPTY 0
+
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFF)
+#define pdMS_TO_TICKS(ms) ((TickType_t)((uint64_t)(ms) * configTICK_RATE_HZ / 1000))
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+// Only one task runs at a time and never in the middle of another's
+// critical section: spinlocks are not needed
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux) ((void)(mux))
+
+#endif
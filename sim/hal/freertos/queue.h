@@ -0,0 +1,21 @@
+#ifndef __SIM_FREERTOS_QUEUE__
+#define __SIM_FREERTOS_QUEUE__
+
+#include "FreeRTOS.h"
+
+struct SimQueue;
+typedef SimQueue* QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize);
+
+/* copies the item; waits for room up to ticksToWait */
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticksToWait);
+#define xQueueSendToBack xQueueSend
+
+/* copies the oldest item out; waits for one up to ticksToWait */
+BaseType_t xQueueReceive(QueueHandle_t queue, void* buffer, TickType_t ticksToWait);
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue);
+
+#endif
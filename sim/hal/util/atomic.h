@@ -0,0 +1,9 @@
+#ifndef __SIM_ATOMIC__
+#define __SIM_ATOMIC__
+
+// Interrupt handlers never preempt firmware code in the simulator
+#define ATOMIC_RESTORESTATE 0
+#define ATOMIC_FORCEON 0
+#define ATOMIC_BLOCK(type) for (int atomicOnce_ = 1; atomicOnce_; atomicOnce_ = 0)
+
+#endif
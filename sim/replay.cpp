@@ -0,0 +1,180 @@
+/*
+ * Sonar trace replay
+ * Feeds the echo durations of a trace exported by the TMS (see
+ * TMS/README.md) to the unchanged TMS firmware, as fast as possible or at
+ * a chosen speed. Sonar, MonitoringTask and WaterLevelData turn them into
+ * level messages again, so a filter or sampling change can be measured
+ * on real storm data and its output compared with a previous run.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "SimConfig.h"
+#include "TraceFile.h"
+#include "Simulation.h"
+#include "SimBoard.h"
+#include "Network.h"
+#include "Firmware.h"
+
+#define PACE_PERIOD 50000ULL   // us of simulated time between real-time pacing checks
+
+struct Sample {
+    double time;        // s since the start of the trace
+    double level;
+    double distance;
+};
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+            "usage: %s [-x speed] [-o levels.csv] [-r records.csv] [-v] trace\n"
+            "  trace  chunk lines from tms/trace/data or 'TRACE ' lines of a serial log\n"
+            "  -x     replay at speed times real time (default: as fast as possible)\n"
+            "  -o     write the level messages the firmware published\n"
+            "  -r     write the decoded trace\n"
+            "  -v     echo the TMS debug output\n",
+            prog);
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    double speed = 0;
+    const char* levelsPath = nullptr;
+    const char* recordsPath = nullptr;
+    bool verbose = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "x:o:r:v")) != -1) {
+        switch (opt) {
+            case 'x': speed = atof(optarg); break;
+            case 'o': levelsPath = optarg; break;
+            case 'r': recordsPath = optarg; break;
+            case 'v': verbose = true; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+    }
+
+    std::vector<TraceRecord> trace = loadTrace(argv[optind]);
+    if (trace.empty()) {
+        fprintf(stderr, "%s: the trace is empty\n", argv[optind]);
+        return 1;
+    }
+    if (recordsPath != nullptr) {
+        FILE* f = fopen(recordsPath, "w");
+        fprintf(f, "time_ms,echo_us\n");
+        for (size_t i = 0; i < trace.size(); i++) {
+            fprintf(f, "%llu,%lu\n", (unsigned long long)trace[i].time, trace[i].echo);
+        }
+        fclose(f);
+    }
+    uint64_t traceLength = (trace.back().time - trace.front().time) * 1000;
+
+    Simulation sim;
+    SimNetwork network(sim);
+    simNetwork = &network;
+    SimBoard tms(sim, "TMS");
+
+    // The trace starts with the firmware's first reading; from then on each
+    // reading gets the echo recorded last at or before the same moment
+    bool started = false;
+    uint64_t offset = 0;
+    size_t next = 0;
+    unsigned long readings = 0, missing = 0;
+    tms.onPulseIn = [&](uint8_t pin) -> unsigned long {
+        if (pin != TMS_SONAR_ECHO_PIN) {
+            return 0;
+        }
+        if (!started) {
+            started = true;
+            offset = tms.getTime();
+        }
+        uint64_t t = trace.front().time + (tms.getTime() - offset) / 1000;
+        while (next + 1 < trace.size() && trace[next + 1].time <= t) {
+            next++;
+        }
+        readings++;
+        if (trace[next].echo == 0) {
+            missing++;
+        }
+        return trace[next].echo;
+    };
+    tms.onTx = [&](uint8_t c, uint64_t arrival) {
+        if (verbose) {
+            putchar(c);
+        }
+    };
+
+    std::vector<Sample> samples;
+    network.subscribe(LEVEL_TOPIC, [&](const std::string& topic, const std::string& payload, uint64_t sentAt) {
+        JsonDocument doc;
+        if (deserializeJson(doc, payload.c_str())) {
+            return;
+        }
+        Sample s = { (sentAt - offset) / 1e6, doc["level"] | -1.0, doc["distance"] | -1.0 };
+        samples.push_back(s);
+    }, 0);
+
+    tms::start(tms, TMS_LOOP_PERIOD);
+
+    auto wallStart = std::chrono::steady_clock::now();
+    if (speed > 0) {
+        sim.every(PACE_PERIOD, [&]() {
+            std::this_thread::sleep_until(wallStart + std::chrono::microseconds((uint64_t)(sim.now() / speed)));
+        });
+    }
+    while (!started || sim.now() < offset + traceLength) {
+        sim.runUntil(sim.now() + 1000000);
+    }
+    // Let the last reading's message arrive
+    sim.runUntil(sim.now() + 1000000);
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+    if (levelsPath != nullptr) {
+        FILE* f = fopen(levelsPath, "w");
+        fprintf(f, "time_s,level_cm,distance_cm\n");
+        for (size_t i = 0; i < samples.size(); i++) {
+            fprintf(f, "%.3f,%.2f,%.2f\n", samples[i].time, samples[i].level, samples[i].distance);
+        }
+        fclose(f);
+    }
+
+    double minLevel = INFINITY, maxLevel = -INFINITY, sum = 0, step = 0;
+    unsigned long valid = 0;
+    double previous = NAN;
+    for (size_t i = 0; i < samples.size(); i++) {
+        if (samples[i].level < 0) {
+            continue;
+        }
+        double level = samples[i].level;
+        minLevel = std::min(minLevel, level);
+        maxLevel = std::max(maxLevel, level);
+        sum += level;
+        if (!std::isnan(previous)) {
+            step += fabs(level - previous);
+        }
+        previous = level;
+        valid++;
+    }
+
+    printf("%-28s %zu over %.1f min, %lu without echo\n", "trace records", trace.size(),
+           traceLength / 6e7, (unsigned long)std::count_if(trace.begin(), trace.end(),
+                                                            [](const TraceRecord& r) { return r.echo == 0; }));
+    printf("%-28s %.2f s (%.0fx real time)\n", "wall time", wall, (sim.now() - offset) / 1e6 / std::max(wall, 1e-9));
+    printf("%-28s %lu, %lu without echo\n", "sonar readings", readings, missing);
+    printf("%-28s %zu, %lu valid\n", "level messages", samples.size(), valid);
+    if (valid > 0) {
+        printf("%-28s %.2f / %.2f / %.2f cm\n", "level min / mean / max", minLevel, sum / valid, maxLevel);
+        printf("%-28s %.3f cm\n", "mean step between messages", valid > 1 ? step / (valid - 1) : 0.0);
+    }
+    return 0;
+}
@@ -0,0 +1,98 @@
+/*
+ * TMS firmware, unchanged, in namespace tms
+ * The HAL and library headers are included first so that the firmware's
+ * own #includes of them are no-ops inside the namespace.
+ * time() is the simulated wall clock. FreeRTOS is SimRtos; make
+ * COOPERATIVE=1 builds the firmware with -DTMS_COOPERATIVE instead.
+ */
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <WiFi.h>
+#include <PubSubClient.h>
+#include <esp_attr.h>
+#include <esp_system.h>
+#include <LittleFS.h>
+#include <Preferences.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include "SimRtos.h"
+#include "Firmware.h"
+
+namespace tms {
+inline time_t time(time_t* t) { return simTime(t); }
+
+#include "devices/Led.cpp"
+#include "devices/Sonar.cpp"
+#include "model/HWPlatform.cpp"
+#include "model/TMSState.cpp"
+#include "model/WaterLevelData.cpp"
+#include "model/EchoTrace.cpp"
+#include "model/FlightRecorder.cpp"
+#include "model/LevelCodec.cpp"
+#include "model/HistoryLog.cpp"
+#include "model/LevelStats.cpp"
+#include "model/RuntimeConfig.cpp"
+#include "kernel/BrokerSelector.cpp"
+#include "kernel/MQTTClient.cpp"
+#include "kernel/Scheduler.cpp"
+#include "kernel/PriorityScheduler.cpp"
+#include "kernel/ZoneTrace.cpp"
+#include "task/LEDTask.cpp"
+#include "task/MQTTTask.cpp"
+#include "task/MonitoringTask.cpp"
+#include "task/PublishTask.cpp"
+#include "task/TraceTask.cpp"
+#include "task/FlightTask.cpp"
+#include "task/HistoryTask.cpp"
+#include "task/SummaryTask.cpp"
+#include "task/ConfigTask.cpp"
+#include "task/ProbeTask.cpp"
+#include "main.cpp"
+
+#ifndef TMS_COOPERATIVE
+/* the Arduino core's loop task */
+static void loopTask(void* parameters) {
+    setup();
+    while (true) {
+        loop();
+    }
+}
+#endif
+
+void start(SimBoard& board, uint64_t loopPeriod) {
+#ifdef TMS_COOPERATIVE
+    board.run([]() { setup(); });
+    board.getSimulation().every(loopPeriod, [&board]() { board.run([]() { loop(); }); });
+#else
+    new SimRtos(board);
+    board.run([]() { xTaskCreate(loopTask, "loopTask", 8192, nullptr, 1, nullptr); });
+#endif
+}
+
+TmsStats getStats() {
+    TmsStats stats;
+    stats.state = stateToString(stateManager->getState());
+    stats.publishing = stateManager->getState() == MONITORING && mqttClient->isConnected();
+    SamplingStats sampling = monitoringTask->getSamplingStats();
+    stats.samples = sampling.samples;
+    stats.lateSamples = sampling.late;
+    stats.droppedReadings = sampling.dropped;
+    stats.maxJitterUs = sampling.maxJitter;
+    stats.meanJitterUs = sampling.samples > 1 ? (double)sampling.totalJitter / (sampling.samples - 1) : 0;
+#ifdef TMS_COOPERATIVE
+    stats.scheduler = "cooperative";
+    stats.deadlineMisses = 0;
+#else
+    stats.scheduler = "FreeRTOS";
+    stats.deadlineMisses = 0;
+    for (int i = 0; i < scheduler->getNumGroups(); i++) {
+        stats.deadlineMisses += scheduler->getStats(i).deadlineMisses;
+    }
+#endif
+    const BrokerSelector& brokers = mqttClient->getBrokers();
+    stats.broker = brokers.getAddress(brokers.getActive()).host;
+    stats.brokerSwitches = brokers.getSwitches();
+    return stats;
+}
+}
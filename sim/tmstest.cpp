@@ -0,0 +1,181 @@
+/*
+ * Host tests of TMS firmware parts that do no I/O
+ * The BrokerSelector cases feed the selector the pings, timeouts and
+ * connects that MQTTClient and ProbeTask would report, with the
+ * thresholds of TMS/src/config.h, and check the broker it selects.
+ *
+ *   ./tmstest            run every case
+ *   ./tmstest <name>...  run the named cases
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <random>
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+
+namespace tms {
+#include "kernel/BrokerSelector.h"
+}
+
+using tms::BrokerAddress;
+using tms::BrokerSelector;
+
+static const unsigned long MS = 1000;     // RTTs are in us, times in ms
+
+static const BrokerAddress brokers[] = {
+    { "primary", 1883 },
+    { "secondary", 1883 },
+};
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            printf("  %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+/* n answered pings of broker */
+static void answer(BrokerSelector& selector, uint8_t broker, unsigned long rtt, int n = 1) {
+    for (int i = 0; i < n; i++) {
+        selector.onAnswer(broker, rtt);
+    }
+}
+
+static void timeout(BrokerSelector& selector, uint8_t broker, int n = 1) {
+    for (int i = 0; i < n; i++) {
+        selector.onTimeout(broker);
+    }
+}
+
+// ===== Cases =====
+
+static void failoverAfterTimeouts() {
+    BrokerSelector selector(brokers, 2);
+    unsigned long now = 0;
+    answer(selector, 0, 50 * MS, 3);
+    answer(selector, 1, 80 * MS, 3);
+    CHECK(selector.select(now) == 0);
+
+    // An answer or a connect in between starts the count again
+    timeout(selector, 0, BROKER_FAILOVER_TIMEOUTS - 1);
+    answer(selector, 0, 50 * MS);
+    timeout(selector, 0, BROKER_FAILOVER_TIMEOUTS - 1);
+    selector.onConnected(0);
+    timeout(selector, 0, BROKER_FAILOVER_TIMEOUTS - 1);
+    CHECK(selector.select(now += 1000) == 0);
+    CHECK(selector.getStats(0).healthy);
+
+    // The last one fails it, and the other broker takes over at once
+    timeout(selector, 0);
+    CHECK(!selector.getStats(0).healthy);
+    CHECK(selector.select(now += 1000) == 1);
+    CHECK(selector.getSwitches() == 1);
+
+    // With no healthy broker left the client stays where it is
+    timeout(selector, 1, BROKER_FAILOVER_TIMEOUTS);
+    CHECK(selector.select(now += 1000) == 1);
+    CHECK(selector.getSwitches() == 1);
+}
+
+static void noReuseBeforeRecovery() {
+    BrokerSelector selector(brokers, 2);
+    unsigned long now = 0;
+    answer(selector, 0, 50 * MS, 3);
+    answer(selector, 1, 80 * MS, 3);
+    timeout(selector, 0, BROKER_FAILOVER_TIMEOUTS);
+    CHECK(selector.select(now += 1000) == 1);
+
+    // A timeout during the recovery starts it again
+    answer(selector, 0, 10 * MS, BROKER_RECOVERY_PINGS - 1);
+    timeout(selector, 0);
+    answer(selector, 0, 10 * MS, BROKER_RECOVERY_PINGS - 1);
+    CHECK(!selector.getStats(0).healthy);
+
+    // Not even when the active broker fails
+    timeout(selector, 1, BROKER_FAILOVER_TIMEOUTS);
+    CHECK(selector.select(now += 1000) == 1);
+
+    answer(selector, 0, 10 * MS);
+    CHECK(selector.getStats(0).healthy);
+    CHECK(selector.select(now += 1000) == 0);
+    CHECK(selector.getSwitches() == 2);
+}
+
+static void noAlternationWithinMargin() {
+    BrokerSelector selector(brokers, 2);
+    std::mt19937 rng(1);
+    // The second broker is faster, but never by BROKER_FAILBACK_MARGIN (25%):
+    // at most 82 * 1.04 against at least 100 * 0.96 ms
+    std::uniform_int_distribution<int> jitter(-4, 4);
+    unsigned long now = 0;
+
+    // A day of probes, one broker per BROKER_PROBE_INTERVAL, in turn
+    for (int i = 0; i < 24 * 3600 * 1000 / BROKER_PROBE_INTERVAL; i++) {
+        now += BROKER_PROBE_INTERVAL;
+        if (i % 2) {
+            answer(selector, 0, 100 * MS * (100 + jitter(rng)) / 100);
+        } else {
+            answer(selector, 1, 82 * MS * (100 + jitter(rng)) / 100);
+        }
+        selector.select(now);
+    }
+    CHECK(selector.getSwitches() == 0);
+    CHECK(selector.getActive() == 0);
+}
+
+static void failbackDwell() {
+    BrokerSelector selector(brokers, 2);
+    unsigned long now = 0;
+    answer(selector, 0, 100 * MS, 3);
+
+    // Clearly faster, but one ping short
+    answer(selector, 1, 50 * MS, BROKER_FAILBACK_PINGS - 1);
+    CHECK(selector.select(now += BROKER_MIN_DWELL) == 0);
+    answer(selector, 1, 50 * MS);
+    CHECK(selector.select(now += 1000) == 1);
+
+    // The other one is faster again at once, but the switch waits
+    // BROKER_MIN_DWELL
+    answer(selector, 0, 10 * MS, 10);
+    CHECK(selector.select(now += BROKER_MIN_DWELL - 1) == 1);
+    CHECK(selector.select(now += 1) == 0);
+    CHECK(selector.getSwitches() == 2);
+}
+
+struct Case {
+    const char* name;
+    void (*run)();
+};
+
+static const Case cases[] = {
+    { "failover_after_timeouts", failoverAfterTimeouts },
+    { "no_reuse_before_recovery", noReuseBeforeRecovery },
+    { "no_alternation_within_margin", noAlternationWithinMargin },
+    { "failback_dwell", failbackDwell },
+};
+
+int main(int argc, char** argv) {
+    int failed = 0, ran = 0;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        bool selected = argc < 2;
+        for (int a = 1; a < argc; a++) {
+            selected = selected || strcmp(argv[a], cases[i].name) == 0;
+        }
+        if (!selected) {
+            continue;
+        }
+
+        int before = failures;
+        cases[i].run();
+        bool ok = failures == before;
+        printf("%-4s %s\n", ok ? "ok" : "FAIL", cases[i].name);
+        ran++;
+        failed += ok ? 0 : 1;
+    }
+    printf("%d of %d passed\n", ran - failed, ran);
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,107 @@
+/*
+ * WCS firmware, unchanged, in namespace wcs
+ * The HAL and library headers are included first so that the firmware's
+ * own #includes of them are no-ops inside the namespace. ServoTimer2 is
+ * the only driver replaced: it is implemented below on the simulated board.
+ */
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <TimerOne.h>
+#include <EnableInterrupt.h>
+#include <LiquidCrystal_I2C.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <util/atomic.h>
+#include "SimBoard.h"
+#include "Firmware.h"
+
+namespace wcs {
+#include "kernel/EventQueue.cpp"
+#include "kernel/FrameCodec.cpp"
+#include "kernel/Messages.cpp"
+#include "kernel/TxQueue.cpp"
+#include "kernel/SerialComm.cpp"
+#include "kernel/scheduler.cpp"
+#include "kernel/ZoneTrace.cpp"
+#include "devices/buttonimpl.cpp"
+#include "devices/lcd.cpp"
+#include "devices/pot.cpp"
+#include "devices/servoMotorImpl.cpp"
+#include "model/HWPlatform.cpp"
+#include "tasks/WCSTask.cpp"
+#include "main.cpp"
+
+// ===== ServoTimer2 =====
+// Like the library, a new pulse width is swapped in at the next frame
+
+static uint8_t servoChannels = 0;
+static int servoPins[NBR_CHANNELS + 1];
+static int servoPulses[NBR_CHANNELS + 1];
+
+ServoTimer2::ServoTimer2() : chanIndex(0) {}
+
+uint8_t ServoTimer2::attach(int pin) {
+    if (chanIndex == 0) {
+        if (servoChannels >= NBR_CHANNELS) {
+            return 0;
+        }
+        chanIndex = ++servoChannels;
+        servoPulses[chanIndex] = DEFAULT_PULSE_WIDTH;
+    }
+    servoPins[chanIndex] = pin;
+    pinMode(pin, OUTPUT);
+    simBoard->writeServo(pin, servoPulses[chanIndex], FRAME_SYNC_PERIOD);
+    return chanIndex;
+}
+
+void ServoTimer2::detach() {
+    servoPins[chanIndex] = -1;
+}
+
+void ServoTimer2::write(int pulsewidth) {
+    if (pulsewidth < MIN_PULSE_WIDTH) {
+        pulsewidth = MIN_PULSE_WIDTH;
+    } else if (pulsewidth > MAX_PULSE_WIDTH) {
+        pulsewidth = MAX_PULSE_WIDTH;
+    }
+    servoPulses[chanIndex] = pulsewidth;
+    if (chanIndex != 0 && servoPins[chanIndex] >= 0) {
+        simBoard->writeServo(servoPins[chanIndex], pulsewidth, FRAME_SYNC_PERIOD);
+    }
+}
+
+int ServoTimer2::read() {
+    return servoPulses[chanIndex];
+}
+
+boolean ServoTimer2::attached() {
+    return chanIndex != 0 && servoPins[chanIndex] >= 0;
+}
+
+// ===== Simulator hooks =====
+
+bool hasWork() {
+    // The wake-up condition of Scheduler::schedule()
+    return pendingTicks != 0 || !eventQueue.isEmpty() || Serial.available() > 0;
+}
+
+void convertAdc(unsigned int n) {
+    for (unsigned int i = 0; i < n; i++) {
+        ADC = simBoard->readAnalog(ADMUX & 0x07);
+        ADC_vect();
+    }
+}
+
+WcsStats getStats() {
+    WcsStats stats;
+    stats.coalescedCommands = wcsTask->getCoalescedCommands();
+    stats.duplicateCommands = wcsTask->getDuplicateCommands();
+    stats.frameErrors = serialComm->getFrameErrors();
+    stats.coalescedEvents = eventQueue.getCoalesced();
+    stats.missedTicks = sched->getMissedTicks();
+    stats.maxBusyUs = sched->getMaxBusyTime();
+    stats.utilisation = sched->getUtilisation();
+    return stats;
+}
+}
@@ -0,0 +1,619 @@
+/*
+ * Host tests of the WCS firmware
+ * Each case boots the WCS firmware on a fresh board, in a child process of
+ * its own (the firmware keeps its state in globals), against a scripted
+ * CUS that speaks JSON at a rate of its own. A byte sent at one rate and
+ * received at another arrives as 0xFF, the way a UART sees a framing error,
+ * so a rate mismatch between the two ends is modelled.
+ *
+ *   ./wcstest            run every case
+ *   ./wcstest <name>...  run the named cases
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "SimBoard.h"
+#include "LiquidCrystal_I2C.h"
+#include "Firmware.h"
+#include "SimConfig.h"
+#include "config.h"
+#include "kernel/Protocol.h"
+
+namespace wcs {
+#include "kernel/FrameCodec.h"
+}
+
+static const uint64_t MS = 1000;
+static const uint64_t SERVO_FRAME_US = 20 * MS;   // ServoTimer2 FRAME_SYNC_PERIOD
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            printf("  %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+/**
+ * The WCS board and the CUS end of its serial line
+ */
+class Link {
+public:
+    Simulation sim;
+    SimBoard wcs;
+    unsigned long cusBaud;
+    bool dropFromWcs;          // lose everything the WCS sends
+    bool answerPings;
+    int valve;                 // last servo position, %, -1 before the first
+    bool held;                 // the main loop is busy elsewhere, see hold()
+    std::vector<std::pair<uint64_t, int> > servoFrames;    // servo position per frame, %
+    std::vector<std::pair<uint64_t, std::string> > lines;   // received by the CUS
+    std::vector<std::pair<uint64_t, std::string> > frames;  // binary, opcode + payload
+
+    Link() : wcs(sim, "WCS"), cusBaud(SERIAL_BAUD), dropFromWcs(false), answerPings(true),
+             valve(-1), held(false), lineFree(0) {
+        wcs.onTx = [this](uint8_t c, uint64_t arrival) {
+            unsigned long rate = wcs.getBaud();
+            sim.at(arrival, [this, c, rate]() { cusReceive(rate == cusBaud ? c : 0xFF); });
+        };
+        wcs.onServo = [this](uint8_t pin, int pulseUs) {
+            double angle = (pulseUs - SERVO_PULSE_MIN) * 180.0 / (SERVO_PULSE_MAX - SERVO_PULSE_MIN);
+            valve = (int)lround(angle * 100 / SERVO_OPEN_ANGLE);
+            // Writes within one frame: the last one is the pulse sent
+            if (!servoFrames.empty() && servoFrames.back().first == sim.now()) {
+                servoFrames.back().second = valve;
+            } else {
+                servoFrames.push_back(std::make_pair(sim.now(), valve));
+            }
+        };
+        wcs.service = [this]() {
+            // loop() runs again at once while the firmware has work left
+            while (!held && wcs::hasWork()) {
+                wcs::loop();
+            }
+        };
+        wcs.run([]() { wcs::setup(); });
+        // setup() keeps the board busy with the LCD for a while
+        sim.runUntil(wcs.getTime());
+    }
+
+    /* a JSON message from the CUS, at the CUS rate; returns when its
+       last byte (the newline) arrives */
+    uint64_t send(const std::string& json) {
+        return sendBytes(json + "\n");
+    }
+
+    /* a binary frame from the CUS, encoded by the WCS codec */
+    uint64_t sendFrame(uint8_t opcode, const uint8_t* payload, uint8_t len) {
+        uint8_t wire[wcs::FrameCodec::MAX_WIRE];
+        uint8_t n = wcs::FrameCodec::encode(opcode, payload, len, wire);
+        return sendBytes(std::string((const char*)wire, n));
+    }
+
+    uint64_t sendBytes(const std::string& wire) {
+        uint64_t byteTime = 10000000ULL / cusBaud;
+        unsigned long rate = cusBaud;
+        for (size_t i = 0; i < wire.size(); i++) {
+            lineFree = std::max(lineFree, sim.now()) + byteTime;
+            uint8_t c = (uint8_t)wire[i];
+            sim.at(lineFree, [this, c, rate]() { wcs.receive(rate == wcs.getBaud() ? c : 0xFF); });
+        }
+        return lineFree;
+    }
+
+    uint64_t valveCommand(int seq, int value) {
+        return send("{\"type\":\"valve\",\"value\":" + std::to_string(value) + ",\"seq\":" + std::to_string(seq) + "}");
+    }
+
+    /* the knob to an ADC reading, then long enough for the filter to settle */
+    void turnPot(int value) {
+        wcs.setAnalog(WCS_POT_CHANNEL, value);
+        for (int i = 1; i <= ADC_SETTLE_BURSTS; i++) {
+            sim.after(i * ADC_BURST_PERIOD, [this]() {
+                wcs.interrupt([]() { wcs::convertAdc(ADC_BURST_CONVERSIONS); });
+            });
+        }
+        runFor((ADC_SETTLE_BURSTS + 1) * ADC_BURST_PERIOD);
+    }
+
+    void pressButton() {
+        wcs.setInput(WCS_BUTTON_PIN, true);
+        runFor(200 * MS);
+        wcs.setInput(WCS_BUTTON_PIN, false);
+        runFor(200 * MS);
+    }
+
+    void runFor(uint64_t us) {
+        sim.runUntil(sim.now() + us);
+    }
+
+    /* the main loop busy elsewhere, as in a long LCD write: received bytes
+       stay in the UART buffer until release() */
+    void hold() {
+        held = true;
+    }
+
+    void release() {
+        held = false;
+        wcs.interrupt([]() {});
+    }
+
+    /* a line received since t containing both needles */
+    bool received(uint64_t since, const char* needle, const char* needle2 = "") const {
+        for (size_t i = 0; i < lines.size(); i++) {
+            if (lines[i].first >= since && lines[i].second.find(needle) != std::string::npos &&
+                lines[i].second.find(needle2) != std::string::npos) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /* a binary frame received since t with this opcode and first payload byte */
+    bool receivedFrame(uint64_t since, uint8_t opcode, uint8_t first) const {
+        for (size_t i = 0; i < frames.size(); i++) {
+            const std::string& f = frames[i].second;
+            if (frames[i].first >= since && f.size() >= 2 && (uint8_t)f[0] == opcode && (uint8_t)f[1] == first) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /* rates, rate and probe as CUS/src/serial_handler.py does them */
+    void negotiate(unsigned long rate, bool loseProbeReply = false) {
+        uint64_t start = sim.now();
+        send("{\"type\":\"rates\",\"value\":\"9600,19200,38400,57600,115200\"}");
+        runFor(200 * MS);
+        CHECK(received(start, "\"rate\"", std::to_string(rate).c_str()));
+        cusBaud = rate;
+        dropFromWcs = loseProbeReply;
+        send("{\"type\":\"probe\"}");
+        runFor(200 * MS);
+    }
+
+private:
+    uint64_t lineFree;
+    std::string partial;
+    std::string wire;          // since the last frame delimiter
+
+    void cusReceive(uint8_t c) {
+        if (dropFromWcs) {
+            return;
+        }
+        if (c == 0) {
+            // A frame may contain 0x0A: it starts at the beginning of the
+            // wire or after one of the newlines in it
+            uint8_t opcode, payload[wcs::FrameCodec::MAX_PAYLOAD], len;
+            size_t from = 0;
+            while (true) {
+                if (wcs::FrameCodec::decode((const uint8_t*)wire.data() + from, wire.size() - from, opcode, payload, len)) {
+                    frames.push_back(std::make_pair(sim.now(), std::string(1, (char)opcode) +
+                                                               std::string((const char*)payload, len)));
+                    break;
+                }
+                from = wire.find('\n', from);
+                if (from == std::string::npos) {
+                    break;
+                }
+                from++;
+            }
+            wire.clear();
+            partial.clear();
+            return;
+        }
+        wire += (char)c;
+        if (c != '\n') {
+            if (c != '\r') {
+                partial += (char)c;
+            }
+            return;
+        }
+        lines.push_back(std::make_pair(sim.now(), partial));
+        if (answerPings && partial.find("\"ping\"") != std::string::npos) {
+            send("{\"type\":\"pong\"}");
+        }
+        partial.clear();
+    }
+};
+
+// ===== Cases =====
+
+static void rateNegotiation() {
+    Link link;
+    uint64_t start = link.sim.now();
+    link.negotiate(115200);
+    CHECK(link.received(start, "\"probe\"", "115200"));
+    CHECK(link.wcs.getBaud() == 115200);
+
+    uint64_t sent = link.sim.now();
+    link.valveCommand(1, 50);
+    link.runFor(100 * MS);
+    CHECK(link.valve == 50);
+    CHECK(link.received(sent, "\"ack\"", "\"seq\":1"));
+
+    // The link stays up at the new rate
+    link.runFor(10 * LINK_TIMEOUT * MS);
+    CHECK(link.wcs.getBaud() == 115200);
+    CHECK(link.valve == 50);
+}
+
+static void lostProbeReply() {
+    Link link;
+    link.negotiate(115200, true);
+    CHECK(link.wcs.getBaud() == 115200);
+
+    // No probe reply: the CUS falls back, the WCS stays at 115200
+    link.runFor(1000 * MS);
+    link.dropFromWcs = false;
+    link.cusBaud = SERIAL_BAUD;
+    link.valveCommand(1, 50);
+    link.runFor(500 * MS);
+    CHECK(link.valve != 50);
+
+    // The link watchdog brings the WCS back to SERIAL_BAUD
+    link.runFor(LINK_TIMEOUT * MS);
+    CHECK(link.wcs.getBaud() == SERIAL_BAUD);
+
+    uint64_t sent = link.sim.now();
+    link.valveCommand(2, 50);
+    link.runFor(500 * MS);
+    CHECK(link.valve == 50);
+    CHECK(link.received(sent, "\"ack\"", "\"seq\":2"));
+}
+
+static void cusRestart() {
+    Link link;
+    link.negotiate(115200);
+    link.valveCommand(1, 30);
+    link.runFor(100 * MS);
+    CHECK(link.valve == 30);
+
+    // The CUS restarts at SERIAL_BAUD and its rate offer is not understood
+    link.cusBaud = SERIAL_BAUD;
+    uint64_t restart = link.sim.now();
+    link.send("{\"type\":\"rates\",\"value\":\"9600,19200,38400,57600,115200\"}");
+    link.runFor((LINK_TIMEOUT + 2 * LINK_PING_INTERVAL) * MS);
+    CHECK(link.wcs.getBaud() == SERIAL_BAUD);
+
+    // Pings are readable again, and the pongs bring the WCS back
+    CHECK(link.received(restart, "\"ping\""));
+    CHECK(link.received(restart, "\"mode\"", "\"value\":0"));
+}
+
+static void cusRestartSeq() {
+    Link link;
+    link.runFor(500 * MS);
+    for (int seq = 1; seq <= 50; seq++) {
+        link.valveCommand(seq, seq % 2 ? 20 : 40);
+        link.runFor(50 * MS);
+    }
+    CHECK(link.valve == 40);
+
+    // A JSON-mode CUS restarts: its hello restarts the sequence
+    uint64_t sent = link.sim.now();
+    link.send("{\"type\":\"hello\",\"value\":\"json\"}");
+    link.runFor(100 * MS);
+    CHECK(link.received(sent, "\"hello\"", "json"));
+    for (int seq = 1; seq <= 10; seq++) {
+        link.valveCommand(seq, seq % 2 ? 60 : 70);
+        link.runFor(50 * MS);
+    }
+    link.runFor(200 * MS);
+    CHECK(link.valve == 70);
+    CHECK(link.received(sent, "\"ack\"", "\"seq\":10,"));
+
+    // The CUS is away longer than LINK_TIMEOUT and its hello is lost:
+    // the WCS restarts the sequence on the link loss
+    link.answerPings = false;
+    link.runFor((LINK_TIMEOUT + LINK_PING_INTERVAL) * MS);
+    link.answerPings = true;
+    sent = link.sim.now();
+    link.valveCommand(1, 80);
+    link.runFor(200 * MS);
+    CHECK(link.valve == 80);
+    CHECK(link.received(sent, "\"ack\"", "\"seq\":1,"));
+}
+
+static void jsonFrameResync() {
+    Link link;
+    link.runFor(500 * MS);
+    uint64_t sent = link.sim.now();
+    link.send("{\"type\":\"hello\",\"value\":\"" PROTO_HELLO_BINARY "\"}");
+    link.runFor(100 * MS);
+    CHECK(link.received(sent, "\"hello\"", PROTO_HELLO_BINARY));
+
+    // A code byte corrupted into '{' swallows its own frame, but the
+    // delimiter ends it: the next frame is heard
+    uint8_t first[2] = { 1, 30 };
+    uint8_t second[2] = { 2, 60 };
+    link.sendBytes("{");
+    link.sendFrame(OP_VALVE, first, 2);
+    link.sendFrame(OP_VALVE, second, 2);
+    link.runFor(100 * MS);
+    CHECK(link.valve == 60);
+}
+
+static void traceOnRequest() {
+    Link link;
+    link.runFor(500 * MS);
+    for (int seq = 1; seq <= 20; seq++) {
+        link.valveCommand(seq, seq % 2 ? 20 : 40);
+        link.runFor(100 * MS);
+    }
+    CHECK(!link.received(0, "ZONES"));
+
+    // Asked for in the middle of traffic: printed whole, once the link is idle
+    uint64_t asked = link.sim.now();
+    link.send("{\"type\":\"trace\"}");
+    link.runFor(100 * MS);
+    link.valveCommand(21, 60);
+    link.runFor(2000 * MS);
+    CHECK(link.valve == 60);
+    size_t begin = link.lines.size(), end = link.lines.size();
+    for (size_t i = 0; i < link.lines.size(); i++) {
+        if (link.lines[i].first >= asked && link.lines[i].second.find("ZONES WCS") != std::string::npos) {
+            begin = i;
+        }
+        if (link.lines[i].second == "ZONES end") {
+            end = i;
+        }
+    }
+    CHECK(begin < end && end < link.lines.size());
+    for (size_t i = begin + 1; i < end && i < link.lines.size(); i++) {
+        CHECK(link.lines[i].second.compare(0, 2, "Z ") == 0);
+    }
+    CHECK(link.received(asked, "\"ack\"", "\"seq\":21,"));
+    CHECK(begin < link.lines.size() && !link.received(link.lines[begin].first, "\"ack\""));
+}
+
+static void lcdUpdateBytes() {
+    Link link;
+    link.runFor(500 * MS);
+    const LiquidCrystal_I2C* lcd = LiquidCrystal_I2C::last;
+    CHECK(strncmp(lcd->getRow(0), "Mode: AUTOMATIC ", 16) == 0);
+
+    // "Valve: 0%" -> "Valve: 50%": one cursor move and three cells,
+    // 6 I2C bytes each
+    unsigned long before = lcd->getI2cBytes();
+    link.valveCommand(1, 50);
+    link.runFor(500 * MS);
+    CHECK(strncmp(lcd->getRow(1), "Valve: 50%      ", 16) == 0);
+    CHECK(lcd->getI2cBytes() - before == (1 + 3) * 6);
+
+    // The same position again changes nothing on the display
+    before = lcd->getI2cBytes();
+    link.valveCommand(2, 50);
+    link.runFor(500 * MS);
+    CHECK(lcd->getI2cBytes() == before);
+
+    // "AUTOMATIC" -> "MANUAL   ": one cursor move and nine cells
+    before = lcd->getI2cBytes();
+    link.send("{\"type\":\"display\",\"mode\":\"MANUAL\",\"valve\":50,\"seq\":3}");
+    link.runFor(500 * MS);
+    CHECK(strncmp(lcd->getRow(0), "Mode: MANUAL    ", 16) == 0);
+    CHECK(lcd->getI2cBytes() - before == (1 + 9) * 6);
+}
+
+static void manualAfterLinkLoss() {
+    Link link;
+    link.runFor(500 * MS);
+    link.pressButton();
+    CHECK(link.received(0, "\"mode\"", "\"value\":1"));
+    link.turnPot(307);   // 30%, within the hysteresis and the servo's 1 degree steps
+    CHECK(abs(link.valve - 30) <= 1);
+
+    // The CUS stops answering: fail-safe, valve closed
+    link.answerPings = false;
+    link.runFor((LINK_TIMEOUT + LINK_PING_INTERVAL) * MS);
+    CHECK(link.valve == 0);
+
+    // Back in MANUAL, with the valve where the knob is
+    uint64_t back = link.sim.now();
+    link.answerPings = true;
+    link.runFor(2 * LINK_PING_INTERVAL * MS);
+    CHECK(link.received(back, "\"mode\"", "\"value\":1"));
+    CHECK(abs(link.valve - 30) <= 1);
+}
+
+static void commandBurst() {
+    Link link;
+    link.runFor(500 * MS);
+    link.negotiate(115200);
+    uint64_t sent = link.sim.now();
+    link.send("{\"type\":\"hello\",\"value\":\"" PROTO_HELLO_BINARY "\"}");
+    link.runFor(100 * MS);
+    CHECK(link.received(sent, "\"hello\"", PROTO_HELLO_BINARY));
+
+    // 12 valve frames back to back, from just after a servo frame. The
+    // loop is busy for the last 9 (63 bytes, a full UART buffer), so they
+    // are handled in one go: more than SERIAL_DRAIN_LIMIT, and the newest is
+    // already decoded when the limit is reached
+    link.runFor(SERVO_FRAME_US - link.sim.now() % SERVO_FRAME_US + 100);
+    uint64_t start = link.sim.now();
+    uint64_t end = 0;
+    for (int i = 1; i <= 12; i++) {
+        uint8_t payload[2] = { (uint8_t)i, (uint8_t)(i == 12 ? 80 : 10 + i) };
+        end = link.sendFrame(OP_VALVE, payload, 2);
+        if (i == 3) {
+            link.sim.runUntil(end);
+            link.hold();
+        }
+    }
+    link.sim.runUntil(end);
+    link.release();
+    CHECK(link.wcs.getRxOverruns() == 0);
+    CHECK(end - start < SERVO_FRAME_US);
+
+    // The first servo frame after the burst has the newest position, and no
+    // frame has an older one
+    link.runFor(SERVO_FRAME_US);
+    size_t first = 0;
+    while (first < link.servoFrames.size() && link.servoFrames[first].first < start) {
+        first++;
+    }
+    CHECK(first < link.servoFrames.size());
+    for (size_t i = first; i < link.servoFrames.size(); i++) {
+        CHECK(link.servoFrames[i].second == 80);
+        CHECK(link.servoFrames[i].first <= end + SERVO_FRAME_US);
+    }
+    CHECK(link.receivedFrame(start, OP_ACK, 12));
+}
+
+static void commandLatency() {
+    Link link;
+    link.runFor(500 * MS);
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> phase(0, 499 * MS);
+    uint64_t worst = 0;
+
+    // Commands at random phases of the scheduler tick; a servo frame is 20 ms
+    for (int i = 0; i < 200; i++) {
+        link.runFor(phase(rng));
+        int value = i % 2 ? 20 : 60;
+        // The command is complete with its '}', one byte before the newline
+        uint64_t closed = link.valveCommand(i % 255 + 1, value) - 10000000ULL / SERIAL_BAUD;
+        while (abs(link.valve - value) > 1 && link.sim.now() < closed + 200 * MS) {
+            link.runFor(100);
+        }
+        CHECK(abs(link.valve - value) <= 1);
+        worst = std::max(worst, link.sim.now() - closed);
+        link.runFor(500 * MS);
+    }
+    CHECK(worst <= 21 * MS);
+}
+
+struct Latency {
+    std::vector<uint64_t> actuate, ack;   // from the first byte sent, us
+
+    void print(const char* protocol) const {
+        const std::vector<uint64_t>* series[2] = { &actuate, &ack };
+        const char* label[2] = { "servo", "ack" };
+        for (int k = 0; k < 2; k++) {
+            std::vector<uint64_t> v = *series[k];
+            std::sort(v.begin(), v.end());
+            printf("     %-6s %-5s mean %5.1f ms  p95 %5.1f ms  max %5.1f ms\n", protocol, label[k],
+                   mean(v) / MS, (double)v[v.size() * 95 / 100] / MS, (double)v.back() / MS);
+        }
+    }
+
+    static double mean(const std::vector<uint64_t>& v) {
+        double sum = 0;
+        for (size_t i = 0; i < v.size(); i++) {
+            sum += v[i];
+        }
+        return sum / v.size();
+    }
+};
+
+static void protocolLatency() {
+    Link link;
+    link.runFor(500 * MS);
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> phase(0, 499 * MS);
+    Latency json, binary;
+
+    // The same commands at SERIAL_BAUD, first as JSON, then as frames.
+    // Latency runs from the first byte the CUS sends, so wire time counts
+    for (int proto = 0; proto < 2; proto++) {
+        Latency& l = proto ? binary : json;
+        if (proto) {
+            link.send("{\"type\":\"hello\",\"value\":\"" PROTO_HELLO_BINARY "\"}");
+            link.runFor(500 * MS);
+        }
+        for (int i = 0; i < 2000; i++) {
+            link.runFor(phase(rng));
+            int value = i % 2 ? 20 : 60;
+            uint8_t seq = i % 255 + 1;
+            uint64_t start = link.sim.now();
+            if (proto) {
+                uint8_t payload[2] = { seq, (uint8_t)value };
+                link.sendFrame(OP_VALVE, payload, 2);
+            } else {
+                // Spaced, as json.dumps() in the CUS writes it
+                link.send("{\"type\": \"valve\", \"value\": " + std::to_string(value) +
+                          ", \"seq\": " + std::to_string(seq) + "}");
+            }
+            std::string needle = "\"seq\":" + std::to_string(seq) + ",";
+            uint64_t actuated = 0, acked = 0;
+            while ((!actuated || !acked) && link.sim.now() < start + 500 * MS) {
+                link.runFor(100);
+                if (!actuated && abs(link.valve - value) <= 1) {
+                    actuated = link.sim.now();
+                }
+                if (!acked && (proto ? link.receivedFrame(start, OP_ACK, seq)
+                                     : link.received(start, "\"ack\"", needle.c_str()))) {
+                    acked = link.sim.now();
+                }
+            }
+            CHECK(actuated && acked);
+            l.actuate.push_back(actuated - start);
+            l.ack.push_back(acked - start);
+            link.runFor(500 * MS);
+        }
+    }
+    json.print("json");
+    binary.print("binary");
+
+    // A binary valve frame is 7 bytes against about 42 for the JSON line,
+    // 36 ms less at 9600 baud; the acknowledgement saves as much again
+    CHECK(Latency::mean(binary.actuate) + 30 * MS < Latency::mean(json.actuate));
+    CHECK(Latency::mean(binary.ack) + 60 * MS < Latency::mean(json.ack));
+}
+
+struct Case {
+    const char* name;
+    void (*run)();
+};
+
+static const Case cases[] = {
+    { "rate_negotiation", rateNegotiation },
+    { "lost_probe_reply", lostProbeReply },
+    { "cus_restart", cusRestart },
+    { "cus_restart_seq", cusRestartSeq },
+    { "json_frame_resync", jsonFrameResync },
+    { "trace_on_request", traceOnRequest },
+    { "lcd_update_bytes", lcdUpdateBytes },
+    { "manual_after_link_loss", manualAfterLinkLoss },
+    { "command_burst", commandBurst },
+    { "command_latency", commandLatency },
+    { "protocol_latency", protocolLatency },
+};
+
+int main(int argc, char** argv) {
+    int failed = 0, ran = 0;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        bool selected = argc < 2;
+        for (int a = 1; a < argc; a++) {
+            selected = selected || strcmp(argv[a], cases[i].name) == 0;
+        }
+        if (!selected) {
+            continue;
+        }
+
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) {
+            cases[i].run();
+            fflush(stdout);
+            _exit(failures == 0 ? 0 : 1);
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+        bool ok = pid > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        printf("%-4s %s\n", ok ? "ok" : "FAIL", cases[i].name);
+        ran++;
+        failed += ok ? 0 : 1;
+    }
+    printf("%d of %d passed\n", ran - failed, ran);
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,169 @@
+#!/usr/bin/env python3
+"""
+Convert zone trace dumps into Chrome trace JSON.
+
+Reads a serial log of a TMS or WCS firmware built with -DZONE_TRACE (see
+the "Zone Trace" sections of TMS/README.md and WCS/README.md) and writes
+every dump it contains as one process of a Chrome trace, which Perfetto
+(https://ui.perfetto.dev) and chrome://tracing open. Other lines of the
+log are skipped.
+
+Usage: zonetrace.py [-o trace.json] [--top N] serial.log
+"""
+
+import argparse
+import json
+import sys
+
+WRAP = 1 << 32
+
+
+class Dump:
+    def __init__(self, firmware: str, ticks_per_us: float, reason: str):
+        self.firmware = firmware
+        self.ticks_per_us = ticks_per_us
+        self.reason = reason
+        self.events = []   # (ticks, 'B' | 'E', name, task)
+
+
+def parse(lines):
+    """Dumps found in the log lines; an unterminated last dump is kept"""
+    dumps = []
+    dump = None
+    for raw in lines:
+        line = raw.replace('\0', '').strip()
+        fields = line.split()
+        if len(fields) >= 2 and fields[0] == 'ZONES':
+            if fields[1] == 'end':
+                dump = None
+            elif len(fields) >= 4:
+                try:
+                    dump = Dump(fields[1], float(fields[2]), fields[3])
+                except ValueError:
+                    dump = None
+                    continue
+                dumps.append(dump)
+        elif dump is not None and len(fields) in (4, 5) and fields[0] == 'Z' and fields[2] in ('B', 'E'):
+            # The TMS adds the FreeRTOS task; the WCS has only its main loop
+            task = fields[4] if len(fields) == 5 else ''
+            try:
+                dump.events.append((int(fields[1]), fields[2], fields[3], task))
+            except ValueError:
+                pass
+    return dumps
+
+
+def to_microseconds(dump: Dump):
+    """
+    Event times in µs from the first event. The counters are 32 bits wide
+    and wrap (every 17.9 s at 240 MHz, 71.6 min for micros()): consecutive
+    events are assumed to be less than one wrap apart.
+    """
+    times = []
+    total = 0
+    previous = None
+    for ticks, _, _, _ in dump.events:
+        if previous is not None:
+            total += (ticks - previous) % WRAP
+        previous = ticks
+        times.append(total / dump.ticks_per_us)
+    return times
+
+
+def tasks(dump: Dump):
+    """Task names in order of their first event"""
+    names = []
+    for _, _, _, task in dump.events:
+        if task not in names:
+            names.append(task)
+    return names
+
+
+def zones(dump: Dump, times):
+    """
+    Matched (name, start, duration, depth, task) spans. Zones nest within a
+    task only: the tasks of the TMS preempt each other, so their zones
+    interleave in the ring. An end whose begin fell out of the ring is
+    dropped; a begin without end lasts until the last event.
+    """
+    spans = []
+    open_zones = {}   # task -> [(name, start)]
+    for (_, phase, name, task), t in zip(dump.events, times):
+        stack = open_zones.setdefault(task, [])
+        if phase == 'B':
+            stack.append((name, t))
+            continue
+        # Scopes nest, so the end closes the innermost begin of that name
+        for i in range(len(stack) - 1, -1, -1):
+            if stack[i][0] == name:
+                spans.append((name, stack[i][1], t - stack[i][1], i, task))
+                del stack[i:]
+                break
+    end = times[-1] if times else 0
+    for task, stack in open_zones.items():
+        for depth, (name, start) in enumerate(stack):
+            spans.append((name, start, end - start, depth, task))
+    return spans
+
+
+def chrome_events(dumps):
+    events = []
+    for pid, dump in enumerate(dumps, start=1):
+        times = to_microseconds(dump)
+        events.append({'name': 'process_name', 'ph': 'M', 'pid': pid, 'tid': 0,
+                       'args': {'name': f'{dump.firmware} dump {pid} ({dump.reason})'}})
+        tids = {task: tid for tid, task in enumerate(tasks(dump))}
+        for task, tid in tids.items():
+            if task:
+                events.append({'name': 'thread_name', 'ph': 'M', 'pid': pid, 'tid': tid,
+                               'args': {'name': task}})
+        for name, start, duration, depth, task in zones(dump, times):
+            events.append({'name': name, 'ph': 'X', 'pid': pid, 'tid': tids[task],
+                           'ts': round(start, 3), 'dur': round(duration, 3),
+                           'args': {'depth': depth}})
+        if dump.reason == 'overrun' and times:
+            # The ring froze right after the pass that overran, in the task
+            # of the last event
+            events.append({'name': 'budget exceeded', 'ph': 'i', 's': 't', 'pid': pid,
+                           'tid': tids[dump.events[-1][3]], 'ts': round(times[-1], 3)})
+    return events
+
+
+def summary(dumps, top: int):
+    for pid, dump in enumerate(dumps, start=1):
+        times = to_microseconds(dump)
+        spans = sorted(zones(dump, times), key=lambda s: s[2], reverse=True)
+        print(f'{dump.firmware} dump {pid} ({dump.reason}): {len(dump.events)} events '
+              f'over {times[-1] / 1000 if times else 0:.3f} ms', file=sys.stderr)
+        for name, start, duration, depth, task in spans[:top]:
+            where = f' in {task}' if task else ''
+            print(f'  {name:<20} {duration / 1000:10.3f} ms at {start / 1000:.3f} ms{where}',
+                  file=sys.stderr)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Convert zone trace dumps into Chrome trace JSON')
+    parser.add_argument('log', help='serial log containing ZONES dumps')
+    parser.add_argument('-o', '--output', default='-', help='output file (default: stdout)')
+    parser.add_argument('--top', type=int, default=5, help='longest zones listed per dump on stderr')
+    args = parser.parse_args()
+
+    with open(args.log, 'r', encoding='utf-8', errors='replace') as f:
+        dumps = parse(f)
+    if not dumps:
+        print(f'{args.log}: no zone trace dumps', file=sys.stderr)
+        return 1
+
+    trace = {'traceEvents': chrome_events(dumps), 'displayTimeUnit': 'ms'}
+    if args.output == '-':
+        json.dump(trace, sys.stdout)
+        print()
+    else:
+        with open(args.output, 'w') as f:
+            json.dump(trace, f)
+    summary(dumps, args.top)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())